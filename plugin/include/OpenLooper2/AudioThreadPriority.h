@@ -0,0 +1,29 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace OpenLooper2 {
+
+/**
+ * Puts the thread running the audio callback under real-time scheduling.
+ * The Standalone build uses this on Linux, where the ALSA backend's callback thread runs at normal
+ * priority and gets preempted under load; JACK's client threads are real-time already.
+ * Needs an rtprio limit for the user (e.g. membership of the audio group), otherwise nothing changes.
+ */
+class AudioThreadPriority
+{
+public:
+    static constexpr int realtimePriority = 80;     // Below JACK's default of 95 for its own threads
+
+    /**
+     * Switch the calling thread to real-time FIFO scheduling. Does nothing on other platforms.
+     * A system call, so do it once, e.g. on the first callback after the device started.
+     * @return false if the system refused or the platform is not supported
+     */
+    static bool promoteCurrentThread();
+
+private:
+    AudioThreadPriority() = delete;
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
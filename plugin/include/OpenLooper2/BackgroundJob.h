@@ -0,0 +1,118 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+class BackgroundJobQueue;
+
+/**
+ * A unit of non-realtime work executed by the BackgroundWorkerPool.
+ * Jobs are long-lived objects owned by the component that submits them, so submitting
+ * never allocates. Results are published by the job itself through atomics.
+ */
+class BackgroundJob
+{
+public:
+    enum class Priority
+    {
+        High = 0,
+        Normal,
+        Low
+    };
+
+    enum class Status
+    {
+        Idle,
+        Queued,
+        Running,
+        Resubmitted,    // Running, and submitted again meanwhile; runs once more when done
+        Finished,
+        Cancelled
+    };
+
+    static constexpr int numPriorities = 3;
+
+    explicit BackgroundJob(Priority priority = Priority::Normal);
+    virtual ~BackgroundJob();
+
+    /**
+     * Get the scheduling priority of this job.
+     */
+    Priority getPriority() const { return priority; }
+
+    /**
+     * Get the current lifecycle status of this job.
+     */
+    Status getStatus() const { return status.load(std::memory_order_acquire); }
+
+    /**
+     * Check if the job is queued or running.
+     */
+    bool isBusy() const;
+
+    /**
+     * Request cancellation. A queued job is dropped, a running job should poll shouldCancel().
+     * Lock-free, safe to call from any thread.
+     */
+    void cancel();
+
+    /**
+     * Block until the job is neither queued nor running. Never call this from the audio thread.
+     * @param timeoutMs Maximum time to wait in milliseconds
+     * @return true if the job became idle in time
+     */
+    bool waitUntilIdle(int timeoutMs) const;
+
+    /**
+     * Block until the job is neither queued nor running, however long that takes. Use this before
+     * freeing or resizing anything the job works on, after cancelling it if it may run for long.
+     * Never call this from the audio thread.
+     */
+    void waitUntilIdle() const;
+
+protected:
+    /**
+     * Perform the work. Called on a worker thread.
+     */
+    virtual void run() = 0;
+
+    /**
+     * Check if cancellation has been requested while running.
+     */
+    bool shouldCancel() const { return cancelRequested.load(std::memory_order_acquire); }
+
+private:
+    friend class BackgroundJobQueue;
+    friend class BackgroundWorkerPool;
+
+    const Priority priority;
+    std::atomic<Status> status{Status::Idle};
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<BackgroundJobQueue*> owner{nullptr};
+
+    // Workers holding the job between taking it from a queue and finishing with it
+    std::atomic<int> claims{0};
+
+    // Counts the times a worker put the job back in a queue after running it
+    std::atomic<juce::uint32> requeues{0};
+
+    /**
+     * Move the job to the queued state. Wait-free: at most two compare-and-swaps, never retried.
+     * Submitting a running job marks it to run again instead of queueing a second copy.
+     * A submission that loses a race with another submitter is merged into that one.
+     * @return true if the caller must place the job in a queue
+     */
+    bool markQueued();
+
+    /**
+     * Run the job on the calling worker thread if it is still queued.
+     * @return true if the job was resubmitted while running and must be queued again
+     */
+    bool execute();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BackgroundJob)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "BackgroundJob.h"
+#include "BackgroundWorkerPool.h"
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Per-processor submission port into the shared BackgroundWorkerPool.
+ * The audio thread submits through bounded single-producer FIFOs (one per priority),
+ * which is wait-free and allocation-free. Other threads submit directly to the workers.
+ */
+class BackgroundJobQueue
+{
+public:
+    static constexpr int capacity = 64;
+
+    BackgroundJobQueue();
+    ~BackgroundJobQueue();
+
+    /**
+     * Submit a job from the audio thread. Wait-free and allocation-free.
+     * Resubmitting a job that is already queued or running coalesces into one more run.
+     * @return false if the bounded queue for the job's priority was full
+     */
+    bool submitFromAudioThread(BackgroundJob& job);
+
+    /**
+     * Submit a job from a non-realtime thread and wake a worker.
+     * @return false if the workers' queues were full
+     */
+    bool submit(BackgroundJob& job);
+
+    /**
+     * Cancel a job, wait for it to stop running and remove every queued reference to it.
+     * Call this from the job owner's destructor. Never call this from the audio thread.
+     */
+    void retractJob(BackgroundJob& job);
+
+    /**
+     * Number of audio-thread submissions rejected because a queue was full.
+     */
+    int getNumDroppedSubmissions() const { return droppedSubmissions.load(std::memory_order_relaxed); }
+
+private:
+    friend class BackgroundWorkerPool;
+
+    struct Intake
+    {
+        juce::AbstractFifo fifo{capacity};
+        std::array<BackgroundJob*, capacity> jobs{};
+        juce::SpinLock consumerLock;
+    };
+
+    std::array<Intake, BackgroundJob::numPriorities> intakes;
+    juce::SharedResourcePointer<BackgroundWorkerPool> pool;
+    std::atomic<int> droppedSubmissions{0};
+
+    /**
+     * Pop the oldest audio-thread submission of a priority. Called by workers only.
+     */
+    BackgroundJob* popRealtimeJob(int priorityIndex);
+
+    /**
+     * Null out references to a job still waiting in the audio-thread FIFOs.
+     */
+    void purgeRealtimeJob(const BackgroundJob& job);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BackgroundJobQueue)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
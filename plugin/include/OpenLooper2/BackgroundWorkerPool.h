@@ -0,0 +1,67 @@
+#pragma once
+
+#include "BackgroundJob.h"
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+class BackgroundJobQueue;
+
+/**
+ * Process-wide pool of low-priority worker threads for non-realtime looper work
+ * (analysis, resampling, compression, file I/O). Shared by every plugin instance via
+ * juce::SharedResourcePointer and fed through each processor's BackgroundJobQueue.
+ *
+ * Each worker owns a bounded deque per priority. Workers serve their own deque first,
+ * then the audio-thread FIFOs of the registered queues, then steal from other workers,
+ * always taking higher priorities before lower ones.
+ */
+class BackgroundWorkerPool
+{
+public:
+    BackgroundWorkerPool();
+    ~BackgroundWorkerPool();
+
+    /**
+     * Get the number of worker threads.
+     */
+    int getNumWorkers() const;
+
+private:
+    friend class BackgroundJobQueue;
+    class Worker;
+
+    juce::OwnedArray<Worker> workers;
+    juce::Array<BackgroundJobQueue*> queues;
+    juce::CriticalSection queueListLock;
+
+    std::atomic<int> nextWorker{0};
+
+    static constexpr int maxWorkers = 4;
+    static constexpr int idleWaitMs = 10;
+
+    void registerQueue(BackgroundJobQueue& queue);
+    void unregisterQueue(BackgroundJobQueue& queue);
+
+    /**
+     * Place a job on a worker deque and wake that worker. Non-realtime threads only.
+     */
+    bool enqueue(BackgroundJob& job);
+
+    /**
+     * Remove every queued reference to a job and wait until no worker holds it.
+     * Only that job is waited for; the workers keep running everything else.
+     */
+    void purgeJob(const BackgroundJob& job);
+
+    /**
+     * Find the next job for a worker, honouring priorities and stealing when idle.
+     * The job is claimed for the worker, which releases it once it has run and requeued it.
+     */
+    BackgroundJob* findJob(int workerIndex);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BackgroundWorkerPool)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
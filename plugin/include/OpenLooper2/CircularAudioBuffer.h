@@ -1,25 +1,59 @@
 #pragma once
 
+#include "LoopMemory.h"
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <atomic>
+#include <memory>
 
 namespace OpenLooper2 {
 
 /**
  * Lock-free circular audio buffer for real-time audio processing.
  * Uses atomic operations to ensure thread safety without blocking.
+ * A peak map with one entry per chunk is kept up to date on every write, so reads can
+ * zero-fill silent chunks and writes of silence onto silence can be skipped entirely.
+ * The samples live in LoopMemory, so they are resident, and locked where allowed, from the moment
+ * the buffer is allocated.
  */
 class CircularAudioBuffer
 {
 public:
+    static constexpr int chunkSize = 256;
+    static constexpr float silenceThreshold = 1.0e-7f;     // -140 dBFS
+
+    /**
+     * One read head for readTaps(): a delay behind a reference index, with the gains
+     * its signal is mixed with into the output and into an optional feedback signal.
+     */
+    struct Tap
+    {
+        int delay{0};
+        float gain{1.0f};
+        float feedback{0.0f};
+    };
+
     CircularAudioBuffer();
     ~CircularAudioBuffer();
 
     /**
      * Initialize the buffer with specified parameters.
      * Buffer size will be rounded up to the next power of 2 for efficiency.
+     * @param allocateStorage If false, only the geometry is set and memory is acquired later by allocate()
+     */
+    void initialize(int numChannels, int bufferSizeInSamples, bool allocateStorage = true);
+
+    /**
+     * Free the sample memory while keeping the buffer geometry.
+     * The audio thread must not access the buffer until allocate() has completed.
+     */
+    void release();
+
+    /**
+     * Acquire cleared, pre-faulted sample memory for the current geometry.
+     * Never call this on the audio thread.
+     * @return false if the memory could not be obtained; the buffer then stays unallocated
      */
-    void initialize(int numChannels, int bufferSizeInSamples);
+    bool allocate();
 
     /**
      * Write audio data to the buffer.
@@ -27,12 +61,70 @@ public:
      */
     void write(const juce::AudioBuffer<float>& input, int startSample, int numSamples);
 
+    /**
+     * Copy a range of the buffer to another place in it, updating the peak map.
+     * The ranges must not overlap. This is lock-free and safe to call from the audio thread.
+     */
+    void copyWithin(int sourceIndex, int destinationIndex, int numSamples);
+
     /**
      * Read audio data from the buffer at a specific offset.
      * This is lock-free and safe to call from the audio thread.
      */
     void read(juce::AudioBuffer<float>& output, int startSample, int numSamples, int readOffset = 0);
 
+    /**
+     * Write audio data at an absolute buffer index without moving the write head.
+     * This is lock-free and safe to call from the audio thread.
+     */
+    void writeAt(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex);
+
+    /**
+     * Read audio data starting at an absolute buffer index.
+     * This is lock-free and safe to call from the audio thread.
+     * @return false if the whole range was silent and the output was only zero-filled
+     */
+    bool readFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex) const;
+
+    /**
+     * Scale what the output holds and add a range of the buffer to it, in one pass per chunk.
+     * Silent chunks only scale the output. With an output gain of zero this is readFrom() with a gain.
+     * This is lock-free and safe to call from the audio thread.
+     * @param outputGain Gain applied to the output's existing content
+     * @param sourceGain Gain applied to the buffer content added to it
+     * @return false if the whole range was silent and the output was only scaled
+     */
+    bool mixFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex,
+                 float outputGain, float sourceGain) const;
+
+    /**
+     * Mix several read heads into the output in one pass. The output is processed in tiles of
+     * chunkSize samples and every tap is added to a tile while it is still in cache, so the
+     * outputs are written once however many taps there are. Each tap's source is read once and
+     * silent chunks are skipped. Adds to what the outputs hold.
+     * Source traffic only grows slower than the tap count where heads lie within a tile of each
+     * other: given in order of delay, such a tap reads lines the one before it just loaded.
+     * Heads further apart, like echo taps, each read their own lines.
+     * This is lock-free and safe to call from the audio thread.
+     * @param output Receives the sum of each tap scaled by its gain
+     * @param feedbackOutput Receives the sum of each tap scaled by its feedback, may be nullptr
+     * @param startSample Starting sample in both outputs
+     * @param numSamples Number of samples to read
+     * @param taps The read heads
+     * @param numTaps Number of read heads
+     * @param bufferIndex Absolute index the tap delays count back from
+     * @return false if every tap read only silence
+     */
+    bool readTaps(juce::AudioBuffer<float>& output, juce::AudioBuffer<float>* feedbackOutput,
+                  int startSample, int numSamples, const Tap* taps, int numTaps, int bufferIndex) const;
+
+    /**
+     * Get the peak magnitude of a range at chunk resolution, from the peak map.
+     * @param bufferIndex Absolute index of the first sample
+     * @param numSamples Number of samples in the range
+     */
+    float getPeak(int bufferIndex, int numSamples) const;
+
     /**
      * Clear the buffer contents.
      */
@@ -49,18 +141,43 @@ public:
     int getBufferSize() const { return bufferSize; }
 
     /**
-     * Check if the buffer is initialized.
+     * Get the number of bytes of sample memory currently held.
+     */
+    size_t getStorageBytes() const;
+
+    /**
+     * Get the memory holding the samples, for its locking and huge page status.
+     */
+    const LoopMemory& getMemory() const { return memory; }
+
+    /**
+     * Check if the buffer is initialized and holds sample memory.
      */
     bool isInitialized() const { return initialized.load(std::memory_order_acquire); }
 
 private:
-    juce::AudioBuffer<float> buffer;
+    LoopMemory memory;
+    juce::AudioBuffer<float> buffer;    // Refers to the channels in memory
     std::atomic<int> writeHead{0};
     std::atomic<bool> initialized{false};
     
     int bufferSize{0};
     int bufferMask{0};  // bufferSize - 1 for fast modulo operations
     int numChannels{0};
+    
+    // Peak magnitude across channels of each chunk
+    std::unique_ptr<std::atomic<float>[]> chunkPeaks;
+    int numChunks{0};
+
+    /**
+     * Write a range that may wrap, one chunk segment at a time.
+     */
+    void writeRange(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex);
+
+    /**
+     * Write a segment that lies within one chunk and update that chunk's peak.
+     */
+    void writeSegment(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex);
 
     /**
      * Round up to the next power of 2.
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cstdint>
+#include <vector>
+
+namespace OpenLooper2 {
+
+/**
+ * Compact representation of one loop, used while the loop is not being written.
+ * The loop is split into fixed blocks, each coded losslessly on its own: silent blocks take no
+ * sample data and blocks with identical channels are stored once. Other blocks are quantized to
+ * 24-bit block floating point, the first two channels are decorrelated as left/side, right/side
+ * or mid/side, whichever is cheapest, and every coded channel is predicted by a quantized linear
+ * predictor of up to maxPredictorOrder taps whose residuals are Rice coded in partitions. The
+ * bits float samples have below the 24-bit grid are kept in a separate remainder stream, so
+ * float material comes back bit for bit too. Lossy encoding, when asked for, drops only that
+ * remainder stream.
+ *
+ * Decoding has to run from the start of a block, so audio thread reads go through a small
+ * window of decoded blocks that is filled ahead of the read head: each mix() decodes a little
+ * of the block after the one it read, and only a jump to a block outside the window decodes
+ * that block's leading part while the audio thread waits.
+ */
+class CompactLoopStore
+{
+public:
+    static constexpr int blockSize = 4096;
+    static constexpr int maxPredictorOrder = 8;
+    static constexpr int partitionSize = 256;
+    static constexpr int windowBlocks = 3;
+
+    CompactLoopStore();
+    ~CompactLoopStore();
+
+    /**
+     * Start encoding a new loop, discarding the previous content. Allocates.
+     * @param numChannels Number of channels of the loop
+     * @param lengthInSamples Total loop length in samples
+     * @param allowLossy Whether samples may be rounded to 24-bit block floating point
+     */
+    void beginEncoding(int numChannels, int lengthInSamples, bool allowLossy);
+
+    /**
+     * Append the next block of the loop. Allocates, never call this on the audio thread.
+     * @param source Buffer holding the block at sample 0
+     * @param numSamples blockSize, or less for the final block
+     */
+    void encodeBlock(const juce::AudioBuffer<float>& source, int numSamples);
+
+    /**
+     * Release spare capacity and set up the decode window once all blocks have been encoded.
+     */
+    void finishEncoding();
+
+    /**
+     * Decode part of the loop without going through the decode window, so any thread may call
+     * this alongside the audio thread. Every block read is decoded from its start.
+     * Does not allocate.
+     * @param output The output audio buffer
+     * @param startSample Starting sample in the output buffer
+     * @param numSamples Number of samples to decode, must not run past the loop end
+     * @param loopOffset Loop-relative position of the first sample
+     * @return false if only silent blocks were read
+     */
+    bool read(juce::AudioBuffer<float>& output, int startSample, int numSamples, int loopOffset) const;
+
+    /**
+     * Decode part of the loop through the decode window straight into a mix: the output's content
+     * is scaled and the decoded samples are added to it in the same pass. Also decodes ahead into
+     * the block after the last one read. Does not allocate; the window belongs to the audio
+     * thread, so only the audio thread may call this.
+     * @param outputGain Gain applied to the output's existing content, 0 to replace it
+     * @param sourceGain Gain applied to the decoded loop
+     * @return false if only silent blocks were read
+     */
+    bool mix(juce::AudioBuffer<float>& output, int startSample, int numSamples, int loopOffset,
+             float outputGain, float sourceGain) const;
+
+    /**
+     * Get the peak magnitude of part of the loop at block resolution, without decoding.
+     * @param loopOffset Loop-relative position of the first sample
+     * @param numSamples Number of samples, must not run past the loop end
+     */
+    float getPeak(int loopOffset, int numSamples) const;
+
+    /**
+     * Free all encoded data and the decode window.
+     */
+    void clear();
+
+    /**
+     * Exchange the encoded loop and decode window with another store, without copying.
+     * Neither store may be read or written meanwhile.
+     */
+    void swap(CompactLoopStore& other);
+
+    /**
+     * Get the encoded loop length in samples.
+     */
+    int getLength() const { return lengthInSamples; }
+
+    /**
+     * Get the number of bytes used by the encoded loop and its decode window.
+     */
+    size_t getStorageBytes() const;
+
+private:
+    enum class BlockFormat : uint8_t
+    {
+        Silent,
+        Coded,
+        Float32
+    };
+
+    enum class ChannelPairing : uint8_t
+    {
+        Independent,
+        LeftSide,
+        RightSide,
+        MidSide
+    };
+
+    struct BlockInfo
+    {
+        uint32_t dataOffset{0};
+        BlockFormat format{BlockFormat::Silent};
+        uint8_t storedChannels{0};
+        ChannelPairing pairing{ChannelPairing::Independent};
+        bool exact{true};       // no remainder streams, every sample sits on the 24-bit grid
+        int8_t exponent{0};     // the grid step is 2^(exponent - 23)
+        float peak{0.0f};
+    };
+
+    // Where decoding of one coded channel stands, enough to carry on part way through a block
+    struct ChannelDecoder
+    {
+        uint64_t residualBit{0};
+        uint64_t remainderBit{0};
+        int blockLength{0};
+        int frame{0};
+        int order{0};
+        int shift{0};
+        int wastedBits{0};
+        int warmupBits{0};
+        int riceParameter{0};
+        int partitionRemaining{0};
+        int32_t coefficients[maxPredictorOrder]{};
+        int32_t history[maxPredictorOrder]{};   // the last decoded values, oldest first
+    };
+
+    struct WindowBlock
+    {
+        int blockIndex{-1};
+        int decodedFrames{0};
+        uint32_t lastUse{0};
+        std::vector<ChannelDecoder> decoders;
+        std::vector<float> samples;     // blockSize per stored channel
+    };
+
+    std::vector<BlockInfo> blocks;
+    std::vector<uint8_t> data;
+    int numChannels{0};
+    int lengthInSamples{0};
+    bool allowLossy{false};
+
+    // Encoder scratch, freed by finishEncoding()
+    std::vector<int32_t> quantized;
+    std::vector<uint32_t> residuals;
+
+    // Touched by mix() only, so by the audio thread only
+    mutable WindowBlock window[windowBlocks];
+    mutable uint32_t windowClock{0};
+
+    int getBlockLength(int blockIndex) const;
+    void encodeChannel(const int32_t* values, int numSamples);
+    void encodeRemainders(const float* samples, const int32_t* quantizedSamples, int numSamples, int exponent);
+    void storeFloats(BlockInfo& block, const juce::AudioBuffer<float>& source, int numSamples);
+
+    void startChannel(const BlockInfo& block, int blockLength, int channel, ChannelDecoder& decoder) const;
+    void decodeValues(ChannelDecoder& decoder, int32_t* coded, int32_t* values, int numFrames) const;
+    void decodeFrames(const BlockInfo& block, ChannelDecoder* decoders, int firstChannel, int groupSize,
+                      int numFrames, float* const* destinations) const;
+    void decodeInto(const BlockInfo& block, int blockLength, int blockOffset, int numSamples,
+                    juce::AudioBuffer<float>& output, int startSample) const;
+
+    WindowBlock& findWindowBlock(int blockIndex) const;
+    void advanceWindowBlock(WindowBlock& entry, int targetFrames) const;
+
+    static bool channelsAreIdentical(const juce::AudioBuffer<float>& source, int numChannels, int numSamples);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CompactLoopStore)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
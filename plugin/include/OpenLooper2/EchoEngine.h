@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CircularAudioBuffer.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+
+namespace OpenLooper2 {
+
+/**
+ * Multi-tap echo built on a CircularAudioBuffer delay line.
+ * Taps sit at whole multiples of the echo time with falling gains, and the last tap feeds back
+ * into the line. All taps are gathered in a single tiled pass per block through readTaps().
+ */
+class EchoEngine
+{
+public:
+    static constexpr int maxTaps = 4;
+    static constexpr float minTimeMs = 10.0f;
+    static constexpr float maxTimeMs = 1000.0f;
+    static constexpr float maxFeedback = 0.95f;
+
+    EchoEngine();
+    ~EchoEngine();
+
+    /**
+     * Allocate the delay line for the longest echo. Message thread only.
+     * @param sampleRate The audio sample rate
+     * @param numChannels Number of audio channels
+     */
+    void initialize(double sampleRate, int numChannels);
+
+    /**
+     * Configure the echo. Allocation-free, call it from the audio thread.
+     * @param timeMs Spacing of the taps in milliseconds
+     * @param numTaps Number of taps, 1 to maxTaps
+     * @param feedback Amount of the last tap fed back into the line, 0 to maxFeedback
+     * @param mix Level of the echoes added to the signal
+     */
+    void setParameters(float timeMs, int numTaps, float feedback, float mix);
+
+    /**
+     * Add the echoes to a block in place.
+     * While disabled, silence is fed into the line so old echoes do not return when it is enabled
+     * again, until the whole line has been overwritten; after that the block is left alone.
+     * @param buffer The audio to echo
+     * @param enabled Whether echoes are heard
+     */
+    void process(juce::AudioBuffer<float>& buffer, bool enabled);
+
+private:
+    CircularAudioBuffer delayLine;
+    std::array<CircularAudioBuffer::Tap, maxTaps> taps;
+    int numTaps{1};
+    float mix{0.0f};
+
+    double sampleRate{44100.0};
+    int maxDelay{0};
+    int silentSamples{0};       // Silence written since the echo was disabled
+
+    // One tile of tap output and of the signal written back into the line
+    juce::AudioBuffer<float> wetBuffer;
+    juce::AudioBuffer<float> feedbackBuffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EchoEngine)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
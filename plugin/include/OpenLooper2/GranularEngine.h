@@ -0,0 +1,140 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Plays the loop as a cloud of short windowed grains instead of a linear read.
+ * Grains start at a steady density around a position in the loop, scattered by the spray, and
+ * read the loop at a pitch ratio. Their envelopes come from a precomputed window table.
+ *
+ * Grain state is held as parallel arrays and every grain is rendered into one accumulator of a
+ * sub-block, so the whole cloud stays in cache. Each grain reads its stretch of the loop once per
+ * sub-block and is mixed in with vector operations. The number of grains is capped, which bounds
+ * the work per sample whatever the density and size settings ask for.
+ */
+class GranularEngine
+{
+public:
+    static constexpr int maxGrains = 128;
+    static constexpr int windowTableSize = 1024;
+    static constexpr float minSizeMs = 10.0f;
+    static constexpr float maxSizeMs = 500.0f;
+    static constexpr float minDensity = 1.0f;        // Grains per second
+    static constexpr float maxDensity = 400.0f;
+    static constexpr float maxPitchSemitones = 24.0f;
+
+    /**
+     * @param loopBufferManager The loop the grains are read from
+     */
+    explicit GranularEngine(LoopBufferManager& loopBufferManager);
+    ~GranularEngine();
+
+    /**
+     * Allocate the grain buffers. Message thread only.
+     * @param sampleRate The audio sample rate
+     * @param maxBlockSize Longest block process() is called with
+     * @param numChannels Number of audio channels
+     */
+    void initialize(double sampleRate, int maxBlockSize, int numChannels);
+
+    /**
+     * Configure the cloud. Allocation-free, call it from the audio thread.
+     * Grains already playing keep the settings they started with.
+     * @param position Centre of the cloud as a fraction of the loop length (0.0 to 1.0)
+     * @param spray Width over which grain starts are scattered, as a fraction of the loop length (0.0 to 1.0)
+     * @param sizeMs Grain length in milliseconds
+     * @param density Grains started per second
+     * @param pitchSemitones Pitch of the grains relative to the loop
+     */
+    void setParameters(float position, float spray, float sizeMs, float density, float pitchSemitones);
+
+    /**
+     * Mix the grain cloud into what the output holds, like LoopBufferManager::mixLoop().
+     * Audio thread only.
+     * @param output The output audio buffer, at most maxBlockSize samples are processed
+     * @param numSamples Number of samples to process
+     * @param outputGain Gain applied to the output's existing content
+     * @param grainGain Gain applied to the grains
+     * @return false if no grain was audible and the output was only scaled
+     */
+    bool process(juce::AudioBuffer<float>& output, int numSamples, float outputGain, float grainGain);
+
+    /**
+     * Stop every grain, e.g. when granular playback is switched off.
+     */
+    void reset();
+
+    /**
+     * Get the number of grains playing.
+     */
+    int getNumActiveGrains() const { return numGrains; }
+
+    /**
+     * Get the number of grains that were not started because the cap was reached.
+     */
+    int getDroppedGrains() const { return droppedGrains.load(std::memory_order_relaxed); }
+
+private:
+    LoopBufferManager& loopBufferManager;
+
+    // Hann window, with guard points so interpolation past the last index reads zero
+    std::array<float, windowTableSize + 2> windowTable;
+
+    // Grains as parallel arrays, the first numGrains entries are playing
+    std::array<double, maxGrains> grainPosition;        // Read position in the loop, in samples
+    std::array<float, maxGrains> grainRate;             // Loop samples per output sample
+    std::array<float, maxGrains> grainPhase;            // Position in the window table
+    std::array<float, maxGrains> grainPhaseStep;
+    std::array<float, maxGrains> grainGain;
+    std::array<int, maxGrains> grainRemaining;          // Output samples left
+    std::array<int, maxGrains> grainDelay;              // Offset into the current block a new grain starts at
+    int numGrains{0};
+
+    // Cloud settings
+    float position{0.0f};
+    float spray{0.0f};
+    int grainLength{1};
+    double grainInterval{1.0};
+    float pitchRatio{1.0f};
+    float levelPerGrain{1.0f};
+
+    double samplesToNextGrain{0.0};
+    int cloudLoopLength{0};
+    juce::Random random;
+    std::atomic<int> droppedGrains{0};
+
+    double sampleRate{44100.0};
+    int maxBlockSize{0};
+    int maxSourceSpan{0};
+
+    // Sub-block accumulator, the loop stretch each grain reads, and per-grain scratch
+    juce::AudioBuffer<float> grainBuffer;
+    juce::AudioBuffer<float> sourceBuffer;
+    juce::HeapBlock<float> envelope;
+    juce::HeapBlock<float> resampled;
+
+    /**
+     * Start a grain at an offset into the current block, if the cap allows.
+     */
+    void startGrain(int offset, int loopLength);
+
+    /**
+     * Render one grain's part of the current block into the accumulator and advance it.
+     * @return false if the grain read only silence
+     */
+    bool renderGrain(int grain, int numSamples, int loopLength);
+
+    /**
+     * Remove a finished grain by moving the last one into its place.
+     */
+    void removeGrain(int grain);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GranularEngine)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
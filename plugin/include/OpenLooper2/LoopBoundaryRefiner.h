@@ -0,0 +1,111 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Refines the seam of a freshly recorded loop as a background job.
+ * Searches near the recorded start and end for transient onsets and zero crossings,
+ * then publishes a refined start offset and loop length as a single atomic word.
+ * The audio thread only posts requests and polls results, so it never blocks or allocates.
+ */
+class LoopBoundaryRefiner : public BackgroundJob
+{
+public:
+    LoopBoundaryRefiner(const LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue);
+    ~LoopBoundaryRefiner() override;
+
+    /**
+     * Initialize the refiner's analysis buffers.
+     * Call this from the message thread (e.g. prepareToPlay).
+     * @param sampleRate The audio sample rate
+     * @param numChannels Number of audio channels in the loop buffer
+     */
+    void initialize(double sampleRate, int numChannels);
+
+    /**
+     * Request refinement of a recorded loop. Wait-free, safe to call from the audio thread.
+     * @param loopStart Absolute index of the recorded loop start in the circular buffer
+     * @param loopLength Recorded loop length in samples
+     */
+    void requestRefinement(int loopStart, int loopLength);
+
+    /**
+     * Discard any pending or published refinement. Wait-free, safe to call from the audio thread.
+     */
+    void cancelRefinement();
+
+    /**
+     * Consume the latest refinement result, if any. Wait-free, safe to call from the audio thread.
+     * @param startOffset Receives the offset of the refined start relative to the requested start
+     * @param loopLength Receives the refined loop length in samples
+     * @return true if a result for the latest request was available
+     */
+    bool getRefinedBoundary(int& startOffset, int& loopLength);
+
+private:
+    const LoopBufferManager& bufferManager;
+    BackgroundJobQueue& jobQueue;
+
+    // Request posted by the audio thread
+    std::atomic<int> requestedStart{0};
+    std::atomic<int> requestedLength{0};
+    std::atomic<juce::uint32> generation{0};
+    std::atomic<bool> requestPending{false};
+
+    // Result packed as [generation:16 | startOffset:16 | length:32], 0 when empty
+    std::atomic<juce::uint64> publishedBoundary{0};
+
+    double sampleRate{44100.0};
+    int numChannels{2};
+    int searchWindowSamples{0};
+
+    // Analysis scratch, only touched while the job runs
+    juce::AudioBuffer<float> analysisBuffer;
+    juce::HeapBlock<float> monoBuffer;
+    juce::HeapBlock<float> energyBuffer;
+
+    static constexpr int envelopeHopSize = 32;        // A power of two, so hops fold in halves
+    static constexpr int envelopeFoldWidth = 4;       // Partial sums left for the scalar tail
+    static constexpr float searchWindowSeconds = 0.02f;
+    static constexpr float onsetEnergyRatio = 8.0f;   // ~ +9 dB jump between hops
+    static constexpr float silenceEnergyFloor = 1.0e-6f;
+
+    void run() override;
+
+    /**
+     * Analyse the recorded loop and publish the refined boundary if still current.
+     */
+    void refine(int loopStart, int loopLength, juce::uint32 requestGeneration);
+
+    /**
+     * Load a region of the loop buffer into monoBuffer as a channel average.
+     */
+    void loadMonoRegion(int bufferIndex, int numSamples);
+
+    /**
+     * Find the first transient onset in monoBuffer using a hop-wise energy envelope.
+     * @return The sample index of the onset, or -1 if none was found
+     */
+    int findOnset(int numSamples);
+
+    /**
+     * Find the nearest zero crossing in monoBuffer, scanning from a sample in a given direction.
+     * @param from Sample index to start scanning from
+     * @param step +1 to scan forward, -1 to scan backward
+     * @param rising Only accept upward crossings when true, downward when false
+     * @return The sample index just after the crossing, or -1 if none was found
+     */
+    int findZeroCrossing(int numSamples, int from, int step, bool rising) const;
+
+    static juce::uint64 packBoundary(juce::uint32 boundaryGeneration, int startOffset, int loopLength);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopBoundaryRefiner)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -1,29 +1,190 @@
 #pragma once
 
 #include "CircularAudioBuffer.h"
+#include "CompactLoopStore.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
 #include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
 #include <atomic>
+#include <memory>
 
 namespace OpenLooper2 {
 
 /**
  * Manages loop buffer storage and retrieval using a circular buffer.
  * Handles dynamic loop length management and efficient audio I/O.
+ * The sample memory can be released while the loop is empty and reacquired on demand,
+ * and a loop that is not being written can be moved into a CompactLoopStore, from which it
+ * keeps playing. Transitions requested from the audio thread are carried out by a background job.
+ *
+ * A loop can be multiplied into repetitions of itself and divided again without copying: the
+ * repetitions read the loop as it was when multiplied through a page map until an overdub writes
+ * into them, and only then is the page they show copied into its own place in the buffer.
+ *
+ * Several loops are held in clip slots, each with its own storage. All reads and writes go to
+ * the active slot, and selecting another slot only swaps a pointer, so prepared loops can be
+ * switched on the audio thread without copying or allocating.
  */
 class LoopBufferManager
 {
 public:
-    LoopBufferManager();
+    enum class StorageState
+    {
+        Allocated,
+        Releasing,
+        Released,
+        Acquiring,
+        Compacting,     // Encoding in the background, still played from the float buffer
+        Compact,        // Played from the compact store, float buffer released
+        Expanding       // Decoding back into a float buffer, still played from the compact store
+    };
+
+    /**
+     * Residency of the float loop memory across all slots.
+     */
+    struct MemoryStatus
+    {
+        size_t allocatedBytes{0};
+        size_t lockedBytes{0};          // Locked into RAM, so never swapped out
+        size_t hugePageBytes{0};        // Backed by reserved huge pages
+        int lockFailures{0};            // Allocations that could not be locked
+        int hugePageFailures{0};        // Allocations that fell back to normal pages
+        int allocationFailures{0};      // Allocations that got no memory at all
+    };
+
+    /**
+     * Notified on the audio thread right before loop samples are overwritten, while the old
+     * content can still be read. Used to keep copy-on-write snapshots of the loop consistent.
+     */
+    class WriteObserver
+    {
+    public:
+        virtual ~WriteObserver() = default;
+
+        /**
+         * @param bufferIndex Absolute index in the circular buffer of the first sample to be written
+         * @param numSamples Number of samples about to be written, may wrap around the buffer end
+         */
+        virtual void aboutToOverwrite(int bufferIndex, int numSamples) = 0;
+    };
+
+    /**
+     * @param jobQueue Queue used to allocate and free the loop memory off the audio thread
+     */
+    static constexpr int numSlots = 8;
+    static constexpr int numDirtyRegions = 64;
+    static constexpr int repetitionPageSize = 1024;
+    static constexpr int maxRepetitionLevels = 24;     // Multiplies on top of each other, each at least doubles the length
+
+    explicit LoopBufferManager(BackgroundJobQueue& jobQueue);
     ~LoopBufferManager();
 
     /**
-     * Initialize the buffer manager with audio specifications.
+     * Initialize the buffer manager with audio specifications. Every slot is emptied.
+     * Storage that is currently released stays released until requested again; the rest is
+     * allocated, pre-faulted and locked by the background job, and reads as silence until then.
      * @param sampleRate The audio sample rate
      * @param maxChannels Maximum number of audio channels
      * @param maxLengthSeconds Maximum loop length in seconds
      */
     void initialize(double sampleRate, int maxChannels, float maxLengthSeconds);
 
+    /**
+     * Make another clip slot the active one. Wait-free, audio thread only.
+     * Only a pointer is swapped; the previous slot keeps its loop and storage.
+     * @param slotIndex Index of the slot, 0 to numSlots - 1
+     */
+    void selectSlot(int slotIndex);
+
+    /**
+     * Get the index of the active clip slot.
+     */
+    int getActiveSlot() const { return activeSlotIndex.load(std::memory_order_acquire); }
+
+    /**
+     * Get the loop length held by a clip slot in samples, 0 if the slot is empty.
+     */
+    int getSlotLength(int slotIndex) const;
+
+    /**
+     * Check if the active slot's memory is allocated as float samples and may be read and written.
+     */
+    bool isStorageReady() const { return isStorageReady(getActiveSlot()); }
+    bool isStorageReady(int slotIndex) const;
+
+    /**
+     * Get the current state of the active slot's memory.
+     */
+    StorageState getStorageState() const { return getStorageState(getActiveSlot()); }
+    StorageState getStorageState(int slotIndex) const;
+
+    /**
+     * Get the number of bytes of loop memory currently allocated across all slots.
+     */
+    size_t getStorageBytes() const;
+
+    /**
+     * Get how much of the loop memory is locked or on huge pages, and how often that failed.
+     * May be called from any thread.
+     */
+    MemoryStatus getMemoryStatus() const;
+
+    /**
+     * Wait until pending storage transitions, such as the allocation after initialize(), are done.
+     * Never call this on the audio thread.
+     * @return false if the timeout expired first
+     */
+    bool waitForStorage(int timeoutMs) const { return storageJob.waitUntilIdle(timeoutMs); }
+
+    /**
+     * Move the active slot's compacted loop into another store as it is, leaving the slot empty,
+     * so that it can be decoded elsewhere. Message thread only, while the audio thread is stopped.
+     * @param destination Receives the encoded loop; its previous content is freed
+     * @return false if the loop is not held in compact storage
+     */
+    bool takeCompactLoop(CompactLoopStore& destination);
+
+    /**
+     * Make a slot's loop writable again: reacquire released memory, expand a compact loop or
+     * abandon a compaction in progress. Wait-free, audio thread safe.
+     * Also used to prefetch a slot before switching to it.
+     */
+    void requestStorage() { requestStorage(getActiveSlot()); }
+    void requestStorage(int slotIndex);
+
+    /**
+     * Ask the background job to move a slot's loop into compact storage. Wait-free, audio thread safe.
+     * The loop keeps playing throughout; writes are ignored until requestStorage() completes.
+     * @param allowLossy Whether float material may be rounded to 24 bits, see CompactLoopStore
+     */
+    void requestCompaction(bool allowLossy) { requestCompaction(getActiveSlot(), allowLossy); }
+    void requestCompaction(int slotIndex, bool allowLossy);
+
+    /**
+     * Ask the background job to free the active slot's memory. Wait-free, audio thread safe.
+     * The loop is cleared; the buffer reads as silence until storage is requested again.
+     */
+    void requestStorageRelease();
+
+    /**
+     * Free the memory of every empty slot synchronously.
+     * Message thread only, while the audio thread is stopped.
+     */
+    void releaseStorage();
+
+    /**
+     * Install the observer notified before every write. Wait-free, audio thread safe.
+     * Only one observer is supported at a time.
+     */
+    void setWriteObserver(WriteObserver* observer);
+
+    /**
+     * Remove the write observer and wait until no notification is in flight.
+     * Never call this on the audio thread.
+     */
+    void removeWriteObserver();
+
     /**
      * Write audio data to the loop buffer.
      * @param input The input audio buffer
@@ -33,13 +194,88 @@ public:
     void writeAudio(const juce::AudioBuffer<float>& input, int startSample, int numSamples);
 
     /**
-     * Read audio data from the loop buffer at a specific position.
+     * Write audio data into the current loop at a sample position (used for overdubbing).
+     * Wraps around the loop end back to the loop start.
+     * @param input The input audio buffer
+     * @param startSample Starting sample in the input buffer
+     * @param numSamples Number of samples to write
+     * @param loopPosition Position in samples from the loop origin, any multiple of the loop length apart is the same place
+     */
+    void writeLoop(const juce::AudioBuffer<float>& input, int startSample, int numSamples, juce::int64 loopPosition);
+
+    /**
+     * Read audio data from the loop at a sample position, wrapping at the loop end.
+     * Works in every storage state. A compacted loop is decoded through the audio thread's
+     * decode window, so call this from the audio thread only and readLoopInBackground() elsewhere.
+     * @param output The output audio buffer
+     * @param startSample Starting sample in the output buffer
+     * @param numSamples Number of samples to read
+     * @param loopPosition Position in samples from the loop origin, any multiple of the loop length apart is the same place
+     * @return false if the range was silent and the output was only zero-filled
+     */
+    bool readLoop(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition);
+
+    /**
+     * Mix the loop into what the output holds: the output is scaled by outputGain and the loop,
+     * scaled by loopGain, is added in the same pass. Reads like readLoop() otherwise.
+     * @param outputGain Gain applied to the output's existing content, e.g. the dry input
+     * @param loopGain Gain applied to the loop
+     * @return false if the range was silent and the output was only scaled
+     */
+    bool mixLoop(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition,
+                 float outputGain, float loopGain);
+
+    /**
+     * Read like readLoop(), from a worker or the message thread while the audio thread plays on.
+     * A compacted loop is decoded from the start of each block read instead of through the
+     * decode window, so large sequential reads are the efficient use.
+     */
+    bool readLoopInBackground(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition);
+
+    /**
+     * Get the peak magnitude of part of the loop from the peak maps, without reading samples.
+     * Resolution is a chunk of the float buffer, or a block of compact storage.
+     * Reader-guarded like readLoop(), so it may be called from the message thread for drawing.
+     * @param loopOffset Position in the loop in samples
+     * @param numSamples Number of samples, wrapping at the loop end
+     */
+    float getLoopPeak(int loopOffset, int numSamples) const;
+
+    /**
+     * Get the parts of the loop written since the last call and forget them.
+     * Overdubs and imports mark what they write; a single consumer, typically the editor, collects.
+     * @return One bit per 1/numDirtyRegions of the loop length, bit 0 at the loop start
+     */
+    juce::uint64 takeDirtyRegions() { return dirtyRegions.exchange(0, std::memory_order_acq_rel); }
+
+    /**
+     * Read audio data starting at an absolute index in the underlying circular buffer.
+     * Indices inside a multiplied loop read what the loop plays there, through the page map.
+     * Intended for analysis and export of recorded material outside the audio thread.
      * @param output The output audio buffer
      * @param startSample Starting sample in the output buffer
      * @param numSamples Number of samples to read
-     * @param position Normalized position in the loop (0.0 to 1.0)
+     * @param bufferIndex Absolute index in the circular buffer
+     */
+    void readAbsolute(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex) const;
+
+    /**
+     * Mark the current write position as the origin of a new loop.
+     * Call this when recording starts.
+     */
+    void beginLoop();
+
+    /**
+     * Move the loop origin and length, e.g. after boundary refinement.
+     * @param startIndex Absolute index of the loop start in the circular buffer
+     * @param lengthInSamples The loop length in samples
      */
-    void readAudio(juce::AudioBuffer<float>& output, int startSample, int numSamples, float position);
+    void setLoopBoundary(int startIndex, int lengthInSamples);
+
+    /**
+     * Get the absolute index of the loop start in the circular buffer.
+     */
+    int getLoopStart() const { return getActive().loopStartIndex.load(std::memory_order_acquire); }
 
     /**
      * Set the current loop length in samples.
@@ -50,7 +286,31 @@ public:
     /**
      * Get the current loop length in samples.
      */
-    int getLoopLength() const { return loopLengthSamples.load(std::memory_order_acquire); }
+    int getLoopLength() const { return getActive().loopLengthSamples.load(std::memory_order_acquire); }
+
+    /**
+     * Extend the loop to a number of repetitions of itself, e.g. to overdub longer phrases over it.
+     * Nothing is copied; repetitions get their own memory page by page as overdubs write into them.
+     * Audio thread only, while the loop is held as float samples.
+     * @param factor Number of repetitions, 2 or more
+     * @return false if the loop is empty, not writable, would not fit into the buffer, or was multiplied
+     *         maxRepetitionLevels times already
+     */
+    bool multiplyLoop(int factor);
+
+    /**
+     * Shorten the loop to its first part, a whole number of times shorter. Nothing is copied.
+     * A multiplied loop divides into whole repetitions, or into a part of its first one.
+     * Audio thread only, while the loop is held as float samples.
+     * @param divisor How many times shorter the loop becomes, 2 or more
+     * @return false if the loop is empty, not writable, or cannot be divided that way
+     */
+    bool divideLoop(int divisor);
+
+    /**
+     * Check if the loop is made of repetitions of its first period.
+     */
+    bool isLoopMultiplied() const { return getActive().periodSamples.load(std::memory_order_acquire) > 0; }
 
     /**
      * Get the current loop length in seconds.
@@ -72,15 +332,120 @@ public:
      */
     int getMaxBufferSize() const { return maxBufferSize; }
 
+    /**
+     * Get the size of the underlying circular buffer (always a power of 2).
+     */
+    int getBufferSize() const { return getActive().circularBuffer.getBufferSize(); }
+
 private:
-    CircularAudioBuffer circularBuffer;
-    std::atomic<int> loopLengthSamples{0};
+    /**
+     * Performs storage transitions requested from the audio thread.
+     */
+    class StorageJob : public BackgroundJob
+    {
+    public:
+        explicit StorageJob(LoopBufferManager& owner);
+
+    private:
+        LoopBufferManager& owner;
+
+        void run() override;
+    };
+
+    /**
+     * One loop with its own storage.
+     */
+    struct LoopSlot
+    {
+        std::atomic<StorageState> storageState{StorageState::Released};
+        CircularAudioBuffer circularBuffer;
+        CompactLoopStore compactStore;
+        std::atomic<int> loopLengthSamples{0};
+        std::atomic<int> loopStartIndex{0};
+        std::atomic<bool> lossyCompaction{false};   // Set with the compaction request, read by the worker
+        
+        // Repetitions of a multiplied loop read what they repeat until a page of them is written
+        std::atomic<int> periodSamples{0};      // 0 while the loop is not multiplied, else its length then
+        std::array<std::atomic<int>, maxRepetitionLevels> repeatedLengths{};  // Length each multiply repeated, ascending
+        std::atomic<int> numRepetitionLevels{0};
+        std::unique_ptr<std::atomic<juce::uint32>[]> materializedPages;
+        int numPageWords{0};
+    };
+
+    BackgroundJobQueue& jobQueue;
+    StorageJob storageJob;
+    
+    std::array<LoopSlot, numSlots> slots;
+    std::atomic<LoopSlot*> activeSlot{&slots[0]};
+    std::atomic<int> activeSlotIndex{0};
+    
+    // Audio-thread reads in flight, checked before a representation is freed
+    mutable std::atomic<int> activeReaders{0};
+    
+    // Write notifications in flight, checked before the observer may go away
+    std::atomic<WriteObserver*> writeObserver{nullptr};
+    std::atomic<int> activeNotifications{0};
+    
+    // Loop regions written since the editor last looked
+    std::atomic<juce::uint64> dirtyRegions{0};
+    
+    std::atomic<int> allocationFailures{0};
+    
+    juce::AudioBuffer<float> transferBuffer;   // Worker-side scratch for compaction
     std::atomic<bool> initialized{false};
     
     double sampleRate{44100.0};
     int maxBufferSize{0};
     int maxChannels{2};
 
+    LoopSlot& getActive() const { return *activeSlot.load(std::memory_order_acquire); }
+
+    void runStorageTransition(LoopSlot& slot);
+    bool allocateStorage(LoopSlot& slot);
+    void compactLoop(LoopSlot& slot);
+    void expandLoop(LoopSlot& slot);
+    void waitForReaders() const;
+    void notifyWrite(const CircularAudioBuffer& circularBuffer, int bufferIndex, int numSamples);
+    void markDirty(int loopOffset, int numSamples, int loopLength);
+
+    /**
+     * Map a loop offset onto the offset its samples are stored at, and how far that mapping holds.
+     */
+    int mapLoopOffset(const LoopSlot& slot, int loopOffset, int& runLength) const;
+
+    /**
+     * Mix loop content from the float buffer through the page map. The range must not pass the loop end.
+     */
+    bool mixMapped(const LoopSlot& slot, juce::AudioBuffer<float>& output, int startSample, int numSamples,
+                   int loopOffset, float outputGain, float loopGain) const;
+
+    /**
+     * The reader behind mixLoop() and readLoopInBackground(), which differ in how compact storage is decoded.
+     */
+    bool mixLoopFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition,
+                     float outputGain, float loopGain, bool inBackground);
+
+    /**
+     * Give the repetitions a write into a loop range is about to change their own pages:
+     * the pages written, and the pages of every repetition that reads them, directly or through
+     * another repetition. Levels below firstLevel are left out, they are done by the caller.
+     */
+    void materializeRepetitions(LoopSlot& slot, int loopOffset, int numSamples, int firstLevel = 0);
+    void materializePages(LoopSlot& slot, int loopOffset, int numSamples);
+
+    bool isPageMaterialized(const LoopSlot& slot, int page) const;
+    void clearPages(LoopSlot& slot, int firstPage);
+    void clearRepetitions(LoopSlot& slot);
+
+    /**
+     * Map a timeline position onto an offset within a loop, in integer arithmetic.
+     */
+    static int wrapLoopPosition(juce::int64 loopPosition, int loopLength)
+    {
+        const auto offset = loopPosition % loopLength;
+        return static_cast<int>(offset < 0 ? offset + loopLength : offset);
+    }
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopBufferManager)
 };
 
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <atomic>
+#include <memory>
+
+namespace OpenLooper2 {
+
+/**
+ * Writes the current loop to an audio file as a background job.
+ * The loop is captured as a copy-on-write snapshot: the worker copies it chunk by chunk while
+ * the loop keeps playing, and any chunk the audio thread is about to overwrite (e.g. while
+ * overdubbing) is preserved first, so the file holds the loop exactly as it was when the
+ * snapshot began. The audio thread only ever copies the chunks it overwrites.
+ *
+ * Only the mixdown is exported, not the overdub layers one by one. Layer memory belongs to the
+ * audio thread and is freed whenever the loop is flattened, so a worker copying a layer would need
+ * to pin it against that; and a layer only holds its pass exactly while feedback is at 1 and tone
+ * shaping is off, so the files would not add up to the loop in general.
+ */
+class LoopExporter : public BackgroundJob,
+                     private LoopBufferManager::WriteObserver
+{
+public:
+    enum class Format
+    {
+        Wav,
+        Flac
+    };
+
+    enum class State
+    {
+        Idle,
+        Requested,      // Snapshot memory allocated, waiting for the audio thread to start it
+        Exporting,
+        Succeeded,
+        Failed
+    };
+
+    static constexpr int bitsPerSample = 24;
+
+    LoopExporter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue);
+    ~LoopExporter() override;
+
+    /**
+     * Ask for the current loop to be exported. Allocates the snapshot, message thread only.
+     * @param file Destination file, replaced if it exists
+     * @param format File format to write
+     * @param numChannels Number of channels to write
+     * @param sampleRate Sample rate of the loop
+     * @return false if there is no loop, an export is already in progress, or the previous one is still finishing
+     */
+    bool requestExport(const juce::File& file, Format format, int numChannels, double sampleRate);
+
+    /**
+     * Check if an export waits for the audio thread to begin its snapshot.
+     */
+    bool isSnapshotRequested() const { return state.load(std::memory_order_acquire) == State::Requested; }
+
+    /**
+     * Capture the loop boundary and start copying in the background. Wait-free, audio thread only.
+     * Call this while the loop is held as float samples and not being recorded.
+     */
+    void beginSnapshot();
+
+    /**
+     * Abandon the export in progress and wait for the worker to stop. Never call this on the audio thread.
+     */
+    void cancelExport();
+
+    /**
+     * Get the progress of the most recent export.
+     */
+    State getState() const { return state.load(std::memory_order_acquire); }
+
+    /**
+     * Check if an export has been requested or is running.
+     */
+    bool isExporting() const;
+
+private:
+    enum class ChunkState : uint8_t
+    {
+        Pending,
+        Preserving,     // The audio thread is copying the old content
+        Copied
+    };
+
+    static constexpr int chunkSize = CircularAudioBuffer::chunkSize;
+    static constexpr int transferChunks = 16;
+
+    LoopBufferManager& bufferManager;
+    BackgroundJobQueue& jobQueue;
+    std::atomic<State> state{State::Idle};
+
+    juce::File destination;
+    Format format{Format::Wav};
+    double sampleRate{44100.0};
+
+    // Snapshot of the loop, written by the worker and by the audio thread chunk by chunk
+    juce::AudioBuffer<float> snapshot;
+    float* const* snapshotChannels{nullptr};
+    std::unique_ptr<std::atomic<ChunkState>[]> chunkStates;
+    int numChunks{0};
+    juce::AudioBuffer<float> transferBuffer;
+
+    // Loop boundary captured when the snapshot began
+    std::atomic<int> snapshotStart{0};
+    std::atomic<int> snapshotLength{0};
+
+    void run() override;
+    void aboutToOverwrite(int bufferIndex, int numSamples) override;
+
+    /**
+     * Claim a chunk for the audio thread and copy its current content into the snapshot.
+     */
+    void preserveChunk(int chunkIndex);
+
+    /**
+     * Copy every chunk the audio thread has not preserved. Worker thread.
+     * @return false if the export was cancelled
+     */
+    bool copyLoop();
+
+    /**
+     * Write the snapshot to the destination file. Worker thread.
+     */
+    bool writeFile() const;
+
+    /**
+     * Free the snapshot memory.
+     */
+    void releaseSnapshot();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopExporter)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
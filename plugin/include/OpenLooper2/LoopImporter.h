@@ -0,0 +1,138 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "PolyphaseResampler.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <atomic>
+#include <memory>
+
+namespace OpenLooper2 {
+
+/**
+ * Loads an audio file (WAV, AIFF, FLAC, ...) as loop content in the background.
+ * The job first opens the file and sizes the loop. The audio thread then hands the buffer
+ * manager over by starting a new loop of that length, after which the job decodes, resamples
+ * and writes the file section by section. Every finished section is published through an atomic
+ * length, so playback can start on the beginning of the loop while the rest is still decoding.
+ * The audio thread must not write to the buffer manager while the loop is streaming in.
+ */
+class LoopImporter : public BackgroundJob
+{
+public:
+    enum class State
+    {
+        Idle,
+        Opening,
+        Ready,          // File opened, waiting for the audio thread to hand over the loop
+        Streaming,
+        Succeeded,
+        Failed
+    };
+
+    static constexpr int sectionSize = 8192;
+
+    LoopImporter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue);
+    ~LoopImporter() override;
+
+    /**
+     * Start loading a file in the background. Message thread only.
+     * Files longer than the maximum loop length are truncated.
+     * @param file The audio file to load
+     * @param sampleRate Sample rate of the loop, the file is converted to it
+     * @param numChannels Number of loop channels, mono files feed every channel
+     * @return false if an import is already in progress, or the previous one is still finishing
+     */
+    bool requestImport(const juce::File& file, double sampleRate, int numChannels);
+
+    /**
+     * Check if the file is open and waits for the audio thread to hand over the loop.
+     */
+    bool isReadyToStream() const { return state.load(std::memory_order_acquire) == State::Ready; }
+
+    /**
+     * Start a new loop for the file and decode it into the buffer. Audio thread only.
+     * Wait-free: one compare-and-swap of the import state that is never retried, then a wait-free
+     * job submission (see BackgroundJobQueue::submitFromAudioThread).
+     * The loop storage must be ready and nothing may be recording into it.
+     * @return The length of the new loop in samples, or 0 if the import could not start
+     */
+    int beginStreaming();
+
+    /**
+     * Check if the loop is still being written by the import.
+     */
+    bool isStreaming() const { return state.load(std::memory_order_acquire) == State::Streaming; }
+
+    /**
+     * Get the number of samples from the loop start that have been written so far.
+     */
+    int getAvailableLength() const { return availableLength.load(std::memory_order_acquire); }
+
+    /**
+     * Abandon the import in progress and wait for the worker to stop. Never call this on the audio thread.
+     */
+    void cancelImport();
+
+    /**
+     * Get the progress of the most recent import.
+     */
+    State getState() const { return state.load(std::memory_order_acquire); }
+
+    /**
+     * Check if an import has been requested or is running.
+     */
+    bool isImporting() const;
+
+private:
+    LoopBufferManager& bufferManager;
+    BackgroundJobQueue& jobQueue;
+    std::atomic<State> state{State::Idle};
+
+    juce::AudioFormatManager formatManager;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    PolyphaseResampler resampler;
+
+    juce::File source;
+    double sampleRate{44100.0};
+    int numChannels{2};
+
+    int fileLength{0};
+    int loopLength{0};
+    bool resampling{false};
+    std::atomic<int> availableLength{0};
+
+    // Whole decoded file when resampling, since every output sample reads a window of input
+    juce::AudioBuffer<float> decodedFile;
+    juce::AudioBuffer<float> sectionBuffer;
+
+    void run() override;
+
+    /**
+     * Open the file and size the loop. Worker thread.
+     */
+    bool openFile();
+
+    /**
+     * Decode the file and write it into the loop. Worker thread.
+     * @return false if the import was cancelled or the file could not be read
+     */
+    bool streamFile();
+    bool streamDirect();
+    bool streamResampled();
+
+    /**
+     * Append a section to the loop and publish it to the audio thread.
+     */
+    void publishSection(int numSamples);
+
+    /**
+     * Close the file and free the decoding memory.
+     */
+    void releaseDecoder();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopImporter)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
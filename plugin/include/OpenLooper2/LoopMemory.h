@@ -0,0 +1,97 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+#ifndef OPENLOOPER2_LOCK_LOOP_MEMORY
+ #define OPENLOOPER2_LOCK_LOOP_MEMORY 0
+#endif
+
+#ifndef OPENLOOPER2_HUGE_PAGE_LOOP_MEMORY
+ #define OPENLOOPER2_HUGE_PAGE_LOOP_MEMORY 0
+#endif
+
+namespace OpenLooper2 {
+
+/**
+ * Sample memory for a loop, made resident before the audio thread first touches it.
+ * Every page is faulted in when the memory is allocated, and with OPENLOOPER2_LOCK_LOOP_MEMORY the
+ * pages are locked into RAM so they cannot be swapped out later in a memory-hungry session.
+ * With OPENLOOPER2_HUGE_PAGE_LOOP_MEMORY the memory is backed by huge pages where the system has
+ * them reserved (Linux), otherwise transparent huge pages are requested for it.
+ * Locking and huge pages are best effort: a failure is counted and the memory is still usable.
+ * Memory that would take the process past RLIMIT_MEMLOCK is not locked at all, so a small limit
+ * costs one counted failure per allocation instead of a failing mlock() call.
+ * Allocation takes time and may block, so never allocate or release on the audio thread.
+ */
+class LoopMemory
+{
+public:
+    static constexpr bool lockPages = OPENLOOPER2_LOCK_LOOP_MEMORY != 0;
+    static constexpr bool useHugePages = OPENLOOPER2_HUGE_PAGE_LOOP_MEMORY != 0;
+
+    LoopMemory();
+    ~LoopMemory();
+
+    /**
+     * Acquire zeroed, pre-faulted memory for a number of channels, replacing any held before.
+     * Each channel starts on a cache line boundary.
+     * @return false if no memory could be obtained
+     */
+    bool allocate(int numChannels, int numSamples);
+
+    /**
+     * Unlock and free the memory.
+     */
+    void release();
+
+    /**
+     * Get a pointer to the first sample of each channel, nullptr if nothing is allocated.
+     */
+    float* const* getChannelPointers() const { return data != nullptr ? channelPointers.get() : nullptr; }
+
+    /**
+     * Get the number of bytes held, including padding up to the page size.
+     */
+    size_t getBytes() const { return mappedBytes.load(std::memory_order_acquire); }
+
+    /**
+     * Get the number of bytes locked into RAM, 0 if locking is disabled or failed.
+     */
+    size_t getLockedBytes() const { return lockedBytes.load(std::memory_order_acquire); }
+
+    /**
+     * Get the number of bytes backed by reserved huge pages.
+     */
+    size_t getHugePageBytes() const { return hugePageBytes.load(std::memory_order_acquire); }
+
+    /**
+     * Get the number of allocations whose pages could not be locked, e.g. beyond RLIMIT_MEMLOCK.
+     */
+    int getLockFailures() const { return lockFailures.load(std::memory_order_acquire); }
+
+    /**
+     * Get the number of allocations that asked for huge pages and fell back to normal ones.
+     */
+    int getHugePageFailures() const { return hugePageFailures.load(std::memory_order_acquire); }
+
+private:
+    void* data{nullptr};
+    bool mapped{false};
+    juce::HeapBlock<float*> channelPointers;
+
+    std::atomic<size_t> mappedBytes{0};
+    std::atomic<size_t> lockedBytes{0};
+    std::atomic<size_t> hugePageBytes{0};
+    std::atomic<int> lockFailures{0};
+    std::atomic<int> hugePageFailures{0};
+
+    /**
+     * Write to one byte of every page, so the system backs each of them now.
+     */
+    static void prefault(void* memory, size_t numBytes, size_t pageSize);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopMemory)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
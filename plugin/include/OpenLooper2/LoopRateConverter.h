@@ -0,0 +1,67 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "PolyphaseResampler.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Converts recorded loop content to a new sample rate as a background job.
+ * The loop is captured before the buffer manager is reinitialized, resampled with
+ * PolyphaseResampler on a worker thread and written back into the new buffer. A compacted
+ * loop is captured in its encoded form and only decoded by the job.
+ * The audio thread must leave the buffer manager alone until the result is published.
+ */
+class LoopRateConverter : public BackgroundJob
+{
+public:
+    LoopRateConverter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue);
+    ~LoopRateConverter() override;
+
+    /**
+     * Copy the current loop out of the buffer manager. Call this from the message thread
+     * while the audio thread is not running (e.g. prepareToPlay), before reinitializing.
+     * @param numChannels Number of channels to capture
+     * @return true if there was loop content to capture
+     */
+    bool captureLoop(int numChannels);
+
+    /**
+     * Start converting the captured loop in the background.
+     * @param sourceRate The sample rate the loop was recorded at
+     * @param targetRate The new sample rate
+     */
+    void startConversion(double sourceRate, double targetRate);
+
+    /**
+     * Consume the conversion result. Wait-free, safe to call from the audio thread.
+     * @param convertedLength Receives the new loop length in samples
+     * @return true once the converted loop has been written to the buffer manager
+     */
+    bool getConvertedLength(int& convertedLength);
+
+private:
+    LoopBufferManager& bufferManager;
+    BackgroundJobQueue& jobQueue;
+    PolyphaseResampler resampler;
+
+    CompactLoopStore capturedStore;
+    int capturedChannels{0};
+    juce::AudioBuffer<float> capturedLoop;
+    juce::AudioBuffer<float> convertedLoop;
+    double sourceRate{44100.0};
+    double targetRate{44100.0};
+
+    // Converted loop length, or -1 while no result is pending
+    std::atomic<int> publishedLength{-1};
+
+    void run() override;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopRateConverter)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
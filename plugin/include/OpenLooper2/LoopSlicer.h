@@ -0,0 +1,146 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+namespace OpenLooper2 {
+
+/**
+ * Divides the loop into slices as a background job, either on an even grid or at detected
+ * transients, and publishes the result as a SliceMap the audio thread can query in O(1).
+ * Maps are triple-buffered: the worker always fills one that is neither published nor in use
+ * by the audio thread, so publishing a new map never blocks or allocates.
+ */
+class LoopSlicer : public BackgroundJob
+{
+public:
+    enum class Mode
+    {
+        Grid,
+        Transients
+    };
+
+    enum class Order
+    {
+        Forward,
+        Reverse,
+        Shuffle
+    };
+
+    static constexpr int maxSlices = 64;
+    static constexpr int bucketShift = 8;      // Lookup granularity, also the shortest slice
+    static constexpr int bucketSize = 1 << bucketShift;
+
+    /**
+     * Slice boundaries of one loop with a lookup table from position to slice.
+     */
+    class SliceMap
+    {
+    public:
+        int getNumSlices() const { return numSlices; }
+        int getLoopLength() const { return loopLength; }
+        int getSliceStart(int slice) const { return starts[static_cast<size_t>(slice)]; }
+        int getSliceEnd(int slice) const { return starts[static_cast<size_t>(slice) + 1]; }
+        int getSliceLength(int slice) const { return getSliceEnd(slice) - getSliceStart(slice); }
+
+        /**
+         * Get the slice holding a loop position. O(1): one table lookup and at most one step,
+         * since slices are never shorter than a lookup bucket.
+         * @param position Position in the loop, 0 to getLoopLength() - 1
+         */
+        int getSliceAt(int position) const;
+
+        /**
+         * Get the slice that plays in place of another under a playback order.
+         */
+        int getOrderedSlice(int slice, Order order) const;
+
+    private:
+        friend class LoopSlicer;
+
+        juce::uint32 generation{0};
+        int loopLength{0};
+        int numSlices{0};
+        std::array<int, maxSlices + 1> starts{};
+        std::array<juce::uint8, maxSlices> shuffleOrder{};
+        std::vector<juce::uint8> bucketSlices;
+    };
+
+    LoopSlicer(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue);
+    ~LoopSlicer() override;
+
+    /**
+     * Allocate the slice maps and analysis buffers. Message thread only.
+     * @param numChannels Number of loop channels
+     * @param maxLoopLength Longest loop in samples
+     */
+    void initialize(int numChannels, int maxLoopLength);
+
+    /**
+     * Ask for the active loop to be sliced again. Wait-free, safe to call from the audio thread.
+     * Maps built for earlier requests are no longer handed out.
+     * @param mode How slice boundaries are placed
+     * @param numSlices Number of slices; transient detection may find fewer
+     * @param loopLength Length of the loop to slice in samples
+     */
+    void requestSlices(Mode mode, int numSlices, int loopLength);
+
+    /**
+     * Get the map for the latest request and keep it valid until the next call. Audio thread only.
+     * @return nullptr while the latest request has not been built yet
+     */
+    const SliceMap* acquireMap();
+
+private:
+    static constexpr int numMaps = 3;
+    static constexpr int analysisHopSize = 32;
+    static constexpr int analysisBlockSize = 4096;
+    static constexpr float onsetEnergyRatio = 8.0f;   // ~ +9 dB jump between hops, as for boundary refinement
+    static constexpr float silenceEnergyFloor = 1.0e-6f;
+
+    LoopBufferManager& bufferManager;
+    BackgroundJobQueue& jobQueue;
+
+    std::array<SliceMap, numMaps> maps;
+    std::atomic<int> publishedMap{-1};
+    std::atomic<int> mapInUse{-1};
+
+    // Request posted by the audio thread
+    std::atomic<Mode> requestedMode{Mode::Grid};
+    std::atomic<int> requestedSlices{1};
+    std::atomic<int> requestedLength{0};
+    std::atomic<juce::uint32> generation{0};
+    std::atomic<bool> requestPending{false};
+
+    // Analysis scratch, only touched while the job runs
+    juce::AudioBuffer<float> analysisBuffer;
+    std::vector<float> hopEnergy;
+    std::vector<std::pair<float, int>> onsets;
+
+    void run() override;
+
+    /**
+     * Build and publish the map for one request if it is still current.
+     */
+    void buildMap(Mode mode, int numSlices, int loopLength, juce::uint32 requestGeneration);
+
+    /**
+     * Place slice starts at detected transients.
+     * @return The number of slices found, at least one
+     */
+    int findTransientSlices(SliceMap& map, int numSlices, int loopLength);
+
+    /**
+     * Pick a map that the audio thread cannot be reading.
+     */
+    int getFreeMap() const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoopSlicer)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
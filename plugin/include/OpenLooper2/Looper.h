@@ -3,11 +3,34 @@
 #include "LoopBufferManager.h"
 #include "TransportController.h"
 #include "OverdubEngine.h"
+#include "OverdubLayers.h"
+#include "EchoEngine.h"
+#include "GranularEngine.h"
 #include "ParameterManager.h"
+#include "LoopBoundaryRefiner.h"
+#include "LoopRateConverter.h"
+#include "LoopExporter.h"
+#include "LoopImporter.h"
+#include "LoopSlicer.h"
+#include "LooperCommandQueue.h"
+#include "BackgroundJobQueue.h"
+#include "SharedLoopClock.h"
+#include "SceneLauncher.h"
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <array>
 
 namespace OpenLooper2 {
 
+/**
+ * Host bus buffers that receive the loop and the dry input separately from the main mix.
+ * Either may be nullptr when the host has the bus switched off.
+ */
+struct AuxOutputs
+{
+    juce::AudioBuffer<float>* loop{nullptr};
+    juce::AudioBuffer<float>* dry{nullptr};
+};
+
 /**
  * Main looper class that integrates all audio looper components.
  * Provides a unified interface for the audio processor.
@@ -15,30 +38,132 @@ namespace OpenLooper2 {
 class Looper
 {
 public:
-    Looper();
+    /**
+     * @param jobQueue The processor's queue for non-realtime background work
+     */
+    explicit Looper(BackgroundJobQueue& jobQueue);
     ~Looper();
 
     /**
      * Initialize the looper with audio specifications.
+     * Re-preparing keeps the recorded loop; a new sample rate converts it in the background.
      * @param sampleRate The audio sample rate
      * @param samplesPerBlock Expected samples per audio block
      * @param numChannels Number of audio channels
      */
     void initialize(double sampleRate, int samplesPerBlock, int numChannels);
 
+    /**
+     * Free memory that is not needed while the processor is inactive.
+     * An empty loop gives back its buffer, which is reacquired when processing resumes.
+     * Message thread only, while the audio thread is stopped.
+     */
+    void releaseResources();
+
+    /**
+     * Account for a block the host processed in bypass.
+     * After a while of bypass with nothing recorded, the loop memory is released in the background.
+     * @param numSamples Number of samples in the bypassed block
+     */
+    void processBypassed(int numSamples);
+
+    /**
+     * Receive parameter changes from the state instead of polling it every block.
+     * Call detachParameters() before the state is destroyed. Message thread only.
+     * @param apvts The AudioProcessorValueTreeState holding the looper parameters
+     */
+    void attachParameters(juce::AudioProcessorValueTreeState& apvts);
+
+    /**
+     * Stop receiving parameter changes. Message thread only.
+     */
+    void detachParameters();
+
     /**
      * Process a block of audio samples.
      * @param buffer The audio buffer to process
-     * @param apvts The AudioProcessorValueTreeState for parameter access
+     * @param midiMessages Incoming MIDI; notes retrigger and stutter loop slices
+     * @param apvts The AudioProcessorValueTreeState for parameter access when not attached
+     * @param hostTimeInSamples Host timeline position of the block while the host plays, otherwise -1
+     * @param auxOutputs Buses to fill with the loop only and the input only, each as long as the buffer
      */
     void processBlock(juce::AudioBuffer<float>& buffer, 
-                     const juce::AudioProcessorValueTreeState& apvts);
+                     const juce::MidiBuffer& midiMessages,
+                     const juce::AudioProcessorValueTreeState& apvts,
+                     juce::int64 hostTimeInSamples = -1,
+                     const AuxOutputs& auxOutputs = {});
+
+    /**
+     * Send a transport or editing command to the audio thread. Message thread only.
+     * Commands are carried out in the order they were sent, each at its own sample, so presses
+     * that fall into the same block are not merged the way parameter toggles are.
+     * @param type The action
+     * @param value Loop length in samples for SetLength, zero-based slot for LaunchSlot,
+     *              factor for Multiply and Divide
+     * @param timelineSample Timeline sample to act at, see getTimelineSample(), or LooperCommand::immediately
+     * @return false if the command queue was full
+     */
+    bool sendCommand(LooperCommand::Type type, int value = 0,
+                     juce::int64 timelineSample = LooperCommand::immediately);
+
+    /**
+     * Get the timeline sample the next block starts at, for timestamping commands.
+     */
+    juce::int64 getTimelineSample() const { return publishedTimelineSample.load(std::memory_order_acquire); }
+
+    /**
+     * Change the gain of an overdub layer through the command queue. Message thread only.
+     * @param layerIndex Zero-based layer, in the order the overdub passes were recorded
+     * @param gain Layer gain (0.0 to 2.0)
+     * @return false if the command queue was full
+     */
+    bool setLayerGain(int layerIndex, float gain);
+
+    /**
+     * Write the current loop to an audio file in the background. Message thread only.
+     * The file holds the loop as it was when the audio thread picked up the request,
+     * even if it is overdubbed while being written.
+     * @param file Destination file, replaced if it exists
+     * @param format File format to write
+     * @return false if there is no loop or an export is already in progress
+     */
+    bool exportLoop(const juce::File& file, LoopExporter::Format format);
+
+    /**
+     * Get the progress of the most recent export.
+     */
+    LoopExporter::State getExportState() const { return loopExporter.getState(); }
+
+    /**
+     * Replace the loop with an audio file, decoded and converted in the background. Message thread only.
+     * The loop starts playing as soon as its beginning has been decoded.
+     * @param file The audio file to load
+     * @return false if an import is already in progress
+     */
+    bool importLoop(const juce::File& file);
+
+    /**
+     * Get the progress of the most recent import.
+     */
+    LoopImporter::State getImportState() const { return loopImporter.getState(); }
+
+    /**
+     * Get the parts of the loop overdubbed since the last call, for redrawing the waveform.
+     * Message thread only; see LoopBufferManager::takeDirtyRegions().
+     */
+    juce::uint64 takeChangedLoopRegions() { return loopBufferManager.takeDirtyRegions(); }
+
+    /**
+     * Get how much of the loop memory is locked into RAM, and whether locking or huge pages failed.
+     */
+    LoopBufferManager::MemoryStatus getLoopMemoryStatus() const { return loopBufferManager.getMemoryStatus(); }
 
     /**
      * Get access to individual components for UI updates.
      */
     const TransportController& getTransportController() const { return transportController; }
     const LoopBufferManager& getLoopBufferManager() const { return loopBufferManager; }
+    const OverdubLayers& getOverdubLayers() const { return overdubLayers; }
     const ParameterManager& getParameterManager() const { return parameterManager; }
 
     /**
@@ -52,9 +177,18 @@ public:
     bool isInitialized() const { return initialized; }
 
 private:
+    BackgroundJobQueue& jobQueue;
     LoopBufferManager loopBufferManager;
+    OverdubLayers overdubLayers;
+    LoopBoundaryRefiner boundaryRefiner;
+    LoopRateConverter rateConverter;
+    LoopExporter loopExporter;
+    LoopImporter loopImporter;
+    LoopSlicer loopSlicer;
     TransportController transportController;
     OverdubEngine overdubEngine;
+    EchoEngine echoEngine;
+    GranularEngine granularEngine;
     ParameterManager parameterManager;
     
     bool initialized{false};
@@ -62,20 +196,364 @@ private:
     int samplesPerBlock{512};
     int numChannels{2};
     
-    // Temporary buffers for processing
+    static constexpr float maxLoopLengthSeconds = 60.0f;
+    static constexpr double bypassReleaseDelaySeconds = 2.0;
+    static constexpr double compactionDelaySeconds = 5.0;
+    static constexpr double importPrerollSeconds = 0.25;
+    
+    // Longest stretch processed in one pass; host blocks are split into sub-blocks of this size
+    static constexpr int subBlockSize = 128;
+    
+    // MIDI notes for slice playback: one note per slice from the base note up, stutter just below
+    static constexpr int sliceBaseNote = 36;
+    static constexpr int stutterNote = 35;
+    static constexpr int maxSliceEvents = 128;
+    static constexpr int maxBlockCommands = 64;
+    static constexpr int maxWaitingCommands = 64;
+    
+    // Samples processed in bypass since the last active block
+    int bypassedSamples{0};
+    
+    // Samples processed since the loop was last written
+    int idleSamples{0};
+    
+    // Record or overdub was pressed while the loop memory was not yet writable
+    bool recordPending{false};
+    bool overdubPending{false};
+    
+    // The overdub pass being recorded, layered or not
+    bool overdubPassActive{false};
+    
+    // An imported loop starts playing once enough of it has been decoded
+    bool importPlaybackPending{false};
+    
+    // Transport changes that wait for a boundary of the shared master loop
+    enum class SyncEvent
+    {
+        None,
+        RecordStart,
+        RecordStop
+    };
+    
+    // Clip slot switch waiting for the next loop boundary, or -1
+    int pendingSlot{-1};
+    juce::SharedResourcePointer<SceneLauncher> sceneLauncher;
+    juce::uint32 lastSceneSequence{0};
+    
+    juce::SharedResourcePointer<SharedLoopClock> sharedClock;
+    SharedLoopClock::Grid clockGrid;
+    SyncEvent pendingSyncEvent{SyncEvent::None};
+    int syncedRecordLength{0};
+    
+    // Slice retriggers and stutter changes at sample offsets within the current block
+    struct SliceEvent
+    {
+        enum class Type
+        {
+            Retrigger,
+            StutterNote,
+            StutterParameter
+        };
+        
+        Type type;
+        int offset;
+        int value;      // Slice index for a retrigger, otherwise whether stutter is held
+    };
+    
+    std::array<SliceEvent, maxSliceEvents> sliceEvents;
+    int numSliceEvents{0};
+    int nextSliceEvent{0};
+    
+    // Commands from the UI due within the current block, at their sample offsets
+    struct ScheduledCommand
+    {
+        LooperCommand command;
+        int offset;
+    };
+    
+    LooperCommandQueue commandQueue;
+    std::array<ScheduledCommand, maxBlockCommands> blockCommands;
+    int numBlockCommands{0};
+    int nextBlockCommand{0};
+    
+    // Commands taken off the queue that are due in a later block, in timeline order
+    std::array<LooperCommand, maxWaitingCommands> waitingCommands;
+    int numWaitingCommands{0};
+    
+    // The host moved its timeline backwards, what was waiting for a later sample is due now
+    bool timelineRewound{false};
+    std::atomic<juce::int64> publishedTimelineSample{0};
+    
+    // Slice map in use this block, and the loop it was requested for
+    const LoopSlicer::SliceMap* sliceMap{nullptr};
+    int slicedMode{-1};
+    int slicedCount{0};
+    int slicedLength{-1};
+    int slicedStart{0};
+    int slicedSlot{-1};
+    
+    // Stutter repeats a fraction of the playing slice while held, the transport keeps running
+    bool stutterNoteHeld{false};
+    bool stutterParameterHeld{false};
+    bool stutterActive{false};
+    int stutterStart{0};
+    int stutterLength{0};
+    int stutterPhase{0};
+    
+    // Position of the current block on the timeline shared between instances
+    juce::int64 timelineSample{0};
+    bool timelineAnchored{false};
+    juce::int64 recordStartTimeline{0};
+    bool loopOnClockGrid{false};
+    
+    // Set while the loop is being converted to a new sample rate
+    std::atomic<bool> conversionPending{false};
+    double conversionRatio{1.0};
+    
+    // Loop-only host bus for the current block, and where the segment being processed starts in it
+    juce::AudioBuffer<float>* loopOutput{nullptr};
+    int segmentStart{0};
+    
+    // Temporary buffers for processing, sized to one sub-block when prepared
     juce::AudioBuffer<float> tempBuffer;
     juce::AudioBuffer<float> loopBuffer;
+    
+    // The loop samples a varispeed segment covers, up to maxPlaybackRate sub-blocks plus interpolation
+    juce::AudioBuffer<float> varispeedBuffer;
 
     /**
      * Handle transport state changes based on parameter triggers.
      */
     void handleTransportControls();
 
+    /**
+     * Transport actions shared by the parameter buttons and UI commands.
+     */
+    void pressRecord();
+    void pressPlay();
+    void pressStop();
+    void pressOverdub();
+
+    /**
+     * Take the UI commands due within this block off the queue, in order.
+     */
+    void collectCommands(int numSamples);
+
+    /**
+     * Carry out a UI command at the current transport position.
+     */
+    void applyCommand(const LooperCommand& command);
+
+    /**
+     * Abandon the take in progress, or disarm one waiting for the master loop boundary.
+     * Otherwise take the last overdub layer out of the loop, ending a pass in progress first.
+     */
+    void undoTake();
+
+    /**
+     * Stop and forget the loop in the active slot.
+     */
+    void clearLoop();
+
+    /**
+     * Change the length of a finished loop, keeping the playback position.
+     */
+    void resizeLoop(int lengthInSamples);
+
+    /**
+     * Repeat the loop a number of times, or keep only its first part, keeping the playback position.
+     * Works while overdubbing, so a longer phrase can be laid over a multiplied loop.
+     */
+    void multiplyLoop(int factor);
+    void divideLoop(int divisor);
+
+    /**
+     * Check if the loop may change its length now.
+     */
+    bool canChangeLoopLength() const;
+
+    /**
+     * Pick up clip slot selections and scene launches.
+     */
+    void handleSlotRequests();
+
+    /**
+     * Switch to a clip slot at the next boundary and prefetch its loop meanwhile.
+     */
+    void queueSlotSwitch(int slotIndex);
+
+    /**
+     * Get the offset within the block at which a pending slot switch falls, or -1 if not in this block.
+     */
+    int getSlotSwitchOffset(int numSamples) const;
+
+    /**
+     * Make the pending slot the active one and restart the transport on its loop.
+     * @param switchTimeline Timeline sample at which the switch happens
+     */
+    void applySlotSwitch(juce::int64 switchTimeline);
+
+    /**
+     * Ask for the loop to be sliced again when its content or the slice settings changed,
+     * and pick up the map for this block.
+     */
+    void updateSliceMap();
+
+    /**
+     * Gather slice retriggers and stutter changes from MIDI and parameters, in block order.
+     */
+    void collectSliceEvents(const juce::MidiBuffer& midiMessages, int numSamples);
+
+    /**
+     * Carry out a slice event at the current transport position.
+     */
+    void applySliceEvent(const SliceEvent& event);
+
+    /**
+     * Start or stop repeating the part of the slice that is playing.
+     */
+    void setStutter(bool held);
+
+    /**
+     * Mix the loop for playback into the buffer, through the slice order and stutter when they
+     * are active, or as a grain cloud in granular mode. The buffer's content is scaled by dryGain
+     * in the same pass; 0 replaces it.
+     * @return false if everything read was silent
+     */
+    bool readSlicedLoop(juce::AudioBuffer<float>& buffer, int numSamples, float dryGain, float loopGain);
+
+    /**
+     * Mix the loop into the buffer at the transport's playback rate, interpolating linearly
+     * between loop samples at the transport's fixed-point phase. Reads like readSlicedLoop().
+     */
+    bool mixLoopAtRate(juce::AudioBuffer<float>& buffer, int numSamples, float dryGain, float loopGain);
+
+    /**
+     * Pass the playback rate parameter to the transport while the loop plays straight through,
+     * and unity otherwise.
+     */
+    void updatePlaybackRate();
+
+    /**
+     * Start a new take at the current write position.
+     * @param startTimeline Timeline sample at which the take starts
+     */
+    void startRecording(juce::int64 startTimeline);
+
+    /**
+     * Start a take now, or at the next master loop boundary when following the shared clock.
+     */
+    void requestRecordStart();
+
+    /**
+     * Close the current take and publish it to the shared clock when acting as the master.
+     */
+    void stopRecording();
+
+    /**
+     * Refresh the shared clock grid, or leave the clock when sync is switched off.
+     */
+    void updateSharedClock();
+
+    /**
+     * Check if this instance quantizes to a grid published by another instance.
+     */
+    bool isClockFollower() const;
+
+    /**
+     * Move the playback position to where the shared clock says it should be.
+     */
+    void alignPlaybackToClock();
+
+    /**
+     * Get the offset within the block at which a pending sync event falls, or -1 if not in this block.
+     */
+    int getSyncEventOffset(int numSamples) const;
+
+    /**
+     * Carry out the pending sync event.
+     * @param eventTimeline Timeline sample at which the event happens
+     */
+    void applySyncEvent(juce::int64 eventTimeline);
+
+    /**
+     * Finish the layer of an overdub pass once the transport has left overdubbing.
+     */
+    void endOverdubPass();
+
+    /**
+     * Check if the block can skip the segment loop: stopped, with nothing armed, pending or arriving
+     * in this block that would change the transport or the loop.
+     */
+    bool isIdleBlock(const juce::MidiBuffer& midiMessages) const;
+
+    /**
+     * Echo the finished block and publish the timeline position it ends at.
+     */
+    void finishBlock(juce::AudioBuffer<float>& buffer);
+
+    /**
+     * Process part of a block in the current state, then advance the transport past it.
+     */
+    void processSegment(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    /**
+     * Check if there is recorded or recording material that must keep its memory.
+     */
+    bool hasLoopContent() const;
+
+    /**
+     * Move a loop that has not been written for a while into compact storage, and back
+     * when compaction gets switched off.
+     */
+    void manageLoopStorage(int numSamples);
+
+    /**
+     * Hand the loop over to an import whose file is open, and start playing it once the
+     * beginning has been decoded.
+     */
+    void beginPendingImport();
+
+    /**
+     * Start the snapshot of a requested export once the loop can be read as float samples.
+     */
+    void beginPendingExport();
+
+    /**
+     * Capture the loop and start converting it to a new format. Message thread only.
+     */
+    void prepareLoopConversion(double newSampleRate, int newNumChannels);
+
+    /**
+     * Resume the transport on a loop that finished converting to the new sample rate.
+     */
+    void finishLoopConversion(int convertedLength);
+
+    /**
+     * Apply a refined loop boundary published by the background refiner, if any.
+     */
+    void applyRefinedLoopBoundary();
+
     /**
      * Process audio based on current transport state.
      */
     void processAudioForCurrentState(juce::AudioBuffer<float>& buffer);
 
+    /**
+     * Get the gain of the live input in the output for a transport state, from dry level and monitoring.
+     */
+    float getDryGain(TransportController::State state) const;
+
+    /**
+     * Copy loop audio of the current segment into the loop-only output, if the host enabled it.
+     */
+    void sendToLoopOutput(const juce::AudioBuffer<float>& source, int numSamples, float gain);
+
+    /**
+     * Check if every channel of a block is below the silence threshold.
+     */
+    static bool isSilent(const juce::AudioBuffer<float>& buffer, int numSamples);
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Looper)
 };
 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * A transport or editing action sent from the UI, to take effect at a given timeline sample.
+ */
+struct LooperCommand
+{
+    enum class Type
+    {
+        Record,         // Start a take, or close the one in progress
+        Play,
+        Stop,
+        Overdub,        // Start or stop overdubbing
+        Undo,
+        Clear,          // Forget the loop in the active slot
+        SetLength,      // value: new loop length in samples
+        LaunchSlot,     // value: zero-based clip slot, switched at the next loop boundary
+        Multiply,       // value: number of repetitions the loop is extended to
+        Divide,         // value: how many times shorter the loop becomes
+        SetLayerGain    // value: zero-based overdub layer, level: its gain
+    };
+
+    // Timestamp for commands that apply at the start of the next block
+    static constexpr juce::int64 immediately = -1;
+
+    Type type{Type::Stop};
+    juce::int64 timelineSample{immediately};
+    int value{0};
+    float level{0.0f};
+};
+
+/**
+ * Wait-free single-producer, single-consumer queue of LooperCommands from the message thread
+ * to the audio thread. Commands are kept by value in a fixed ring, so neither side allocates,
+ * and every command is delivered on its own, however many arrive within one block.
+ */
+class LooperCommandQueue
+{
+public:
+    static constexpr int capacity = 256;
+
+    LooperCommandQueue();
+    ~LooperCommandQueue();
+
+    /**
+     * Append a command. Wait-free, message thread only.
+     * @return false if the queue was full and the command was dropped
+     */
+    bool push(const LooperCommand& command);
+
+    /**
+     * Look at the oldest command without removing it. Wait-free, audio thread only.
+     * @return false if the queue is empty
+     */
+    bool peek(LooperCommand& command) const;
+
+    /**
+     * Remove the oldest command. Wait-free, audio thread only.
+     */
+    void pop();
+
+    /**
+     * Number of commands dropped because the queue was full.
+     */
+    int getNumDroppedCommands() const { return droppedCommands.load(std::memory_order_relaxed); }
+
+private:
+    juce::AbstractFifo fifo{capacity};
+    std::array<LooperCommand, capacity> commands{};
+    std::atomic<int> droppedCommands{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LooperCommandQueue)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
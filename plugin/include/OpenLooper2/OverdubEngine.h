@@ -3,12 +3,15 @@
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_dsp/juce_dsp.h>
 #include <atomic>
+#include <memory>
 
 namespace OpenLooper2 {
 
 /**
  * Handles audio layering and feedback processing for overdub operations.
  * Provides high-quality mixing with configurable feedback levels.
+ * The feedback path can be tone shaped like tape: low-cut, high-cut and soft saturation are
+ * applied to the existing content once per loop pass. Only the saturation is oversampled.
  */
 class OverdubEngine
 {
@@ -16,12 +19,30 @@ public:
     OverdubEngine();
     ~OverdubEngine();
 
+    static constexpr float minLowCutHz = 20.0f;       // Low-cut is off at this setting
+    static constexpr float maxHighCutHz = 20000.0f;   // High-cut is off at this setting
+
     /**
      * Initialize the overdub engine with audio specifications.
      * @param sampleRate The audio sample rate
      * @param samplesPerBlock Expected samples per audio block
+     * @param numChannels Number of channels to prepare the feedback filters for
+     */
+    void initialize(double sampleRate, int samplesPerBlock, int numChannels = 2);
+
+    /**
+     * Configure the feedback path tone shaping. Allocation-free, call it from the audio thread.
+     * @param lowCutHz Low-cut frequency, minLowCutHz disables it
+     * @param highCutHz High-cut frequency, maxHighCutHz disables it
+     * @param saturation Soft saturation amount (0.0 to 1.0), 0 disables it
+     */
+    void setToneShaping(float lowCutHz, float highCutHz, float saturation);
+
+    /**
+     * Get the delay in samples that the feedback path adds to the existing content.
+     * Callers read the loop this far ahead so the shaped content lands back in place.
      */
-    void initialize(double sampleRate, int samplesPerBlock);
+    int getFeedbackLatency() const;
 
     /**
      * Process overdub mixing, combining input audio with existing buffer content.
@@ -70,12 +91,31 @@ private:
     
     double sampleRate{44100.0};
     int samplesPerBlock{512};
+    int numChannels{2};
+    
+    // Feedback path tone shaping
+    juce::dsp::StateVariableTPTFilter<float> lowCutFilter;
+    juce::dsp::StateVariableTPTFilter<float> highCutFilter;
+    std::unique_ptr<juce::dsp::Oversampling<float>> saturationOversampler;
+    float lowCutFrequency{minLowCutHz};
+    float highCutFrequency{maxHighCutHz};
+    float saturationAmount{0.0f};
 
     /**
      * Apply smooth parameter changes to prevent audio artifacts.
      */
     void updateGainParameters();
 
+    /**
+     * Run the existing loop content through saturation and the filters.
+     */
+    void shapeFeedback(juce::dsp::AudioBlock<float>& block);
+
+    /**
+     * Soft-clip a block at the oversampled rate, keeping unity gain for small signals.
+     */
+    void saturate(juce::dsp::AudioBlock<float>& block) const;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OverdubEngine)
 };
 
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "LoopBufferManager.h"
+#include "LoopMemory.h"
+#include "BackgroundJob.h"
+#include "BackgroundJobQueue.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Keeps every overdub pass over the active loop as a layer of its own, with its own gain.
+ * The loop buffer stays the mixdown that playback reads, so playing costs one read stream
+ * however many layers there are. A layer holds what its pass changed in the loop; when its gain
+ * moves, only the region that pass covered is brought up to date, by adding the gain difference
+ * times the layer into the mixdown a bounded number of samples per block.
+ *
+ * Layer memory is allocated, pre-faulted and locked off the audio thread: a spare layer for the
+ * current loop length is kept ready, and a pass that starts without one is written into the loop
+ * without a layer. Anything that moves the loop content relative to its offsets (a new take, a new
+ * length or boundary, another slot, an import) flattens the layers: their sum stays in the loop and
+ * the layers themselves are dropped.
+ *
+ * A layer is exact while feedback is at 1 and tone shaping is off. Otherwise a pass also fades
+ * the layers below it, and that fade belongs to the later layer.
+ */
+class OverdubLayers
+{
+public:
+    static constexpr int maxLayers = 8;
+    static constexpr int remixSamplesPerSample = 8;     // Mixdown samples brought up to date per sample played
+
+    /**
+     * @param loopBufferManager The loop whose overdubs are layered, its buffer is the mixdown
+     * @param jobQueue Queue used to allocate and free layer memory off the audio thread
+     */
+    OverdubLayers(LoopBufferManager& loopBufferManager, BackgroundJobQueue& jobQueue);
+    ~OverdubLayers();
+
+    /**
+     * Drop every layer and free their memory. Message thread only, while the audio thread is stopped.
+     * @param numChannels Number of channels each layer holds
+     */
+    void prepare(int numChannels);
+
+    /**
+     * Follow the active loop, flattening the layers when its slot or length changed, and keep a
+     * spare layer ready for the next pass. Wait-free, audio thread only, once per block.
+     */
+    void update();
+
+    /**
+     * Keep the layers' current mix in the loop and forget the layers. Wait-free, audio thread only.
+     */
+    void flatten();
+
+    /**
+     * Start recording an overdub pass into a new layer. Wait-free, audio thread only.
+     * @return false if no spare layer is ready or all layers are in use; the pass is then not layered
+     */
+    bool beginLayer();
+
+    /**
+     * Finish the layer being recorded, it keeps its place and gain.
+     */
+    void endLayer();
+
+    /**
+     * Check if an overdub pass is being recorded into a layer.
+     */
+    bool isRecordingLayer() const { return recordingLayer >= 0; }
+
+    /**
+     * Add what the pass changed in the loop to the layer being recorded.
+     * @param change The loop content after the pass minus the content before it
+     * @param numSamples Number of samples, wrapping at the loop end
+     * @param loopPosition Position in samples from the loop origin the change was written at
+     */
+    void addToLayer(const juce::AudioBuffer<float>& change, int numSamples, juce::int64 loopPosition);
+
+    /**
+     * Change the gain of a finished layer. The mixdown follows over the next blocks.
+     * @param layerIndex Zero-based layer, in the order the passes were recorded
+     * @param gain Layer gain (0.0 to 2.0)
+     * @return false if there is no such layer, or it is still being recorded
+     */
+    bool setLayerGain(int layerIndex, float gain);
+
+    /**
+     * Take the most recent finished layer out of the mixdown and free it afterwards.
+     * @return false if there is no finished layer
+     */
+    bool removeLastLayer();
+
+    /**
+     * Bring the mixdown up to date with the layer gains, at most remixSamplesPerSample times the
+     * block length per call, so the cost per sample played stays the same whatever the block size.
+     * The sweep starts where the loop is playing, so a change is heard right away.
+     * Audio thread only, never while the loop is being recorded.
+     * @param scratch Buffer to pass loop content through, its size bounds each read and write
+     * @param playbackPosition Current position in samples from the loop origin
+     * @param numSamples Length of the block being processed
+     */
+    void remix(juce::AudioBuffer<float>& scratch, juce::int64 playbackPosition, int numSamples);
+
+    /**
+     * Check if the mixdown is still behind a gain change or removal.
+     */
+    bool isRemixing() const { return remixLayer >= 0; }
+
+    /**
+     * Get the number of layers, including the one being recorded. May be called from any thread.
+     */
+    int getNumLayers() const { return numLayers.load(std::memory_order_acquire); }
+
+    /**
+     * Get the gain of a layer, 0 if there is no such layer. May be called from any thread.
+     */
+    float getLayerGain(int layerIndex) const;
+
+    /**
+     * Get the number of passes that were written without a layer because none was ready.
+     */
+    int getUnlayeredPasses() const { return unlayeredPasses.load(std::memory_order_relaxed); }
+
+private:
+    /**
+     * Allocates the spare layer and frees dropped ones.
+     */
+    class LayerJob : public BackgroundJob
+    {
+    public:
+        explicit LayerJob(OverdubLayers& owner);
+
+    private:
+        OverdubLayers& owner;
+
+        void run() override;
+    };
+
+    enum class State
+    {
+        Free,
+        Allocating,     // Worker owns the memory
+        Spare,          // Allocated and zeroed, waiting for a pass
+        Recording,
+        Active,
+        Releasing       // Dropped, the worker frees it
+    };
+
+    struct Layer
+    {
+        std::atomic<State> state{State::Free};
+        LoopMemory memory;
+        int length{0};                  // Loop length the layer was allocated for
+        std::atomic<float> gain{1.0f};  // Gain asked for
+
+        // Audio thread only
+        float mixedGain{1.0f};          // Gain the layer has in the mixdown
+        int start{0};                   // Loop offset the pass started at
+        int extent{0};                  // Samples covered from the start, at most the loop length
+        bool removing{false};
+    };
+
+    LoopBufferManager& loopBufferManager;
+    BackgroundJobQueue& jobQueue;
+    LayerJob layerJob;
+
+    std::array<Layer, maxLayers> layers;
+
+    // Layers in the order their passes were recorded
+    std::array<std::atomic<int>, maxLayers> order{};
+    std::atomic<int> numLayers{0};
+
+    // Loop the layers belong to, audio thread only
+    int layerSlot{-1};
+    int layerLength{0};
+    int recordingLayer{-1};
+
+    // Remix in progress, audio thread only
+    int remixLayer{-1};
+    float remixGain{1.0f};
+    int remixFirst{0};      // Index within the layer's region the sweep started at
+    int remixDone{0};
+
+    std::atomic<int> requestedLength{0};
+    std::atomic<int> unlayeredPasses{0};
+    int numChannels{2};
+
+    /**
+     * Pick the next layer whose gain in the mixdown is out of date.
+     * @return false if the mixdown is up to date
+     */
+    bool startRemix(juce::int64 playbackPosition);
+
+    /**
+     * Record the new gain of the remixed layer, and drop it if it was removed.
+     */
+    void finishRemix();
+
+    /**
+     * Run the spare and release transitions. Called on the worker.
+     */
+    void runLayerTransitions();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OverdubLayers)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
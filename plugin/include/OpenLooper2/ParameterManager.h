@@ -1,6 +1,7 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include <array>
 #include <atomic>
 
 namespace OpenLooper2 {
@@ -8,8 +9,10 @@ namespace OpenLooper2 {
 /**
  * Manages all plugin parameters and automation for the audio looper.
  * Provides thread-safe parameter access and VST3 automation support.
+ * When attached to the AudioProcessorValueTreeState, values are pushed in as they change
+ * so the audio thread does not have to poll every parameter on every block.
  */
-class ParameterManager
+class ParameterManager : public juce::AudioProcessorValueTreeState::Listener
 {
 public:
     // Parameter IDs
@@ -19,9 +22,49 @@ public:
     static constexpr const char* OVERDUB_ID = "overdub";
     static constexpr const char* FEEDBACK_ID = "feedback";
     static constexpr const char* VOLUME_ID = "volume";
+    static constexpr const char* PLAYBACK_RATE_ID = "playbackrate";
+    static constexpr const char* REFINE_ID = "refine";
+    static constexpr const char* COMPACT_ID = "compact";
+    static constexpr const char* COMPACT_LOSSY_ID = "compactlossy";
+    static constexpr const char* LOW_CUT_ID = "lowcut";
+    static constexpr const char* HIGH_CUT_ID = "highcut";
+    static constexpr const char* SATURATION_ID = "saturation";
+    static constexpr const char* SYNC_ID = "sync";
+    static constexpr const char* SLOT_ID = "slot";
+    static constexpr const char* SCENE_ID = "scene";
+    static constexpr const char* SLICE_MODE_ID = "slicemode";
+    static constexpr const char* SLICES_ID = "slices";
+    static constexpr const char* SLICE_ORDER_ID = "sliceorder";
+    static constexpr const char* RETRIGGER_ID = "retrigger";
+    static constexpr const char* STUTTER_ID = "stutter";
+    static constexpr const char* STUTTER_LENGTH_ID = "stutterlength";
+    static constexpr const char* ECHO_ID = "echo";
+    static constexpr const char* ECHO_TIME_ID = "echotime";
+    static constexpr const char* ECHO_TAPS_ID = "echotaps";
+    static constexpr const char* ECHO_FEEDBACK_ID = "echofeedback";
+    static constexpr const char* ECHO_MIX_ID = "echomix";
+    static constexpr const char* DRY_LEVEL_ID = "drylevel";
+    static constexpr const char* MONITORING_ID = "monitoring";
+    static constexpr const char* GRANULAR_ID = "granular";
+    static constexpr const char* GRAIN_POSITION_ID = "grainposition";
+    static constexpr const char* GRAIN_SPRAY_ID = "grainspray";
+    static constexpr const char* GRAIN_SIZE_ID = "grainsize";
+    static constexpr const char* GRAIN_DENSITY_ID = "graindensity";
+    static constexpr const char* GRAIN_PITCH_ID = "grainpitch";
+
+    // When the live input is heard, in the order of the monitoring parameter's choices
+    enum class Monitoring
+    {
+        Always,
+        WhileRecording,     // While recording or stopped, muted while the loop plays
+        Never               // Overdubs are still heard as they are written into the loop
+    };
+
+    static constexpr int numClipSlots = 8;
+    static constexpr int maxSlices = 64;
 
     ParameterManager();
-    ~ParameterManager();
+    ~ParameterManager() override;
 
     /**
      * Create and add parameters to the AudioProcessorValueTreeState.
@@ -36,6 +79,28 @@ public:
      */
     void updateFromParameters(const juce::AudioProcessorValueTreeState& apvts);
 
+    /**
+     * Listen to parameter changes instead of polling. Message thread only.
+     * detach() must be called before the AudioProcessorValueTreeState is destroyed.
+     * @param apvts The AudioProcessorValueTreeState to listen to
+     */
+    void attachTo(juce::AudioProcessorValueTreeState& apvts);
+
+    /**
+     * Stop listening to parameter changes. Message thread only.
+     */
+    void detach();
+
+    /**
+     * Check if parameter values are pushed by a listener, making polling unnecessary.
+     */
+    bool isAttached() const { return attachedState != nullptr; }
+
+    /**
+     * Receive a parameter change. May be called on any thread, including the audio thread.
+     */
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+
     /**
      * Check if a transport button was triggered and reset the trigger state.
      */
@@ -50,6 +115,97 @@ public:
     float getFeedbackLevel() const { return feedbackLevel.load(std::memory_order_acquire); }
     float getVolumeLevel() const { return volumeLevel.load(std::memory_order_acquire); }
 
+    /**
+     * Get the varispeed rate of loop playback, in loop samples per output sample.
+     */
+    float getPlaybackRate() const { return playbackRate.load(std::memory_order_acquire); }
+
+    /**
+     * Get the level of the live input in the output, and when it is heard at all.
+     */
+    float getDryLevel() const { return dryLevel.load(std::memory_order_acquire); }
+    Monitoring getMonitoring() const { return static_cast<Monitoring>(monitoring.load(std::memory_order_acquire)); }
+
+    /**
+     * Get the feedback path tone shaping settings.
+     */
+    float getLowCutFrequency() const { return lowCutFrequency.load(std::memory_order_acquire); }
+    float getHighCutFrequency() const { return highCutFrequency.load(std::memory_order_acquire); }
+    float getSaturationAmount() const { return saturationAmount.load(std::memory_order_acquire); }
+
+    /**
+     * Whether recorded loop boundaries should be refined in the background.
+     */
+    bool isBoundaryRefinementEnabled() const { return refineBoundaries.load(std::memory_order_acquire); }
+
+    /**
+     * Whether loops that are not being written should be kept in compact storage.
+     */
+    bool isIdleCompactionEnabled() const { return compactIdleLoops.load(std::memory_order_acquire); }
+
+    /**
+     * Whether compact storage may round float material to 24 bits instead of keeping it exact.
+     */
+    bool isLossyCompactionEnabled() const { return compactLossy.load(std::memory_order_acquire); }
+
+    /**
+     * Whether this instance takes part in the process-wide shared loop clock.
+     */
+    bool isClockSyncEnabled() const { return clockSync.load(std::memory_order_acquire); }
+
+    /**
+     * Get the clip slot newly selected through the parameter and reset the request.
+     * @return The zero-based slot index, or -1 if the selection has not changed
+     */
+    int takeSlotRequest() { return slotRequest.exchange(-1, std::memory_order_acq_rel); }
+
+    /**
+     * Get the scene newly launched through the parameter and reset the request.
+     * @return The zero-based scene index, or -1 if no scene was launched
+     */
+    int takeSceneRequest() { return sceneRequest.exchange(-1, std::memory_order_acq_rel); }
+
+    /**
+     * Get the loop slicing settings. One slice plays the loop as recorded.
+     * @return Mode and order as indices into the choices of their parameters
+     */
+    int getSliceMode() const { return sliceMode.load(std::memory_order_acquire); }
+    int getNumSlices() const { return numSlices.load(std::memory_order_acquire); }
+    int getSliceOrder() const { return sliceOrder.load(std::memory_order_acquire); }
+
+    /**
+     * Get the slice newly retriggered through the parameter and reset the request.
+     * @return The zero-based slice index, or -1 if no slice was retriggered
+     */
+    int takeRetriggerRequest() { return retriggerRequest.exchange(-1, std::memory_order_acq_rel); }
+    bool hasRetriggerRequest() const { return retriggerRequest.load(std::memory_order_acquire) >= 0; }
+
+    /**
+     * Whether the stutter button is held, and the fraction of a slice it repeats.
+     * @return The divisor of the slice length, a power of two from 1 to 16
+     */
+    bool isStutterHeld() const { return stutterHeld.load(std::memory_order_acquire); }
+    int getStutterDivision() const { return 1 << stutterLength.load(std::memory_order_acquire); }
+
+    /**
+     * Get the echo settings.
+     */
+    bool isEchoEnabled() const { return echoEnabled.load(std::memory_order_acquire); }
+    float getEchoTime() const { return echoTime.load(std::memory_order_acquire); }
+    int getEchoTaps() const { return echoTaps.load(std::memory_order_acquire); }
+    float getEchoFeedback() const { return echoFeedback.load(std::memory_order_acquire); }
+    float getEchoMix() const { return echoMix.load(std::memory_order_acquire); }
+
+    /**
+     * Get the granular playback settings.
+     */
+    bool isGranularEnabled() const { return granularEnabled.load(std::memory_order_acquire); }
+    float getGrainPosition() const { return grainPosition.load(std::memory_order_acquire); }
+    float getGrainSpray() const { return grainSpray.load(std::memory_order_acquire); }
+    float getGrainSize() const { return grainSize.load(std::memory_order_acquire); }
+    float getGrainDensity() const { return grainDensity.load(std::memory_order_acquire); }
+    float getGrainPitch() const { return grainPitch.load(std::memory_order_acquire); }
+
     /**
      * Set parameter values programmatically.
      */
@@ -62,6 +218,17 @@ public:
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
 private:
+    static constexpr std::array<const char*, 35> parameterIDs{
+        RECORD_ID, PLAY_ID, STOP_ID, OVERDUB_ID, FEEDBACK_ID, VOLUME_ID, PLAYBACK_RATE_ID, DRY_LEVEL_ID, MONITORING_ID, REFINE_ID, COMPACT_ID,
+        COMPACT_LOSSY_ID,
+        LOW_CUT_ID, HIGH_CUT_ID, SATURATION_ID, SYNC_ID, SLOT_ID, SCENE_ID,
+        SLICE_MODE_ID, SLICES_ID, SLICE_ORDER_ID, RETRIGGER_ID, STUTTER_ID, STUTTER_LENGTH_ID,
+        ECHO_ID, ECHO_TIME_ID, ECHO_TAPS_ID, ECHO_FEEDBACK_ID, ECHO_MIX_ID,
+        GRANULAR_ID, GRAIN_POSITION_ID, GRAIN_SPRAY_ID, GRAIN_SIZE_ID, GRAIN_DENSITY_ID, GRAIN_PITCH_ID
+    };
+    
+    juce::AudioProcessorValueTreeState* attachedState{nullptr};
+    
     // Trigger states for transport buttons
     std::atomic<bool> recordTriggered{false};
     std::atomic<bool> playTriggered{false};
@@ -71,12 +238,62 @@ private:
     // Continuous parameter values
     std::atomic<float> feedbackLevel{0.8f};
     std::atomic<float> volumeLevel{1.0f};
+    std::atomic<float> playbackRate{1.0f};
+    std::atomic<float> dryLevel{1.0f};
+    std::atomic<int> monitoring{static_cast<int>(Monitoring::WhileRecording)};
+    std::atomic<bool> refineBoundaries{false};
+    std::atomic<bool> compactIdleLoops{false};
+    std::atomic<bool> compactLossy{false};
+    std::atomic<bool> clockSync{false};
+    std::atomic<float> lowCutFrequency{20.0f};
+    std::atomic<float> highCutFrequency{20000.0f};
+    std::atomic<float> saturationAmount{0.0f};
     
     // Previous button states for edge detection
     std::atomic<bool> prevRecordState{false};
     std::atomic<bool> prevPlayState{false};
     std::atomic<bool> prevStopState{false};
     std::atomic<bool> prevOverdubState{false};
+    
+    // Slot and scene selections, raised as requests when the parameter value changes
+    std::atomic<int> slotValue{1};
+    std::atomic<int> sceneValue{0};
+    std::atomic<int> slotRequest{-1};
+    std::atomic<int> sceneRequest{-1};
+    
+    // Slice playback settings
+    std::atomic<int> sliceMode{0};
+    std::atomic<int> numSlices{1};
+    std::atomic<int> sliceOrder{0};
+    std::atomic<int> retriggerValue{0};
+    std::atomic<int> retriggerRequest{-1};
+    std::atomic<bool> stutterHeld{false};
+    std::atomic<int> stutterLength{2};
+    
+    // Echo settings
+    std::atomic<bool> echoEnabled{false};
+    std::atomic<float> echoTime{375.0f};
+    std::atomic<int> echoTaps{1};
+    std::atomic<float> echoFeedback{0.4f};
+    std::atomic<float> echoMix{0.35f};
+    
+    // Granular playback settings
+    std::atomic<bool> granularEnabled{false};
+    std::atomic<float> grainPosition{0.0f};
+    std::atomic<float> grainSpray{0.1f};
+    std::atomic<float> grainSize{80.0f};
+    std::atomic<float> grainDensity{20.0f};
+    std::atomic<float> grainPitch{0.0f};
+
+    /**
+     * Raise a trigger on the rising edge of a button parameter.
+     */
+    static void detectPress(std::atomic<bool>& previousState, std::atomic<bool>& trigger, bool pressed);
+
+    /**
+     * Raise a request when a selection parameter moves to a new value above zero.
+     */
+    static void detectSelection(std::atomic<int>& previousValue, std::atomic<int>& request, float newValue);
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ParameterManager)
 };
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "PluginProcessor.h"
+#include "WaveformView.h"
 #include <juce_audio_utils/juce_audio_utils.h>
 
 
 //==============================================================================
-class AudioPluginAudioProcessorEditor  : public juce::AudioProcessorEditor
+class AudioPluginAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                         private juce::Timer
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&);
@@ -19,5 +21,30 @@ private:
     // access the processor object that created it.
     AudioPluginAudioProcessor& processorRef;
 
+    OpenLooper2::WaveformView waveformView;
+    juce::TextButton multiplyButton { "Multiply x2" };
+    juce::TextButton divideButton { "Divide /2" };
+    juce::TextButton undoButton { "Undo" };
+    juce::Slider layerSelector;
+    juce::Slider layerGainSlider;
+    juce::TextButton importButton { "Import Loop" };
+    juce::TextButton exportButton { "Export Loop" };
+    juce::Label fileStatusLabel;
+    std::unique_ptr<juce::FileChooser> fileChooser;
+
+    // The status label follows whichever file operation was started last
+    enum class FileAction { None, Import, Export };
+    FileAction lastFileAction = FileAction::None;
+
+    // A failure to lock loop memory is shown once, for a few seconds, rather than for good
+    static constexpr juce::uint32 lockWarningMilliseconds = 5000;
+    bool lockFailureReported = false;
+    juce::uint32 lockWarningEndTime = 0;
+
+    void updateLayerControls();
+    void chooseImportFile();
+    void chooseExportFile();
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
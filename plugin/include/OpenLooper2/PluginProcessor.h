@@ -1,6 +1,8 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include "BackgroundJobQueue.h"
+#include <atomic>
 #include <memory>
 
 namespace OpenLooper2 {
@@ -22,6 +24,7 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -49,12 +52,19 @@ public:
     //==============================================================================
     // Looper access for UI
     const OpenLooper2::Looper& getLooper() const { return *looper; }
+    OpenLooper2::Looper& getLooper() { return *looper; }
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
 
 private:
     //==============================================================================
+    // Declared before the looper so its jobs are retracted while the queue still exists
+    OpenLooper2::BackgroundJobQueue jobQueue;
     std::unique_ptr<OpenLooper2::Looper> looper;
     juce::AudioProcessorValueTreeState apvts;
 
+    // Set by prepareToPlay in the Standalone build, so the first callback raises its thread's priority;
+    // the two run on different threads
+    std::atomic<bool> promoteAudioThread { false };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
 };
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <vector>
+
+namespace OpenLooper2 {
+
+/**
+ * Offline windowed-sinc polyphase resampler for converting loop content between sample rates.
+ * Uses a Kaiser-windowed sinc filter bank with linear interpolation between phases, so any
+ * rate ratio is supported. The input is treated as periodic, which keeps loop seams seamless.
+ */
+class PolyphaseResampler
+{
+public:
+    PolyphaseResampler();
+    ~PolyphaseResampler();
+
+    /**
+     * Build the filter bank for a conversion. Allocates, so never call it on the audio thread.
+     * @param sourceRate The sample rate of the input material
+     * @param targetRate The desired output sample rate
+     */
+    void prepare(double sourceRate, double targetRate);
+
+    /**
+     * Get the number of output samples produced for a given input length.
+     */
+    int getOutputLength(int numInputSamples) const;
+
+    /**
+     * Resample one channel of a loop.
+     * @param input The input samples, treated as one period of a loop
+     * @param numInputSamples Number of input samples
+     * @param output Destination for the resampled samples
+     * @param numOutputSamples Number of output samples to produce
+     */
+    void process(const float* input, int numInputSamples, float* output, int numOutputSamples) const;
+
+    /**
+     * Resample a section of one channel of a loop, e.g. while the input is still being decoded.
+     * Output sample n reads the input up to getInputLookahead() samples past n / ratio, and
+     * the first few output samples read up to getInputLookahead() samples from the input end.
+     * @param input The input samples, treated as one period of a loop
+     * @param numInputSamples Number of input samples
+     * @param totalOutputSamples Number of output samples in the whole period
+     * @param output Destination for the first resampled sample of the section
+     * @param firstOutputSample Index of the first output sample to produce
+     * @param numOutputSamples Number of output samples to produce
+     */
+    void process(const float* input, int numInputSamples, int totalOutputSamples,
+                 float* output, int firstOutputSample, int numOutputSamples) const;
+
+    /**
+     * Get how many input samples past an output instant (and before the input end) are read.
+     */
+    int getInputLookahead() const { return halfLength; }
+
+private:
+    static constexpr int numPhases = 256;
+    static constexpr int zeroCrossings = 16;      // per side, at full bandwidth
+    static constexpr double kaiserBeta = 8.0;
+    static constexpr double passband = 0.95;
+    static constexpr int dotLanes = 8;            // partial sums kept apart in the filter dot product
+
+    std::vector<float> filterBank;  // numPhases rows of tapsPerPhase coefficients
+    std::vector<float> filterSlopes;    // per row, the step to the next phase's coefficients
+    int tapsPerPhase{0};
+    int halfLength{0};
+    double ratio{1.0};              // output rate / input rate
+
+    static double besselI0(double x);
+
+    /**
+     * Dot product of the input with a filter row interpolated towards the next phase.
+     */
+    static float interpolatedDot(const float* input, const float* row, const float* slope,
+                                 float fraction, int numTaps);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PolyphaseResampler)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+
+#ifndef OPENLOOPER2_REALTIME_CHECKS
+ #define OPENLOOPER2_REALTIME_CHECKS 0
+#endif
+
+namespace OpenLooper2 {
+
+/**
+ * Debug-only detector for work the audio thread must never do.
+ * Built with OPENLOOPER2_REALTIME_CHECKS, the plugin intercepts heap allocation (operator new/delete
+ * and, on Linux and macOS, malloc/calloc/realloc/free), mutex, rwlock and condition-variable waits,
+ * and sleeping or file I/O calls made from its own code and the JUCE code linked into it. Any such
+ * call on a thread inside a ScopedRealtimeSection is reported with a stack trace and counted.
+ * The interposers only count and forward, so threads outside a section, including the host's,
+ * behave as before.
+ * In normal builds every member compiles to nothing.
+ */
+class RealtimeSafetyChecker
+{
+public:
+    enum class Violation
+    {
+        Allocation,
+        Deallocation,
+        Lock,
+        BlockingCall
+    };
+
+    static constexpr int numViolationKinds = 4;
+
+    /**
+     * Marks the current thread as real-time for the lifetime of the object.
+     * Put one at the top of every audio callback. Sections may nest.
+     */
+    class ScopedRealtimeSection
+    {
+    public:
+       #if OPENLOOPER2_REALTIME_CHECKS
+        ScopedRealtimeSection() { enterRealtimeSection(); }
+        ~ScopedRealtimeSection() { exitRealtimeSection(); }
+       #else
+        ScopedRealtimeSection() {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+    };
+
+    /**
+     * Lets the current thread do non-real-time work inside a real-time section, e.g. a test
+     * harness preparing its next step. Sections may nest.
+     */
+    class ScopedNonRealtimeSection
+    {
+    public:
+       #if OPENLOOPER2_REALTIME_CHECKS
+        ScopedNonRealtimeSection() { enterNonRealtimeSection(); }
+        ~ScopedNonRealtimeSection() { exitNonRealtimeSection(); }
+       #else
+        ScopedNonRealtimeSection() {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedNonRealtimeSection)
+    };
+
+    /**
+     * Check if violations are detected in this build.
+     */
+    static constexpr bool isEnabled() { return OPENLOOPER2_REALTIME_CHECKS != 0; }
+
+    /**
+     * Check if the current thread is inside a real-time section.
+     */
+    static bool isRealtimeThread();
+
+    /**
+     * Record a violation if the current thread is inside a real-time section.
+     * Called by the interceptors; may also be called by code that knows it is about to block.
+     * The first reports print a stack trace through juce::Logger, later ones are only counted.
+     * @param violation What kind of call was made
+     * @param function Name of the intercepted function
+     */
+    static void check(Violation violation, const char* function);
+
+    /**
+     * Get the number of violations of one kind since the last reset.
+     */
+    static int getViolationCount(Violation violation);
+
+    /**
+     * Get the number of violations of every kind since the last reset.
+     */
+    static int getTotalViolationCount();
+
+    /**
+     * Forget all counted violations, and print stack traces for the next reports again.
+     */
+    static void resetViolationCounts();
+
+    /**
+     * Get a readable name for a kind of violation.
+     */
+    static const char* getViolationName(Violation violation);
+
+    /**
+     * Stack traces are printed for this many violations after each reset.
+     */
+    static constexpr int maxReportedViolations = 16;
+
+private:
+    static std::array<std::atomic<int>, numViolationKinds> violationCounts;
+    static std::atomic<int> reportedViolations;
+
+    static void enterRealtimeSection();
+    static void exitRealtimeSection();
+    static void enterNonRealtimeSection();
+    static void exitNonRealtimeSection();
+
+    RealtimeSafetyChecker() = delete;
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
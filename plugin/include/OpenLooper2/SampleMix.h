@@ -0,0 +1,53 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace OpenLooper2 {
+
+/**
+ * Inner loops for reads that mix loop audio into what an output already holds instead of
+ * replacing it, so playback, loop level and dry level take one pass over the output.
+ */
+struct SampleMix
+{
+    /**
+     * output = output * outputGain + source * sourceGain, in a single pass the compiler vectorizes.
+     * An output gain of zero replaces the output, which is then never read.
+     */
+    static void scaleAndAdd(float* output, const float* source, float outputGain, float sourceGain, int numSamples)
+    {
+        if (outputGain == 0.0f)
+        {
+            if (sourceGain == 1.0f)
+                juce::FloatVectorOperations::copy(output, source, numSamples);
+            else
+                juce::FloatVectorOperations::copyWithMultiply(output, source, sourceGain, numSamples);
+            return;
+        }
+
+        if (outputGain == 1.0f)
+        {
+            juce::FloatVectorOperations::addWithMultiply(output, source, sourceGain, numSamples);
+            return;
+        }
+
+        float* __restrict out = output;
+        const float* __restrict in = source;
+
+        for (int i = 0; i < numSamples; ++i)
+            out[i] = out[i] * outputGain + in[i] * sourceGain;
+    }
+
+    /**
+     * output = output * outputGain, for the stretches where the source is silent.
+     */
+    static void scale(float* output, float outputGain, int numSamples)
+    {
+        if (outputGain == 0.0f)
+            juce::FloatVectorOperations::clear(output, numSamples);
+        else if (outputGain != 1.0f)
+            juce::FloatVectorOperations::multiply(output, outputGain, numSamples);
+    }
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Process-wide scene launch broadcast shared by every plugin instance via juce::SharedResourcePointer.
+ * Each instance acts as one track; launching scene n makes every synced instance switch to its
+ * clip slot n at its next quantization boundary.
+ *
+ * A launch is a single 64-bit word holding a sequence number and the scene index, so a launch is
+ * never seen half-written. Polling is a single load and wait-free; launching is lock-free.
+ */
+class SceneLauncher
+{
+public:
+    SceneLauncher();
+    ~SceneLauncher();
+
+    /**
+     * Launch a scene. Lock-free, safe to call from any thread: the sequence number is bumped with a
+     * compare-and-swap that is retried only when another launch lands at the same moment.
+     * @param sceneIndex Index of the scene, which is the clip slot every track switches to
+     */
+    void launch(int sceneIndex);
+
+    /**
+     * Check for a launch that the caller has not seen yet. Wait-free.
+     * @param lastSequence The sequence number of the last launch seen, updated on success
+     * @param sceneIndex Receives the launched scene
+     * @return true if a new launch happened since lastSequence
+     */
+    bool getNewLaunch(juce::uint32& lastSequence, int& sceneIndex) const;
+
+    /**
+     * Get the sequence number of the latest launch, used to ignore launches from before joining.
+     */
+    juce::uint32 getSequence() const;
+
+private:
+    std::atomic<juce::uint64> launchWord{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SceneLauncher)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace OpenLooper2 {
+
+/**
+ * Process-wide master loop clock shared by every plugin instance via juce::SharedResourcePointer.
+ * The first instance that finishes a synced recording becomes the master and publishes its loop
+ * origin and length on a common sample timeline; other instances quantize to that grid.
+ *
+ * Only the master writes, through a sequence counter. Reads are wait-free: a read that overlaps
+ * a publish fails instead of retrying, and the caller keeps the grid it read last.
+ */
+class SharedLoopClock
+{
+public:
+    /**
+     * The master loop grid on the shared timeline.
+     */
+    struct Grid
+    {
+        juce::int64 originSample{0};
+        int loopLength{0};
+
+        bool isValid() const { return loopLength > 0; }
+
+        /**
+         * Get the position within the master loop at a timeline sample.
+         */
+        int getPhase(juce::int64 timelineSample) const;
+
+        /**
+         * Get the number of samples from a timeline sample to the next master loop start.
+         */
+        int getSamplesToNextBoundary(juce::int64 timelineSample) const;
+    };
+
+    SharedLoopClock();
+    ~SharedLoopClock();
+
+    /**
+     * Publish the master loop grid, claiming the master role if nobody holds it.
+     * Wait-free, safe to call from the audio thread.
+     * @param owner Identity of the publishing instance
+     * @param originSample Timeline sample at which the master loop starts
+     * @param loopLength Master loop length in samples
+     * @return false if another instance is the master
+     */
+    bool publish(const void* owner, juce::int64 originSample, int loopLength);
+
+    /**
+     * Give up the master role if held by owner; followers lose the grid until someone publishes again.
+     */
+    void release(const void* owner);
+
+    /**
+     * Check if an instance is the current master.
+     */
+    bool isMaster(const void* owner) const { return master.load(std::memory_order_acquire) == owner; }
+
+    /**
+     * Read the current grid. Wait-free.
+     * @param grid Receives the grid when the read succeeds
+     * @return false if a publish was in progress and grid was left untouched
+     */
+    bool read(Grid& grid) const;
+
+    /**
+     * Get a timeline sample derived from the wall clock, used to anchor instances
+     * that have no host timeline yet.
+     */
+    static juce::int64 getWallClockSample(double sampleRate);
+
+private:
+    std::atomic<const void*> master{nullptr};
+    std::atomic<juce::uint32> sequence{0};
+    std::atomic<juce::int64> originSample{0};
+    std::atomic<int> loopLength{0};
+
+    void write(juce::int64 newOrigin, int newLength);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedLoopClock)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -8,6 +8,8 @@ namespace OpenLooper2 {
 /**
  * Manages playback state and timing for the audio looper.
  * Provides thread-safe state management using atomic operations.
+ * The position is kept as a 64-bit sample count from the loop origin plus a 32-bit fixed-point
+ * fraction for playback rates other than one, so it never loses precision on long loops.
  */
 class TransportController
 {
@@ -20,6 +22,8 @@ public:
         Overdubbing
     };
 
+    static constexpr double maxPlaybackRate = 8.0;
+
     TransportController();
     ~TransportController();
 
@@ -30,6 +34,13 @@ public:
      */
     void initialize(double sampleRate, int samplesPerBlock);
 
+    /**
+     * Update audio specifications without resetting state, position or loop length.
+     * @param sampleRate The audio sample rate
+     * @param samplesPerBlock Expected samples per audio block
+     */
+    void prepare(double sampleRate, int samplesPerBlock);
+
     /**
      * Process a block of audio samples, updating timing and position.
      * @param numSamples Number of samples in the current block
@@ -52,14 +63,39 @@ public:
     State getCurrentState() const { return currentState.load(std::memory_order_acquire); }
 
     /**
-     * Get the current playback position as a normalized value (0.0 to 1.0).
+     * Get the current playback position in samples from the loop origin.
+     * While recording this is the length of the take so far.
      */
-    float getPlaybackPosition() const { return playbackPosition.load(std::memory_order_acquire); }
+    juce::int64 getPlaybackPositionSamples() const { return playbackPositionSamples.load(std::memory_order_acquire); }
 
     /**
-     * Get the current playback position in samples.
+     * Get the fraction of a sample the playback position lies past getPlaybackPositionSamples().
+     * @return The fraction in units of 2^-32 of a sample
      */
-    int getPlaybackPositionSamples() const { return playbackPositionSamples.load(std::memory_order_acquire); }
+    juce::uint32 getPlaybackPhase() const { return playbackPhase.load(std::memory_order_acquire); }
+
+    /**
+     * Set the speed at which playback advances through the loop.
+     * The rate is converted to fixed point once here, so advancing stays in integer arithmetic.
+     * Recording and overdubbing always advance at the input rate, an overdub writes one loop
+     * sample per input sample. Readers of a loop played at another rate interpolate at
+     * getPlaybackPhase().
+     * @param rate Loop samples per output sample, 0 to maxPlaybackRate
+     */
+    void setPlaybackRate(double rate);
+
+    /**
+     * Get the number of output samples playback takes to advance by a number of loop samples,
+     * from the current position and phase at the current rate.
+     * @param loopSamples Distance in loop samples, at least 0
+     * @return The distance in output samples, rounded up
+     */
+    juce::int64 getSamplesToAdvance(juce::int64 loopSamples) const;
+
+    /**
+     * Get the playback speed in loop samples per output sample.
+     */
+    double getPlaybackRate() const;
 
     /**
      * Set the loop length for position calculations.
@@ -77,15 +113,25 @@ public:
      */
     void resetPosition();
 
+    /**
+     * Move the playback position to a specific sample within the loop.
+     * @param positionSamples The new position in samples
+     */
+    void setPositionSamples(juce::int64 positionSamples);
+
     /**
      * Check if the transport is initialized.
      */
     bool isInitialized() const { return initialized.load(std::memory_order_acquire); }
 
 private:
+    static constexpr int phaseBits = 32;
+    static constexpr juce::uint64 unityPhaseIncrement = juce::uint64{1} << phaseBits;
+
     std::atomic<State> currentState{State::Stopped};
-    std::atomic<float> playbackPosition{0.0f};
-    std::atomic<int> playbackPositionSamples{0};
+    std::atomic<juce::int64> playbackPositionSamples{0};
+    std::atomic<juce::uint32> playbackPhase{0};
+    std::atomic<juce::uint64> phaseIncrement{unityPhaseIncrement};
     std::atomic<int> loopLengthSamples{0};
     std::atomic<bool> initialized{false};
     
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Looper.h"
+#include <juce_gui_basics/juce_gui_basics.h>
+#include <vector>
+
+namespace OpenLooper2 {
+
+/**
+ * Draws the loop waveform and a moving playhead.
+ * The waveform is rendered from the buffer's peak maps into fixed-width image tiles that are kept
+ * between frames. Only tiles covering loop regions the audio thread has written since the last
+ * frame are re-rendered, and the playhead is moved by repainting just the strips it leaves and
+ * enters, so a playing loop costs two narrow repaints per display refresh.
+ * Message thread only.
+ */
+class WaveformView : public juce::Component
+{
+public:
+    static constexpr int tileWidth = 64;
+    static constexpr int playheadWidth = 2;
+
+    explicit WaveformView(Looper& looper);
+    ~WaveformView() override;
+
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+
+private:
+    struct Tile
+    {
+        juce::Image image;
+        bool valid{false};
+    };
+
+    Looper& looper;
+    std::vector<Tile> tiles;
+
+    // What the cached tiles show, so a new loop or slot redraws everything
+    int shownLength{0};
+    int shownSlot{-1};
+
+    // Left edge of the drawn playhead, or -1 if none is drawn
+    int playheadX{-1};
+
+    juce::VBlankAttachment vBlankAttachment;
+
+    /**
+     * Pick up loop changes and move the playhead, once per display refresh.
+     */
+    void onVBlank();
+
+    /**
+     * Mark the tiles covering the given loop regions for re-rendering and repaint them.
+     * @param regions One bit per LoopBufferManager::numDirtyRegions of the loop
+     */
+    void invalidateRegions(juce::uint64 regions);
+
+    /**
+     * Mark every tile for re-rendering.
+     */
+    void invalidateAll();
+
+    /**
+     * Move the playhead to the transport position, repainting only the strips that change.
+     */
+    void updatePlayhead();
+
+    /**
+     * Render one tile, one vertical peak line per pixel column.
+     */
+    void renderTile(int tileIndex);
+
+    /**
+     * Get the first loop sample drawn in a pixel column.
+     */
+    int columnToLoopOffset(int x) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformView)
+};
+
+} // namespace OpenLooper2
\ No newline at end of file
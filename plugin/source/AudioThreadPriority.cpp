@@ -0,0 +1,25 @@
+#include "OpenLooper2/AudioThreadPriority.h"
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+namespace OpenLooper2 {
+
+bool AudioThreadPriority::promoteCurrentThread()
+{
+   #if JUCE_LINUX
+    int policy = 0;
+    sched_param parameters{};
+    if (pthread_getschedparam(pthread_self(), &policy, &parameters) == 0 && policy == SCHED_FIFO)
+        return true;
+
+    parameters.sched_priority = juce::jmin(realtimePriority, sched_get_priority_max(SCHED_FIFO));
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;
+   #else
+    return false;
+   #endif
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
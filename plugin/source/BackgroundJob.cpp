@@ -0,0 +1,96 @@
+#include "OpenLooper2/BackgroundJob.h"
+
+namespace OpenLooper2 {
+
+BackgroundJob::BackgroundJob(Priority priority)
+    : priority(priority)
+{
+}
+
+BackgroundJob::~BackgroundJob()
+{
+    // Owners must retract their jobs from the queue before destroying them
+    jassert(!isBusy());
+}
+
+bool BackgroundJob::isBusy() const
+{
+    const Status current = status.load(std::memory_order_acquire);
+    return current == Status::Queued || current == Status::Running || current == Status::Resubmitted;
+}
+
+void BackgroundJob::cancel()
+{
+    // A running job sees the request when it finishes and skips its next run
+    cancelRequested.store(true, std::memory_order_release);
+
+    Status expected = Status::Queued;
+    status.compare_exchange_strong(expected, Status::Cancelled, std::memory_order_acq_rel);
+}
+
+bool BackgroundJob::waitUntilIdle(int timeoutMs) const
+{
+    const auto startTime = juce::Time::getMillisecondCounter();
+
+    while (isBusy())
+    {
+        if (juce::Time::getMillisecondCounter() - startTime > static_cast<juce::uint32>(timeoutMs))
+            return false;
+
+        juce::Thread::sleep(1);
+    }
+
+    return true;
+}
+
+void BackgroundJob::waitUntilIdle() const
+{
+    while (isBusy())
+        juce::Thread::sleep(1);
+}
+
+bool BackgroundJob::markQueued()
+{
+    cancelRequested.store(false, std::memory_order_release);
+    Status current = status.load(std::memory_order_acquire);
+
+    // The worker queues a resubmitted job again itself once the current run ends. If the run ends
+    // first, current holds the state it ended in and the job is queued below
+    if (current == Status::Running
+        && status.compare_exchange_strong(current, Status::Resubmitted, std::memory_order_acq_rel))
+        return false;
+
+    if (current == Status::Queued || current == Status::Running || current == Status::Resubmitted)
+        return false;
+
+    // Failing here means another submitter moved the job first, and its run covers this submission
+    return status.compare_exchange_strong(current, Status::Queued, std::memory_order_acq_rel);
+}
+
+bool BackgroundJob::execute()
+{
+    // Stale queue entries of cancelled or already executed jobs are skipped here
+    Status expected = Status::Queued;
+    if (!status.compare_exchange_strong(expected, Status::Running, std::memory_order_acq_rel))
+        return false;
+
+    run();
+
+    expected = Status::Running;
+    const bool cancelled = cancelRequested.load(std::memory_order_acquire);
+    if (status.compare_exchange_strong(expected, cancelled ? Status::Cancelled : Status::Finished,
+                                       std::memory_order_acq_rel))
+        return false;
+
+    // Submitted again while running: the caller queues it once more, unless it was cancelled since
+    if (cancelRequested.load(std::memory_order_acquire))
+    {
+        status.store(Status::Cancelled, std::memory_order_release);
+        return false;
+    }
+
+    status.store(Status::Queued, std::memory_order_release);
+    return true;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "OpenLooper2/BackgroundJobQueue.h"
+
+namespace OpenLooper2 {
+
+BackgroundJobQueue::BackgroundJobQueue()
+{
+    pool->registerQueue(*this);
+}
+
+BackgroundJobQueue::~BackgroundJobQueue()
+{
+    pool->unregisterQueue(*this);
+}
+
+bool BackgroundJobQueue::submitFromAudioThread(BackgroundJob& job)
+{
+    job.owner.store(this, std::memory_order_release);
+
+    // Already queued, or running and now flagged to run once more
+    if (!job.markQueued())
+        return true;
+
+    auto& intake = intakes[static_cast<size_t>(job.getPriority())];
+
+    int start1, size1, start2, size2;
+    intake.fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+    {
+        job.status.store(BackgroundJob::Status::Idle, std::memory_order_release);
+        droppedSubmissions.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    intake.jobs[static_cast<size_t>(size1 > 0 ? start1 : start2)] = &job;
+    intake.fifo.finishedWrite(1);
+    return true;
+}
+
+bool BackgroundJobQueue::submit(BackgroundJob& job)
+{
+    job.owner.store(this, std::memory_order_release);
+
+    if (!job.markQueued())
+        return true;
+
+    if (!pool->enqueue(job))
+    {
+        job.status.store(BackgroundJob::Status::Idle, std::memory_order_release);
+        return false;
+    }
+
+    return true;
+}
+
+void BackgroundJobQueue::retractJob(BackgroundJob& job)
+{
+    job.cancel();
+    pool->purgeJob(job);
+}
+
+BackgroundJob* BackgroundJobQueue::popRealtimeJob(int priorityIndex)
+{
+    auto& intake = intakes[static_cast<size_t>(priorityIndex)];
+
+    // Several workers may consume; the audio thread never takes this lock
+    const juce::SpinLock::ScopedTryLockType lock(intake.consumerLock);
+    if (!lock.isLocked())
+        return nullptr;
+
+    while (intake.fifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        intake.fifo.prepareToRead(1, start1, size1, start2, size2);
+
+        auto& entry = intake.jobs[static_cast<size_t>(size1 > 0 ? start1 : start2)];
+        BackgroundJob* job = entry;
+        entry = nullptr;
+        intake.fifo.finishedRead(1);
+
+        if (job != nullptr)
+        {
+            // Under the lock the purge takes, so it cannot miss the claim
+            job->claims.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void BackgroundJobQueue::purgeRealtimeJob(const BackgroundJob& job)
+{
+    for (auto& intake : intakes)
+    {
+        const juce::SpinLock::ScopedLockType lock(intake.consumerLock);
+
+        int start1, size1, start2, size2;
+        intake.fifo.prepareToRead(intake.fifo.getNumReady(), start1, size1, start2, size2);
+
+        for (int i = 0; i < size1; ++i)
+            if (intake.jobs[static_cast<size_t>(start1 + i)] == &job)
+                intake.jobs[static_cast<size_t>(start1 + i)] = nullptr;
+
+        for (int i = 0; i < size2; ++i)
+            if (intake.jobs[static_cast<size_t>(start2 + i)] == &job)
+                intake.jobs[static_cast<size_t>(start2 + i)] = nullptr;
+    }
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "OpenLooper2/BackgroundWorkerPool.h"
+#include "OpenLooper2/BackgroundJobQueue.h"
+#include <array>
+
+namespace OpenLooper2 {
+
+//==============================================================================
+class BackgroundWorkerPool::Worker : public juce::Thread
+{
+public:
+    Worker(BackgroundWorkerPool& pool, int index)
+        : juce::Thread("OpenLooper2 Worker " + juce::String(index)),
+          pool(pool),
+          index(index)
+    {
+    }
+
+    ~Worker() override
+    {
+        stopThread(2000);
+    }
+
+    /**
+     * Push a job onto the back of this worker's deque.
+     */
+    bool pushBack(BackgroundJob& job)
+    {
+        const juce::SpinLock::ScopedLockType lock(dequeLock);
+        auto& deque = deques[static_cast<size_t>(job.getPriority())];
+
+        if (deque.count == BackgroundJobQueue::capacity)
+            return false;
+
+        deque.jobs[static_cast<size_t>((deque.head + deque.count) % BackgroundJobQueue::capacity)] = &job;
+        ++deque.count;
+        return true;
+    }
+
+    /**
+     * Take the most recently pushed job (owner side).
+     */
+    BackgroundJob* popBack(int priorityIndex)
+    {
+        const juce::SpinLock::ScopedLockType lock(dequeLock);
+        auto& deque = deques[static_cast<size_t>(priorityIndex)];
+
+        while (deque.count > 0)
+        {
+            --deque.count;
+            if (auto* job = deque.jobs[static_cast<size_t>((deque.head + deque.count) % BackgroundJobQueue::capacity)])
+            {
+                // Under the lock the purge takes, so it cannot miss the claim
+                job->claims.fetch_add(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Take the oldest job (thief side).
+     */
+    BackgroundJob* steal(int priorityIndex)
+    {
+        const juce::SpinLock::ScopedTryLockType lock(dequeLock);
+        if (!lock.isLocked())
+            return nullptr;
+
+        auto& deque = deques[static_cast<size_t>(priorityIndex)];
+
+        while (deque.count > 0)
+        {
+            BackgroundJob* job = deque.jobs[static_cast<size_t>(deque.head)];
+            deque.head = (deque.head + 1) % BackgroundJobQueue::capacity;
+            --deque.count;
+
+            if (job != nullptr)
+            {
+                job->claims.fetch_add(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * Null out every reference to a job. Nulled entries are skipped when popping.
+     */
+    void purge(const BackgroundJob& job)
+    {
+        const juce::SpinLock::ScopedLockType lock(dequeLock);
+
+        for (auto& deque : deques)
+            for (int i = 0; i < deque.count; ++i)
+            {
+                auto& entry = deque.jobs[static_cast<size_t>((deque.head + i) % BackgroundJobQueue::capacity)];
+                if (entry == &job)
+                    entry = nullptr;
+            }
+    }
+
+private:
+    struct Deque
+    {
+        std::array<BackgroundJob*, BackgroundJobQueue::capacity> jobs{};
+        int head{0};
+        int count{0};
+    };
+
+    BackgroundWorkerPool& pool;
+    const int index;
+    std::array<Deque, BackgroundJob::numPriorities> deques;
+    juce::SpinLock dequeLock;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            if (auto* job = pool.findJob(index))
+            {
+                // Resubmitted while running: keep it local so idle workers can steal it
+                if (job->execute())
+                {
+                    if (!pushBack(*job))
+                        pool.enqueue(*job);
+
+                    job->requeues.fetch_add(1, std::memory_order_release);
+                }
+
+                // The owner may destroy the job as soon as no worker holds it
+                job->claims.fetch_sub(1, std::memory_order_release);
+            }
+            else
+            {
+                wait(idleWaitMs);
+            }
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Worker)
+};
+
+//==============================================================================
+BackgroundWorkerPool::BackgroundWorkerPool()
+{
+    // Leave most cores to the host's realtime threads
+    const int numWorkers = juce::jlimit(1, maxWorkers, juce::SystemStats::getNumCpus() / 2);
+
+    for (int i = 0; i < numWorkers; ++i)
+        workers.add(new Worker(*this, i));
+
+    for (auto* worker : workers)
+        worker->startThread(juce::Thread::Priority::low);
+}
+
+BackgroundWorkerPool::~BackgroundWorkerPool()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    // Stop every worker before deleting any, since they steal from each other
+    for (auto* worker : workers)
+        worker->stopThread(2000);
+
+    workers.clear();
+}
+
+int BackgroundWorkerPool::getNumWorkers() const
+{
+    return workers.size();
+}
+
+void BackgroundWorkerPool::registerQueue(BackgroundJobQueue& queue)
+{
+    const juce::ScopedLock lock(queueListLock);
+    queues.add(&queue);
+}
+
+void BackgroundWorkerPool::unregisterQueue(BackgroundJobQueue& queue)
+{
+    const juce::ScopedLock lock(queueListLock);
+    queues.removeFirstMatchingValue(&queue);
+}
+
+bool BackgroundWorkerPool::enqueue(BackgroundJob& job)
+{
+    const int numWorkers = workers.size();
+
+    for (int attempt = 0; attempt < numWorkers; ++attempt)
+    {
+        auto* worker = workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % numWorkers];
+
+        if (worker->pushBack(job))
+        {
+            worker->notify();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void BackgroundWorkerPool::purgeJob(const BackgroundJob& job)
+{
+    // Workers claim the job under the locks the sweep takes and only requeue it while holding the
+    // claim, so once no claims are left the sweep is complete unless a requeue slipped in behind it
+    for (;;)
+    {
+        const auto requeuesBefore = job.requeues.load(std::memory_order_acquire);
+
+        for (auto* worker : workers)
+            worker->purge(job);
+
+        if (auto* queue = job.owner.load(std::memory_order_acquire))
+            queue->purgeRealtimeJob(job);
+
+        while (job.claims.load(std::memory_order_acquire) > 0)
+            juce::Thread::sleep(1);
+
+        if (job.requeues.load(std::memory_order_acquire) == requeuesBefore)
+            return;
+    }
+}
+
+BackgroundJob* BackgroundWorkerPool::findJob(int workerIndex)
+{
+    const int numWorkers = workers.size();
+
+    for (int priorityIndex = 0; priorityIndex < BackgroundJob::numPriorities; ++priorityIndex)
+    {
+        // 1. Our own deque, newest first for cache locality
+        if (auto* job = workers.getUnchecked(workerIndex)->popBack(priorityIndex))
+            return job;
+
+        // 2. Audio-thread submissions of every registered processor
+        {
+            const juce::ScopedLock lock(queueListLock);
+            const int numQueues = queues.size();
+
+            for (int i = 0; i < numQueues; ++i)
+                if (auto* job = queues.getUnchecked((workerIndex + i) % numQueues)->popRealtimeJob(priorityIndex))
+                    return job;
+        }
+
+        // 3. Steal the oldest work from the other workers
+        for (int i = 1; i < numWorkers; ++i)
+            if (auto* job = workers.getUnchecked((workerIndex + i) % numWorkers)->steal(priorityIndex))
+                return job;
+    }
+
+    return nullptr;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "OpenLooper2/CircularAudioBuffer.h"
+#include "OpenLooper2/SampleMix.h"
 
 namespace OpenLooper2 {
 
@@ -10,17 +11,57 @@ CircularAudioBuffer::~CircularAudioBuffer()
 {
 }
 
-void CircularAudioBuffer::initialize(int numChannels, int bufferSizeInSamples)
+void CircularAudioBuffer::initialize(int numChannels, int bufferSizeInSamples, bool allocateStorage)
 {
     this->numChannels = numChannels;
-    this->bufferSize = nextPowerOfTwo(bufferSizeInSamples);
+    this->bufferSize = nextPowerOfTwo(juce::jmax(bufferSizeInSamples, chunkSize));
     this->bufferMask = bufferSize - 1;
     
-    buffer.setSize(numChannels, bufferSize);
-    buffer.clear();
+    if (allocateStorage)
+        allocate();
+    else
+        release();
+}
+
+void CircularAudioBuffer::release()
+{
+    initialized.store(false, std::memory_order_release);
+    writeHead.store(0, std::memory_order_release);
+    
+    buffer = juce::AudioBuffer<float>();
+    memory.release();
+    chunkPeaks.reset();
+    numChunks = 0;
+}
+
+bool CircularAudioBuffer::allocate()
+{
+    initialized.store(false, std::memory_order_release);
+    buffer = juce::AudioBuffer<float>();
+    
+    // Fresh memory is already zeroed and every page faulted in, so there is nothing to clear
+    if (!memory.allocate(numChannels, bufferSize))
+    {
+        chunkPeaks.reset();
+        numChunks = 0;
+        return false;
+    }
+    
+    buffer.setDataToReferTo(memory.getChannelPointers(), numChannels, bufferSize);
+    
+    numChunks = bufferSize / chunkSize;
+    chunkPeaks.reset(new std::atomic<float>[static_cast<size_t>(numChunks)]);
+    for (int chunk = 0; chunk < numChunks; ++chunk)
+        chunkPeaks[chunk].store(0.0f, std::memory_order_relaxed);
     
     writeHead.store(0, std::memory_order_release);
     initialized.store(true, std::memory_order_release);
+    return true;
+}
+
+size_t CircularAudioBuffer::getStorageBytes() const
+{
+    return memory.getBytes() + static_cast<size_t>(numChunks) * sizeof(float);
 }
 
 void CircularAudioBuffer::write(const juce::AudioBuffer<float>& input, int startSample, int numSamples)
@@ -29,18 +70,7 @@ void CircularAudioBuffer::write(const juce::AudioBuffer<float>& input, int start
         return;
 
     const int currentWriteHead = writeHead.load(std::memory_order_acquire);
-    
-    for (int channel = 0; channel < juce::jmin(numChannels, input.getNumChannels()); ++channel)
-    {
-        const float* inputData = input.getReadPointer(channel, startSample);
-        float* bufferData = buffer.getWritePointer(channel);
-        
-        for (int i = 0; i < numSamples; ++i)
-        {
-            const int writeIndex = (currentWriteHead + i) & bufferMask;
-            bufferData[writeIndex] = inputData[i];
-        }
-    }
+    writeRange(input, startSample, numSamples, currentWriteHead);
     
     // Update write head atomically
     const int newWriteHead = (currentWriteHead + numSamples) & bufferMask;
@@ -49,26 +79,151 @@ void CircularAudioBuffer::write(const juce::AudioBuffer<float>& input, int start
 
 void CircularAudioBuffer::read(juce::AudioBuffer<float>& output, int startSample, int numSamples, int readOffset)
 {
-    if (!initialized.load(std::memory_order_acquire) || numSamples <= 0)
+    const int currentWriteHead = writeHead.load(std::memory_order_acquire);
+    readFrom(output, startSample, numSamples, currentWriteHead - readOffset);
+}
+
+void CircularAudioBuffer::copyWithin(int sourceIndex, int destinationIndex, int numSamples)
+{
+    if (!initialized.load(std::memory_order_acquire))
+        return;
+
+    while (numSamples > 0)
     {
-        output.clear(startSample, numSamples);
+        // A view of our own channels must end at the buffer end, so the source is taken in two parts when it wraps
+        const int source = sourceIndex & bufferMask;
+        const int length = juce::jmin(numSamples, bufferSize - source);
+        juce::AudioBuffer<float> sourceView(buffer.getArrayOfWritePointers(), numChannels, source, length);
+        writeRange(sourceView, 0, length, destinationIndex);
+
+        sourceIndex += length;
+        destinationIndex += length;
+        numSamples -= length;
+    }
+}
+
+void CircularAudioBuffer::writeAt(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex)
+{
+    if (!initialized.load(std::memory_order_acquire) || numSamples <= 0)
         return;
+
+    writeRange(input, startSample, numSamples, bufferIndex);
+}
+
+bool CircularAudioBuffer::readFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex) const
+{
+    return mixFrom(output, startSample, numSamples, bufferIndex, 0.0f, 1.0f);
+}
+
+bool CircularAudioBuffer::mixFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex,
+                                  float outputGain, float sourceGain) const
+{
+    if (!initialized.load(std::memory_order_acquire) || numSamples <= 0)
+    {
+        output.applyGain(startSample, numSamples, outputGain);
+        return false;
     }
 
-    const int currentWriteHead = writeHead.load(std::memory_order_acquire);
-    const int readHead = (currentWriteHead - readOffset) & bufferMask;
-    
-    for (int channel = 0; channel < juce::jmin(numChannels, output.getNumChannels()); ++channel)
+    const int channelsToRead = juce::jmin(numChannels, output.getNumChannels());
+    bool audible = false;
+    int index = bufferIndex & bufferMask;
+
+    // Chunks never straddle the buffer end, so mixing chunk segments also handles the wrap
+    while (numSamples > 0)
     {
-        const float* bufferData = buffer.getReadPointer(channel);
-        float* outputData = output.getWritePointer(channel, startSample);
-        
-        for (int i = 0; i < numSamples; ++i)
+        const int segmentLength = juce::jmin(numSamples, chunkSize - (index & (chunkSize - 1)));
+        const bool silent = chunkPeaks[index / chunkSize].load(std::memory_order_relaxed) < silenceThreshold;
+
+        for (int channel = 0; channel < channelsToRead; ++channel)
         {
-            const int readIndex = (readHead + i) & bufferMask;
-            outputData[i] = bufferData[readIndex];
+            float* outputData = output.getWritePointer(channel, startSample);
+
+            if (silent)
+                SampleMix::scale(outputData, outputGain, segmentLength);
+            else
+                SampleMix::scaleAndAdd(outputData, buffer.getReadPointer(channel, index), outputGain, sourceGain, segmentLength);
+        }
+
+        audible = audible || !silent;
+        startSample += segmentLength;
+        numSamples -= segmentLength;
+        index = (index + segmentLength) & bufferMask;
+    }
+
+    return audible;
+}
+
+bool CircularAudioBuffer::readTaps(juce::AudioBuffer<float>& output, juce::AudioBuffer<float>* feedbackOutput,
+                                   int startSample, int numSamples, const Tap* taps, int numTaps, int bufferIndex) const
+{
+    if (!initialized.load(std::memory_order_acquire) || numSamples <= 0)
+        return false;
+
+    const int channelsToRead = juce::jmin(numChannels, output.getNumChannels());
+    bool audible = false;
+
+    // Output tiles stay in cache while every tap is added to them
+    for (int tileStart = 0; tileStart < numSamples; tileStart += chunkSize)
+    {
+        const int tileLength = juce::jmin(chunkSize, numSamples - tileStart);
+
+        for (int tap = 0; tap < numTaps; ++tap)
+        {
+            const float gain = taps[tap].gain;
+            const float feedback = feedbackOutput != nullptr ? taps[tap].feedback : 0.0f;
+            if (gain == 0.0f && feedback == 0.0f)
+                continue;
+
+            int index = (bufferIndex - taps[tap].delay + tileStart) & bufferMask;
+            int outputSample = startSample + tileStart;
+            int remaining = tileLength;
+
+            // A tile spans at most two source chunks
+            while (remaining > 0)
+            {
+                const int segmentLength = juce::jmin(remaining, chunkSize - (index & (chunkSize - 1)));
+
+                if (chunkPeaks[index / chunkSize].load(std::memory_order_relaxed) >= silenceThreshold)
+                {
+                    for (int channel = 0; channel < channelsToRead; ++channel)
+                    {
+                        const float* source = buffer.getReadPointer(channel, index);
+
+                        if (gain != 0.0f)
+                            juce::FloatVectorOperations::addWithMultiply(output.getWritePointer(channel, outputSample),
+                                                                         source, gain, segmentLength);
+
+                        if (feedback != 0.0f)
+                            juce::FloatVectorOperations::addWithMultiply(feedbackOutput->getWritePointer(channel, outputSample),
+                                                                         source, feedback, segmentLength);
+                    }
+
+                    audible = true;
+                }
+
+                outputSample += segmentLength;
+                remaining -= segmentLength;
+                index = (index + segmentLength) & bufferMask;
+            }
         }
     }
+
+    return audible;
+}
+
+float CircularAudioBuffer::getPeak(int bufferIndex, int numSamples) const
+{
+    if (!initialized.load(std::memory_order_acquire) || numSamples <= 0)
+        return 0.0f;
+
+    const int firstChunk = (bufferIndex & bufferMask) / chunkSize;
+    const int chunkCount = juce::jmin(numChunks, ((bufferIndex & (chunkSize - 1)) + numSamples + chunkSize - 1) / chunkSize);
+    float peak = 0.0f;
+
+    for (int i = 0; i < chunkCount; ++i)
+        peak = juce::jmax(peak, chunkPeaks[(firstChunk + i) % numChunks].load(std::memory_order_relaxed));
+
+    return peak;
 }
 
 void CircularAudioBuffer::clear()
@@ -76,10 +231,57 @@ void CircularAudioBuffer::clear()
     if (initialized.load(std::memory_order_acquire))
     {
         buffer.clear();
+        for (int chunk = 0; chunk < numChunks; ++chunk)
+            chunkPeaks[chunk].store(0.0f, std::memory_order_relaxed);
+        
         writeHead.store(0, std::memory_order_release);
     }
 }
 
+void CircularAudioBuffer::writeRange(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex)
+{
+    int index = bufferIndex & bufferMask;
+
+    while (numSamples > 0)
+    {
+        const int segmentLength = juce::jmin(numSamples, chunkSize - (index & (chunkSize - 1)));
+        writeSegment(input, startSample, segmentLength, index);
+
+        startSample += segmentLength;
+        numSamples -= segmentLength;
+        index = (index + segmentLength) & bufferMask;
+    }
+}
+
+void CircularAudioBuffer::writeSegment(const juce::AudioBuffer<float>& input, int startSample, int numSamples, int bufferIndex)
+{
+    const int channelsToWrite = juce::jmin(numChannels, input.getNumChannels());
+    const int chunk = bufferIndex / chunkSize;
+
+    float segmentPeak = 0.0f;
+    for (int channel = 0; channel < channelsToWrite; ++channel)
+        segmentPeak = juce::jmax(segmentPeak, input.getMagnitude(channel, startSample, numSamples));
+
+    // Writing silence onto a silent chunk changes nothing a reader can observe
+    if (segmentPeak < silenceThreshold && chunkPeaks[chunk].load(std::memory_order_relaxed) < silenceThreshold)
+        return;
+
+    for (int channel = 0; channel < channelsToWrite; ++channel)
+        juce::FloatVectorOperations::copy(buffer.getWritePointer(channel, bufferIndex),
+                                          input.getReadPointer(channel, startSample), numSamples);
+
+    // A partial overwrite keeps part of the old content, so rescan the whole chunk
+    float chunkPeak = segmentPeak;
+    if (numSamples < chunkSize || channelsToWrite < numChannels)
+    {
+        chunkPeak = 0.0f;
+        for (int channel = 0; channel < numChannels; ++channel)
+            chunkPeak = juce::jmax(chunkPeak, buffer.getMagnitude(channel, chunk * chunkSize, chunkSize));
+    }
+
+    chunkPeaks[chunk].store(chunkPeak, std::memory_order_relaxed);
+}
+
 int CircularAudioBuffer::nextPowerOfTwo(int value)
 {
     if (value <= 0)
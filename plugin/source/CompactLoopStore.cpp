@@ -0,0 +1,1045 @@
+#include "OpenLooper2/CompactLoopStore.h"
+#include "OpenLooper2/SampleMix.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace OpenLooper2 {
+
+namespace {
+
+constexpr int coefficientBits = 14;
+constexpr int maxCoefficientShift = 15;
+constexpr int riceParameterBits = 5;
+constexpr int maxRiceParameter = 30;
+constexpr int32_t maxResidual = 1 << 30;
+
+inline uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1u)));
+}
+
+inline int bitLength(uint32_t value)
+{
+    return value == 0 ? 0 : juce::findHighestSetBit(value) + 1;
+}
+
+inline int signedBitLength(int32_t value)
+{
+    return bitLength(static_cast<uint32_t>(value >= 0 ? value : ~value)) + 1;
+}
+
+// MSB-first bit packer appending to a byte vector
+class BitWriter
+{
+public:
+    explicit BitWriter(std::vector<uint8_t>& target) : bytes(target) {}
+
+    void write(uint32_t value, int numBits)
+    {
+        accumulator = (accumulator << numBits) | (value & ((static_cast<uint64_t>(1) << numBits) - 1));
+        pendingBits += numBits;
+
+        while (pendingBits >= 8)
+        {
+            pendingBits -= 8;
+            bytes.push_back(static_cast<uint8_t>(accumulator >> pendingBits));
+        }
+    }
+
+    void writeSigned(int32_t value, int numBits) { write(static_cast<uint32_t>(value), numBits); }
+
+    void writeRice(uint32_t value, int parameter)
+    {
+        for (uint32_t zeros = value >> parameter; zeros > 0;)
+        {
+            const auto run = juce::jmin(zeros, 32u);
+            write(0, static_cast<int>(run));
+            zeros -= run;
+        }
+
+        write(1, 1);
+        write(value, parameter);
+    }
+
+    void flush()
+    {
+        if (pendingBits > 0)
+            bytes.push_back(static_cast<uint8_t>(accumulator << (8 - pendingBits)));
+
+        pendingBits = 0;
+    }
+
+private:
+    std::vector<uint8_t>& bytes;
+    uint64_t accumulator{0};
+    int pendingBits{0};
+};
+
+// Reads what BitWriter wrote, relying on the store padding its data so 8 bytes can always be loaded
+struct BitReader
+{
+    const uint8_t* bytes;
+    uint64_t position;
+
+    uint64_t peek() const
+    {
+        return juce::ByteOrder::bigEndianInt64(bytes + (position >> 3)) << (position & 7);
+    }
+
+    uint32_t read(int numBits)
+    {
+        if (numBits == 0)
+            return 0;
+
+        const auto value = static_cast<uint32_t>(peek() >> (64 - numBits));
+        position += static_cast<uint64_t>(numBits);
+        return value;
+    }
+
+    int32_t readSigned(int numBits)
+    {
+        if (numBits == 0)
+            return 0;
+
+        const auto value = static_cast<int32_t>(static_cast<int64_t>(peek()) >> (64 - numBits));
+        position += static_cast<uint64_t>(numBits);
+        return value;
+    }
+
+    int32_t readRice(int parameter)
+    {
+        uint32_t zeros = 0;
+
+        for (;;)
+        {
+            const uint64_t word = peek();
+
+            if (word != 0)
+            {
+                const auto high = static_cast<uint32_t>(word >> 32);
+                const int leadingZeros = high != 0 ? 31 - juce::findHighestSetBit(high)
+                                                   : 63 - juce::findHighestSetBit(static_cast<uint32_t>(word));
+                zeros += static_cast<uint32_t>(leadingZeros);
+                position += static_cast<uint64_t>(leadingZeros) + 1;
+                break;
+            }
+
+            const int available = 64 - static_cast<int>(position & 7);
+            zeros += static_cast<uint32_t>(available);
+            position += static_cast<uint64_t>(available);
+        }
+
+        return unzigzag((zeros << parameter) | read(parameter));
+    }
+};
+
+// Pick the Rice parameter for one partition, returning its size in bits
+int64_t codePartition(const uint32_t* values, int count, int& parameter)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < count; ++i)
+        sum += values[i];
+
+    // The mean is close to the best parameter, look at its neighbours for the exact optimum
+    const int estimate = juce::jmax(0, bitLength(static_cast<uint32_t>(sum / static_cast<uint64_t>(count))) - 1);
+    int64_t bestBits = -1;
+
+    for (int candidate = juce::jmax(0, estimate - 2); candidate <= juce::jmin(maxRiceParameter, estimate + 2); ++candidate)
+    {
+        int64_t bits = static_cast<int64_t>(count) * (candidate + 1);
+        for (int i = 0; i < count; ++i)
+            bits += values[i] >> candidate;
+
+        if (bestBits < 0 || bits < bestBits)
+        {
+            bestBits = bits;
+            parameter = candidate;
+        }
+    }
+
+    return bestBits;
+}
+
+int64_t measureResiduals(const uint32_t* values, int firstFrame, int numSamples)
+{
+    int64_t bits = 0;
+    int parameter = 0;
+
+    for (int frame = firstFrame; frame < numSamples;)
+    {
+        const int partitionEnd = juce::jmin((frame / CompactLoopStore::partitionSize + 1) * CompactLoopStore::partitionSize,
+                                            numSamples);
+        bits += riceParameterBits + codePartition(values + frame, partitionEnd - frame, parameter);
+        frame = partitionEnd;
+    }
+
+    return bits;
+}
+
+// Levinson-Durbin on a Welch-windowed autocorrelation, predictors[order - 1] holds the taps of each order
+int findPredictors(const int32_t* values, int numSamples, double (&predictors)[CompactLoopStore::maxPredictorOrder][CompactLoopStore::maxPredictorOrder])
+{
+    constexpr int maxOrder = CompactLoopStore::maxPredictorOrder;
+    double autocorrelation[maxOrder + 1]{};
+    double windowed[CompactLoopStore::blockSize];
+
+    const double centre = 0.5 * (numSamples - 1);
+    const double halfWidth = 0.5 * (numSamples + 1);
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const double distance = (i - centre) / halfWidth;
+        windowed[i] = values[i] * (1.0 - distance * distance);
+    }
+
+    for (int lag = 0; lag <= maxOrder; ++lag)
+        for (int i = lag; i < numSamples; ++i)
+            autocorrelation[lag] += windowed[i] * windowed[i - lag];
+
+    if (autocorrelation[0] <= 0.0)
+        return 0;
+
+    double taps[maxOrder]{};
+    double error = autocorrelation[0];
+
+    for (int order = 1; order <= maxOrder; ++order)
+    {
+        double accumulated = autocorrelation[order];
+        for (int j = 0; j < order - 1; ++j)
+            accumulated -= taps[j] * autocorrelation[order - 1 - j];
+
+        const double reflection = accumulated / error;
+        double previous[maxOrder];
+        std::copy(taps, taps + order - 1, previous);
+
+        taps[order - 1] = reflection;
+        for (int j = 0; j < order - 1; ++j)
+            taps[j] = previous[j] - reflection * previous[order - 2 - j];
+
+        std::copy(taps, taps + order, predictors[order - 1]);
+
+        error *= 1.0 - reflection * reflection;
+        if (error <= 0.0)
+            return order;
+    }
+
+    return maxOrder;
+}
+
+bool quantizePredictor(const double* taps, int order, int32_t* coefficients, int& shift)
+{
+    double largest = 0.0;
+    for (int j = 0; j < order; ++j)
+        largest = juce::jmax(largest, std::abs(taps[j]));
+
+    if (largest <= 0.0)
+        return false;
+
+    int exponent = 0;
+    std::frexp(largest, &exponent);
+    shift = juce::jmin(maxCoefficientShift, coefficientBits - 1 - exponent);
+    if (shift < 0)
+        return false;
+
+    // Carry each rounding error into the next tap so the taps stay right as a whole
+    constexpr int32_t limit = 1 << (coefficientBits - 1);
+    double error = 0.0;
+
+    for (int j = 0; j < order; ++j)
+    {
+        error += std::ldexp(taps[j], shift);
+        coefficients[j] = static_cast<int32_t>(juce::jlimit(-static_cast<long>(limit), static_cast<long>(limit - 1), std::lround(error)));
+        error -= coefficients[j];
+    }
+
+    return true;
+}
+
+bool predict(const int32_t* values, int numSamples, int order, const int32_t* coefficients, int shift, uint32_t* residuals)
+{
+    for (int i = order; i < numSamples; ++i)
+    {
+        int64_t prediction = 0;
+        for (int j = 0; j < order; ++j)
+            prediction += static_cast<int64_t>(coefficients[j]) * values[i - 1 - j];
+
+        const int64_t residual = values[i] - (prediction >> shift);
+        if (residual >= maxResidual || residual <= -maxResidual)
+            return false;
+
+        residuals[i] = zigzag(static_cast<int32_t>(residual));
+    }
+
+    return true;
+}
+
+int64_t sumOfSteps(const int32_t* values, int numSamples)
+{
+    int64_t sum = 0;
+    for (int i = 1; i < numSamples; ++i)
+        sum += std::abs(static_cast<int64_t>(values[i]) - values[i - 1]);
+
+    return sum;
+}
+
+} // namespace
+
+CompactLoopStore::CompactLoopStore()
+{
+}
+
+CompactLoopStore::~CompactLoopStore()
+{
+}
+
+void CompactLoopStore::beginEncoding(int numChannels, int lengthInSamples, bool allowLossy)
+{
+    this->numChannels = numChannels;
+    this->lengthInSamples = lengthInSamples;
+    this->allowLossy = allowLossy;
+
+    blocks.clear();
+    blocks.reserve(static_cast<size_t>((lengthInSamples + blockSize - 1) / blockSize));
+
+    // Worst case is a float per sample per channel, coded blocks that come out larger are stored as floats
+    data.clear();
+    data.reserve(static_cast<size_t>(numChannels) * static_cast<size_t>(lengthInSamples) * sizeof(float));
+
+    // Quantized channels, the decorrelated pair and the shifted channel being coded
+    quantized.assign(static_cast<size_t>(numChannels + 3) * blockSize, 0);
+    residuals.assign(2 * static_cast<size_t>(blockSize), 0);
+
+    for (auto& entry : window)
+        entry.blockIndex = -1;
+}
+
+void CompactLoopStore::encodeBlock(const juce::AudioBuffer<float>& source, int numSamples)
+{
+    BlockInfo block;
+    block.dataOffset = static_cast<uint32_t>(data.size());
+
+    float peak = 0.0f;
+    for (int channel = 0; channel < numChannels; ++channel)
+        peak = juce::jmax(peak, source.getMagnitude(channel, 0, numSamples));
+
+    block.peak = peak;
+    if (peak == 0.0f)
+    {
+        blocks.push_back(block);
+        return;
+    }
+
+    block.storedChannels = static_cast<uint8_t>(channelsAreIdentical(source, numChannels, numSamples) ? 1 : numChannels);
+
+    bool finite = true;
+    for (int channel = 0; channel < block.storedChannels && finite; ++channel)
+    {
+        const float* samples = source.getReadPointer(channel);
+        for (int i = 0; i < numSamples && finite; ++i)
+            finite = std::isfinite(samples[i]);
+    }
+
+    // Block floating point: the grid spans the smallest power of two above the block peak
+    int exponent = 0;
+    std::frexp(peak, &exponent);
+
+    if (!finite || exponent > 120)
+    {
+        storeFloats(block, source, numSamples);
+        blocks.push_back(block);
+        return;
+    }
+
+    exponent = juce::jmax(-96, exponent);
+    block.exponent = static_cast<int8_t>(exponent);
+    const float toGrid = std::ldexp(1.0f, 23 - exponent);
+
+    // Lossless coding truncates towards zero and keeps what is below the grid as the remainder
+    bool exact = true;
+    for (int channel = 0; channel < block.storedChannels; ++channel)
+    {
+        const float* samples = source.getReadPointer(channel);
+        int32_t* values = quantized.data() + channel * blockSize;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float scaled = samples[i] * toGrid;
+
+            if (allowLossy)
+            {
+                values[i] = static_cast<int32_t>(juce::jlimit(-8388608.0f, 8388607.0f, std::round(scaled)));
+                continue;
+            }
+
+            values[i] = static_cast<int32_t>(scaled);
+            if (static_cast<float>(values[i]) != scaled || (values[i] == 0 && (samples[i] != 0.0f || std::signbit(samples[i]))))
+                exact = false;
+        }
+    }
+
+    block.exact = allowLossy || exact;
+
+    // Code the first two channels as whichever pair of left, right, mid and side changes least
+    const int32_t* coded[2] = { quantized.data(), quantized.data() + blockSize };
+
+    if (block.storedChannels >= 2)
+    {
+        const int32_t* left = quantized.data();
+        const int32_t* right = quantized.data() + blockSize;
+        int32_t* mid = quantized.data() + numChannels * blockSize;
+        int32_t* side = mid + blockSize;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            mid[i] = (left[i] + right[i]) >> 1;
+            side[i] = left[i] - right[i];
+        }
+
+        const int64_t leftSteps = sumOfSteps(left, numSamples);
+        const int64_t rightSteps = sumOfSteps(right, numSamples);
+        const int64_t midSteps = sumOfSteps(mid, numSamples);
+        const int64_t sideSteps = sumOfSteps(side, numSamples);
+
+        const int64_t costs[] = { leftSteps + rightSteps, leftSteps + sideSteps, sideSteps + rightSteps, midSteps + sideSteps };
+        const auto pairing = static_cast<int>(std::min_element(std::begin(costs), std::end(costs)) - std::begin(costs));
+        block.pairing = static_cast<ChannelPairing>(pairing);
+
+        if (block.pairing == ChannelPairing::LeftSide)
+            coded[1] = side;
+        else if (block.pairing == ChannelPairing::RightSide)
+            coded[0] = side;
+        else if (block.pairing == ChannelPairing::MidSide)
+        {
+            coded[0] = mid;
+            coded[1] = side;
+        }
+    }
+
+    // A header of stream offsets, then a residual stream per channel and a remainder stream per channel
+    const size_t headerBytes = static_cast<size_t>(block.storedChannels) * 2 * sizeof(uint32_t);
+    data.resize(data.size() + headerBytes);
+
+    for (int channel = 0; channel < block.storedChannels; ++channel)
+    {
+        const auto offset = static_cast<uint32_t>(data.size() - block.dataOffset);
+        std::memcpy(data.data() + block.dataOffset + channel * 2 * sizeof(uint32_t), &offset, sizeof(offset));
+        encodeChannel(channel < 2 ? coded[channel] : quantized.data() + channel * blockSize, numSamples);
+    }
+
+    for (int channel = 0; channel < block.storedChannels && !block.exact; ++channel)
+    {
+        const auto offset = static_cast<uint32_t>(data.size() - block.dataOffset);
+        std::memcpy(data.data() + block.dataOffset + (channel * 2 + 1) * sizeof(uint32_t), &offset, sizeof(offset));
+        encodeRemainders(source.getReadPointer(channel), quantized.data() + channel * blockSize, numSamples, exponent);
+    }
+
+    block.format = BlockFormat::Coded;
+
+    // Material that does not predict, like noise with float detail, is better off as it was
+    if (data.size() - block.dataOffset > static_cast<size_t>(block.storedChannels) * numSamples * sizeof(float))
+    {
+        data.resize(block.dataOffset);
+        storeFloats(block, source, numSamples);
+    }
+
+    // Keep every block 4-byte aligned so float blocks stay aligned
+    data.resize((data.size() + 3) & ~static_cast<size_t>(3));
+    blocks.push_back(block);
+}
+
+void CompactLoopStore::finishEncoding()
+{
+    // Readers load 8 bytes at a time, so they may look past the last stream
+    data.resize(data.size() + sizeof(uint64_t), 0);
+    data.shrink_to_fit();
+    blocks.shrink_to_fit();
+
+    std::vector<int32_t>().swap(quantized);
+    std::vector<uint32_t>().swap(residuals);
+
+    const bool anyCoded = std::any_of(blocks.begin(), blocks.end(),
+                                      [](const BlockInfo& block) { return block.format == BlockFormat::Coded; });
+
+    for (auto& entry : window)
+    {
+        entry.blockIndex = -1;
+        entry.decodedFrames = 0;
+        entry.lastUse = 0;
+
+        if (anyCoded)
+        {
+            entry.decoders.assign(static_cast<size_t>(numChannels), ChannelDecoder());
+            entry.samples.assign(static_cast<size_t>(numChannels) * blockSize, 0.0f);
+        }
+    }
+
+    windowClock = 0;
+}
+
+bool CompactLoopStore::read(juce::AudioBuffer<float>& output, int startSample, int numSamples, int loopOffset) const
+{
+    numSamples = juce::jmin(numSamples, lengthInSamples - loopOffset);
+    const int channelsToWrite = juce::jmin(numChannels, output.getNumChannels());
+    bool audible = false;
+
+    while (numSamples > 0)
+    {
+        const int blockIndex = loopOffset / blockSize;
+        const int blockOffset = loopOffset - blockIndex * blockSize;
+        const int blockLength = getBlockLength(blockIndex);
+        const int chunkSize = juce::jmin(numSamples, blockLength - blockOffset);
+        const auto& block = blocks[static_cast<size_t>(blockIndex)];
+
+        if (block.format == BlockFormat::Coded)
+        {
+            decodeInto(block, blockLength, blockOffset, chunkSize, output, startSample);
+        }
+        else
+        {
+            for (int channel = 0; channel < channelsToWrite; ++channel)
+            {
+                float* outputData = output.getWritePointer(channel, startSample);
+
+                if (block.format == BlockFormat::Silent)
+                {
+                    juce::FloatVectorOperations::clear(outputData, chunkSize);
+                    continue;
+                }
+
+                const int storedChannel = juce::jmin(channel, block.storedChannels - 1);
+                const auto* stored = reinterpret_cast<const float*>(data.data() + block.dataOffset)
+                                     + storedChannel * blockLength + blockOffset;
+                juce::FloatVectorOperations::copy(outputData, stored, chunkSize);
+            }
+        }
+
+        audible = audible || block.format != BlockFormat::Silent;
+        startSample += chunkSize;
+        loopOffset += chunkSize;
+        numSamples -= chunkSize;
+    }
+
+    return audible;
+}
+
+bool CompactLoopStore::mix(juce::AudioBuffer<float>& output, int startSample, int numSamples, int loopOffset,
+                           float outputGain, float sourceGain) const
+{
+    numSamples = juce::jmin(numSamples, lengthInSamples - loopOffset);
+    const int channelsToWrite = juce::jmin(numChannels, output.getNumChannels());
+    const int requested = numSamples;
+    int lastBlock = -1;
+    bool audible = false;
+
+    while (numSamples > 0)
+    {
+        const int blockIndex = loopOffset / blockSize;
+        const int blockOffset = loopOffset - blockIndex * blockSize;
+        const int blockLength = getBlockLength(blockIndex);
+        const int chunkSize = juce::jmin(numSamples, blockLength - blockOffset);
+        const auto& block = blocks[static_cast<size_t>(blockIndex)];
+
+        const float* decoded = nullptr;
+        if (block.format == BlockFormat::Coded)
+        {
+            auto& entry = findWindowBlock(blockIndex);
+            advanceWindowBlock(entry, blockOffset + chunkSize);
+            decoded = entry.samples.data() + blockOffset;
+        }
+        else if (block.format == BlockFormat::Float32)
+        {
+            decoded = reinterpret_cast<const float*>(data.data() + block.dataOffset) + blockOffset;
+        }
+
+        for (int channel = 0; channel < channelsToWrite; ++channel)
+        {
+            float* outputData = output.getWritePointer(channel, startSample);
+
+            if (decoded == nullptr)
+            {
+                SampleMix::scale(outputData, outputGain, chunkSize);
+                continue;
+            }
+
+            // Mono-collapsed blocks feed every output channel from the one stored channel
+            const int storedChannel = juce::jmin(channel, block.storedChannels - 1);
+            const int channelStride = block.format == BlockFormat::Coded ? blockSize : blockLength;
+            SampleMix::scaleAndAdd(outputData, decoded + storedChannel * channelStride, outputGain, sourceGain, chunkSize);
+        }
+
+        audible = audible || block.format != BlockFormat::Silent;
+        lastBlock = blockIndex;
+        startSample += chunkSize;
+        loopOffset += chunkSize;
+        numSamples -= chunkSize;
+    }
+
+    // Decode ahead into the next block at twice the read rate, so it is ready before the read head gets there
+    if (lastBlock >= 0 && blocks.size() > 1)
+    {
+        const int nextBlock = (lastBlock + 1) % static_cast<int>(blocks.size());
+
+        if (blocks[static_cast<size_t>(nextBlock)].format == BlockFormat::Coded)
+        {
+            auto& entry = findWindowBlock(nextBlock);
+            advanceWindowBlock(entry, juce::jmin(getBlockLength(nextBlock), entry.decodedFrames + 2 * requested));
+        }
+    }
+
+    return audible;
+}
+
+float CompactLoopStore::getPeak(int loopOffset, int numSamples) const
+{
+    numSamples = juce::jmin(numSamples, lengthInSamples - loopOffset);
+    if (numSamples <= 0)
+        return 0.0f;
+
+    const int firstBlock = loopOffset / blockSize;
+    const int lastBlock = (loopOffset + numSamples - 1) / blockSize;
+    float peak = 0.0f;
+
+    for (int blockIndex = firstBlock; blockIndex <= lastBlock; ++blockIndex)
+        peak = juce::jmax(peak, blocks[static_cast<size_t>(blockIndex)].peak);
+
+    return peak;
+}
+
+void CompactLoopStore::clear()
+{
+    // Swap with empty vectors so the memory is actually returned
+    std::vector<BlockInfo>().swap(blocks);
+    std::vector<uint8_t>().swap(data);
+    std::vector<int32_t>().swap(quantized);
+    std::vector<uint32_t>().swap(residuals);
+
+    for (auto& entry : window)
+    {
+        entry.blockIndex = -1;
+        std::vector<ChannelDecoder>().swap(entry.decoders);
+        std::vector<float>().swap(entry.samples);
+    }
+
+    lengthInSamples = 0;
+}
+
+void CompactLoopStore::swap(CompactLoopStore& other)
+{
+    blocks.swap(other.blocks);
+    data.swap(other.data);
+    std::swap(numChannels, other.numChannels);
+    std::swap(lengthInSamples, other.lengthInSamples);
+    std::swap(allowLossy, other.allowLossy);
+    quantized.swap(other.quantized);
+    residuals.swap(other.residuals);
+
+    for (int i = 0; i < windowBlocks; ++i)
+        std::swap(window[i], other.window[i]);
+
+    std::swap(windowClock, other.windowClock);
+}
+
+size_t CompactLoopStore::getStorageBytes() const
+{
+    size_t bytes = data.capacity() + blocks.capacity() * sizeof(BlockInfo);
+
+    for (const auto& entry : window)
+        bytes += entry.samples.capacity() * sizeof(float) + entry.decoders.capacity() * sizeof(ChannelDecoder);
+
+    return bytes;
+}
+
+int CompactLoopStore::getBlockLength(int blockIndex) const
+{
+    return juce::jmin(blockSize, lengthInSamples - blockIndex * blockSize);
+}
+
+void CompactLoopStore::storeFloats(BlockInfo& block, const juce::AudioBuffer<float>& source, int numSamples)
+{
+    block.format = BlockFormat::Float32;
+
+    for (int channel = 0; channel < block.storedChannels; ++channel)
+    {
+        const size_t channelOffset = data.size();
+        data.resize(channelOffset + static_cast<size_t>(numSamples) * sizeof(float));
+        std::memcpy(data.data() + channelOffset, source.getReadPointer(channel), static_cast<size_t>(numSamples) * sizeof(float));
+    }
+}
+
+void CompactLoopStore::encodeChannel(const int32_t* values, int numSamples)
+{
+    int32_t* shifted = quantized.data() + (numChannels + 2) * blockSize;
+    uint32_t* candidate = residuals.data();
+    uint32_t* best = residuals.data() + blockSize;
+
+    // Low bits that are zero throughout, as 16-bit material has on a 24-bit grid, are not coded
+    uint32_t setBits = 0;
+    for (int i = 0; i < numSamples; ++i)
+        setBits |= static_cast<uint32_t>(values[i]);
+
+    int wastedBits = 0;
+    while (setBits != 0 && ((setBits >> wastedBits) & 1u) == 0)
+        ++wastedBits;
+
+    for (int i = 0; i < numSamples; ++i)
+        shifted[i] = values[i] >> wastedBits;
+
+    // Order 0 codes the values themselves
+    int bestOrder = 0;
+    int bestShift = 0;
+    int bestWarmupBits = 0;
+    int32_t bestCoefficients[maxPredictorOrder]{};
+
+    for (int i = 0; i < numSamples; ++i)
+        best[i] = zigzag(shifted[i]);
+
+    int64_t bestBits = measureResiduals(best, 0, numSamples);
+
+    double predictors[maxPredictorOrder][maxPredictorOrder];
+    const int numOrders = numSamples > 2 * maxPredictorOrder ? findPredictors(shifted, numSamples, predictors) : 0;
+
+    for (int order = 1; order <= numOrders; ++order)
+    {
+        int32_t coefficients[maxPredictorOrder]{};
+        int shift = 0;
+
+        if (!quantizePredictor(predictors[order - 1], order, coefficients, shift)
+            || !predict(shifted, numSamples, order, coefficients, shift, candidate))
+            continue;
+
+        int warmupBits = 0;
+        for (int i = 0; i < order; ++i)
+            warmupBits = juce::jmax(warmupBits, signedBitLength(shifted[i]));
+
+        const int64_t bits = 4 + order * coefficientBits + 5 + order * warmupBits + measureResiduals(candidate, order, numSamples);
+
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            bestOrder = order;
+            bestShift = shift;
+            bestWarmupBits = warmupBits;
+            std::copy(coefficients, coefficients + order, bestCoefficients);
+            std::swap(candidate, best);
+        }
+    }
+
+    BitWriter writer(data);
+    writer.write(static_cast<uint32_t>(bestOrder), 4);
+    writer.write(static_cast<uint32_t>(wastedBits), 5);
+
+    if (bestOrder > 0)
+    {
+        writer.write(static_cast<uint32_t>(bestShift), 4);
+        for (int j = 0; j < bestOrder; ++j)
+            writer.writeSigned(bestCoefficients[j], coefficientBits);
+
+        writer.write(static_cast<uint32_t>(bestWarmupBits), 5);
+        for (int i = 0; i < bestOrder; ++i)
+            writer.writeSigned(shifted[i], bestWarmupBits);
+    }
+
+    for (int frame = bestOrder; frame < numSamples;)
+    {
+        const int partitionEnd = juce::jmin((frame / partitionSize + 1) * partitionSize, numSamples);
+        int parameter = 0;
+        codePartition(best + frame, partitionEnd - frame, parameter);
+
+        writer.write(static_cast<uint32_t>(parameter), riceParameterBits);
+        for (; frame < partitionEnd; ++frame)
+            writer.writeRice(best[frame], parameter);
+    }
+
+    writer.flush();
+}
+
+void CompactLoopStore::encodeRemainders(const float* samples, const int32_t* quantizedSamples, int numSamples, int exponent)
+{
+    BitWriter writer(data);
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const float sample = samples[i];
+        const int32_t value = quantizedSamples[i];
+
+        if (value != 0)
+        {
+            // The full 24-bit mantissa minus the bits the grid value already holds
+            const auto magnitude = static_cast<uint32_t>(value < 0 ? -value : value);
+            const int gridBits = bitLength(magnitude);
+            const auto mantissa = static_cast<uint32_t>(std::ldexp(std::abs(sample), 47 - gridBits - exponent));
+            writer.write(mantissa - (magnitude << (24 - gridBits)), 24 - gridBits);
+        }
+        else if (sample == 0.0f && !std::signbit(sample))
+        {
+            writer.write(0, 1);
+        }
+        else
+        {
+            // Below the grid altogether, rare enough to keep as the raw float
+            uint32_t raw = 0;
+            std::memcpy(&raw, &sample, sizeof(raw));
+            writer.write(1, 1);
+            writer.write(raw, 32);
+        }
+    }
+
+    writer.flush();
+}
+
+void CompactLoopStore::startChannel(const BlockInfo& block, int blockLength, int channel, ChannelDecoder& decoder) const
+{
+    uint32_t offsets[2];
+    std::memcpy(offsets, data.data() + block.dataOffset + channel * sizeof(offsets), sizeof(offsets));
+
+    decoder = ChannelDecoder();
+    decoder.blockLength = blockLength;
+    decoder.remainderBit = (static_cast<uint64_t>(block.dataOffset) + offsets[1]) * 8;
+
+    BitReader reader{ data.data(), (static_cast<uint64_t>(block.dataOffset) + offsets[0]) * 8 };
+    decoder.order = static_cast<int>(reader.read(4));
+    decoder.wastedBits = static_cast<int>(reader.read(5));
+
+    if (decoder.order > 0)
+    {
+        decoder.shift = static_cast<int>(reader.read(4));
+        for (int j = 0; j < decoder.order; ++j)
+            decoder.coefficients[j] = reader.readSigned(coefficientBits);
+
+        decoder.warmupBits = static_cast<int>(reader.read(5));
+    }
+
+    decoder.residualBit = reader.position;
+}
+
+void CompactLoopStore::decodeValues(ChannelDecoder& decoder, int32_t* coded, int32_t* values, int numFrames) const
+{
+    // The coded values run on from the history, so the predictor can look back across calls
+    std::copy(decoder.history, decoder.history + maxPredictorOrder, coded);
+    int32_t* current = coded + maxPredictorOrder;
+
+    BitReader reader{ data.data(), decoder.residualBit };
+    const int32_t wastedScale = 1 << decoder.wastedBits;
+
+    for (int i = 0; i < numFrames; ++i)
+    {
+        const int frame = decoder.frame + i;
+        int32_t value = 0;
+
+        if (frame < decoder.order)
+        {
+            value = reader.readSigned(decoder.warmupBits);
+        }
+        else
+        {
+            if (decoder.partitionRemaining == 0)
+            {
+                decoder.riceParameter = static_cast<int>(reader.read(riceParameterBits));
+                decoder.partitionRemaining = juce::jmin((frame / partitionSize + 1) * partitionSize, decoder.blockLength) - frame;
+            }
+
+            --decoder.partitionRemaining;
+
+            int64_t prediction = 0;
+            for (int j = 0; j < decoder.order; ++j)
+                prediction += static_cast<int64_t>(decoder.coefficients[j]) * current[i - 1 - j];
+
+            value = static_cast<int32_t>(prediction >> decoder.shift) + reader.readRice(decoder.riceParameter);
+        }
+
+        current[i] = value;
+        values[i] = value * wastedScale;
+    }
+
+    decoder.frame += numFrames;
+    decoder.residualBit = reader.position;
+    std::copy(current + numFrames - maxPredictorOrder, current + numFrames, decoder.history);
+}
+
+void CompactLoopStore::decodeFrames(const BlockInfo& block, ChannelDecoder* decoders, int firstChannel, int groupSize,
+                                    int numFrames, float* const* destinations) const
+{
+    constexpr int chunkLength = 256;
+    int32_t coded[2][maxPredictorOrder + chunkLength];
+    int32_t values[2][chunkLength];
+    float discarded[chunkLength];
+
+    const float gridStep = std::ldexp(1.0f, block.exponent - 23);
+
+    for (int done = 0; done < numFrames; done += chunkLength)
+    {
+        const int count = juce::jmin(chunkLength, numFrames - done);
+
+        for (int member = 0; member < groupSize; ++member)
+            decodeValues(decoders[member], coded[member], values[member], count);
+
+        // Undo the decorrelation of the first two channels
+        if (firstChannel == 0 && groupSize == 2 && block.pairing != ChannelPairing::Independent)
+        {
+            int32_t* first = values[0];
+            int32_t* second = values[1];
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (block.pairing == ChannelPairing::LeftSide)
+                {
+                    second[i] = first[i] - second[i];
+                }
+                else if (block.pairing == ChannelPairing::RightSide)
+                {
+                    first[i] = second[i] + first[i];
+                }
+                else
+                {
+                    const int32_t side = second[i];
+                    const int32_t sum = first[i] * 2 + (side & 1);
+                    first[i] = (sum + side) >> 1;
+                    second[i] = (sum - side) >> 1;
+                }
+            }
+        }
+
+        for (int member = 0; member < groupSize; ++member)
+        {
+            float* output = destinations[member] != nullptr ? destinations[member] + done : discarded;
+            const int32_t* grid = values[member];
+
+            if (block.exact)
+            {
+                juce::FloatVectorOperations::convertFixedToFloat(output, grid, gridStep, count);
+                continue;
+            }
+
+            // Put the remainder bits back below each grid value, the scaling is by powers of two and exact
+            auto& decoder = decoders[member];
+            BitReader reader{ data.data(), decoder.remainderBit };
+
+            for (int i = 0; i < count; ++i)
+            {
+                if (grid[i] != 0)
+                {
+                    const auto magnitude = static_cast<uint32_t>(grid[i] < 0 ? -grid[i] : grid[i]);
+                    const int gridBits = bitLength(magnitude);
+                    const uint32_t mantissa = (magnitude << (24 - gridBits)) | reader.read(24 - gridBits);
+                    const float sample = static_cast<float>(mantissa) * (static_cast<float>(1u << gridBits) * (1.0f / 16777216.0f))
+                                         * gridStep;
+                    output[i] = grid[i] < 0 ? -sample : sample;
+                }
+                else if (reader.read(1) != 0)
+                {
+                    const uint32_t raw = reader.read(32);
+                    std::memcpy(output + i, &raw, sizeof(raw));
+                }
+                else
+                {
+                    output[i] = 0.0f;
+                }
+            }
+
+            decoder.remainderBit = reader.position;
+        }
+    }
+}
+
+void CompactLoopStore::decodeInto(const BlockInfo& block, int blockLength, int blockOffset, int numSamples,
+                                  juce::AudioBuffer<float>& output, int startSample) const
+{
+    float* const skipped[2] = { nullptr, nullptr };
+
+    for (int firstChannel = 0; firstChannel < block.storedChannels;)
+    {
+        const int groupSize = firstChannel == 0 && block.storedChannels >= 2 ? 2 : 1;
+        ChannelDecoder decoders[2];
+        float* destinations[2] = { nullptr, nullptr };
+
+        for (int member = 0; member < groupSize; ++member)
+        {
+            const int channel = firstChannel + member;
+            startChannel(block, blockLength, channel, decoders[member]);
+
+            if (channel < output.getNumChannels())
+                destinations[member] = output.getWritePointer(channel, startSample);
+        }
+
+        // Everything before the read position still has to be decoded, it is only not kept
+        decodeFrames(block, decoders, firstChannel, groupSize, blockOffset, skipped);
+        decodeFrames(block, decoders, firstChannel, groupSize, numSamples, destinations);
+        firstChannel += groupSize;
+    }
+
+    if (block.storedChannels == 1)
+        for (int channel = 1; channel < juce::jmin(numChannels, output.getNumChannels()); ++channel)
+            output.copyFrom(channel, startSample, output, 0, startSample, numSamples);
+}
+
+CompactLoopStore::WindowBlock& CompactLoopStore::findWindowBlock(int blockIndex) const
+{
+    WindowBlock* leastRecent = nullptr;
+
+    for (auto& entry : window)
+    {
+        if (entry.blockIndex == blockIndex)
+        {
+            entry.lastUse = ++windowClock;
+            return entry;
+        }
+
+        if (leastRecent == nullptr || entry.lastUse < leastRecent->lastUse)
+            leastRecent = &entry;
+    }
+
+    const auto& block = blocks[static_cast<size_t>(blockIndex)];
+    const int blockLength = getBlockLength(blockIndex);
+
+    leastRecent->blockIndex = blockIndex;
+    leastRecent->decodedFrames = 0;
+    leastRecent->lastUse = ++windowClock;
+
+    for (int channel = 0; channel < block.storedChannels; ++channel)
+        startChannel(block, blockLength, channel, leastRecent->decoders[static_cast<size_t>(channel)]);
+
+    return *leastRecent;
+}
+
+void CompactLoopStore::advanceWindowBlock(WindowBlock& entry, int targetFrames) const
+{
+    if (targetFrames <= entry.decodedFrames)
+        return;
+
+    const auto& block = blocks[static_cast<size_t>(entry.blockIndex)];
+
+    for (int firstChannel = 0; firstChannel < block.storedChannels;)
+    {
+        const int groupSize = firstChannel == 0 && block.storedChannels >= 2 ? 2 : 1;
+        float* destinations[2] = { nullptr, nullptr };
+
+        for (int member = 0; member < groupSize; ++member)
+            destinations[member] = entry.samples.data() + (firstChannel + member) * blockSize + entry.decodedFrames;
+
+        decodeFrames(block, entry.decoders.data() + firstChannel, firstChannel, groupSize,
+                     targetFrames - entry.decodedFrames, destinations);
+        firstChannel += groupSize;
+    }
+
+    entry.decodedFrames = targetFrames;
+}
+
+bool CompactLoopStore::channelsAreIdentical(const juce::AudioBuffer<float>& source, int numChannels, int numSamples)
+{
+    for (int channel = 1; channel < numChannels; ++channel)
+    {
+        if (std::memcmp(source.getReadPointer(0), source.getReadPointer(channel),
+                        static_cast<size_t>(numSamples) * sizeof(float)) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
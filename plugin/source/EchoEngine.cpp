@@ -0,0 +1,88 @@
+#include "OpenLooper2/EchoEngine.h"
+#include <cmath>
+
+namespace OpenLooper2 {
+
+EchoEngine::EchoEngine()
+{
+}
+
+EchoEngine::~EchoEngine()
+{
+}
+
+void EchoEngine::initialize(double sampleRate, int numChannels)
+{
+    this->sampleRate = sampleRate;
+    maxDelay = static_cast<int>(std::ceil(sampleRate * maxTimeMs * 0.001)) * maxTaps;
+
+    // One extra tile keeps the longest tap clear of the samples being written
+    delayLine.initialize(numChannels, maxDelay + CircularAudioBuffer::chunkSize);
+    wetBuffer.setSize(numChannels, CircularAudioBuffer::chunkSize);
+    feedbackBuffer.setSize(numChannels, CircularAudioBuffer::chunkSize);
+    silentSamples = 0;
+}
+
+void EchoEngine::setParameters(float timeMs, int numTaps, float feedback, float mix)
+{
+    this->numTaps = juce::jlimit(1, maxTaps, numTaps);
+    this->mix = mix;
+
+    // Taps must lie at least a tile back, since a tile is read before it is written
+    const int spacing = juce::jmax(CircularAudioBuffer::chunkSize,
+                                   static_cast<int>(juce::jlimit(minTimeMs, maxTimeMs, timeMs) * 0.001f * sampleRate));
+
+    for (int tap = 0; tap < this->numTaps; ++tap)
+    {
+        taps[static_cast<size_t>(tap)].delay = juce::jmin(spacing * (tap + 1), maxDelay);
+        taps[static_cast<size_t>(tap)].gain = 1.0f / static_cast<float>(tap + 1);
+        taps[static_cast<size_t>(tap)].feedback = 0.0f;
+    }
+
+    taps[static_cast<size_t>(this->numTaps - 1)].feedback = juce::jlimit(0.0f, maxFeedback, feedback);
+}
+
+void EchoEngine::process(juce::AudioBuffer<float>& buffer, bool enabled)
+{
+    if (!delayLine.isInitialized())
+        return;
+
+    const int numSamples = buffer.getNumSamples();
+
+    // Once silence has gone all the way round the line, there is nothing left to flush
+    if (enabled)
+        silentSamples = 0;
+    else if (silentSamples >= delayLine.getBufferSize())
+        return;
+    else
+        silentSamples += numSamples;
+    
+    const int channels = juce::jmin(buffer.getNumChannels(), feedbackBuffer.getNumChannels());
+
+    for (int offset = 0; offset < numSamples; offset += CircularAudioBuffer::chunkSize)
+    {
+        const int length = juce::jmin(CircularAudioBuffer::chunkSize, numSamples - offset);
+        wetBuffer.clear(0, length);
+        feedbackBuffer.clear(0, length);
+
+        if (enabled)
+        {
+            delayLine.readTaps(wetBuffer, &feedbackBuffer, 0, length, taps.data(), numTaps, delayLine.getWritePosition());
+
+            for (int channel = 0; channel < channels; ++channel)
+                juce::FloatVectorOperations::add(feedbackBuffer.getWritePointer(channel),
+                                                 buffer.getReadPointer(channel, offset), length);
+        }
+
+        delayLine.write(feedbackBuffer, 0, length);
+
+        if (enabled)
+        {
+            for (int channel = 0; channel < channels; ++channel)
+                juce::FloatVectorOperations::addWithMultiply(buffer.getWritePointer(channel, offset),
+                                                             wetBuffer.getReadPointer(channel), mix, length);
+        }
+    }
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "OpenLooper2/GranularEngine.h"
+#include "OpenLooper2/SampleMix.h"
+#include <cmath>
+
+namespace OpenLooper2 {
+
+GranularEngine::GranularEngine(LoopBufferManager& loopBufferManager)
+    : loopBufferManager(loopBufferManager)
+{
+    // Raised cosine over the table, the guard points past its end stay silent
+    for (int index = 0; index < windowTableSize + 2; ++index)
+    {
+        const double phase = static_cast<double>(juce::jmin(index, windowTableSize)) / windowTableSize;
+        windowTable[static_cast<size_t>(index)] = index <= windowTableSize
+            ? static_cast<float>(0.5 - 0.5 * std::cos(juce::MathConstants<double>::twoPi * phase))
+            : 0.0f;
+    }
+}
+
+GranularEngine::~GranularEngine()
+{
+}
+
+void GranularEngine::initialize(double sampleRate, int maxBlockSize, int numChannels)
+{
+    this->sampleRate = sampleRate;
+    this->maxBlockSize = maxBlockSize;
+
+    // The highest pitch reads this many loop samples per block, plus one for interpolation
+    const float maxRate = std::exp2(maxPitchSemitones / 12.0f);
+    maxSourceSpan = static_cast<int>(std::ceil(maxRate * static_cast<float>(maxBlockSize))) + 2;
+
+    grainBuffer.setSize(numChannels, maxBlockSize);
+    sourceBuffer.setSize(numChannels, maxSourceSpan);
+    envelope.calloc(static_cast<size_t>(maxBlockSize));
+    resampled.calloc(static_cast<size_t>(maxBlockSize));
+
+    reset();
+}
+
+void GranularEngine::setParameters(float position, float spray, float sizeMs, float density, float pitchSemitones)
+{
+    this->position = juce::jlimit(0.0f, 1.0f, position);
+    this->spray = juce::jlimit(0.0f, 1.0f, spray);
+
+    const float size = juce::jlimit(minSizeMs, maxSizeMs, sizeMs);
+    const float rate = juce::jlimit(minDensity, maxDensity, density);
+    grainLength = juce::jmax(2, static_cast<int>(size * 0.001f * static_cast<float>(sampleRate)));
+    grainInterval = sampleRate / rate;
+    pitchRatio = std::exp2(juce::jlimit(-maxPitchSemitones, maxPitchSemitones, pitchSemitones) / 12.0f);
+
+    // A denser cloud must not wait out the long gap a sparse one left
+    samplesToNextGrain = juce::jmin(samplesToNextGrain, grainInterval);
+
+    // Overlapping grains add up in power; a Hann window squared averages 3/8
+    const float overlap = rate * size * 0.001f;
+    levelPerGrain = 1.0f / std::sqrt(juce::jmax(1.0f, overlap * 0.375f));
+}
+
+void GranularEngine::reset()
+{
+    numGrains = 0;
+    samplesToNextGrain = 0.0;
+}
+
+bool GranularEngine::process(juce::AudioBuffer<float>& output, int numSamples, float outputGain, float grainGain)
+{
+    jassert(numSamples <= maxBlockSize);
+    numSamples = juce::jmin(numSamples, maxBlockSize);
+
+    const int loopLength = loopBufferManager.getLoopLength();
+
+    // Grain positions only hold for the loop they were started in
+    if (loopLength != cloudLoopLength)
+    {
+        reset();
+        cloudLoopLength = loopLength;
+    }
+
+    bool audible = false;
+    if (loopLength > 0)
+    {
+        grainBuffer.clear(0, numSamples);
+
+        // New grains start at their own sample within the block
+        while (samplesToNextGrain < numSamples)
+        {
+            startGrain(static_cast<int>(samplesToNextGrain), loopLength);
+            samplesToNextGrain += grainInterval;
+        }
+
+        samplesToNextGrain -= numSamples;
+
+        for (int grain = 0; grain < numGrains;)
+        {
+            audible |= renderGrain(grain, numSamples, loopLength);
+
+            if (grainRemaining[static_cast<size_t>(grain)] <= 0)
+                removeGrain(grain);
+            else
+                ++grain;
+        }
+    }
+
+    for (int channel = 0; channel < output.getNumChannels(); ++channel)
+    {
+        if (audible && channel < grainBuffer.getNumChannels())
+            SampleMix::scaleAndAdd(output.getWritePointer(channel), grainBuffer.getReadPointer(channel),
+                                   outputGain, grainGain, numSamples);
+        else
+            SampleMix::scale(output.getWritePointer(channel), outputGain, numSamples);
+    }
+
+    return audible;
+}
+
+void GranularEngine::startGrain(int offset, int loopLength)
+{
+    if (numGrains >= maxGrains)
+    {
+        droppedGrains.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Scatter the start around the cloud centre, wrapped into the loop
+    const float scatter = (random.nextFloat() * 2.0f - 1.0f) * spray * 0.5f;
+    int start = static_cast<int>((position + scatter) * static_cast<float>(loopLength)) % loopLength;
+    if (start < 0)
+        start += loopLength;
+
+    const auto grain = static_cast<size_t>(numGrains++);
+    grainPosition[grain] = static_cast<double>(start);
+    grainRate[grain] = pitchRatio;
+    grainPhase[grain] = 0.0f;
+    grainPhaseStep[grain] = static_cast<float>(windowTableSize) / static_cast<float>(grainLength);
+    grainGain[grain] = levelPerGrain;
+    grainRemaining[grain] = grainLength;
+    grainDelay[grain] = offset;
+}
+
+bool GranularEngine::renderGrain(int grain, int numSamples, int loopLength)
+{
+    const auto index = static_cast<size_t>(grain);
+    const int offset = grainDelay[index];
+    const int length = juce::jmin(numSamples - offset, grainRemaining[index]);
+    grainDelay[index] = 0;
+
+    const double readPosition = grainPosition[index];
+    const float rate = grainRate[index];
+    const float phase = grainPhase[index];
+    const float phaseStep = grainPhaseStep[index];
+
+    grainPosition[index] = std::fmod(readPosition + static_cast<double>(length) * rate, static_cast<double>(loopLength));
+    grainPhase[index] = phase + static_cast<float>(length) * phaseStep;
+    grainRemaining[index] -= length;
+
+    if (length <= 0)
+        return false;
+
+    // One read covers the stretch of the loop this part of the grain passes over
+    const auto first = static_cast<juce::int64>(readPosition);
+    const float fraction = static_cast<float>(readPosition - static_cast<double>(first));
+    const int span = juce::jmin(maxSourceSpan, static_cast<int>(fraction + static_cast<float>(length - 1) * rate) + 2);
+
+    juce::AudioBuffer<float> source(sourceBuffer.getArrayOfWritePointers(), sourceBuffer.getNumChannels(), span);
+    if (!loopBufferManager.readLoop(source, 0, span, first))
+        return false;
+
+    // Envelope from the window table, positions computed from the index so iterations are independent
+    const float gain = grainGain[index];
+    const float* window = windowTable.data();
+    float* __restrict env = envelope.get();
+
+    for (int i = 0; i < length; ++i)
+    {
+        const float tablePosition = phase + static_cast<float>(i) * phaseStep;
+        const int tableIndex = juce::jmin(static_cast<int>(tablePosition), windowTableSize);
+        const float tableFraction = tablePosition - static_cast<float>(tableIndex);
+        env[i] = gain * (window[tableIndex] + tableFraction * (window[tableIndex + 1] - window[tableIndex]));
+    }
+
+    // At the loop's own pitch and on whole samples the grain reads the source directly
+    const bool direct = rate == 1.0f && fraction == 0.0f;
+
+    for (int channel = 0; channel < grainBuffer.getNumChannels(); ++channel)
+    {
+        const float* input = source.getReadPointer(channel);
+        float* accumulator = grainBuffer.getWritePointer(channel, offset);
+
+        if (!direct)
+        {
+            float* __restrict interpolated = resampled.get();
+            for (int i = 0; i < length; ++i)
+            {
+                const float sourcePosition = fraction + static_cast<float>(i) * rate;
+                const int sourceIndex = static_cast<int>(sourcePosition);
+                const float sourceFraction = sourcePosition - static_cast<float>(sourceIndex);
+                interpolated[i] = input[sourceIndex] + sourceFraction * (input[sourceIndex + 1] - input[sourceIndex]);
+            }
+
+            input = interpolated;
+        }
+
+        juce::FloatVectorOperations::addWithMultiply(accumulator, input, env, length);
+    }
+
+    return true;
+}
+
+void GranularEngine::removeGrain(int grain)
+{
+    const auto index = static_cast<size_t>(grain);
+    const auto last = static_cast<size_t>(--numGrains);
+
+    grainPosition[index] = grainPosition[last];
+    grainRate[index] = grainRate[last];
+    grainPhase[index] = grainPhase[last];
+    grainPhaseStep[index] = grainPhaseStep[last];
+    grainGain[index] = grainGain[last];
+    grainRemaining[index] = grainRemaining[last];
+    grainDelay[index] = grainDelay[last];
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "OpenLooper2/LoopBoundaryRefiner.h"
+
+namespace OpenLooper2 {
+
+LoopBoundaryRefiner::LoopBoundaryRefiner(const LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue)
+    : BackgroundJob(Priority::Normal),
+      bufferManager(bufferManager),
+      jobQueue(jobQueue)
+{
+}
+
+LoopBoundaryRefiner::~LoopBoundaryRefiner()
+{
+    jobQueue.retractJob(*this);
+}
+
+void LoopBoundaryRefiner::initialize(double sampleRate, int numChannels)
+{
+    // The analysis scratch is used by the job, so let it finish before resizing
+    cancelRefinement();
+    cancel();
+    waitUntilIdle();
+
+    this->sampleRate = sampleRate;
+    this->numChannels = numChannels;
+    this->searchWindowSamples = juce::jlimit(envelopeHopSize * 4, 32767,
+                                             static_cast<int>(sampleRate * searchWindowSeconds));
+
+    analysisBuffer.setSize(numChannels, searchWindowSamples);
+    monoBuffer.calloc(static_cast<size_t>(searchWindowSamples));
+    energyBuffer.calloc(static_cast<size_t>(searchWindowSamples));
+}
+
+void LoopBoundaryRefiner::requestRefinement(int loopStart, int loopLength)
+{
+    requestedStart.store(loopStart, std::memory_order_relaxed);
+    requestedLength.store(loopLength, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    publishedBoundary.store(0, std::memory_order_release);
+    requestPending.store(true, std::memory_order_release);
+    jobQueue.submitFromAudioThread(*this);
+}
+
+void LoopBoundaryRefiner::cancelRefinement()
+{
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    requestPending.store(false, std::memory_order_release);
+    publishedBoundary.store(0, std::memory_order_release);
+}
+
+bool LoopBoundaryRefiner::getRefinedBoundary(int& startOffset, int& loopLength)
+{
+    const juce::uint64 packed = publishedBoundary.exchange(0, std::memory_order_acq_rel);
+    if (packed == 0)
+        return false;
+
+    // Drop results that belong to a request that has since been replaced or cancelled
+    const auto packedGeneration = static_cast<juce::uint32>(packed >> 48);
+    if (packedGeneration != (generation.load(std::memory_order_acquire) & 0xffffu))
+        return false;
+
+    startOffset = static_cast<int>((packed >> 32) & 0xffffu);
+    loopLength = static_cast<int>(packed & 0xffffffffu);
+    return true;
+}
+
+void LoopBoundaryRefiner::run()
+{
+    // Requests posted while we run are coalesced into the latest one
+    while (!shouldCancel() && requestPending.exchange(false, std::memory_order_acq_rel))
+    {
+        const juce::uint32 requestGeneration = generation.load(std::memory_order_acquire);
+        refine(requestedStart.load(std::memory_order_relaxed),
+               requestedLength.load(std::memory_order_relaxed),
+               requestGeneration);
+    }
+}
+
+void LoopBoundaryRefiner::refine(int loopStart, int loopLength, juce::uint32 requestGeneration)
+{
+    // Keep the search regions well inside the loop so they never overlap
+    const int window = juce::jmin(searchWindowSamples, loopLength / 4);
+    if (window < envelopeHopSize * 4)
+        return;
+
+    // Start: an early press leaves a gap before the first transient
+    loadMonoRegion(loopStart, window);
+    int startOffset = 0;
+    const int startOnset = findOnset(window);
+    if (startOnset >= 0)
+    {
+        const int crossing = findZeroCrossing(window, startOnset, -1, true);
+        startOffset = crossing >= 0 ? crossing : startOnset;
+    }
+    else
+    {
+        startOffset = juce::jmax(0, findZeroCrossing(window, 1, 1, true));
+    }
+
+    // End: a late press catches the attack of the next bar, so cut just before it
+    const int endRegionStart = loopStart + loopLength - window;
+    loadMonoRegion(endRegionStart, window);
+    const int endOnset = findOnset(window);
+    const int endSearchFrom = endOnset >= 0 ? endOnset : window - 1;
+    const int endCrossing = findZeroCrossing(window, endSearchFrom, -1, true);
+    const int endOffset = endCrossing >= 0 ? endCrossing : (endOnset >= 0 ? endOnset : window);
+
+    const int refinedLength = (loopLength - window + endOffset) - startOffset;
+    if (refinedLength <= loopLength / 2 || (startOffset == 0 && refinedLength == loopLength))
+        return;
+
+    // Only publish if the audio thread has not moved on to another loop meanwhile
+    if (generation.load(std::memory_order_acquire) != requestGeneration)
+        return;
+
+    publishedBoundary.store(packBoundary(requestGeneration, startOffset, refinedLength),
+                            std::memory_order_release);
+}
+
+void LoopBoundaryRefiner::loadMonoRegion(int bufferIndex, int numSamples)
+{
+    bufferManager.readAbsolute(analysisBuffer, 0, numSamples, bufferIndex);
+
+    const int channels = juce::jmin(numChannels, analysisBuffer.getNumChannels());
+    juce::FloatVectorOperations::copy(monoBuffer, analysisBuffer.getReadPointer(0), numSamples);
+
+    for (int channel = 1; channel < channels; ++channel)
+        juce::FloatVectorOperations::add(monoBuffer, analysisBuffer.getReadPointer(channel), numSamples);
+
+    if (channels > 1)
+        juce::FloatVectorOperations::multiply(monoBuffer, 1.0f / static_cast<float>(channels), numSamples);
+}
+
+int LoopBoundaryRefiner::findOnset(int numSamples)
+{
+    const int numHops = numSamples / envelopeHopSize;
+
+    // Square the signal, then fold it in place into a per-hop mean energy envelope. Each hop is
+    // halved with vector adds until a few partial sums are left, which keeps the scalar chain short
+    juce::FloatVectorOperations::multiply(energyBuffer, monoBuffer, monoBuffer, numSamples);
+
+    for (int hop = 0; hop < numHops; ++hop)
+    {
+        float* hopData = energyBuffer + hop * envelopeHopSize;
+
+        for (int width = envelopeHopSize / 2; width >= envelopeFoldWidth; width /= 2)
+            juce::FloatVectorOperations::add(hopData, hopData + width, width);
+
+        float sum = 0.0f;
+
+        for (int i = 0; i < envelopeFoldWidth; ++i)
+            sum += hopData[i];
+
+        energyBuffer[hop] = sum / static_cast<float>(envelopeHopSize);
+    }
+
+    for (int hop = 2; hop < numHops; ++hop)
+    {
+        const float background = 0.5f * (energyBuffer[hop - 1] + energyBuffer[hop - 2]);
+        const float energy = energyBuffer[hop];
+
+        if (energy > silenceEnergyFloor
+            && energy > onsetEnergyRatio * juce::jmax(background, silenceEnergyFloor * 0.01f))
+            return hop * envelopeHopSize;
+    }
+
+    return -1;
+}
+
+int LoopBoundaryRefiner::findZeroCrossing(int numSamples, int from, int step, bool rising) const
+{
+    for (int i = from; i > 0 && i < numSamples; i += step)
+    {
+        const float previous = monoBuffer[i - 1];
+        const float current = monoBuffer[i];
+
+        if (rising ? (previous < 0.0f && current >= 0.0f)
+                   : (previous > 0.0f && current <= 0.0f))
+            return i;
+    }
+
+    return -1;
+}
+
+juce::uint64 LoopBoundaryRefiner::packBoundary(juce::uint32 boundaryGeneration, int startOffset, int loopLength)
+{
+    return (static_cast<juce::uint64>(boundaryGeneration & 0xffffu) << 48)
+         | (static_cast<juce::uint64>(startOffset & 0xffff) << 32)
+         | static_cast<juce::uint64>(static_cast<juce::uint32>(loopLength));
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -2,74 +2,864 @@
 
 namespace OpenLooper2 {
 
-LoopBufferManager::LoopBufferManager()
+LoopBufferManager::StorageJob::StorageJob(LoopBufferManager& owner)
+    : BackgroundJob(Priority::High),
+      owner(owner)
+{
+}
+
+void LoopBufferManager::StorageJob::run()
+{
+    // Requests for several slots coalesce into one run
+    for (auto& slot : owner.slots)
+        owner.runStorageTransition(slot);
+}
+
+LoopBufferManager::LoopBufferManager(BackgroundJobQueue& jobQueue)
+    : jobQueue(jobQueue),
+      storageJob(*this)
 {
 }
 
 LoopBufferManager::~LoopBufferManager()
 {
+    jobQueue.retractJob(storageJob);
 }
 
 void LoopBufferManager::initialize(double sampleRate, int maxChannels, float maxLengthSeconds)
 {
+    // Let a pending transition settle before the geometry changes underneath it
+    storageJob.waitUntilIdle();
+    
     this->sampleRate = sampleRate;
     this->maxChannels = maxChannels;
     this->maxBufferSize = static_cast<int>(sampleRate * maxLengthSeconds);
     
-    circularBuffer.initialize(maxChannels, maxBufferSize);
+    const bool wasInitialized = initialized.load(std::memory_order_acquire);
+    bool acquiring = false;
+    
+    // One bit per repetition page, enough for a loop filling the whole buffer
+    const int pagesPerWord = 32;
+    const int numPageWords = (maxBufferSize / repetitionPageSize + pagesPerWord) / pagesPerWord;
+    
+    for (auto& slot : slots)
+    {
+        // Only the first slot is allocated up front, the others when a loop is recorded into them
+        const bool keepReleased = wasInitialized ? slot.storageState.load(std::memory_order_acquire) == StorageState::Released
+                                                 : &slot != &slots[0];
+        
+        // Faulting in and locking the memory takes a while, so the worker does it
+        slot.circularBuffer.initialize(maxChannels, maxBufferSize, false);
+        slot.compactStore.clear();
+        slot.storageState.store(keepReleased ? StorageState::Released : StorageState::Acquiring, std::memory_order_release);
+        slot.loopLengthSamples.store(0, std::memory_order_release);
+        slot.loopStartIndex.store(0, std::memory_order_release);
+        acquiring = acquiring || !keepReleased;
+        
+        slot.materializedPages.reset(new std::atomic<juce::uint32>[static_cast<size_t>(numPageWords)]);
+        slot.numPageWords = numPageWords;
+        slot.periodSamples.store(0, std::memory_order_release);
+        clearPages(slot, 0);
+    }
     
-    loopLengthSamples.store(0, std::memory_order_release);
     initialized.store(true, std::memory_order_release);
+    
+    if (acquiring)
+        jobQueue.submit(storageJob);
 }
 
-void LoopBufferManager::writeAudio(const juce::AudioBuffer<float>& input, int startSample, int numSamples)
+bool LoopBufferManager::takeCompactLoop(CompactLoopStore& destination)
 {
-    if (!initialized.load(std::memory_order_acquire))
+    // An expansion in progress still decodes from the store
+    storageJob.waitUntilIdle();
+    
+    auto& slot = getActive();
+    const int loopLength = slot.loopLengthSamples.load(std::memory_order_acquire);
+    if (loopLength <= 0 || slot.storageState.load(std::memory_order_acquire) != StorageState::Compact
+        || slot.compactStore.getLength() != loopLength)
+        return false;
+    
+    destination.swap(slot.compactStore);
+    slot.compactStore.clear();
+    slot.loopLengthSamples.store(0, std::memory_order_release);
+    return true;
+}
+
+void LoopBufferManager::selectSlot(int slotIndex)
+{
+    if (slotIndex < 0 || slotIndex >= numSlots)
         return;
     
-    circularBuffer.write(input, startSample, numSamples);
+    activeSlot.store(&slots[static_cast<size_t>(slotIndex)], std::memory_order_release);
+    activeSlotIndex.store(slotIndex, std::memory_order_release);
+}
+
+int LoopBufferManager::getSlotLength(int slotIndex) const
+{
+    if (slotIndex < 0 || slotIndex >= numSlots)
+        return 0;
+    
+    return slots[static_cast<size_t>(slotIndex)].loopLengthSamples.load(std::memory_order_acquire);
+}
+
+bool LoopBufferManager::isStorageReady(int slotIndex) const
+{
+    return getStorageState(slotIndex) == StorageState::Allocated;
+}
+
+LoopBufferManager::StorageState LoopBufferManager::getStorageState(int slotIndex) const
+{
+    return slots[static_cast<size_t>(slotIndex)].storageState.load(std::memory_order_acquire);
+}
+
+size_t LoopBufferManager::getStorageBytes() const
+{
+    size_t bytes = 0;
+    
+    for (const auto& slot : slots)
+    {
+        switch (slot.storageState.load(std::memory_order_acquire))
+        {
+            case StorageState::Allocated:
+            case StorageState::Compacting:
+                bytes += slot.circularBuffer.getStorageBytes();
+                break;
+            
+            case StorageState::Compact:
+            case StorageState::Expanding:
+                bytes += slot.compactStore.getStorageBytes();
+                break;
+            
+            default:
+                break;
+        }
+    }
+    
+    return bytes;
 }
 
-void LoopBufferManager::readAudio(juce::AudioBuffer<float>& output, int startSample, int numSamples, float position)
+LoopBufferManager::MemoryStatus LoopBufferManager::getMemoryStatus() const
 {
-    if (!initialized.load(std::memory_order_acquire))
+    MemoryStatus status;
+    
+    for (const auto& slot : slots)
     {
-        output.clear(startSample, numSamples);
+        const auto& memory = slot.circularBuffer.getMemory();
+        status.allocatedBytes += memory.getBytes();
+        status.lockedBytes += memory.getLockedBytes();
+        status.hugePageBytes += memory.getHugePageBytes();
+        status.lockFailures += memory.getLockFailures();
+        status.hugePageFailures += memory.getHugePageFailures();
+    }
+    
+    status.allocationFailures = allocationFailures.load(std::memory_order_acquire);
+    return status;
+}
+
+void LoopBufferManager::requestStorage(int slotIndex)
+{
+    auto& slot = slots[static_cast<size_t>(slotIndex)];
+    auto state = slot.storageState.load(std::memory_order_acquire);
+    
+    if (state == StorageState::Compacting)
+    {
+        // The float buffer is still intact, the worker notices and discards its encoding
+        slot.storageState.compare_exchange_strong(state, StorageState::Allocated);
         return;
     }
     
-    const int currentLoopLength = loopLengthSamples.load(std::memory_order_acquire);
+    StorageState next;
+    if (state == StorageState::Released)
+        next = StorageState::Acquiring;
+    else if (state == StorageState::Compact)
+        next = StorageState::Expanding;
+    else
+        return;
+    
+    if (!slot.storageState.compare_exchange_strong(state, next, std::memory_order_acq_rel))
+        return;
+    
+    if (!jobQueue.submitFromAudioThread(storageJob))
+        slot.storageState.store(state, std::memory_order_release);
+}
+
+void LoopBufferManager::requestCompaction(int slotIndex, bool allowLossy)
+{
+    auto& slot = slots[static_cast<size_t>(slotIndex)];
+    if (slot.loopLengthSamples.load(std::memory_order_acquire) <= 0
+        || slot.storageState.load(std::memory_order_acquire) != StorageState::Allocated)
+        return;
+    
+    // The worker only looks at it after the state change below publishes it
+    slot.lossyCompaction.store(allowLossy, std::memory_order_relaxed);
+    
+    auto expected = StorageState::Allocated;
+    if (!slot.storageState.compare_exchange_strong(expected, StorageState::Compacting, std::memory_order_acq_rel))
+        return;
+    
+    if (!jobQueue.submitFromAudioThread(storageJob))
+        slot.storageState.store(StorageState::Allocated, std::memory_order_release);
+}
+
+void LoopBufferManager::requestStorageRelease()
+{
+    auto& slot = getActive();
+    auto expected = StorageState::Allocated;
+    if (!slot.storageState.compare_exchange_strong(expected, StorageState::Releasing, std::memory_order_acq_rel))
+        return;
+    
+    clearRepetitions(slot);
+    slot.loopLengthSamples.store(0, std::memory_order_release);
+    slot.loopStartIndex.store(0, std::memory_order_release);
+    
+    if (!jobQueue.submitFromAudioThread(storageJob))
+        slot.storageState.store(StorageState::Allocated, std::memory_order_release);
+}
+
+void LoopBufferManager::releaseStorage()
+{
+    storageJob.waitUntilIdle();
+    
+    for (auto& slot : slots)
+    {
+        if (slot.loopLengthSamples.load(std::memory_order_acquire) > 0)
+            continue;
+        
+        slot.storageState.store(StorageState::Released, std::memory_order_release);
+        slot.circularBuffer.release();
+        slot.compactStore.clear();
+        clearRepetitions(slot);
+        slot.loopStartIndex.store(0, std::memory_order_release);
+    }
+}
+
+void LoopBufferManager::setWriteObserver(WriteObserver* observer)
+{
+    writeObserver.store(observer);
+}
+
+void LoopBufferManager::removeWriteObserver()
+{
+    writeObserver.store(nullptr);
+    
+    // Notifications only last for part of a block, so this is a short wait
+    while (activeNotifications.load() > 0)
+        juce::Thread::sleep(1);
+}
+
+void LoopBufferManager::writeAudio(const juce::AudioBuffer<float>& input, int startSample, int numSamples)
+{
+    auto& slot = getActive();
+    if (!initialized.load(std::memory_order_acquire)
+        || slot.storageState.load(std::memory_order_acquire) != StorageState::Allocated)
+        return;
+    
+    notifyWrite(slot.circularBuffer, slot.circularBuffer.getWritePosition(), numSamples);
+    slot.circularBuffer.write(input, startSample, numSamples);
+}
+
+bool LoopBufferManager::readLoop(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition)
+{
+    return mixLoop(output, startSample, numSamples, loopPosition, 0.0f, 1.0f);
+}
+
+bool LoopBufferManager::mixLoop(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition,
+                                float outputGain, float loopGain)
+{
+    return mixLoopFrom(output, startSample, numSamples, loopPosition, outputGain, loopGain, false);
+}
+
+bool LoopBufferManager::readLoopInBackground(juce::AudioBuffer<float>& output, int startSample, int numSamples,
+                                             juce::int64 loopPosition)
+{
+    return mixLoopFrom(output, startSample, numSamples, loopPosition, 0.0f, 1.0f, true);
+}
+
+bool LoopBufferManager::mixLoopFrom(juce::AudioBuffer<float>& output, int startSample, int numSamples, juce::int64 loopPosition,
+                                    float outputGain, float loopGain, bool inBackground)
+{
+    const auto& slot = getActive();
+    const int currentLoopLength = slot.loopLengthSamples.load(std::memory_order_acquire);
+    if (!initialized.load(std::memory_order_acquire) || currentLoopLength <= 0)
+    {
+        output.applyGain(startSample, numSamples, outputGain);
+        return false;
+    }
+    
+    // Announce the read before looking at the state, so the worker cannot free what we pick
+    activeReaders.fetch_add(1);
+    const auto state = slot.storageState.load();
+    const bool fromFloat = state == StorageState::Allocated || state == StorageState::Compacting;
+    const bool fromCompact = state == StorageState::Compact || state == StorageState::Expanding;
+    
+    if (!fromFloat && !fromCompact)
+    {
+        activeReaders.fetch_sub(1, std::memory_order_release);
+        output.applyGain(startSample, numSamples, outputGain);
+        return false;
+    }
+    
+    // Read relative to the loop origin, wrapping at the loop end
+    int loopOffset = wrapLoopPosition(loopPosition, currentLoopLength);
+    int outputSample = startSample;
+    int samplesRemaining = numSamples;
+    bool audible = false;
+    
+    while (samplesRemaining > 0)
+    {
+        const int chunkSize = juce::jmin(samplesRemaining, currentLoopLength - loopOffset);
+        
+        if (fromFloat)
+            audible = mixMapped(slot, output, outputSample, chunkSize, loopOffset, outputGain, loopGain) || audible;
+        else if (inBackground)
+            audible = slot.compactStore.read(output, outputSample, chunkSize, loopOffset) || audible;
+        else
+            audible = slot.compactStore.mix(output, outputSample, chunkSize, loopOffset, outputGain, loopGain) || audible;
+        
+        outputSample += chunkSize;
+        samplesRemaining -= chunkSize;
+        loopOffset = 0;
+    }
+    
+    activeReaders.fetch_sub(1, std::memory_order_release);
+    return audible;
+}
+
+void LoopBufferManager::writeLoop(const juce::AudioBuffer<float>& input, int startSample, int numSamples, juce::int64 loopPosition)
+{
+    auto& slot = getActive();
+    if (!initialized.load(std::memory_order_acquire)
+        || slot.storageState.load(std::memory_order_acquire) != StorageState::Allocated)
+        return;
+    
+    const int currentLoopLength = slot.loopLengthSamples.load(std::memory_order_acquire);
     if (currentLoopLength <= 0)
+        return;
+    
+    // Write relative to the loop origin, wrapping at the loop end
+    const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+    int loopOffset = wrapLoopPosition(loopPosition, currentLoopLength);
+    int inputSample = startSample;
+    int samplesRemaining = numSamples;
+    
+    while (samplesRemaining > 0)
+    {
+        const int chunkSize = juce::jmin(samplesRemaining, currentLoopLength - loopOffset);
+        materializeRepetitions(slot, loopOffset, chunkSize);
+        notifyWrite(slot.circularBuffer, loopStart + loopOffset, chunkSize);
+        slot.circularBuffer.writeAt(input, inputSample, chunkSize, loopStart + loopOffset);
+        markDirty(loopOffset, chunkSize, currentLoopLength);
+        
+        inputSample += chunkSize;
+        samplesRemaining -= chunkSize;
+        loopOffset = 0;
+    }
+}
+
+float LoopBufferManager::getLoopPeak(int loopOffset, int numSamples) const
+{
+    const auto& slot = getActive();
+    const int currentLoopLength = slot.loopLengthSamples.load(std::memory_order_acquire);
+    if (!initialized.load(std::memory_order_acquire) || currentLoopLength <= 0 || numSamples <= 0)
+        return 0.0f;
+    
+    // Same guard as readLoop(), the editor may ask while the worker converts storage
+    activeReaders.fetch_add(1);
+    const auto state = slot.storageState.load();
+    const bool fromFloat = state == StorageState::Allocated || state == StorageState::Compacting;
+    const bool fromCompact = state == StorageState::Compact || state == StorageState::Expanding;
+    
+    const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+    loopOffset = wrapLoopPosition(loopOffset, currentLoopLength);
+    numSamples = juce::jmin(numSamples, currentLoopLength);
+    float peak = 0.0f;
+    
+    while (numSamples > 0 && (fromFloat || fromCompact))
+    {
+        // Repetitions that were never written show the peaks of the first period
+        int chunkSize = juce::jmin(numSamples, currentLoopLength - loopOffset);
+        if (fromFloat)
+        {
+            const int storedOffset = mapLoopOffset(slot, loopOffset, chunkSize);
+            peak = juce::jmax(peak, slot.circularBuffer.getPeak(loopStart + storedOffset, chunkSize));
+        }
+        else
+        {
+            peak = juce::jmax(peak, slot.compactStore.getPeak(loopOffset, chunkSize));
+        }
+        
+        numSamples -= chunkSize;
+        loopOffset = (loopOffset + chunkSize) % currentLoopLength;
+    }
+    
+    activeReaders.fetch_sub(1, std::memory_order_release);
+    return peak;
+}
+
+void LoopBufferManager::readAbsolute(juce::AudioBuffer<float>& output, int startSample, int numSamples, int bufferIndex) const
+{
+    const auto& slot = getActive();
+    const int loopLength = slot.loopLengthSamples.load(std::memory_order_acquire);
+    
+    if (slot.periodSamples.load(std::memory_order_acquire) == 0)
     {
-        output.clear(startSample, numSamples);
+        slot.circularBuffer.readFrom(output, startSample, numSamples, bufferIndex);
         return;
     }
     
-    // Calculate read offset based on position within the loop
-    const int readOffset = static_cast<int>(position * currentLoopLength);
-    circularBuffer.read(output, startSample, numSamples, readOffset);
+    // Inside the loop, read what it plays there; outside, the buffer as it is
+    const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+    const int bufferMask = slot.circularBuffer.getBufferSize() - 1;
+    
+    while (numSamples > 0)
+    {
+        const int loopOffset = (bufferIndex - loopStart) & bufferMask;
+        int length = 0;
+        
+        if (loopOffset < loopLength)
+        {
+            length = juce::jmin(numSamples, loopLength - loopOffset);
+            mixMapped(slot, output, startSample, length, loopOffset, 0.0f, 1.0f);
+        }
+        else
+        {
+            length = juce::jmin(numSamples, bufferMask + 1 - loopOffset);
+            slot.circularBuffer.readFrom(output, startSample, length, bufferIndex);
+        }
+        
+        startSample += length;
+        bufferIndex += length;
+        numSamples -= length;
+    }
+}
+
+void LoopBufferManager::beginLoop()
+{
+    auto& slot = getActive();
+    clearRepetitions(slot);
+    slot.loopStartIndex.store(slot.circularBuffer.getWritePosition(), std::memory_order_release);
+}
+
+void LoopBufferManager::setLoopBoundary(int startIndex, int lengthInSamples)
+{
+    if (lengthInSamples <= 0 || lengthInSamples > maxBufferSize)
+        return;
+    
+    auto& slot = getActive();
+    const int bufferMask = slot.circularBuffer.getBufferSize() - 1;
+    clearRepetitions(slot);
+    slot.loopStartIndex.store(startIndex & bufferMask, std::memory_order_release);
+    slot.loopLengthSamples.store(lengthInSamples, std::memory_order_release);
 }
 
 void LoopBufferManager::setLoopLength(int lengthInSamples)
 {
     if (lengthInSamples >= 0 && lengthInSamples <= maxBufferSize)
     {
-        loopLengthSamples.store(lengthInSamples, std::memory_order_release);
+        clearRepetitions(getActive());
+        getActive().loopLengthSamples.store(lengthInSamples, std::memory_order_release);
+    }
+}
+
+bool LoopBufferManager::multiplyLoop(int factor)
+{
+    auto& slot = getActive();
+    const int length = slot.loopLengthSamples.load(std::memory_order_acquire);
+    if (factor < 2 || length <= 0 || static_cast<juce::int64>(length) * factor > maxBufferSize
+        || slot.storageState.load(std::memory_order_acquire) != StorageState::Allocated)
+        return false;
+    
+    const int period = slot.periodSamples.load(std::memory_order_acquire);
+    if (period == 0)
+    {
+        // The level is in place before the period makes readers look for it
+        slot.repeatedLengths[0].store(length, std::memory_order_release);
+        slot.numRepetitionLevels.store(1, std::memory_order_release);
+        slot.periodSamples.store(length, std::memory_order_release);
+    }
+    else
+    {
+        // The new repetitions repeat the whole loop as it plays now, overdubbed repetitions included
+        const int levels = slot.numRepetitionLevels.load(std::memory_order_acquire);
+        if (levels >= maxRepetitionLevels)
+            return false;
+        
+        if (length % repetitionPageSize != 0 && isPageMaterialized(slot, length / repetitionPageSize))
+        {
+            // The page across the old end has its own memory, but past the end it holds what a divided-away
+            // part left there; give that part what it repeats like any other new repetition
+            const int pageEnd = juce::jmin((length / repetitionPageSize + 1) * repetitionPageSize, length * factor);
+            const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+            
+            for (int offset = length; offset < pageEnd;)
+            {
+                const int repeatedOffset = offset % length;
+                int runLength = juce::jmin(pageEnd - offset, length - repeatedOffset);
+                const int sourceOffset = mapLoopOffset(slot, repeatedOffset, runLength);
+                notifyWrite(slot.circularBuffer, loopStart + offset, runLength);
+                slot.circularBuffer.copyWithin(loopStart + sourceOffset, loopStart + offset, runLength);
+                offset += runLength;
+            }
+        }
+        
+        slot.repeatedLengths[static_cast<size_t>(levels)].store(length, std::memory_order_release);
+        slot.numRepetitionLevels.store(levels + 1, std::memory_order_release);
+    }
+    
+    slot.loopLengthSamples.store(length * factor, std::memory_order_release);
+    dirtyRegions.store(~juce::uint64{0}, std::memory_order_release);
+    return true;
+}
+
+bool LoopBufferManager::divideLoop(int divisor)
+{
+    auto& slot = getActive();
+    const int length = slot.loopLengthSamples.load(std::memory_order_acquire);
+    const int newLength = divisor > 1 ? length / divisor : 0;
+    if (newLength <= 0 || slot.storageState.load(std::memory_order_acquire) != StorageState::Allocated)
+        return false;
+    
+    const int period = slot.periodSamples.load(std::memory_order_acquire);
+    if (period == 0 || newLength <= period)
+    {
+        // Within the first period, which is stored as it plays: a plain loop again
+        clearRepetitions(slot);
+    }
+    else
+    {
+        // Repetitions past the new end are forgotten, so a later multiply repeats the loop as it is then
+        if (newLength % period != 0)
+            return false;
+        
+        clearPages(slot, (newLength + repetitionPageSize - 1) / repetitionPageSize);
+        
+        // So are the multiplies that only repeated into the part divided away
+        int levels = slot.numRepetitionLevels.load(std::memory_order_acquire);
+        while (levels > 1 && slot.repeatedLengths[static_cast<size_t>(levels - 1)].load(std::memory_order_acquire) >= newLength)
+            --levels;
+        
+        slot.numRepetitionLevels.store(levels, std::memory_order_release);
+    }
+    
+    slot.loopLengthSamples.store(newLength, std::memory_order_release);
+    dirtyRegions.store(~juce::uint64{0}, std::memory_order_release);
+    return true;
+}
+
+void LoopBufferManager::runStorageTransition(LoopSlot& slot)
+{
+    auto state = slot.storageState.load(std::memory_order_acquire);
+    
+    if (state == StorageState::Releasing)
+    {
+        slot.circularBuffer.release();
+        slot.storageState.store(StorageState::Released, std::memory_order_release);
+    }
+    else if (state == StorageState::Acquiring)
+    {
+        // Without memory the slot stays released, so the next request tries again
+        const bool allocated = allocateStorage(slot);
+        slot.storageState.store(allocated ? StorageState::Allocated : StorageState::Released, std::memory_order_release);
+    }
+    else if (state == StorageState::Compacting)
+    {
+        compactLoop(slot);
+    }
+    else if (state == StorageState::Expanding)
+    {
+        expandLoop(slot);
     }
 }
 
+void LoopBufferManager::compactLoop(LoopSlot& slot)
+{
+    auto& compactStore = slot.compactStore;
+    auto& circularBuffer = slot.circularBuffer;
+    const int length = slot.loopLengthSamples.load(std::memory_order_acquire);
+    
+    compactStore.beginEncoding(maxChannels, length, slot.lossyCompaction.load(std::memory_order_relaxed));
+    transferBuffer.setSize(maxChannels, CompactLoopStore::blockSize);
+    
+    for (int offset = 0; offset < length; offset += CompactLoopStore::blockSize)
+    {
+        // The audio thread took the loop back for writing
+        if (slot.storageState.load(std::memory_order_acquire) != StorageState::Compacting)
+        {
+            compactStore.clear();
+            transferBuffer = juce::AudioBuffer<float>();
+            return;
+        }
+        
+        // Repetitions are stored the way they play, the compact loop has no page map
+        const int blockLength = juce::jmin(CompactLoopStore::blockSize, length - offset);
+        mixMapped(slot, transferBuffer, 0, blockLength, offset, 0.0f, 1.0f);
+        compactStore.encodeBlock(transferBuffer, blockLength);
+    }
+    
+    compactStore.finishEncoding();
+    transferBuffer = juce::AudioBuffer<float>();
+    
+    auto expected = StorageState::Compacting;
+    if (!slot.storageState.compare_exchange_strong(expected, StorageState::Compact))
+    {
+        compactStore.clear();
+        return;
+    }
+    
+    waitForReaders();
+    clearRepetitions(slot);
+    circularBuffer.release();
+}
+
+void LoopBufferManager::expandLoop(LoopSlot& slot)
+{
+    auto& compactStore = slot.compactStore;
+    auto& circularBuffer = slot.circularBuffer;
+    const int length = compactStore.getLength();
+    
+    // Keep playing from the compact store if there is no memory to expand into
+    if (!allocateStorage(slot))
+    {
+        slot.storageState.store(StorageState::Compact, std::memory_order_release);
+        return;
+    }
+    
+    transferBuffer.setSize(maxChannels, CompactLoopStore::blockSize);
+    
+    // The expanded loop starts at the buffer origin
+    for (int offset = 0; offset < length; offset += CompactLoopStore::blockSize)
+    {
+        const int blockLength = juce::jmin(CompactLoopStore::blockSize, length - offset);
+        compactStore.read(transferBuffer, 0, blockLength, offset);
+        circularBuffer.writeAt(transferBuffer, 0, blockLength, offset);
+    }
+    
+    transferBuffer = juce::AudioBuffer<float>();
+    slot.loopStartIndex.store(0, std::memory_order_release);
+    slot.storageState.store(StorageState::Allocated);
+    
+    waitForReaders();
+    compactStore.clear();
+}
+
+bool LoopBufferManager::allocateStorage(LoopSlot& slot)
+{
+    const auto& memory = slot.circularBuffer.getMemory();
+    const int previousLockFailures = memory.getLockFailures();
+    const int previousHugePageFailures = memory.getHugePageFailures();
+    
+    if (!slot.circularBuffer.allocate())
+    {
+        // Requests keep retrying, only the first failure is logged
+        if (allocationFailures.fetch_add(1, std::memory_order_acq_rel) == 0)
+            juce::Logger::writeToLog("OpenLooper2: could not allocate loop memory, the slot stays silent");
+        return false;
+    }
+    
+    // Still usable, but the first touches from the audio thread may fault again later
+    if (memory.getLockFailures() != previousLockFailures)
+        juce::Logger::writeToLog("OpenLooper2: could not lock " + juce::File::descriptionOfSizeInBytes(static_cast<juce::int64>(memory.getBytes()))
+                                 + " of loop memory, raise the memlock limit to keep it resident");
+    
+    if (memory.getHugePageFailures() != previousHugePageFailures)
+        juce::Logger::writeToLog("OpenLooper2: no huge pages reserved for loop memory, using normal pages");
+    
+    return true;
+}
+
+int LoopBufferManager::mapLoopOffset(const LoopSlot& slot, int loopOffset, int& runLength) const
+{
+    const int period = slot.periodSamples.load(std::memory_order_acquire);
+    if (period == 0)
+        return loopOffset;
+    
+    // Follow a repetition back to what it repeats until the samples are found in their own place;
+    // a level is never dropped to zero while the loop is multiplied
+    int level = slot.numRepetitionLevels.load(std::memory_order_acquire) - 1;
+    
+    while (loopOffset >= period)
+    {
+        const int page = loopOffset / repetitionPageSize;
+        runLength = juce::jmin(runLength, (page + 1) * repetitionPageSize - loopOffset);
+        
+        if (isPageMaterialized(slot, page))
+            return loopOffset;
+        
+        // The latest multiply that reached this offset is the one whose repetition it is in,
+        // and the run ends where the repetitions of a later one begin
+        int repeatedLength = slot.repeatedLengths[static_cast<size_t>(level)].load(std::memory_order_acquire);
+        while (level > 0 && repeatedLength > loopOffset)
+        {
+            runLength = juce::jmin(runLength, repeatedLength - loopOffset);
+            repeatedLength = slot.repeatedLengths[static_cast<size_t>(--level)].load(std::memory_order_acquire);
+        }
+        
+        loopOffset %= repeatedLength;
+        runLength = juce::jmin(runLength, repeatedLength - loopOffset);
+    }
+    
+    // The first period is always stored in place
+    runLength = juce::jmin(runLength, period - loopOffset);
+    return loopOffset;
+}
+
+bool LoopBufferManager::mixMapped(const LoopSlot& slot, juce::AudioBuffer<float>& output, int startSample, int numSamples,
+                                  int loopOffset, float outputGain, float loopGain) const
+{
+    const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+    bool audible = false;
+    
+    while (numSamples > 0)
+    {
+        int runLength = numSamples;
+        const int storedOffset = mapLoopOffset(slot, loopOffset, runLength);
+        
+        if (slot.circularBuffer.mixFrom(output, startSample, runLength, loopStart + storedOffset, outputGain, loopGain))
+            audible = true;
+        
+        startSample += runLength;
+        loopOffset += runLength;
+        numSamples -= runLength;
+    }
+    
+    return audible;
+}
+
+void LoopBufferManager::materializeRepetitions(LoopSlot& slot, int loopOffset, int numSamples, int firstLevel)
+{
+    const int period = slot.periodSamples.load(std::memory_order_acquire);
+    if (period == 0)
+        return;
+    
+    materializePages(slot, loopOffset, numSamples);
+    
+    // Every repetition still reading the range would change along with it, and so would the later
+    // repetitions reading that one
+    const int length = slot.loopLengthSamples.load(std::memory_order_acquire);
+    const int levels = slot.numRepetitionLevels.load(std::memory_order_acquire);
+    
+    for (int level = firstLevel; level < levels; ++level)
+    {
+        const int repeatedLength = slot.repeatedLengths[static_cast<size_t>(level)].load(std::memory_order_acquire);
+        if (loopOffset >= repeatedLength)
+            continue;
+        
+        // This multiply's repetitions run up to where the next one starts
+        const int levelEnd = level + 1 < levels
+            ? slot.repeatedLengths[static_cast<size_t>(level + 1)].load(std::memory_order_acquire)
+            : length;
+        const int repeatedSamples = juce::jmin(numSamples, repeatedLength - loopOffset);
+        
+        for (int repetition = repeatedLength; repetition + loopOffset < levelEnd; repetition += repeatedLength)
+            materializeRepetitions(slot, repetition + loopOffset,
+                                   juce::jmin(repeatedSamples, levelEnd - repetition - loopOffset), level + 1);
+    }
+}
+
+void LoopBufferManager::materializePages(LoopSlot& slot, int loopOffset, int numSamples)
+{
+    const int period = slot.periodSamples.load(std::memory_order_acquire);
+    const int length = slot.loopLengthSamples.load(std::memory_order_acquire);
+    const int loopStart = slot.loopStartIndex.load(std::memory_order_acquire);
+    if (loopOffset + numSamples <= period)
+        return;
+    
+    const int firstPage = juce::jmax(loopOffset, period) / repetitionPageSize;
+    const int lastPage = (loopOffset + numSamples - 1) / repetitionPageSize;
+    
+    for (int page = firstPage; page <= lastPage; ++page)
+    {
+        if (isPageMaterialized(slot, page))
+            continue;
+        
+        // Copy what the page shows into its own place; the part inside the first period already is there
+        const int pageEnd = juce::jmin((page + 1) * repetitionPageSize, length);
+        for (int offset = juce::jmax(page * repetitionPageSize, period); offset < pageEnd;)
+        {
+            int runLength = pageEnd - offset;
+            const int sourceOffset = mapLoopOffset(slot, offset, runLength);
+            notifyWrite(slot.circularBuffer, loopStart + offset, runLength);
+            slot.circularBuffer.copyWithin(loopStart + sourceOffset, loopStart + offset, runLength);
+            offset += runLength;
+        }
+        
+        slot.materializedPages[page / 32].fetch_or(juce::uint32{1} << (page % 32), std::memory_order_release);
+    }
+}
+
+bool LoopBufferManager::isPageMaterialized(const LoopSlot& slot, int page) const
+{
+    return (slot.materializedPages[page / 32].load(std::memory_order_acquire) >> (page % 32)) & 1;
+}
+
+void LoopBufferManager::clearPages(LoopSlot& slot, int firstPage)
+{
+    for (int word = firstPage / 32; word < slot.numPageWords; ++word)
+    {
+        // The first word may keep the pages before firstPage
+        const juce::uint32 keep = word == firstPage / 32 ? (juce::uint32{1} << (firstPage % 32)) - 1 : 0;
+        slot.materializedPages[word].fetch_and(keep, std::memory_order_release);
+    }
+}
+
+void LoopBufferManager::clearRepetitions(LoopSlot& slot)
+{
+    if (slot.periodSamples.exchange(0, std::memory_order_acq_rel) != 0)
+        clearPages(slot, 0);
+}
+
+void LoopBufferManager::waitForReaders() const
+{
+    // Readers only last for one block, so this is a short wait
+    while (activeReaders.load() > 0)
+        juce::Thread::sleep(1);
+}
+
+void LoopBufferManager::notifyWrite(const CircularAudioBuffer& circularBuffer, int bufferIndex, int numSamples)
+{
+    // Announce the call before looking at the observer, so it cannot be removed underneath us
+    activeNotifications.fetch_add(1);
+    
+    if (auto* observer = writeObserver.load())
+        observer->aboutToOverwrite(bufferIndex & (circularBuffer.getBufferSize() - 1), numSamples);
+    
+    activeNotifications.fetch_sub(1, std::memory_order_release);
+}
+
+void LoopBufferManager::markDirty(int loopOffset, int numSamples, int loopLength)
+{
+    if (numSamples >= loopLength)
+    {
+        dirtyRegions.store(~juce::uint64{0}, std::memory_order_release);
+        return;
+    }
+    
+    // Callers never pass a range that wraps, so the regions are contiguous
+    const int firstRegion = static_cast<int>(static_cast<juce::int64>(loopOffset) * numDirtyRegions / loopLength);
+    const int lastRegion = static_cast<int>(static_cast<juce::int64>(loopOffset + numSamples - 1) * numDirtyRegions / loopLength);
+    
+    juce::uint64 bits = 0;
+    for (int region = firstRegion; region <= lastRegion; ++region)
+        bits |= juce::uint64{1} << region;
+    
+    dirtyRegions.fetch_or(bits, std::memory_order_release);
+}
+
 float LoopBufferManager::getLoopLengthSeconds() const
 {
-    const int lengthSamples = loopLengthSamples.load(std::memory_order_acquire);
+    const int lengthSamples = getLoopLength();
     return static_cast<float>(lengthSamples / sampleRate);
 }
 
 void LoopBufferManager::clear()
 {
-    if (initialized.load(std::memory_order_acquire))
+    auto& slot = getActive();
+    if (initialized.load(std::memory_order_acquire) && isStorageReady())
     {
-        circularBuffer.clear();
-        loopLengthSamples.store(0, std::memory_order_release);
+        slot.circularBuffer.clear();
+        clearRepetitions(slot);
+        slot.loopLengthSamples.store(0, std::memory_order_release);
+        slot.loopStartIndex.store(0, std::memory_order_release);
     }
 }
 
@@ -0,0 +1,229 @@
+#include "OpenLooper2/LoopExporter.h"
+
+namespace OpenLooper2 {
+
+LoopExporter::LoopExporter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue)
+    : BackgroundJob(Priority::Normal),
+      bufferManager(bufferManager),
+      jobQueue(jobQueue)
+{
+}
+
+LoopExporter::~LoopExporter()
+{
+    cancelExport();
+    jobQueue.retractJob(*this);
+}
+
+bool LoopExporter::requestExport(const juce::File& file, Format format, int numChannels, double sampleRate)
+{
+    if (isExporting())
+        return false;
+
+    // The worker may still be finishing the previous file, its settings cannot be replaced before that
+    if (!waitUntilIdle(10000))
+        return false;
+
+    const int loopLength = bufferManager.getLoopLength();
+    if (loopLength <= 0 || numChannels <= 0)
+        return false;
+
+    destination = file;
+    this->format = format;
+    this->sampleRate = sampleRate;
+
+    snapshot.setSize(numChannels, loopLength);
+    snapshotChannels = snapshot.getArrayOfWritePointers();
+    transferBuffer.setSize(numChannels, chunkSize * transferChunks);
+
+    numChunks = (loopLength + chunkSize - 1) / chunkSize;
+    chunkStates = std::make_unique<std::atomic<ChunkState>[]>(static_cast<size_t>(numChunks));
+    for (int i = 0; i < numChunks; ++i)
+        chunkStates[i].store(ChunkState::Pending, std::memory_order_relaxed);
+
+    state.store(State::Requested, std::memory_order_release);
+    return true;
+}
+
+void LoopExporter::beginSnapshot()
+{
+    auto expected = State::Requested;
+    const int loopLength = bufferManager.getLoopLength();
+
+    // The loop grew past the memory reserved for it since the request
+    if (loopLength <= 0 || loopLength > snapshot.getNumSamples())
+    {
+        state.compare_exchange_strong(expected, State::Failed, std::memory_order_acq_rel);
+        return;
+    }
+
+    snapshotStart.store(bufferManager.getLoopStart(), std::memory_order_relaxed);
+    snapshotLength.store(loopLength, std::memory_order_relaxed);
+
+    // From here on every write into the loop preserves the chunks it touches first
+    bufferManager.setWriteObserver(this);
+
+    if (!state.compare_exchange_strong(expected, State::Exporting, std::memory_order_acq_rel))
+    {
+        bufferManager.setWriteObserver(nullptr);
+        return;
+    }
+
+    if (!jobQueue.submitFromAudioThread(*this))
+    {
+        bufferManager.setWriteObserver(nullptr);
+        state.store(State::Failed, std::memory_order_release);
+    }
+}
+
+void LoopExporter::cancelExport()
+{
+    auto expected = State::Requested;
+    state.compare_exchange_strong(expected, State::Idle, std::memory_order_acq_rel);
+
+    cancel();
+    waitUntilIdle();
+
+    // A queued job that was dropped never got to clean up after itself
+    expected = State::Exporting;
+    if (state.compare_exchange_strong(expected, State::Idle, std::memory_order_acq_rel))
+        bufferManager.removeWriteObserver();
+
+    releaseSnapshot();
+}
+
+bool LoopExporter::isExporting() const
+{
+    const auto current = state.load(std::memory_order_acquire);
+    return current == State::Requested || current == State::Exporting;
+}
+
+void LoopExporter::run()
+{
+    const bool copied = copyLoop();
+
+    // The snapshot is complete once no preservation can be in flight anymore
+    bufferManager.removeWriteObserver();
+
+    const bool written = copied && writeFile();
+    releaseSnapshot();
+
+    if (!shouldCancel())
+        state.store(written ? State::Succeeded : State::Failed, std::memory_order_release);
+}
+
+void LoopExporter::aboutToOverwrite(int bufferIndex, int numSamples)
+{
+    const int start = snapshotStart.load(std::memory_order_relaxed);
+    const int length = snapshotLength.load(std::memory_order_relaxed);
+    const int bufferMask = bufferManager.getBufferSize() - 1;
+
+    while (numSamples > 0)
+    {
+        const int loopOffset = (bufferIndex - start) & bufferMask;
+        int step = 0;
+
+        if (loopOffset < length)
+        {
+            const int chunkIndex = loopOffset / chunkSize;
+            preserveChunk(chunkIndex);
+            step = juce::jmin(chunkSize * (chunkIndex + 1), length) - loopOffset;
+        }
+        else
+        {
+            // Outside the captured loop, skip ahead to where the buffer wraps into it again
+            step = bufferMask + 1 - loopOffset;
+        }
+
+        step = juce::jmin(step, numSamples);
+        bufferIndex += step;
+        numSamples -= step;
+    }
+}
+
+void LoopExporter::preserveChunk(int chunkIndex)
+{
+    auto expected = ChunkState::Pending;
+    if (!chunkStates[chunkIndex].compare_exchange_strong(expected, ChunkState::Preserving))
+        return;
+
+    const int offset = chunkIndex * chunkSize;
+    const int length = juce::jmin(chunkSize, snapshotLength.load(std::memory_order_relaxed) - offset);
+
+    // Refers to the snapshot's channel data, nothing is allocated
+    juce::AudioBuffer<float> target(snapshotChannels, snapshot.getNumChannels(), offset, length);
+    bufferManager.readAbsolute(target, 0, length, snapshotStart.load(std::memory_order_relaxed) + offset);
+
+    chunkStates[chunkIndex].store(ChunkState::Copied, std::memory_order_release);
+}
+
+bool LoopExporter::copyLoop()
+{
+    const int start = snapshotStart.load(std::memory_order_relaxed);
+    const int length = snapshotLength.load(std::memory_order_relaxed);
+
+    for (int offset = 0; offset < length; offset += transferBuffer.getNumSamples())
+    {
+        if (shouldCancel())
+            return false;
+
+        const int transferLength = juce::jmin(transferBuffer.getNumSamples(), length - offset);
+        bufferManager.readAbsolute(transferBuffer, 0, transferLength, start + offset);
+
+        // Only chunks the audio thread has not touched yet hold the content read above
+        for (int done = 0; done < transferLength; done += chunkSize)
+        {
+            auto expected = ChunkState::Pending;
+            if (!chunkStates[(offset + done) / chunkSize].compare_exchange_strong(expected, ChunkState::Copied))
+                continue;
+
+            const int count = juce::jmin(chunkSize, transferLength - done);
+            for (int channel = 0; channel < snapshot.getNumChannels(); ++channel)
+                juce::FloatVectorOperations::copy(snapshotChannels[channel] + offset + done,
+                                                  transferBuffer.getReadPointer(channel, done), count);
+        }
+    }
+
+    return true;
+}
+
+bool LoopExporter::writeFile() const
+{
+    auto stream = destination.createOutputStream();
+    if (stream == nullptr || !stream->openedOk())
+        return false;
+
+    // Replace an existing file instead of appending to it
+    stream->setPosition(0);
+    stream->truncate();
+
+    std::unique_ptr<juce::AudioFormat> audioFormat;
+    if (format == Format::Flac)
+        audioFormat = std::make_unique<juce::FlacAudioFormat>();
+    else
+        audioFormat = std::make_unique<juce::WavAudioFormat>();
+
+    std::unique_ptr<juce::AudioFormatWriter> writer(audioFormat->createWriterFor(
+        stream.get(), sampleRate, static_cast<unsigned int>(snapshot.getNumChannels()), bitsPerSample, {}, 0));
+
+    if (writer == nullptr)
+        return false;
+
+    // The writer owns the stream from here on
+    stream.release();
+
+    const int length = snapshotLength.load(std::memory_order_relaxed);
+    return writer->writeFromAudioSampleBuffer(snapshot, 0, length) && writer->flush();
+}
+
+void LoopExporter::releaseSnapshot()
+{
+    // Exported loops can be tens of megabytes
+    snapshot = juce::AudioBuffer<float>();
+    snapshotChannels = nullptr;
+    transferBuffer = juce::AudioBuffer<float>();
+    chunkStates.reset();
+    numChunks = 0;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "OpenLooper2/LoopImporter.h"
+#include <cmath>
+
+namespace OpenLooper2 {
+
+LoopImporter::LoopImporter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue)
+    : BackgroundJob(Priority::Normal),
+      bufferManager(bufferManager),
+      jobQueue(jobQueue)
+{
+    formatManager.registerBasicFormats();
+}
+
+LoopImporter::~LoopImporter()
+{
+    cancelImport();
+    jobQueue.retractJob(*this);
+}
+
+bool LoopImporter::requestImport(const juce::File& file, double sampleRate, int numChannels)
+{
+    if (isImporting() || numChannels <= 0)
+        return false;
+
+    // The worker may still be closing the previous file, its settings cannot be replaced before that
+    if (!waitUntilIdle(10000))
+        return false;
+
+    source = file;
+    this->sampleRate = sampleRate;
+    this->numChannels = numChannels;
+    availableLength.store(0, std::memory_order_release);
+
+    // Opening reads the file header, which can be slow on network drives
+    state.store(State::Opening, std::memory_order_release);
+    if (!jobQueue.submit(*this))
+    {
+        state.store(State::Failed, std::memory_order_release);
+        return false;
+    }
+
+    return true;
+}
+
+int LoopImporter::beginStreaming()
+{
+    auto expected = State::Ready;
+    if (!state.compare_exchange_strong(expected, State::Streaming, std::memory_order_acq_rel))
+        return 0;
+
+    // The worker appends from the new loop origin on; nothing of it is readable yet
+    availableLength.store(0, std::memory_order_release);
+    bufferManager.beginLoop();
+    bufferManager.setLoopLength(loopLength);
+
+    if (!jobQueue.submitFromAudioThread(*this))
+    {
+        bufferManager.setLoopLength(0);
+        state.store(State::Failed, std::memory_order_release);
+        return 0;
+    }
+
+    return loopLength;
+}
+
+void LoopImporter::cancelImport()
+{
+    auto expected = State::Ready;
+    state.compare_exchange_strong(expected, State::Idle, std::memory_order_acq_rel);
+
+    cancel();
+    waitUntilIdle();
+
+    const auto current = state.load(std::memory_order_acquire);
+    if (current == State::Opening || current == State::Streaming)
+        state.store(State::Idle, std::memory_order_release);
+
+    releaseDecoder();
+}
+
+bool LoopImporter::isImporting() const
+{
+    const auto current = state.load(std::memory_order_acquire);
+    return current == State::Opening || current == State::Ready || current == State::Streaming;
+}
+
+void LoopImporter::run()
+{
+    const auto current = state.load(std::memory_order_acquire);
+
+    if (current == State::Opening)
+    {
+        const bool opened = openFile();
+        if (!shouldCancel())
+            state.store(opened ? State::Ready : State::Failed, std::memory_order_release);
+
+        if (!opened)
+            releaseDecoder();
+    }
+    else if (current == State::Streaming)
+    {
+        const bool streamed = streamFile();
+        releaseDecoder();
+
+        if (!shouldCancel())
+            state.store(streamed ? State::Succeeded : State::Failed, std::memory_order_release);
+    }
+}
+
+bool LoopImporter::openFile()
+{
+    reader.reset(formatManager.createReaderFor(source));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+        return false;
+
+    const int maxLength = bufferManager.getMaxBufferSize();
+    resampling = reader->sampleRate != sampleRate;
+
+    if (resampling)
+    {
+        resampler.prepare(reader->sampleRate, sampleRate);
+
+        // Read no more input than it takes to fill the longest possible loop
+        const auto maxInput = static_cast<juce::int64>(std::ceil(maxLength * reader->sampleRate / sampleRate));
+        fileLength = static_cast<int>(juce::jmin(reader->lengthInSamples, maxInput));
+        loopLength = juce::jmin(resampler.getOutputLength(fileLength), maxLength);
+        decodedFile.setSize(numChannels, fileLength);
+    }
+    else
+    {
+        fileLength = static_cast<int>(juce::jmin(reader->lengthInSamples, static_cast<juce::int64>(maxLength)));
+        loopLength = fileLength;
+    }
+
+    sectionBuffer.setSize(numChannels, sectionSize);
+    return loopLength > 0;
+}
+
+bool LoopImporter::streamFile()
+{
+    if (reader == nullptr)
+        return false;
+
+    return resampling ? streamResampled() : streamDirect();
+}
+
+bool LoopImporter::streamDirect()
+{
+    for (int offset = 0; offset < loopLength; offset += sectionSize)
+    {
+        if (shouldCancel())
+            return false;
+
+        const int length = juce::jmin(sectionSize, loopLength - offset);
+        if (!reader->read(&sectionBuffer, 0, length, offset, true, true))
+            return false;
+
+        publishSection(length);
+    }
+
+    return true;
+}
+
+bool LoopImporter::streamResampled()
+{
+    const int totalOutput = resampler.getOutputLength(fileLength);
+    const int lookahead = resampler.getInputLookahead();
+    const double step = static_cast<double>(fileLength) / totalOutput;
+
+    // The loop start filters across the seam, so the end of the file is needed first
+    const int tailStart = juce::jmax(0, fileLength - lookahead);
+    if (!reader->read(&decodedFile, tailStart, fileLength - tailStart, tailStart, true, true))
+        return false;
+
+    int decoded = 0;
+    int produced = 0;
+
+    while (produced < loopLength)
+    {
+        if (shouldCancel())
+            return false;
+
+        if (decoded < tailStart)
+        {
+            const int length = juce::jmin(sectionSize, tailStart - decoded);
+            if (!reader->read(&decodedFile, decoded, length, decoded, true, true))
+                return false;
+
+            decoded += length;
+        }
+        else
+        {
+            decoded = fileLength;
+        }
+
+        // Output samples whose filter window lies entirely in the decoded input
+        const int ready = decoded == fileLength
+                              ? loopLength
+                              : juce::jlimit(0, loopLength, static_cast<int>((decoded - lookahead) / step));
+
+        while (produced < ready)
+        {
+            const int length = juce::jmin(sectionSize, ready - produced);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                resampler.process(decodedFile.getReadPointer(channel), fileLength, totalOutput,
+                                  sectionBuffer.getWritePointer(channel), produced, length);
+
+            publishSection(length);
+            produced += length;
+        }
+    }
+
+    return true;
+}
+
+void LoopImporter::publishSection(int numSamples)
+{
+    bufferManager.writeAudio(sectionBuffer, 0, numSamples);
+    availableLength.store(availableLength.load(std::memory_order_relaxed) + numSamples, std::memory_order_release);
+}
+
+void LoopImporter::releaseDecoder()
+{
+    // A decoded file can be tens of megabytes
+    reader.reset();
+    decodedFile = juce::AudioBuffer<float>();
+    sectionBuffer = juce::AudioBuffer<float>();
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
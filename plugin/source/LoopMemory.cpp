@@ -0,0 +1,170 @@
+#include "OpenLooper2/LoopMemory.h"
+#include <cstdlib>
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+ #include <sys/mman.h>
+ #include <sys/resource.h>
+ #include <unistd.h>
+#endif
+
+namespace OpenLooper2 {
+
+namespace {
+
+constexpr size_t cacheLineSize = 64;
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+size_t roundUp(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+// Bytes locked by all loop memory in the process, checked against RLIMIT_MEMLOCK before locking more
+std::atomic<size_t> processLockedBytes{0};
+
+bool fitsLockLimit(size_t numBytes)
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+        return true;
+
+    return processLockedBytes.load(std::memory_order_acquire) + numBytes <= static_cast<size_t>(limit.rlim_cur);
+}
+#endif
+
+} // namespace
+
+LoopMemory::LoopMemory()
+{
+}
+
+LoopMemory::~LoopMemory()
+{
+    release();
+}
+
+bool LoopMemory::allocate(int numChannels, int numSamples)
+{
+    release();
+
+    if (numChannels <= 0 || numSamples <= 0)
+        return false;
+
+    const size_t channelStride = roundUp(static_cast<size_t>(numSamples) * sizeof(float), cacheLineSize);
+    const size_t requiredBytes = channelStride * static_cast<size_t>(numChannels);
+    size_t numBytes = 0;
+
+   #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+   #if JUCE_LINUX
+    // Reserved huge pages first; they are locked by nature and need no faulting
+    if (useHugePages)
+    {
+        numBytes = roundUp(requiredBytes, hugePageSize);
+        void* memory = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (memory != MAP_FAILED)
+        {
+            data = memory;
+            hugePageBytes.store(numBytes, std::memory_order_release);
+        }
+        else
+        {
+            hugePageFailures.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+   #endif
+
+    if (data == nullptr)
+    {
+        numBytes = roundUp(requiredBytes, pageSize);
+        void* memory = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return false;
+
+        data = memory;
+
+       #if JUCE_LINUX
+        // Without reserved huge pages, let the kernel merge the range into transparent ones
+        if (useHugePages)
+            madvise(data, numBytes, MADV_HUGEPAGE);
+       #endif
+    }
+
+    mapped = true;
+
+    // Anonymous mappings read as zero, so touching each page is all the clearing needed
+    prefault(data, numBytes, hugePageBytes.load(std::memory_order_relaxed) > 0 ? hugePageSize : pageSize);
+
+    if (lockPages)
+    {
+        if (fitsLockLimit(numBytes) && mlock(data, numBytes) == 0)
+        {
+            processLockedBytes.fetch_add(numBytes, std::memory_order_acq_rel);
+            lockedBytes.store(numBytes, std::memory_order_release);
+        }
+        else
+            lockFailures.fetch_add(1, std::memory_order_acq_rel);
+    }
+   #else
+    // No page control here, but the memory is still faulted in before the audio thread sees it
+    numBytes = requiredBytes;
+    data = std::calloc(numBytes, 1);
+    if (data == nullptr)
+        return false;
+
+    prefault(data, numBytes, 4096);
+
+    if (lockPages)
+        lockFailures.fetch_add(1, std::memory_order_acq_rel);
+   #endif
+
+    channelPointers.malloc(static_cast<size_t>(numChannels));
+    for (int channel = 0; channel < numChannels; ++channel)
+        channelPointers[channel] = reinterpret_cast<float*>(static_cast<char*>(data) + channelStride * static_cast<size_t>(channel));
+
+    mappedBytes.store(numBytes, std::memory_order_release);
+    return true;
+}
+
+void LoopMemory::release()
+{
+    if (data == nullptr)
+        return;
+
+    const size_t numBytes = mappedBytes.load(std::memory_order_acquire);
+
+   #if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+    if (mapped)
+    {
+        if (lockedBytes.load(std::memory_order_acquire) > 0)
+        {
+            munlock(data, numBytes);
+            processLockedBytes.fetch_sub(numBytes, std::memory_order_acq_rel);
+        }
+
+        munmap(data, numBytes);
+    }
+   #endif
+
+    if (!mapped)
+        std::free(data);
+
+    data = nullptr;
+    mapped = false;
+    channelPointers.free();
+    mappedBytes.store(0, std::memory_order_release);
+    lockedBytes.store(0, std::memory_order_release);
+    hugePageBytes.store(0, std::memory_order_release);
+}
+
+void LoopMemory::prefault(void* memory, size_t numBytes, size_t pageSize)
+{
+    auto* bytes = static_cast<volatile char*>(memory);
+    for (size_t offset = 0; offset < numBytes; offset += pageSize)
+        bytes[offset] = 0;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "OpenLooper2/LoopRateConverter.h"
+
+namespace OpenLooper2 {
+
+LoopRateConverter::LoopRateConverter(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue)
+    : BackgroundJob(Priority::High),
+      bufferManager(bufferManager),
+      jobQueue(jobQueue)
+{
+}
+
+LoopRateConverter::~LoopRateConverter()
+{
+    jobQueue.retractJob(*this);
+}
+
+bool LoopRateConverter::captureLoop(int numChannels)
+{
+    // A previous conversion must land before its output can be captured again
+    waitUntilIdle();
+
+    const int loopLength = bufferManager.getLoopLength();
+    if (loopLength <= 0)
+        return false;
+
+    // Decoding a compacted loop is most of the work, so it is taken as it is and left to the job
+    capturedChannels = numChannels;
+    if (bufferManager.takeCompactLoop(capturedStore))
+        return true;
+
+    capturedLoop.setSize(numChannels, loopLength);
+    bufferManager.readLoopInBackground(capturedLoop, 0, loopLength, 0);
+    return true;
+}
+
+void LoopRateConverter::startConversion(double sourceRate, double targetRate)
+{
+    this->sourceRate = sourceRate;
+    this->targetRate = targetRate;
+
+    publishedLength.store(-1, std::memory_order_release);
+    jobQueue.submit(*this);
+}
+
+bool LoopRateConverter::getConvertedLength(int& convertedLength)
+{
+    const int length = publishedLength.exchange(-1, std::memory_order_acq_rel);
+    if (length < 0)
+        return false;
+
+    convertedLength = length;
+    return true;
+}
+
+void LoopRateConverter::run()
+{
+    if (capturedStore.getLength() > 0)
+    {
+        capturedLoop.setSize(capturedChannels, capturedStore.getLength());
+        capturedLoop.clear();
+        capturedStore.read(capturedLoop, 0, capturedStore.getLength(), 0);
+        capturedStore.clear();
+    }
+
+    resampler.prepare(sourceRate, targetRate);
+
+    const int sourceLength = capturedLoop.getNumSamples();
+    const int targetLength = resampler.getOutputLength(sourceLength);
+    convertedLoop.setSize(capturedLoop.getNumChannels(), targetLength);
+
+    for (int channel = 0; channel < capturedLoop.getNumChannels(); ++channel)
+    {
+        if (shouldCancel())
+            return;
+
+        resampler.process(capturedLoop.getReadPointer(channel), sourceLength,
+                          convertedLoop.getWritePointer(channel), targetLength);
+    }
+
+    // Loops that grew past the maximum length at the new rate are truncated
+    const int writeLength = juce::jmin(targetLength, bufferManager.getMaxBufferSize());
+    bufferManager.beginLoop();
+    bufferManager.writeAudio(convertedLoop, 0, writeLength);
+    bufferManager.setLoopLength(writeLength);
+
+    // Release the working copies, they can be tens of megabytes
+    capturedLoop = juce::AudioBuffer<float>();
+    convertedLoop = juce::AudioBuffer<float>();
+
+    publishedLength.store(writeLength, std::memory_order_release);
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,243 @@
+#include "OpenLooper2/LoopSlicer.h"
+#include <algorithm>
+
+namespace OpenLooper2 {
+
+int LoopSlicer::SliceMap::getSliceAt(int position) const
+{
+    int slice = bucketSlices[static_cast<size_t>(position >> bucketShift)];
+    if (slice + 1 < numSlices && position >= starts[static_cast<size_t>(slice) + 1])
+        ++slice;
+
+    return slice;
+}
+
+int LoopSlicer::SliceMap::getOrderedSlice(int slice, Order order) const
+{
+    switch (order)
+    {
+        case Order::Reverse:
+            return numSlices - 1 - slice;
+
+        case Order::Shuffle:
+            return shuffleOrder[static_cast<size_t>(slice)];
+
+        case Order::Forward:
+        default:
+            return slice;
+    }
+}
+
+LoopSlicer::LoopSlicer(LoopBufferManager& bufferManager, BackgroundJobQueue& jobQueue)
+    : BackgroundJob(Priority::Low),
+      bufferManager(bufferManager),
+      jobQueue(jobQueue)
+{
+}
+
+LoopSlicer::~LoopSlicer()
+{
+    jobQueue.retractJob(*this);
+}
+
+void LoopSlicer::initialize(int numChannels, int maxLoopLength)
+{
+    cancel();
+    waitUntilIdle();
+
+    for (auto& map : maps)
+    {
+        map.generation = 0;
+        map.loopLength = 0;
+        map.numSlices = 0;
+        map.bucketSlices.assign(static_cast<size_t>(maxLoopLength / bucketSize + 1), 0);
+    }
+
+    publishedMap.store(-1, std::memory_order_release);
+    mapInUse.store(-1, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_acq_rel);
+
+    analysisBuffer.setSize(numChannels, analysisBlockSize);
+    hopEnergy.reserve(static_cast<size_t>(maxLoopLength / analysisHopSize + 1));
+}
+
+void LoopSlicer::requestSlices(Mode mode, int numSlices, int loopLength)
+{
+    requestedMode.store(mode, std::memory_order_relaxed);
+    requestedSlices.store(numSlices, std::memory_order_relaxed);
+    requestedLength.store(loopLength, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    requestPending.store(true, std::memory_order_release);
+
+    jobQueue.submitFromAudioThread(*this);
+}
+
+const LoopSlicer::SliceMap* LoopSlicer::acquireMap()
+{
+    // Claim the published map, then make sure it was not replaced before the claim became visible
+    int index = publishedMap.load();
+    for (;;)
+    {
+        mapInUse.store(index);
+
+        const int current = publishedMap.load();
+        if (current == index)
+            break;
+
+        index = current;
+    }
+
+    if (index < 0)
+        return nullptr;
+
+    const auto& map = maps[static_cast<size_t>(index)];
+    return map.generation == generation.load(std::memory_order_acquire) ? &map : nullptr;
+}
+
+void LoopSlicer::run()
+{
+    // Requests posted while we run are coalesced into the latest one
+    while (!shouldCancel() && requestPending.exchange(false, std::memory_order_acq_rel))
+    {
+        const juce::uint32 requestGeneration = generation.load(std::memory_order_acquire);
+        buildMap(requestedMode.load(std::memory_order_relaxed),
+                 requestedSlices.load(std::memory_order_relaxed),
+                 requestedLength.load(std::memory_order_relaxed),
+                 requestGeneration);
+    }
+}
+
+void LoopSlicer::buildMap(Mode mode, int numSlices, int loopLength, juce::uint32 requestGeneration)
+{
+    auto& map = maps[static_cast<size_t>(getFreeMap())];
+
+    loopLength = juce::jmin(loopLength, static_cast<int>(map.bucketSlices.size()) * bucketSize);
+    if (loopLength < bucketSize)
+        return;
+
+    // Slices are never shorter than a lookup bucket, which keeps getSliceAt() to a single step
+    numSlices = juce::jlimit(1, juce::jmin(maxSlices, loopLength / bucketSize), numSlices);
+
+    if (mode == Mode::Transients && numSlices > 1)
+    {
+        numSlices = findTransientSlices(map, numSlices, loopLength);
+        if (numSlices <= 0)
+            return;
+    }
+    else
+    {
+        for (int slice = 0; slice < numSlices; ++slice)
+            map.starts[static_cast<size_t>(slice)] = static_cast<int>(static_cast<juce::int64>(loopLength) * slice / numSlices);
+    }
+
+    map.starts[static_cast<size_t>(numSlices)] = loopLength;
+    map.numSlices = numSlices;
+    map.loopLength = loopLength;
+
+    int slice = 0;
+    for (int bucket = 0; bucket * bucketSize < loopLength; ++bucket)
+    {
+        while (map.starts[static_cast<size_t>(slice) + 1] <= bucket * bucketSize)
+            ++slice;
+
+        map.bucketSlices[static_cast<size_t>(bucket)] = static_cast<juce::uint8>(slice);
+    }
+
+    // A fixed seed per loop length keeps the shuffle stable while the same loop plays
+    juce::Random random(loopLength);
+    for (int i = 0; i < numSlices; ++i)
+        map.shuffleOrder[static_cast<size_t>(i)] = static_cast<juce::uint8>(i);
+
+    for (int i = numSlices - 1; i > 0; --i)
+        std::swap(map.shuffleOrder[static_cast<size_t>(i)], map.shuffleOrder[static_cast<size_t>(random.nextInt(i + 1))]);
+
+    // Only publish if the audio thread has not asked for another slicing meanwhile
+    if (generation.load(std::memory_order_acquire) != requestGeneration)
+        return;
+
+    map.generation = requestGeneration;
+    publishedMap.store(static_cast<int>(&map - maps.data()));
+}
+
+int LoopSlicer::findTransientSlices(SliceMap& map, int numSlices, int loopLength)
+{
+    const int numHops = loopLength / analysisHopSize;
+    const int channels = analysisBuffer.getNumChannels();
+    hopEnergy.assign(static_cast<size_t>(numHops), 0.0f);
+
+    // Mean energy per hop across channels, read in blocks through the regular loop reader
+    for (int offset = 0; offset < numHops * analysisHopSize; offset += analysisBlockSize)
+    {
+        if (shouldCancel())
+            return 0;
+
+        const int length = juce::jmin(analysisBlockSize, numHops * analysisHopSize - offset);
+        bufferManager.readLoopInBackground(analysisBuffer, 0, length, offset);
+
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            const float* samples = analysisBuffer.getReadPointer(channel);
+
+            for (int i = 0; i < length; ++i)
+                hopEnergy[static_cast<size_t>((offset + i) / analysisHopSize)] += samples[i] * samples[i];
+        }
+    }
+
+    const float energyScale = 1.0f / static_cast<float>(analysisHopSize * juce::jmax(1, channels));
+    for (auto& energy : hopEnergy)
+        energy *= energyScale;
+
+    // Every hop that jumps well above the two before it is a candidate, strongest first
+    onsets.clear();
+    for (int hop = 2; hop < numHops; ++hop)
+    {
+        const float background = juce::jmax(0.5f * (hopEnergy[static_cast<size_t>(hop) - 1] + hopEnergy[static_cast<size_t>(hop) - 2]),
+                                            silenceEnergyFloor * 0.01f);
+        const float energy = hopEnergy[static_cast<size_t>(hop)];
+
+        if (energy > silenceEnergyFloor && energy > onsetEnergyRatio * background)
+            onsets.emplace_back(energy / background, hop * analysisHopSize);
+    }
+
+    std::sort(onsets.begin(), onsets.end(), [] (const auto& a, const auto& b) { return a.first > b.first; });
+
+    // The loop start always begins a slice; keep the strongest onsets that leave room for a bucket
+    map.starts[0] = 0;
+    int count = 1;
+
+    for (const auto& onset : onsets)
+    {
+        if (count == numSlices)
+            break;
+
+        const int position = onset.second;
+        if (position < bucketSize || position > loopLength - bucketSize)
+            continue;
+
+        bool spaced = true;
+        for (int i = 0; i < count && spaced; ++i)
+            spaced = std::abs(map.starts[static_cast<size_t>(i)] - position) >= bucketSize;
+
+        if (spaced)
+            map.starts[static_cast<size_t>(count++)] = position;
+    }
+
+    std::sort(map.starts.begin(), map.starts.begin() + count);
+    return count;
+}
+
+int LoopSlicer::getFreeMap() const
+{
+    const int published = publishedMap.load();
+    const int inUse = mapInUse.load();
+
+    for (int index = 0; index < numMaps; ++index)
+    {
+        if (index != published && index != inUse)
+            return index;
+    }
+
+    return 0;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
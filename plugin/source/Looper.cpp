@@ -1,104 +1,1339 @@
 #include "OpenLooper2/Looper.h"
+#include "OpenLooper2/SampleMix.h"
 
 namespace OpenLooper2 {
 
-Looper::Looper()
+Looper::Looper(BackgroundJobQueue& jobQueue)
+    : jobQueue(jobQueue),
+      loopBufferManager(jobQueue),
+      overdubLayers(loopBufferManager, jobQueue),
+      boundaryRefiner(loopBufferManager, jobQueue),
+      rateConverter(loopBufferManager, jobQueue),
+      loopExporter(loopBufferManager, jobQueue),
+      loopImporter(loopBufferManager, jobQueue),
+      loopSlicer(loopBufferManager, jobQueue),
+      granularEngine(loopBufferManager)
 {
+    // Only scenes launched from now on concern this instance
+    lastSceneSequence = sceneLauncher->getSequence();
 }
 
 Looper::~Looper()
 {
+    sharedClock->release(this);
 }
 
 void Looper::initialize(double sampleRate, int samplesPerBlock, int numChannels)
 {
+    const bool rateChanged = initialized && sampleRate != this->sampleRate;
+    const bool specChanged = !initialized
+                             || sampleRate != this->sampleRate
+                             || samplesPerBlock != this->samplesPerBlock
+                             || numChannels != this->numChannels;
+    
+    if (!initialized)
+    {
+        // First prepare: start with an empty loop
+        loopBufferManager.initialize(sampleRate, numChannels, maxLoopLengthSeconds);
+        boundaryRefiner.initialize(sampleRate, numChannels);
+        loopSlicer.initialize(numChannels, loopBufferManager.getMaxBufferSize());
+        overdubLayers.prepare(numChannels);
+        transportController.initialize(sampleRate, samplesPerBlock);
+    }
+    else if (sampleRate != this->sampleRate || numChannels != this->numChannels)
+    {
+        // New format: keep the recorded loop and convert it in the background, its layers are flattened
+        prepareLoopConversion(sampleRate, numChannels);
+        overdubLayers.prepare(numChannels);
+        transportController.prepare(sampleRate, samplesPerBlock);
+    }
+    else
+    {
+        // Same format: recorded audio and transport state carry over untouched
+        transportController.prepare(sampleRate, samplesPerBlock);
+    }
+    
     this->sampleRate = sampleRate;
     this->samplesPerBlock = samplesPerBlock;
     this->numChannels = numChannels;
     
-    // Initialize all components
-    const float maxLoopLengthSeconds = 60.0f; // 60 seconds maximum loop length
+    // Timeline positions are in samples, so a new rate needs a new anchor and grid
+    if (rateChanged)
+    {
+        timelineAnchored = false;
+        pendingSyncEvent = SyncEvent::None;
+        loopOnClockGrid = false;
+        sharedClock->release(this);
+    }
+    
+    if (specChanged)
+    {
+        overdubEngine.initialize(sampleRate, juce::jmin(samplesPerBlock, subBlockSize), numChannels);
+        echoEngine.initialize(sampleRate, numChannels);
+        granularEngine.initialize(sampleRate, subBlockSize, numChannels);
+    }
+    
+    // Scratch buffers hold one sub-block whatever the host block size, and are never resized in the callback
+    tempBuffer.setSize(numChannels, subBlockSize, false, false, true);
+    loopBuffer.setSize(numChannels, subBlockSize, false, false, true);
+    varispeedBuffer.setSize(numChannels, static_cast<int>(TransportController::maxPlaybackRate) * subBlockSize + 2,
+                            false, false, true);
+    
+    bypassedSamples = 0;
+    initialized = true;
+}
+
+void Looper::releaseResources()
+{
+    if (!initialized || hasLoopContent())
+        return;
+    
+    recordPending = false;
+    boundaryRefiner.cancelRefinement();
+    boundaryRefiner.cancel();
+    boundaryRefiner.waitUntilIdle();
+    
+    loopBufferManager.releaseStorage();
+}
+
+void Looper::processBypassed(int numSamples)
+{
+    if (!initialized || hasLoopContent())
+    {
+        bypassedSamples = 0;
+        return;
+    }
+    
+    if (!loopBufferManager.isStorageReady())
+        return;
+    
+    bypassedSamples += numSamples;
+    if (bypassedSamples >= static_cast<int>(sampleRate * bypassReleaseDelaySeconds))
+    {
+        recordPending = false;
+        loopBufferManager.requestStorageRelease();
+        bypassedSamples = 0;
+    }
+}
+
+void Looper::attachParameters(juce::AudioProcessorValueTreeState& apvts)
+{
+    parameterManager.attachTo(apvts);
+}
+
+void Looper::detachParameters()
+{
+    parameterManager.detach();
+}
+
+bool Looper::exportLoop(const juce::File& file, LoopExporter::Format format)
+{
+    if (!initialized || conversionPending.load(std::memory_order_acquire))
+        return false;
+    
+    return loopExporter.requestExport(file, format, numChannels, sampleRate);
+}
+
+bool Looper::sendCommand(LooperCommand::Type type, int value, juce::int64 commandTimelineSample)
+{
+    LooperCommand command;
+    command.type = type;
+    command.timelineSample = commandTimelineSample;
+    command.value = value;
+    return commandQueue.push(command);
+}
+
+bool Looper::setLayerGain(int layerIndex, float gain)
+{
+    LooperCommand command;
+    command.type = LooperCommand::Type::SetLayerGain;
+    command.value = layerIndex;
+    command.level = gain;
+    return commandQueue.push(command);
+}
+
+bool Looper::importLoop(const juce::File& file)
+{
+    if (!initialized || conversionPending.load(std::memory_order_acquire))
+        return false;
+    
+    return loopImporter.requestImport(file, sampleRate, numChannels);
+}
+
+void Looper::processBlock(juce::AudioBuffer<float>& buffer, 
+                         const juce::MidiBuffer& midiMessages,
+                         const juce::AudioProcessorValueTreeState& apvts,
+                         juce::int64 hostTimeInSamples,
+                         const AuxOutputs& auxOutputs)
+{
+    if (!initialized)
+        return;
+    
+    const int numSamples = buffer.getNumSamples();
+    bypassedSamples = 0;
+    
+    // The dry output is the input as it arrived; the loop output is filled as the loop plays
+    if (auxOutputs.dry != nullptr)
+    {
+        const int dryChannels = juce::jmin(auxOutputs.dry->getNumChannels(), buffer.getNumChannels());
+        for (int channel = 0; channel < dryChannels; ++channel)
+            auxOutputs.dry->copyFrom(channel, 0, buffer, channel, 0, numSamples);
+    }
+    
+    loopOutput = auxOutputs.loop != nullptr && auxOutputs.loop->getNumChannels() > 0 ? auxOutputs.loop : nullptr;
+    if (loopOutput != nullptr)
+        loopOutput->clear();
+    
+    // Lazily reacquire loop memory that was given back while inactive
+    if (loopBufferManager.getStorageState() == LoopBufferManager::StorageState::Released)
+        loopBufferManager.requestStorage();
+    
+    // Parameters are pushed by the listener; poll only when nothing is attached
+    if (!parameterManager.isAttached())
+        parameterManager.updateFromParameters(apvts);
+    
+    // Follow the host timeline while it plays, otherwise keep counting from where it left off
+    if (hostTimeInSamples >= 0)
+    {
+        if (timelineAnchored && hostTimeInSamples < timelineSample)
+            timelineRewound = true;
+        
+        timelineSample = hostTimeInSamples;
+    }
+    else if (!timelineAnchored)
+        timelineSample = SharedLoopClock::getWallClockSample(sampleRate);
+    
+    timelineAnchored = true;
+    
+    // Hold the loop while its content is converted to a new sample rate; input passes through
+    if (conversionPending.load(std::memory_order_acquire))
+    {
+        int convertedLength = 0;
+        if (!rateConverter.getConvertedLength(convertedLength))
+        {
+            timelineSample += numSamples;
+            publishedTimelineSample.store(timelineSample, std::memory_order_release);
+            loopOutput = nullptr;
+            return;
+        }
+        
+        finishLoopConversion(convertedLength);
+    }
+    
+    updateSharedClock();
+    
+    // Handle transport control triggers
+    handleTransportControls();
+    handleSlotRequests();
+    
+    // Pick up a refined loop seam from the background analysis
+    applyRefinedLoopBoundary();
+    
+    // Compact or expand the loop storage as needed
+    manageLoopStorage(numSamples);
+    
+    // A stopped looper with nothing to do only passes its input through
+    if (isIdleBlock(midiMessages))
+    {
+        endOverdubPass();
+        buffer.applyGain(getDryGain(TransportController::State::Stopped));
+        timelineSample += numSamples;
+        finishBlock(buffer);
+        return;
+    }
+    
+    // Switch to an imported loop, then snapshot the loop for a requested export
+    beginPendingImport();
+    beginPendingExport();
+    
+    // Follow the loop with the overdub layers and bring its mixdown up to date with their gains
+    overdubLayers.update();
+    if (transportController.getCurrentState() != TransportController::State::Recording && !loopImporter.isStreaming())
+        overdubLayers.remix(tempBuffer, transportController.getPlaybackPositionSamples(), numSamples);
+    
+    // Slice the loop in the background and gather this block's retriggers and UI commands
+    updateSliceMap();
+    collectSliceEvents(midiMessages, numSamples);
+    collectCommands(numSamples);
+    updatePlaybackRate();
+    
+    // Split the block where a quantized transport change, slot switch, slice event or command falls,
+    // and into sub-blocks of at most subBlockSize samples so each pass stays in cache
+    int processed = 0;
+    while (processed < numSamples)
+    {
+        // Commands and slice events take effect on their own sample, before the audio from there on
+        while (nextBlockCommand < numBlockCommands && blockCommands[static_cast<size_t>(nextBlockCommand)].offset <= processed)
+            applyCommand(blockCommands[static_cast<size_t>(nextBlockCommand++)].command);
+        
+        while (nextSliceEvent < numSliceEvents && sliceEvents[static_cast<size_t>(nextSliceEvent)].offset <= processed)
+            applySliceEvent(sliceEvents[static_cast<size_t>(nextSliceEvent++)]);
+        
+        const int remaining = numSamples - processed;
+        const int eventOffset = getSyncEventOffset(remaining);
+        const int switchOffset = getSlotSwitchOffset(remaining);
+        const int sliceOffset = nextSliceEvent < numSliceEvents
+                                    ? sliceEvents[static_cast<size_t>(nextSliceEvent)].offset - processed
+                                    : -1;
+        const int commandOffset = nextBlockCommand < numBlockCommands
+                                      ? blockCommands[static_cast<size_t>(nextBlockCommand)].offset - processed
+                                      : -1;
+        
+        int segmentLength = juce::jmin(remaining, subBlockSize);
+        if (eventOffset >= 0)
+            segmentLength = juce::jmin(segmentLength, eventOffset);
+        if (switchOffset >= 0)
+            segmentLength = juce::jmin(segmentLength, switchOffset);
+        if (sliceOffset >= 0)
+            segmentLength = juce::jmin(segmentLength, sliceOffset);
+        if (commandOffset >= 0)
+            segmentLength = juce::jmin(segmentLength, commandOffset);
+        
+        processSegment(buffer, processed, segmentLength);
+        processed += segmentLength;
+        timelineSample += segmentLength;
+        
+        if (eventOffset == segmentLength)
+            applySyncEvent(timelineSample);
+        
+        if (switchOffset == segmentLength)
+            applySlotSwitch(timelineSample);
+    }
+    
+    finishBlock(buffer);
+}
+
+bool Looper::isIdleBlock(const juce::MidiBuffer& midiMessages) const
+{
+    if (transportController.getCurrentState() != TransportController::State::Stopped
+        || recordPending || overdubPending || importPlaybackPending
+        || pendingSyncEvent != SyncEvent::None || pendingSlot >= 0)
+        return false;
+    
+    // Commands and slice events would be applied in the segment loop; a gain change waits for playback
+    LooperCommand command;
+    if (!midiMessages.isEmpty() || commandQueue.peek(command) || numWaitingCommands > 0 || parameterManager.hasRetriggerRequest()
+        || parameterManager.isStutterHeld() != stutterParameterHeld)
+        return false;
+    
+    return !overdubLayers.isRemixing() && !loopImporter.isReadyToStream() && !loopExporter.isSnapshotRequested();
+}
+
+void Looper::finishBlock(juce::AudioBuffer<float>& buffer)
+{
+    // Echo the whole output, loop and pass-through alike
+    echoEngine.setParameters(parameterManager.getEchoTime(), parameterManager.getEchoTaps(),
+                             parameterManager.getEchoFeedback(), parameterManager.getEchoMix());
+    echoEngine.process(buffer, parameterManager.isEchoEnabled());
+    
+    publishedTimelineSample.store(timelineSample, std::memory_order_release);
+    loopOutput = nullptr;
+}
+
+void Looper::endOverdubPass()
+{
+    if (!overdubPassActive || transportController.getCurrentState() == TransportController::State::Overdubbing)
+        return;
+    
+    overdubPassActive = false;
+    overdubLayers.endLayer();
+}
+
+void Looper::processSegment(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    if (numSamples <= 0)
+        return;
+    
+    endOverdubPass();
+    
+    // A stopped looper only passes its input through, at the dry level while monitored
+    if (transportController.getCurrentState() == TransportController::State::Stopped)
+    {
+        buffer.applyGain(startSample, numSamples, getDryGain(TransportController::State::Stopped));
+        return;
+    }
+    
+    // Process audio based on current state, reading and writing from the segment's own position
+    segmentStart = startSample;
+    if (startSample == 0 && numSamples == buffer.getNumSamples())
+    {
+        processAudioForCurrentState(buffer);
+    }
+    else
+    {
+        // Refers to the caller's channel data, nothing is allocated or copied
+        juce::AudioBuffer<float> segment(buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                                         startSample, numSamples);
+        processAudioForCurrentState(segment);
+    }
+    
+    // Update transport timing
+    transportController.processBlock(numSamples);
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout Looper::createParameterLayout()
+{
+    return ParameterManager::createParameterLayout();
+}
+
+void Looper::handleTransportControls()
+{
+    // Check for transport button triggers
+    if (parameterManager.wasRecordTriggered())
+        pressRecord();
+    
+    if (recordPending && loopBufferManager.isStorageReady())
+    {
+        recordPending = false;
+        if (transportController.getCurrentState() == TransportController::State::Stopped)
+            requestRecordStart();
+    }
+    
+    if (parameterManager.wasPlayTriggered())
+        pressPlay();
+    
+    if (parameterManager.wasStopTriggered())
+        pressStop();
+    
+    if (parameterManager.wasOverdubTriggered())
+        pressOverdub();
+}
+
+void Looper::pressRecord()
+{
+    // An imported loop is being written into the buffer, so takes have to wait until it is done
+    if (loopImporter.isStreaming())
+        return;
+    
+    const auto currentState = transportController.getCurrentState();
+    if (currentState == TransportController::State::Stopped)
+    {
+        // Without writable memory the take starts as soon as the buffer is ready
+        loopBufferManager.requestStorage();
+        if (loopBufferManager.isStorageReady())
+            requestRecordStart();
+        else
+            recordPending = !recordPending;
+    }
+    else if (currentState == TransportController::State::Recording)
+    {
+        if (isClockFollower() && loopOnClockGrid)
+        {
+            // Round the take up to whole master loops and stop on the boundary
+            const int masterLength = clockGrid.loopLength;
+            const int recorded = static_cast<int>(transportController.getPlaybackPositionSamples());
+            const int maxCycles = juce::jmax(1, loopBufferManager.getMaxBufferSize() / masterLength);
+            const int cycles = juce::jlimit(1, maxCycles, (recorded + masterLength - 1) / masterLength);
+            
+            syncedRecordLength = cycles * masterLength;
+            pendingSyncEvent = SyncEvent::RecordStop;
+        }
+        else
+        {
+            stopRecording();
+        }
+    }
+}
+
+void Looper::pressPlay()
+{
+    transportController.startPlayback();
+    
+    if (isClockFollower() && transportController.getCurrentState() == TransportController::State::Playing)
+        alignPlaybackToClock();
+}
+
+void Looper::pressStop()
+{
+    recordPending = false;
+    overdubPending = false;
+    importPlaybackPending = false;
+    pendingSyncEvent = SyncEvent::None;
+    transportController.stopPlayback();
+}
+
+void Looper::pressOverdub()
+{
+    if (loopImporter.isStreaming())
+        return;
+    
+    const auto currentState = transportController.getCurrentState();
+    if (currentState == TransportController::State::Playing)
+    {
+        // A compacted loop keeps playing until it has been expanded for writing
+        loopBufferManager.requestStorage();
+        if (loopBufferManager.isStorageReady())
+            transportController.startOverdub();
+        else
+            overdubPending = !overdubPending;
+    }
+    else if (currentState == TransportController::State::Overdubbing)
+    {
+        transportController.stopOverdub();
+    }
+}
+
+void Looper::collectCommands(int numSamples)
+{
+    numBlockCommands = 0;
+    nextBlockCommand = 0;
+    
+    const juce::int64 blockEnd = timelineSample + numSamples;
+    LooperCommand command;
+    
+    // After a jump back, waiting for the times the host skipped could stall the commands indefinitely
+    if (timelineRewound)
+    {
+        for (int i = 0; i < numWaitingCommands; ++i)
+            waitingCommands[static_cast<size_t>(i)].timelineSample = LooperCommand::immediately;
+        
+        timelineRewound = false;
+    }
+    
+    // Immediate commands apply at the start of the block, whatever is still waiting for a later one
+    while (numBlockCommands < maxBlockCommands && commandQueue.peek(command))
+    {
+        if (command.timelineSample == LooperCommand::immediately || command.timelineSample < timelineSample)
+        {
+            commandQueue.pop();
+            blockCommands[static_cast<size_t>(numBlockCommands++)] = { command, 0 };
+            continue;
+        }
+        
+        if (numWaitingCommands == maxWaitingCommands)
+            break;
+        
+        commandQueue.pop();
+        
+        // Keep the waiting commands in timeline order, those sent first first among equal times
+        int index = numWaitingCommands++;
+        for (; index > 0 && waitingCommands[static_cast<size_t>(index - 1)].timelineSample > command.timelineSample; --index)
+            waitingCommands[static_cast<size_t>(index)] = waitingCommands[static_cast<size_t>(index - 1)];
+        
+        waitingCommands[static_cast<size_t>(index)] = command;
+    }
+    
+    // Then the waiting commands due within this block, at their own sample
+    int numDue = 0;
+    while (numDue < numWaitingCommands && numBlockCommands < maxBlockCommands
+           && waitingCommands[static_cast<size_t>(numDue)].timelineSample < blockEnd)
+    {
+        const auto& due = waitingCommands[static_cast<size_t>(numDue++)];
+        const int offset = due.timelineSample == LooperCommand::immediately
+                               ? 0
+                               : static_cast<int>(juce::jlimit<juce::int64>(0, numSamples - 1, due.timelineSample - timelineSample));
+        
+        blockCommands[static_cast<size_t>(numBlockCommands++)] = { due, offset };
+    }
+    
+    std::move(waitingCommands.begin() + numDue, waitingCommands.begin() + numWaitingCommands, waitingCommands.begin());
+    numWaitingCommands -= numDue;
+}
+
+void Looper::applyCommand(const LooperCommand& command)
+{
+    switch (command.type)
+    {
+        case LooperCommand::Type::Record:       pressRecord(); break;
+        case LooperCommand::Type::Play:         pressPlay(); break;
+        case LooperCommand::Type::Stop:         pressStop(); break;
+        case LooperCommand::Type::Overdub:      pressOverdub(); break;
+        case LooperCommand::Type::Undo:         undoTake(); break;
+        case LooperCommand::Type::Clear:        clearLoop(); break;
+        case LooperCommand::Type::SetLength:    resizeLoop(command.value); break;
+        case LooperCommand::Type::LaunchSlot:   queueSlotSwitch(command.value); break;
+        case LooperCommand::Type::Multiply:     multiplyLoop(command.value); break;
+        case LooperCommand::Type::Divide:       divideLoop(command.value); break;
+        case LooperCommand::Type::SetLayerGain: overdubLayers.setLayerGain(command.value, command.level); break;
+        default: break;
+    }
+}
+
+void Looper::undoTake()
+{
+    // An armed take is simply disarmed
+    if (pendingSyncEvent == SyncEvent::RecordStart)
+    {
+        pendingSyncEvent = SyncEvent::None;
+        return;
+    }
+    
+    recordPending = false;
+    
+    // Overdub passes are kept as layers, the last one is taken back out of the mixdown
+    if (transportController.getCurrentState() != TransportController::State::Recording)
+    {
+        overdubPending = false;
+        transportController.stopOverdub();
+        endOverdubPass();
+        overdubLayers.removeLastLayer();
+        return;
+    }
+    
+    // The take already overwrote the start of whatever the slot held before
+    pendingSyncEvent = SyncEvent::None;
+    transportController.stopPlayback();
+    transportController.setLoopLength(0);
+    loopBufferManager.setLoopLength(0);
+}
+
+void Looper::clearLoop()
+{
+    if (loopImporter.isStreaming())
+        return;
+    
+    pressStop();
+    boundaryRefiner.cancelRefinement();
+    overdubLayers.flatten();
+    transportController.setLoopLength(0);
+    loopBufferManager.setLoopLength(0);
+    
+    // A master without a loop no longer defines the grid
+    sharedClock->release(this);
+    loopOnClockGrid = false;
+}
+
+bool Looper::canChangeLoopLength() const
+{
+    // Only a finished loop held as float samples can change its length
+    return transportController.getCurrentState() != TransportController::State::Recording
+           && !loopImporter.isStreaming() && loopBufferManager.getLoopLength() > 0
+           && loopBufferManager.getStorageState() == LoopBufferManager::StorageState::Allocated;
+}
+
+void Looper::resizeLoop(int lengthInSamples)
+{
+    // Repetitions of a multiplied loop only exist through its page map, which a new length drops
+    if (!canChangeLoopLength() || loopBufferManager.isLoopMultiplied())
+        return;
+    
+    const int newLength = juce::jlimit(1, loopBufferManager.getMaxBufferSize(), lengthInSamples);
+    boundaryRefiner.cancelRefinement();
+    loopBufferManager.setLoopLength(newLength);
+    transportController.setLoopLength(newLength);
+    
+    // Keep playing from the same place, wrapped into the new length
+    transportController.setPositionSamples(transportController.getPlaybackPositionSamples());
+}
+
+void Looper::multiplyLoop(int factor)
+{
+    if (!canChangeLoopLength() || !loopBufferManager.multiplyLoop(factor))
+        return;
+    
+    // The position lies in the first repetition, which keeps its place
+    boundaryRefiner.cancelRefinement();
+    transportController.setLoopLength(loopBufferManager.getLoopLength());
+}
+
+void Looper::divideLoop(int divisor)
+{
+    if (!canChangeLoopLength() || !loopBufferManager.divideLoop(divisor))
+        return;
+    
+    boundaryRefiner.cancelRefinement();
+    transportController.setLoopLength(loopBufferManager.getLoopLength());
+    
+    // Keep playing from the same place, wrapped into the first part
+    transportController.setPositionSamples(transportController.getPlaybackPositionSamples());
+}
+
+void Looper::handleSlotRequests()
+{
+    const int slotRequest = parameterManager.takeSlotRequest();
+    if (slotRequest >= 0)
+        queueSlotSwitch(slotRequest);
+    
+    // Synced instances launch the scene on every track, others only switch their own slot
+    const bool synced = parameterManager.isClockSyncEnabled();
+    const int sceneRequest = parameterManager.takeSceneRequest();
+    if (sceneRequest >= 0)
+    {
+        if (synced)
+            sceneLauncher->launch(sceneRequest);
+        else
+            queueSlotSwitch(sceneRequest);
+    }
+    
+    int scene = 0;
+    if (sceneLauncher->getNewLaunch(lastSceneSequence, scene) && synced)
+        queueSlotSwitch(scene);
+}
+
+void Looper::queueSlotSwitch(int slotIndex)
+{
+    if (slotIndex < 0 || slotIndex >= LoopBufferManager::numSlots)
+        return;
+    
+    // Launching the slot that already plays cancels a switch that is still waiting
+    if (slotIndex == loopBufferManager.getActiveSlot())
+    {
+        pendingSlot = -1;
+        return;
+    }
+    
+    pendingSlot = slotIndex;
+    
+    // Prefetch: a compacted loop is decoded back into float samples before the boundary
+    if (loopBufferManager.getSlotLength(slotIndex) > 0)
+        loopBufferManager.requestStorage(slotIndex);
+}
+
+int Looper::getSlotSwitchOffset(int numSamples) const
+{
+    if (pendingSlot < 0)
+        return -1;
+    
+    // Imports and exports work on the active slot, and a take has to be closed first
+    const auto currentState = transportController.getCurrentState();
+    if (loopImporter.isImporting() || loopExporter.isExporting() || conversionPending.load(std::memory_order_acquire)
+        || currentState == TransportController::State::Recording)
+        return -1;
+    
+    if (currentState == TransportController::State::Stopped)
+        return 0;
+    
+    // Playing loops switch on the master loop boundary when following, otherwise on their own
+    int offset = 0;
+    if (isClockFollower())
+    {
+        offset = clockGrid.getSamplesToNextBoundary(timelineSample);
+    }
+    else
+    {
+        // The loop end is this many loop samples ahead, which takes longer or shorter under varispeed
+        const int loopLength = juce::jmax(1, transportController.getLoopLength());
+        const juce::int64 toLoopEnd = (loopLength - transportController.getPlaybackPositionSamples()) % loopLength;
+        offset = static_cast<int>(juce::jmin<juce::int64>(numSamples, transportController.getSamplesToAdvance(toLoopEnd)));
+    }
+    
+    return offset < numSamples ? offset : -1;
+}
+
+void Looper::applySlotSwitch(juce::int64 switchTimeline)
+{
+    const int previousSlot = loopBufferManager.getActiveSlot();
+    const int slotIndex = pendingSlot;
+    pendingSlot = -1;
+    
+    // A refinement in flight belongs to the loop we are leaving
+    boundaryRefiner.cancelRefinement();
+    loopBufferManager.selectSlot(slotIndex);
+    
+    const int loopLength = loopBufferManager.getLoopLength();
+    const auto currentState = transportController.getCurrentState();
+    transportController.setLoopLength(loopLength);
+    
+    // An empty slot stops the track; a compact loop plays but cannot take an overdub
+    if (loopLength <= 0)
+    {
+        transportController.stopPlayback();
+    }
+    else
+    {
+        transportController.stopOverdub();
+        transportController.setPositionSamples(0);
+        
+        if (isClockFollower() && currentState != TransportController::State::Stopped)
+        {
+            loopOnClockGrid = false;
+            alignPlaybackToClock();
+        }
+        else if (sharedClock->isMaster(this))
+        {
+            // The master's new loop becomes the grid from this boundary on
+            recordStartTimeline = switchTimeline;
+            if (sharedClock->publish(this, switchTimeline, loopLength))
+            {
+                clockGrid.originSample = switchTimeline;
+                clockGrid.loopLength = loopLength;
+            }
+        }
+    }
+    
+    idleSamples = 0;
     
-    loopBufferManager.initialize(sampleRate, numChannels, maxLoopLengthSeconds);
-    transportController.initialize(sampleRate, samplesPerBlock);
-    overdubEngine.initialize(sampleRate, samplesPerBlock);
+    // The slot we left is idle from now on
+    if (parameterManager.isIdleCompactionEnabled())
+        loopBufferManager.requestCompaction(previousSlot, parameterManager.isLossyCompactionEnabled());
+}
+
+void Looper::updateSliceMap()
+{
+    const auto currentState = transportController.getCurrentState();
+    const int mode = parameterManager.getSliceMode();
+    const int count = parameterManager.getNumSlices();
+    const int loopLength = loopBufferManager.getLoopLength();
     
-    // Prepare temporary buffers
-    tempBuffer.setSize(numChannels, samplesPerBlock);
-    loopBuffer.setSize(numChannels, samplesPerBlock);
+    // Content that is still being written is sliced once it is complete
+    if (currentState == TransportController::State::Recording || currentState == TransportController::State::Overdubbing
+        || loopImporter.isStreaming() || count <= 1 || loopLength <= 0)
+    {
+        slicedLength = -1;
+        sliceMap = nullptr;
+        stutterActive = false;
+        return;
+    }
     
-    initialized = true;
+    const int loopStart = loopBufferManager.getLoopStart();
+    const int slot = loopBufferManager.getActiveSlot();
+    
+    if (mode != slicedMode || count != slicedCount || loopLength != slicedLength
+        || loopStart != slicedStart || slot != slicedSlot)
+    {
+        slicedMode = mode;
+        slicedCount = count;
+        slicedLength = loopLength;
+        slicedStart = loopStart;
+        slicedSlot = slot;
+        
+        loopSlicer.requestSlices(mode == 1 ? LoopSlicer::Mode::Transients : LoopSlicer::Mode::Grid, count, loopLength);
+    }
+    
+    // The loop plays unsliced until the map for it has been built
+    sliceMap = loopSlicer.acquireMap();
+    if (sliceMap == nullptr)
+        stutterActive = false;
 }
 
-void Looper::processBlock(juce::AudioBuffer<float>& buffer, 
-                         const juce::AudioProcessorValueTreeState& apvts)
+void Looper::collectSliceEvents(const juce::MidiBuffer& midiMessages, int numSamples)
 {
-    if (!initialized)
+    numSliceEvents = 0;
+    nextSliceEvent = 0;
+    
+    // Parameter changes land at the start of the block, ahead of the block's MIDI
+    const int retrigger = parameterManager.takeRetriggerRequest();
+    if (retrigger >= 0)
+        sliceEvents[static_cast<size_t>(numSliceEvents++)] = { SliceEvent::Type::Retrigger, 0, retrigger };
+    
+    const bool stutterHeld = parameterManager.isStutterHeld();
+    if (stutterHeld != stutterParameterHeld)
+        sliceEvents[static_cast<size_t>(numSliceEvents++)] = { SliceEvent::Type::StutterParameter, 0, stutterHeld ? 1 : 0 };
+    
+    // MIDI events arrive in time order, which keeps the event list sorted
+    for (const auto metadata : midiMessages)
+    {
+        if (numSliceEvents == maxSliceEvents)
+            break;
+        
+        const auto message = metadata.getMessage();
+        const int note = message.getNoteNumber();
+        const int offset = juce::jlimit(0, numSamples - 1, metadata.samplePosition);
+        
+        if (message.isNoteOn() && note >= sliceBaseNote && note < sliceBaseNote + LoopSlicer::maxSlices)
+            sliceEvents[static_cast<size_t>(numSliceEvents++)] = { SliceEvent::Type::Retrigger, offset, note - sliceBaseNote };
+        else if ((message.isNoteOn() || message.isNoteOff()) && note == stutterNote)
+            sliceEvents[static_cast<size_t>(numSliceEvents++)] = { SliceEvent::Type::StutterNote, offset, message.isNoteOn() ? 1 : 0 };
+    }
+}
+
+void Looper::applySliceEvent(const SliceEvent& event)
+{
+    if (event.type == SliceEvent::Type::StutterNote)
+    {
+        stutterNoteHeld = event.value != 0;
+        setStutter(stutterNoteHeld || stutterParameterHeld);
         return;
+    }
     
-    const int numSamples = buffer.getNumSamples();
+    if (event.type == SliceEvent::Type::StutterParameter)
+    {
+        stutterParameterHeld = event.value != 0;
+        setStutter(stutterNoteHeld || stutterParameterHeld);
+        return;
+    }
     
-    // Update parameters from APVTS
-    parameterManager.updateFromParameters(apvts);
+    // Retriggers jump to where the slice sits on the timeline; nothing to jump to without a map
+    if (sliceMap == nullptr || event.value >= sliceMap->getNumSlices())
+        return;
     
-    // Handle transport control triggers
-    handleTransportControls();
+    const auto currentState = transportController.getCurrentState();
+    if (currentState == TransportController::State::Recording || currentState == TransportController::State::Overdubbing)
+        return;
     
-    // Update transport timing
-    transportController.processBlock(numSamples);
+    transportController.setPositionSamples(sliceMap->getSliceStart(event.value));
+    if (currentState == TransportController::State::Stopped)
+        transportController.startPlayback();
     
-    // Process audio based on current state
-    processAudioForCurrentState(buffer);
+    // A held stutter restarts on the retriggered slice
+    if (stutterActive)
+    {
+        stutterActive = false;
+        setStutter(true);
+    }
 }
 
-juce::AudioProcessorValueTreeState::ParameterLayout Looper::createParameterLayout()
+void Looper::setStutter(bool held)
 {
-    return ParameterManager::createParameterLayout();
+    if (!held || sliceMap == nullptr)
+    {
+        stutterActive = false;
+        return;
+    }
+    
+    if (stutterActive)
+        return;
+    
+    // Repeat the grid division of the slice that is audible right now, starting where it plays
+    const int position = static_cast<int>(transportController.getPlaybackPositionSamples() % sliceMap->getLoopLength());
+    const int slice = sliceMap->getSliceAt(position);
+    const int source = sliceMap->getOrderedSlice(slice, static_cast<LoopSlicer::Order>(parameterManager.getSliceOrder()));
+    const int sliceOffset = juce::jmin(position - sliceMap->getSliceStart(slice), sliceMap->getSliceLength(source) - 1);
+    
+    stutterLength = juce::jmax(1, sliceMap->getSliceLength(source) / parameterManager.getStutterDivision());
+    stutterStart = sliceMap->getSliceStart(source) + sliceOffset / stutterLength * stutterLength;
+    stutterPhase = sliceOffset % stutterLength;
+    stutterActive = true;
 }
 
-void Looper::handleTransportControls()
+bool Looper::readSlicedLoop(juce::AudioBuffer<float>& buffer, int numSamples, float dryGain, float loopGain)
 {
-    // Check for transport button triggers
-    if (parameterManager.wasRecordTriggered())
+    // Grains replace the linear read, the slice order and stutter while granular mode is on
+    if (parameterManager.isGranularEnabled())
+    {
+        granularEngine.setParameters(parameterManager.getGrainPosition(), parameterManager.getGrainSpray(),
+                                     parameterManager.getGrainSize(), parameterManager.getGrainDensity(),
+                                     parameterManager.getGrainPitch());
+        return granularEngine.process(buffer, numSamples, dryGain, loopGain);
+    }
+    
+    // The cloud starts afresh the next time granular mode is switched on
+    granularEngine.reset();
+    
+    const juce::int64 position = transportController.getPlaybackPositionSamples();
+    const auto order = static_cast<LoopSlicer::Order>(parameterManager.getSliceOrder());
+    bool audible = false;
+    
+    if (stutterActive)
+    {
+        // The repeated fragment plays in runs up to its end, then starts over
+        for (int done = 0; done < numSamples;)
+        {
+            const int length = juce::jmin(numSamples - done, stutterLength - stutterPhase);
+            audible |= loopBufferManager.mixLoop(buffer, done, length, stutterStart + stutterPhase, dryGain, loopGain);
+            stutterPhase = (stutterPhase + length) % stutterLength;
+            done += length;
+        }
+        
+        return audible;
+    }
+    
+    if (sliceMap == nullptr || order == LoopSlicer::Order::Forward)
+    {
+        if (transportController.getPlaybackRate() != 1.0)
+            return mixLoopAtRate(buffer, numSamples, dryGain, loopGain);
+        
+        return loopBufferManager.mixLoop(buffer, 0, numSamples, position, dryGain, loopGain);
+    }
+    
+    // Each slice position plays the slice the order puts there, in runs up to the slice end
+    const int loopLength = sliceMap->getLoopLength();
+    for (int done = 0; done < numSamples;)
+    {
+        const int loopPosition = static_cast<int>((position + done) % loopLength);
+        const int slice = sliceMap->getSliceAt(loopPosition);
+        const int source = sliceMap->getOrderedSlice(slice, order);
+        
+        // Transient slices differ in length, a shorter source slice repeats to fill the place
+        const int sourceLength = sliceMap->getSliceLength(source);
+        const int sourceOffset = (loopPosition - sliceMap->getSliceStart(slice)) % sourceLength;
+        const int length = juce::jmin(numSamples - done,
+                                      sliceMap->getSliceEnd(slice) - loopPosition,
+                                      sourceLength - sourceOffset);
+        
+        audible |= loopBufferManager.mixLoop(buffer, done, length, sliceMap->getSliceStart(source) + sourceOffset,
+                                             dryGain, loopGain);
+        done += length;
+    }
+    
+    return audible;
+}
+
+bool Looper::mixLoopAtRate(juce::AudioBuffer<float>& buffer, int numSamples, float dryGain, float loopGain)
+{
+    // Output sample i sits at phase + i * increment past the position, in 2^-32 of a loop sample
+    constexpr double unityIncrement = 4294967296.0;
+    const juce::int64 position = transportController.getPlaybackPositionSamples();
+    const juce::uint64 phase = transportController.getPlaybackPhase();
+    const auto increment = static_cast<juce::uint64>(transportController.getPlaybackRate() * unityIncrement);
+    
+    // The loop samples up to the last output sample, and the one after it to interpolate towards
+    const int span = static_cast<int>((phase + increment * static_cast<juce::uint64>(numSamples - 1)) >> 32) + 2;
+    jassert(span <= varispeedBuffer.getNumSamples());
+    
+    const int channels = juce::jmin(buffer.getNumChannels(), varispeedBuffer.getNumChannels());
+    juce::AudioBuffer<float> source(varispeedBuffer.getArrayOfWritePointers(), channels, span);
+    
+    if (!loopBufferManager.readLoop(source, 0, span, position))
     {
-        const auto currentState = transportController.getCurrentState();
-        if (currentState == TransportController::State::Stopped)
+        buffer.applyGain(0, numSamples, dryGain);
+        return false;
+    }
+    
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        float* output = buffer.getWritePointer(channel);
+        
+        if (channel >= channels)
         {
-            transportController.startRecording();
+            SampleMix::scale(output, dryGain, numSamples);
+            continue;
         }
-        else if (currentState == TransportController::State::Recording)
+        
+        const float* input = source.getReadPointer(channel);
+        juce::uint64 samplePhase = phase;
+        
+        for (int i = 0; i < numSamples; ++i)
         {
-            transportController.stopRecording();
-            // Set the loop length in the buffer manager
-            const int loopLength = transportController.getLoopLength();
-            loopBufferManager.setLoopLength(loopLength);
+            const auto index = static_cast<int>(samplePhase >> 32);
+            const float fraction = static_cast<float>(samplePhase & 0xffffffffu) * static_cast<float>(1.0 / unityIncrement);
+            const float sample = input[index] + fraction * (input[index + 1] - input[index]);
+            output[i] = output[i] * dryGain + sample * loopGain;
+            samplePhase += increment;
         }
     }
     
-    if (parameterManager.wasPlayTriggered())
+    return true;
+}
+
+void Looper::updatePlaybackRate()
+{
+    // Slice orders, stutter and grains keep their own pace through the loop, and a synced loop stays on the grid
+    const bool straightThrough = !parameterManager.isClockSyncEnabled() && !parameterManager.isGranularEnabled()
+                                 && !stutterActive
+                                 && (sliceMap == nullptr
+                                     || static_cast<LoopSlicer::Order>(parameterManager.getSliceOrder()) == LoopSlicer::Order::Forward);
+    
+    transportController.setPlaybackRate(straightThrough ? parameterManager.getPlaybackRate() : 1.0);
+}
+
+void Looper::startRecording(juce::int64 startTimeline)
+{
+    boundaryRefiner.cancelRefinement();
+    overdubLayers.flatten();
+    loopBufferManager.beginLoop();
+    transportController.startRecording();
+    
+    recordStartTimeline = startTimeline;
+    loopOnClockGrid = false;
+}
+
+void Looper::requestRecordStart()
+{
+    if (!isClockFollower())
     {
-        transportController.startPlayback();
+        startRecording(timelineSample);
+        return;
     }
     
-    if (parameterManager.wasStopTriggered())
+    // Pressing record again before the boundary cancels the armed take
+    pendingSyncEvent = pendingSyncEvent == SyncEvent::RecordStart ? SyncEvent::None : SyncEvent::RecordStart;
+}
+
+void Looper::stopRecording()
+{
+    transportController.stopRecording();
+    
+    // Set the loop length in the buffer manager
+    const int loopLength = transportController.getLoopLength();
+    loopBufferManager.setLoopLength(loopLength);
+    
+    // Optionally tighten the seam in the background; takes locked to the master grid stay as they are
+    const bool lockedToGrid = isClockFollower() && loopOnClockGrid;
+    if (loopLength > 0 && parameterManager.isBoundaryRefinementEnabled() && !lockedToGrid)
+        boundaryRefiner.requestRefinement(loopBufferManager.getLoopStart(), loopLength);
+    
+    // Without a master yet, this take defines the grid everybody else follows
+    if (loopLength > 0 && parameterManager.isClockSyncEnabled() && !isClockFollower()
+        && sharedClock->publish(this, recordStartTimeline, loopLength))
     {
-        transportController.stopPlayback();
+        clockGrid.originSample = recordStartTimeline;
+        clockGrid.loopLength = loopLength;
+        loopOnClockGrid = true;
+    }
+}
+
+void Looper::updateSharedClock()
+{
+    if (!parameterManager.isClockSyncEnabled())
+    {
+        sharedClock->release(this);
+        clockGrid = {};
+        return;
     }
     
-    if (parameterManager.wasOverdubTriggered())
+    // A read that overlaps a publish keeps last block's grid
+    SharedLoopClock::Grid grid;
+    if (sharedClock->read(grid))
+        clockGrid = grid;
+}
+
+bool Looper::isClockFollower() const
+{
+    return parameterManager.isClockSyncEnabled() && clockGrid.isValid() && !sharedClock->isMaster(this);
+}
+
+void Looper::alignPlaybackToClock()
+{
+    const int loopLength = transportController.getLoopLength();
+    if (loopLength <= 0)
+        return;
+    
+    // A take recorded on the grid keeps its own origin, anything else locks to the master phase
+    const juce::int64 origin = loopOnClockGrid ? recordStartTimeline : clockGrid.originSample;
+    transportController.setPositionSamples(timelineSample - origin);
+}
+
+int Looper::getSyncEventOffset(int numSamples) const
+{
+    if (pendingSyncEvent == SyncEvent::None)
+        return -1;
+    
+    // Without a grid to wait for, the event happens right away
+    if (!isClockFollower())
+        return 0;
+    
+    int offset = 0;
+    if (pendingSyncEvent == SyncEvent::RecordStart)
+        offset = clockGrid.getSamplesToNextBoundary(timelineSample);
+    else
+        offset = static_cast<int>(juce::jmax<juce::int64>(0, syncedRecordLength - transportController.getPlaybackPositionSamples()));
+    
+    return offset < numSamples ? offset : -1;
+}
+
+void Looper::applySyncEvent(juce::int64 eventTimeline)
+{
+    const auto event = pendingSyncEvent;
+    pendingSyncEvent = SyncEvent::None;
+    
+    const auto currentState = transportController.getCurrentState();
+    
+    if (event == SyncEvent::RecordStart && currentState == TransportController::State::Stopped
+        && loopBufferManager.isStorageReady())
+    {
+        const bool onGrid = isClockFollower();
+        startRecording(eventTimeline);
+        loopOnClockGrid = onGrid;
+    }
+    else if (event == SyncEvent::RecordStop && currentState == TransportController::State::Recording)
+    {
+        stopRecording();
+    }
+}
+
+bool Looper::hasLoopContent() const
+{
+    return loopBufferManager.getLoopLength() > 0
+           || transportController.getCurrentState() == TransportController::State::Recording
+           || conversionPending.load(std::memory_order_acquire)
+           || loopImporter.isImporting();
+}
+
+void Looper::manageLoopStorage(int numSamples)
+{
+    if (recordPending || overdubPending)
     {
-        const auto currentState = transportController.getCurrentState();
-        if (currentState == TransportController::State::Playing)
+        loopBufferManager.requestStorage();
+        
+        if (overdubPending && loopBufferManager.isStorageReady())
         {
-            transportController.startOverdub();
+            overdubPending = false;
+            if (transportController.getCurrentState() == TransportController::State::Playing)
+                transportController.startOverdub();
+        }
+    }
+    
+    const auto currentState = transportController.getCurrentState();
+    const bool writing = currentState == TransportController::State::Recording
+                         || currentState == TransportController::State::Overdubbing;
+    
+    // Imports and exports access the float buffer, so it must not be compacted underneath them
+    if (writing || recordPending || overdubPending || overdubLayers.isRemixing() || loopExporter.isExporting()
+        || loopImporter.isImporting() || !parameterManager.isIdleCompactionEnabled())
+    {
+        idleSamples = 0;
+        
+        const auto storageState = loopBufferManager.getStorageState();
+        if (storageState == LoopBufferManager::StorageState::Compact
+            || storageState == LoopBufferManager::StorageState::Compacting)
+            loopBufferManager.requestStorage();
+        return;
+    }
+    
+    // The refiner reads the float buffer, so wait for it to finish first
+    if (loopBufferManager.getLoopLength() <= 0 || !loopBufferManager.isStorageReady() || boundaryRefiner.isBusy())
+        return;
+    
+    idleSamples += numSamples;
+    if (idleSamples >= static_cast<int>(sampleRate * compactionDelaySeconds))
+    {
+        idleSamples = 0;
+        loopBufferManager.requestCompaction(parameterManager.isLossyCompactionEnabled());
+    }
+}
+
+void Looper::beginPendingImport()
+{
+    if (importPlaybackPending)
+    {
+        const int loopLength = loopBufferManager.getLoopLength();
+        const int preroll = juce::jmin(loopLength, static_cast<int>(sampleRate * importPrerollSeconds));
+        
+        if (!loopImporter.isStreaming() || loopImporter.getAvailableLength() >= preroll)
+        {
+            importPlaybackPending = false;
+            transportController.startPlayback();
         }
-        else if (currentState == TransportController::State::Overdubbing)
+    }
+    
+    if (!loopImporter.isReadyToStream())
+        return;
+    
+    if (!loopBufferManager.isStorageReady())
+    {
+        loopBufferManager.requestStorage();
+        return;
+    }
+    
+    // The imported file replaces whatever was recorded or armed
+    boundaryRefiner.cancelRefinement();
+    recordPending = false;
+    overdubPending = false;
+    pendingSyncEvent = SyncEvent::None;
+    transportController.stopPlayback();
+    
+    overdubLayers.flatten();
+    const int loopLength = loopImporter.beginStreaming();
+    if (loopLength <= 0)
+        return;
+    
+    transportController.setLoopLength(loopLength);
+    transportController.setPositionSamples(0);
+    idleSamples = 0;
+    importPlaybackPending = true;
+    
+    // The file has no place on the shared grid, and a grid this instance published no longer applies
+    loopOnClockGrid = false;
+    sharedClock->release(this);
+}
+
+void Looper::beginPendingExport()
+{
+    if (!loopExporter.isSnapshotRequested())
+        return;
+    
+    // An import still writing the loop is exported once it is complete
+    if (loopImporter.isStreaming())
+        return;
+    
+    // A take in progress has no loop boundary yet, export it once it is closed
+    if (transportController.getCurrentState() == TransportController::State::Recording)
+        return;
+    
+    // A compacted loop is expanded first; the request stays pending meanwhile
+    if (!loopBufferManager.isStorageReady())
+    {
+        loopBufferManager.requestStorage();
+        return;
+    }
+    
+    loopExporter.beginSnapshot();
+}
+
+void Looper::applyRefinedLoopBoundary()
+{
+    int startOffset = 0;
+    int refinedLength = 0;
+    if (!boundaryRefiner.getRefinedBoundary(startOffset, refinedLength))
+        return;
+    
+    // A new recording supersedes any refinement of the previous take
+    if (transportController.getCurrentState() == TransportController::State::Recording)
+        return;
+    
+    // Boundaries can only move while the loop is held as float samples
+    if (!loopBufferManager.isStorageReady())
+        return;
+    
+    // Layer offsets are relative to the old origin
+    overdubLayers.flatten();
+    loopBufferManager.setLoopBoundary(loopBufferManager.getLoopStart() + startOffset, refinedLength);
+    transportController.setLoopLength(refinedLength);
+    
+    // Keep the audible position continuous across the moved loop origin
+    transportController.setPositionSamples(transportController.getPlaybackPositionSamples() - startOffset);
+    
+    // Followers quantize to the refined loop from now on
+    if (sharedClock->isMaster(this))
+    {
+        recordStartTimeline += startOffset;
+        if (sharedClock->publish(this, recordStartTimeline, refinedLength))
         {
-            transportController.stopOverdub();
+            clockGrid.originSample = recordStartTimeline;
+            clockGrid.loopLength = refinedLength;
         }
     }
 }
 
+void Looper::prepareLoopConversion(double newSampleRate, int newNumChannels)
+{
+    // Land a conversion that is still in flight so its output is what gets captured
+    if (conversionPending.load(std::memory_order_acquire))
+    {
+        rateConverter.waitUntilIdle();
+        
+        int convertedLength = 0;
+        if (rateConverter.getConvertedLength(convertedLength))
+            finishLoopConversion(convertedLength);
+    }
+    
+    // Close a take in progress so that it survives the format change
+    if (transportController.getCurrentState() == TransportController::State::Recording)
+    {
+        transportController.stopRecording();
+        loopBufferManager.setLoopLength(transportController.getLoopLength());
+    }
+    
+    boundaryRefiner.cancelRefinement();
+    loopExporter.cancelExport();
+    loopImporter.cancelImport();
+    importPlaybackPending = false;
+    loopSlicer.cancel();
+    loopSlicer.waitUntilIdle();
+    const bool hasLoop = rateConverter.captureLoop(numChannels);
+    
+    loopBufferManager.initialize(newSampleRate, newNumChannels, maxLoopLengthSeconds);
+    boundaryRefiner.initialize(newSampleRate, newNumChannels);
+    
+    // The converted loop is written into the new storage, so it has to be there first
+    if (hasLoop)
+        loopBufferManager.waitForStorage(10000);
+    
+    // Slice positions are in samples of the old rate; the converted loop is sliced anew
+    loopSlicer.initialize(newNumChannels, loopBufferManager.getMaxBufferSize());
+    sliceMap = nullptr;
+    slicedLength = -1;
+    stutterActive = false;
+    
+    if (hasLoop)
+    {
+        conversionRatio = newSampleRate / sampleRate;
+        conversionPending.store(true, std::memory_order_release);
+        rateConverter.startConversion(sampleRate, newSampleRate);
+    }
+}
+
+void Looper::finishLoopConversion(int convertedLength)
+{
+    const juce::int64 previousPosition = transportController.getPlaybackPositionSamples();
+    
+    transportController.setLoopLength(convertedLength);
+    transportController.setPositionSamples(static_cast<juce::int64>(previousPosition * conversionRatio));
+    
+    conversionPending.store(false, std::memory_order_release);
+}
+
 void Looper::processAudioForCurrentState(juce::AudioBuffer<float>& buffer)
 {
     const auto currentState = transportController.getCurrentState();
@@ -110,42 +1345,129 @@ void Looper::processAudioForCurrentState(juce::AudioBuffer<float>& buffer)
         {
             // Write input audio to the loop buffer
             loopBufferManager.writeAudio(buffer, 0, numSamples);
-            // Pass through the input audio
+            // Pass through the input audio while monitored
+            buffer.applyGain(getDryGain(currentState));
             break;
         }
         
         case TransportController::State::Playing:
         {
-            // Read from loop buffer and replace the input
-            const float position = transportController.getPlaybackPosition();
-            loopBufferManager.readAudio(buffer, 0, numSamples, position);
-            
-            // Apply volume control
+            // The loop at its volume is mixed over the input at the dry level, in one pass over the block
+            const float dryGain = getDryGain(currentState);
             const float volume = parameterManager.getVolumeLevel();
-            buffer.applyGain(volume);
+            
+            // Parts of an imported loop that are still being decoded play as silence; under varispeed
+            // the segment reads further into the loop than its own length
+            const auto readLength = static_cast<juce::int64>(std::ceil(numSamples * transportController.getPlaybackRate())) + 1;
+            if (loopImporter.isStreaming()
+                && transportController.getPlaybackPositionSamples() + readLength > loopImporter.getAvailableLength())
+            {
+                buffer.applyGain(dryGain);
+                break;
+            }
+            
+            if (loopOutput == nullptr)
+            {
+                readSlicedLoop(buffer, numSamples, dryGain, volume);
+                break;
+            }
+            
+            // The loop bus takes the loop alone; the output mixes it from there rather than reading it twice
+            juce::AudioBuffer<float> loopSegment(loopOutput->getArrayOfWritePointers(), loopOutput->getNumChannels(),
+                                                 segmentStart, numSamples);
+            if (!readSlicedLoop(loopSegment, numSamples, 0.0f, volume))
+            {
+                buffer.applyGain(dryGain);
+                break;
+            }
+            
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                if (channel < loopSegment.getNumChannels())
+                    SampleMix::scaleAndAdd(buffer.getWritePointer(channel), loopSegment.getReadPointer(channel),
+                                           dryGain, 1.0f, numSamples);
+                else
+                    SampleMix::scale(buffer.getWritePointer(channel), dryGain, numSamples);
+            }
             break;
         }
         
         case TransportController::State::Overdubbing:
         {
-            // Read existing loop content
-            const float position = transportController.getPlaybackPosition();
-            loopBuffer.setSize(buffer.getNumChannels(), numSamples, false, false, true);
-            loopBufferManager.readAudio(loopBuffer, 0, numSamples, position);
+            overdubEngine.setToneShaping(parameterManager.getLowCutFrequency(),
+                                         parameterManager.getHighCutFrequency(),
+                                         parameterManager.getSaturationAmount());
+            
+            // Each pass goes into a layer of its own when one is ready
+            if (!overdubPassActive)
+            {
+                overdubPassActive = true;
+                overdubLayers.beginLayer();
+            }
+            
+            // Read existing loop content, ahead by the feedback path delay so it lands back in place
+            const juce::int64 position = transportController.getPlaybackPositionSamples();
+            const int feedbackLatency = overdubEngine.getFeedbackLatency();
+            // Segments never exceed a sub-block, so a view into the scratch buffer covers it
+            jassert(numSamples <= loopBuffer.getNumSamples());
+            juce::AudioBuffer<float> loopSegment(loopBuffer.getArrayOfWritePointers(),
+                                                 juce::jmin(buffer.getNumChannels(), loopBuffer.getNumChannels()),
+                                                 numSamples);
+            const bool loopAudible = loopBufferManager.readLoop(loopSegment, 0, numSamples, position + feedbackLatency);
+            
+            // Silence over a silent region leaves the loop unchanged and the output silent
+            if (!loopAudible && isSilent(buffer, numSamples))
+            {
+                buffer.clear();
+                break;
+            }
+            
+            // Keep the loop as it was at the playback position: it is what the output hears, like playback,
+            // and the layer takes what this pass changes against it
+            juce::AudioBuffer<float> previous(tempBuffer.getArrayOfWritePointers(), loopSegment.getNumChannels(), numSamples);
+            bool previousAudible = loopAudible;
+            if (feedbackLatency == 0)
+            {
+                for (int channel = 0; channel < loopSegment.getNumChannels(); ++channel)
+                    previous.copyFrom(channel, 0, loopSegment, channel, 0, numSamples);
+            }
+            else
+            {
+                previousAudible = loopBufferManager.readLoop(previous, 0, numSamples, position);
+            }
+            
+            // The loop output carries the loop as it was, without the input being added
+            const float volume = parameterManager.getVolumeLevel();
+            if (previousAudible)
+                sendToLoopOutput(previous, numSamples, volume);
             
             // Mix input with existing content using overdub engine
             const float feedbackLevel = parameterManager.getFeedbackLevel();
-            overdubEngine.processOverdub(loopBuffer, buffer, feedbackLevel);
+            overdubEngine.processOverdub(loopSegment, buffer, feedbackLevel);
             
-            // Write the mixed result back to the loop buffer
-            loopBufferManager.writeAudio(loopBuffer, 0, numSamples);
+            // Write the mixed result back into the loop at the same position
+            loopBufferManager.writeLoop(loopSegment, 0, numSamples, position);
             
-            // Output the mixed result
-            buffer.makeCopyOf(loopBuffer);
+            // The output is the input at the dry level over the loop at its volume, as in playback, so the
+            // overdub is heard through monitoring rather than through the loop it is written into
+            const float dryGain = getDryGain(currentState);
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                if (channel < previous.getNumChannels())
+                    SampleMix::scaleAndAdd(buffer.getWritePointer(channel), previous.getReadPointer(channel),
+                                           dryGain, volume, numSamples);
+                else
+                    SampleMix::scale(buffer.getWritePointer(channel), dryGain, numSamples);
+            }
             
-            // Apply volume control
-            const float volume = parameterManager.getVolumeLevel();
-            buffer.applyGain(volume);
+            if (overdubLayers.isRecordingLayer())
+            {
+                for (int channel = 0; channel < loopSegment.getNumChannels(); ++channel)
+                    juce::FloatVectorOperations::subtract(previous.getWritePointer(channel), loopSegment.getReadPointer(channel),
+                                                          previous.getReadPointer(channel), numSamples);
+                
+                overdubLayers.addToLayer(previous, numSamples, position);
+            }
             break;
         }
         
@@ -158,4 +1480,42 @@ void Looper::processAudioForCurrentState(juce::AudioBuffer<float>& buffer)
     }
 }
 
+float Looper::getDryGain(TransportController::State state) const
+{
+    switch (parameterManager.getMonitoring())
+    {
+        case ParameterManager::Monitoring::Always:
+            return parameterManager.getDryLevel();
+        
+        case ParameterManager::Monitoring::WhileRecording:
+            return state == TransportController::State::Playing ? 0.0f : parameterManager.getDryLevel();
+        
+        case ParameterManager::Monitoring::Never:
+        default:
+            return 0.0f;
+    }
+}
+
+void Looper::sendToLoopOutput(const juce::AudioBuffer<float>& source, int numSamples, float gain)
+{
+    if (loopOutput == nullptr)
+        return;
+    
+    // Written straight into the host's bus at the segment's position
+    const int channels = juce::jmin(loopOutput->getNumChannels(), source.getNumChannels());
+    for (int channel = 0; channel < channels; ++channel)
+        loopOutput->copyFrom(channel, segmentStart, source.getReadPointer(channel), numSamples, gain);
+}
+
+bool Looper::isSilent(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        if (buffer.getMagnitude(channel, 0, numSamples) >= CircularAudioBuffer::silenceThreshold)
+            return false;
+    }
+    
+    return true;
+}
+
 } // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "OpenLooper2/LooperCommandQueue.h"
+
+namespace OpenLooper2 {
+
+LooperCommandQueue::LooperCommandQueue()
+{
+}
+
+LooperCommandQueue::~LooperCommandQueue()
+{
+}
+
+bool LooperCommandQueue::push(const LooperCommand& command)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+    {
+        droppedCommands.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    commands[static_cast<size_t>(size1 > 0 ? start1 : start2)] = command;
+    fifo.finishedWrite(1);
+    return true;
+}
+
+bool LooperCommandQueue::peek(LooperCommand& command) const
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+        return false;
+
+    command = commands[static_cast<size_t>(size1 > 0 ? start1 : start2)];
+    return true;
+}
+
+void LooperCommandQueue::pop()
+{
+    if (fifo.getNumReady() > 0)
+        fifo.finishedRead(1);
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -10,20 +10,34 @@ OverdubEngine::~OverdubEngine()
 {
 }
 
-void OverdubEngine::initialize(double sampleRate, int samplesPerBlock)
+void OverdubEngine::initialize(double sampleRate, int samplesPerBlock, int numChannels)
 {
     this->sampleRate = sampleRate;
     this->samplesPerBlock = samplesPerBlock;
+    this->numChannels = numChannels;
     
     // Initialize DSP components
     juce::dsp::ProcessSpec spec;
     spec.sampleRate = sampleRate;
     spec.maximumBlockSize = static_cast<juce::uint32>(samplesPerBlock);
-    spec.numChannels = 2; // Stereo
+    spec.numChannels = static_cast<juce::uint32>(numChannels);
     
     feedbackGain.prepare(spec);
     overdubGain.prepare(spec);
     
+    // The filters process all channels of a block in one call
+    lowCutFilter.prepare(spec);
+    lowCutFilter.setType(juce::dsp::StateVariableTPTFilterType::highpass);
+    lowCutFilter.setCutoffFrequency(lowCutFrequency);
+    highCutFilter.prepare(spec);
+    highCutFilter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
+    highCutFilter.setCutoffFrequency(juce::jmin(highCutFrequency, static_cast<float>(sampleRate * 0.45)));
+    
+    // 2x oversampling for the saturator only, with an integer delay the caller can compensate
+    saturationOversampler = std::make_unique<juce::dsp::Oversampling<float>>(
+        static_cast<size_t>(numChannels), 1, juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, false, true);
+    saturationOversampler->initProcessing(static_cast<size_t>(samplesPerBlock));
+    
     // Set initial gain values
     feedbackGain.setGainLinear(currentFeedbackLevel.load(std::memory_order_acquire));
     overdubGain.setGainLinear(currentOverdubGain.load(std::memory_order_acquire));
@@ -52,7 +66,8 @@ void OverdubEngine::processOverdub(juce::AudioBuffer<float>& buffer,
     juce::dsp::AudioBlock<float> bufferBlock(buffer);
     juce::dsp::AudioBlock<const float> inputBlock(input);
     
-    // Apply feedback to existing buffer content
+    // Shape and apply feedback to existing buffer content
+    shapeFeedback(bufferBlock);
     feedbackGain.process(juce::dsp::ProcessContextReplacing<float>(bufferBlock));
     
     // Mix in the new input with overdub gain
@@ -83,6 +98,91 @@ void OverdubEngine::setOverdubGain(float gain)
     currentOverdubGain.store(clampedGain, std::memory_order_release);
 }
 
+void OverdubEngine::setToneShaping(float lowCutHz, float highCutHz, float saturation)
+{
+    // Filter coefficients are only recomputed when a setting actually moves
+    const float newLowCut = juce::jlimit(minLowCutHz, maxHighCutHz, lowCutHz);
+    if (newLowCut != lowCutFrequency)
+    {
+        lowCutFrequency = newLowCut;
+        lowCutFilter.setCutoffFrequency(lowCutFrequency);
+    }
+    
+    const float newHighCut = juce::jlimit(minLowCutHz, maxHighCutHz, highCutHz);
+    if (newHighCut != highCutFrequency)
+    {
+        highCutFrequency = newHighCut;
+        highCutFilter.setCutoffFrequency(juce::jmin(highCutFrequency, static_cast<float>(sampleRate * 0.45)));
+    }
+    
+    const float newSaturation = juce::jlimit(0.0f, 1.0f, saturation);
+    if ((newSaturation > 0.0f) != (saturationAmount > 0.0f) && saturationOversampler != nullptr)
+        saturationOversampler->reset();
+    
+    saturationAmount = newSaturation;
+}
+
+int OverdubEngine::getFeedbackLatency() const
+{
+    if (saturationAmount <= 0.0f || saturationOversampler == nullptr)
+        return 0;
+    
+    return static_cast<int>(saturationOversampler->getLatencyInSamples());
+}
+
+void OverdubEngine::shapeFeedback(juce::dsp::AudioBlock<float>& block)
+{
+    const bool lowCutActive = lowCutFrequency > minLowCutHz;
+    const bool highCutActive = highCutFrequency < maxHighCutHz;
+    const bool saturationActive = saturationAmount > 0.0f && saturationOversampler != nullptr;
+    
+    // Unshaped feedback costs nothing
+    if (!lowCutActive && !highCutActive && !saturationActive)
+        return;
+    
+    const auto channels = juce::jmin(block.getNumChannels(), static_cast<size_t>(numChannels));
+    const auto totalSamples = block.getNumSamples();
+    
+    // Stay within the block size the processors were prepared for
+    for (size_t offset = 0; offset < totalSamples; offset += static_cast<size_t>(samplesPerBlock))
+    {
+        auto subBlock = block.getSubsetChannelBlock(0, channels)
+                             .getSubBlock(offset, juce::jmin(static_cast<size_t>(samplesPerBlock), totalSamples - offset));
+        
+        if (saturationActive)
+        {
+            auto oversampledBlock = saturationOversampler->processSamplesUp(subBlock);
+            saturate(oversampledBlock);
+            saturationOversampler->processSamplesDown(subBlock);
+        }
+        
+        if (lowCutActive)
+            lowCutFilter.process(juce::dsp::ProcessContextReplacing<float>(subBlock));
+        
+        if (highCutActive)
+            highCutFilter.process(juce::dsp::ProcessContextReplacing<float>(subBlock));
+    }
+}
+
+void OverdubEngine::saturate(juce::dsp::AudioBlock<float>& block) const
+{
+    // tanh(drive * x) / drive has unity slope at zero and compresses peaks smoothly
+    const float drive = 1.0f + 4.0f * saturationAmount;
+    const float inverseDrive = 1.0f / drive;
+    
+    for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+    {
+        float* samples = block.getChannelPointer(channel);
+        
+        for (size_t i = 0; i < block.getNumSamples(); ++i)
+        {
+            // The rational approximation is accurate within +-5, beyond that tanh is flat anyway
+            const float x = juce::jlimit(-5.0f, 5.0f, drive * samples[i]);
+            samples[i] = juce::dsp::FastMathApproximations::tanh(x) * inverseDrive;
+        }
+    }
+}
+
 void OverdubEngine::updateGainParameters()
 {
     if (!initialized.load(std::memory_order_acquire))
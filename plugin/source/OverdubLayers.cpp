@@ -0,0 +1,369 @@
+#include "OpenLooper2/OverdubLayers.h"
+
+namespace OpenLooper2 {
+
+OverdubLayers::LayerJob::LayerJob(OverdubLayers& owner)
+    : BackgroundJob(Priority::High),
+      owner(owner)
+{
+}
+
+void OverdubLayers::LayerJob::run()
+{
+    owner.runLayerTransitions();
+}
+
+OverdubLayers::OverdubLayers(LoopBufferManager& loopBufferManager, BackgroundJobQueue& jobQueue)
+    : loopBufferManager(loopBufferManager),
+      jobQueue(jobQueue),
+      layerJob(*this)
+{
+}
+
+OverdubLayers::~OverdubLayers()
+{
+    jobQueue.retractJob(layerJob);
+}
+
+void OverdubLayers::prepare(int numChannels)
+{
+    layerJob.waitUntilIdle();
+
+    for (auto& layer : layers)
+    {
+        layer.memory.release();
+        layer.length = 0;
+        layer.state.store(State::Free, std::memory_order_release);
+    }
+
+    this->numChannels = numChannels;
+    numLayers.store(0, std::memory_order_release);
+    requestedLength.store(0, std::memory_order_release);
+    layerSlot = -1;
+    layerLength = 0;
+    recordingLayer = -1;
+    remixLayer = -1;
+}
+
+void OverdubLayers::update()
+{
+    const int slot = loopBufferManager.getActiveSlot();
+    const int length = loopBufferManager.getLoopLength();
+
+    // Layer offsets only hold for the loop they were recorded over
+    if (slot != layerSlot || length != layerLength)
+    {
+        flatten();
+        layerSlot = slot;
+        layerLength = length;
+    }
+
+    if (requestedLength.load(std::memory_order_relaxed) != length)
+    {
+        requestedLength.store(length, std::memory_order_release);
+        jobQueue.submitFromAudioThread(layerJob);
+    }
+}
+
+void OverdubLayers::flatten()
+{
+    bool dropped = false;
+
+    for (auto& layer : layers)
+    {
+        const auto state = layer.state.load(std::memory_order_acquire);
+        if (state == State::Recording || state == State::Active)
+        {
+            layer.state.store(State::Releasing, std::memory_order_release);
+            dropped = true;
+        }
+    }
+
+    // A remix cut short here leaves the rest of its region at the old gain
+    numLayers.store(0, std::memory_order_release);
+    recordingLayer = -1;
+    remixLayer = -1;
+
+    if (dropped)
+        jobQueue.submitFromAudioThread(layerJob);
+}
+
+bool OverdubLayers::beginLayer()
+{
+    if (recordingLayer >= 0 || layerLength <= 0)
+        return false;
+
+    const int count = numLayers.load(std::memory_order_relaxed);
+    if (count < maxLayers)
+    {
+        for (int index = 0; index < maxLayers; ++index)
+        {
+            auto& layer = layers[static_cast<size_t>(index)];
+            auto expected = State::Spare;
+            if (!layer.state.compare_exchange_strong(expected, State::Recording, std::memory_order_acq_rel))
+                continue;
+
+            // A spare left from a previous length is the worker's to replace
+            if (layer.length != layerLength)
+            {
+                layer.state.store(State::Spare, std::memory_order_release);
+                continue;
+            }
+
+            layer.gain.store(1.0f, std::memory_order_release);
+            layer.mixedGain = 1.0f;
+            layer.start = 0;
+            layer.extent = 0;
+            layer.removing = false;
+
+            order[static_cast<size_t>(count)].store(index, std::memory_order_release);
+            numLayers.store(count + 1, std::memory_order_release);
+            recordingLayer = index;
+
+            // Get the next spare ready while this pass is recorded
+            jobQueue.submitFromAudioThread(layerJob);
+            return true;
+        }
+    }
+
+    unlayeredPasses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void OverdubLayers::endLayer()
+{
+    if (recordingLayer < 0)
+        return;
+
+    layers[static_cast<size_t>(recordingLayer)].state.store(State::Active, std::memory_order_release);
+    recordingLayer = -1;
+}
+
+void OverdubLayers::addToLayer(const juce::AudioBuffer<float>& change, int numSamples, juce::int64 loopPosition)
+{
+    if (recordingLayer < 0 || numSamples <= 0)
+        return;
+
+    auto& layer = layers[static_cast<size_t>(recordingLayer)];
+    float* const* channels = layer.memory.getChannelPointers();
+    const int channelCount = juce::jmin(change.getNumChannels(), numChannels);
+
+    int offset = static_cast<int>(loopPosition % layerLength);
+    if (offset < 0)
+        offset += layerLength;
+
+    // The region a pass covers grows from where it started, up to the whole loop
+    if (layer.extent == 0)
+        layer.start = offset;
+    layer.extent = juce::jmin(layerLength, layer.extent + numSamples);
+
+    int done = 0;
+    while (done < numSamples)
+    {
+        const int run = juce::jmin(numSamples - done, layerLength - offset);
+        for (int channel = 0; channel < channelCount; ++channel)
+            juce::FloatVectorOperations::add(channels[channel] + offset, change.getReadPointer(channel, done), run);
+
+        done += run;
+        offset = 0;
+    }
+}
+
+bool OverdubLayers::setLayerGain(int layerIndex, float gain)
+{
+    if (layerIndex < 0 || layerIndex >= numLayers.load(std::memory_order_relaxed))
+        return false;
+
+    const int index = order[static_cast<size_t>(layerIndex)].load(std::memory_order_relaxed);
+    if (index == recordingLayer)
+        return false;
+
+    layers[static_cast<size_t>(index)].gain.store(juce::jlimit(0.0f, 2.0f, gain), std::memory_order_release);
+    return true;
+}
+
+bool OverdubLayers::removeLastLayer()
+{
+    const int count = numLayers.load(std::memory_order_relaxed);
+    if (count <= 0)
+        return false;
+
+    const int index = order[static_cast<size_t>(count - 1)].load(std::memory_order_relaxed);
+    if (index == recordingLayer)
+        return false;
+
+    // The remix takes it out of the mixdown, then it is freed
+    auto& layer = layers[static_cast<size_t>(index)];
+    layer.removing = true;
+    layer.gain.store(0.0f, std::memory_order_release);
+    numLayers.store(count - 1, std::memory_order_release);
+
+    // A layer already silent in the mixdown has nothing left to take out
+    if (index != remixLayer && layer.mixedGain == 0.0f)
+    {
+        layer.state.store(State::Releasing, std::memory_order_release);
+        jobQueue.submitFromAudioThread(layerJob);
+    }
+
+    return true;
+}
+
+float OverdubLayers::getLayerGain(int layerIndex) const
+{
+    if (layerIndex < 0 || layerIndex >= numLayers.load(std::memory_order_acquire))
+        return 0.0f;
+
+    const int index = order[static_cast<size_t>(layerIndex)].load(std::memory_order_acquire);
+    return layers[static_cast<size_t>(index)].gain.load(std::memory_order_acquire);
+}
+
+void OverdubLayers::remix(juce::AudioBuffer<float>& scratch, juce::int64 playbackPosition, int numSamples)
+{
+    int budget = remixSamplesPerSample * numSamples;
+
+    while (budget > 0)
+    {
+        if (remixLayer < 0 && !startRemix(playbackPosition))
+            return;
+
+        // The mixdown can only be written as float samples, a compacted loop is expanded first
+        if (!loopBufferManager.isStorageReady())
+        {
+            loopBufferManager.requestStorage();
+            return;
+        }
+
+        auto& layer = layers[static_cast<size_t>(remixLayer)];
+        float* const* channels = layer.memory.getChannelPointers();
+        const int index = (remixFirst + remixDone) % layer.extent;
+        const int offset = (layer.start + index) % layerLength;
+        const int runLength = juce::jmin(juce::jmin(budget, scratch.getNumSamples()),
+                                         juce::jmin(layer.extent - index, layerLength - offset),
+                                         layer.extent - remixDone);
+
+        // Mixdown += (new gain - old gain) * layer, over this stretch of the layer's region
+        juce::AudioBuffer<float> segment(scratch.getArrayOfWritePointers(),
+                                         juce::jmin(scratch.getNumChannels(), numChannels), runLength);
+        loopBufferManager.readLoop(segment, 0, runLength, offset);
+
+        const float gainChange = remixGain - layer.mixedGain;
+        for (int channel = 0; channel < segment.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::addWithMultiply(segment.getWritePointer(channel), channels[channel] + offset,
+                                                         gainChange, runLength);
+
+        loopBufferManager.writeLoop(segment, 0, runLength, offset);
+
+        remixDone += runLength;
+        budget -= runLength;
+
+        if (remixDone >= layer.extent)
+            finishRemix();
+    }
+}
+
+bool OverdubLayers::startRemix(juce::int64 playbackPosition)
+{
+    for (int index = 0; index < maxLayers; ++index)
+    {
+        auto& layer = layers[static_cast<size_t>(index)];
+        const auto state = layer.state.load(std::memory_order_acquire);
+        if (state != State::Active || layer.mixedGain == layer.gain.load(std::memory_order_acquire))
+            continue;
+
+        remixLayer = index;
+        remixGain = layer.gain.load(std::memory_order_acquire);
+        remixDone = 0;
+
+        // A pass that wrote nothing has nothing to remix
+        if (layer.extent <= 0)
+        {
+            finishRemix();
+            continue;
+        }
+
+        // Start at the playhead when it is inside the region, so the change is heard right away
+        int playOffset = static_cast<int>(playbackPosition % layerLength);
+        if (playOffset < 0)
+            playOffset += layerLength;
+
+        const int fromStart = (playOffset - layer.start + layerLength) % layerLength;
+        remixFirst = fromStart < layer.extent ? fromStart : 0;
+        return true;
+    }
+
+    return false;
+}
+
+void OverdubLayers::finishRemix()
+{
+    auto& layer = layers[static_cast<size_t>(remixLayer)];
+    layer.mixedGain = remixGain;
+    remixLayer = -1;
+
+    if (layer.removing && layer.mixedGain == 0.0f)
+    {
+        layer.state.store(State::Releasing, std::memory_order_release);
+        jobQueue.submitFromAudioThread(layerJob);
+    }
+}
+
+void OverdubLayers::runLayerTransitions()
+{
+    const int length = requestedLength.load(std::memory_order_acquire);
+    bool haveSpare = false;
+
+    for (auto& layer : layers)
+    {
+        auto state = layer.state.load(std::memory_order_acquire);
+
+        if (state == State::Releasing)
+        {
+            layer.memory.release();
+            layer.length = 0;
+            layer.state.store(State::Free, std::memory_order_release);
+            continue;
+        }
+
+        if (state != State::Spare)
+            continue;
+
+        if (layer.length == length && !haveSpare)
+        {
+            haveSpare = true;
+            continue;
+        }
+
+        // A spare for another loop length is of no use; the audio thread may take it meanwhile
+        if (layer.state.compare_exchange_strong(state, State::Allocating, std::memory_order_acq_rel))
+        {
+            layer.memory.release();
+            layer.length = 0;
+            layer.state.store(State::Free, std::memory_order_release);
+        }
+    }
+
+    if (haveSpare || length <= 0)
+        return;
+
+    for (auto& layer : layers)
+    {
+        auto expected = State::Free;
+        if (!layer.state.compare_exchange_strong(expected, State::Allocating, std::memory_order_acq_rel))
+            continue;
+
+        // Fresh memory is zeroed, so the spare is ready to take a pass as it is
+        if (layer.memory.allocate(numChannels, length))
+        {
+            layer.length = length;
+            layer.state.store(State::Spare, std::memory_order_release);
+        }
+        else
+        {
+            juce::Logger::writeToLog("OverdubLayers: no memory for a layer of " + juce::String(length) + " samples");
+            layer.state.store(State::Free, std::memory_order_release);
+        }
+        return;
+    }
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -8,6 +8,8 @@ ParameterManager::ParameterManager()
 
 ParameterManager::~ParameterManager()
 {
+    // The owner is expected to have detached already, while the state still existed
+    jassert(attachedState == nullptr);
 }
 
 void ParameterManager::createParameters(juce::AudioProcessorValueTreeState& apvts)
@@ -42,6 +44,116 @@ juce::AudioProcessorValueTreeState::ParameterLayout ParameterManager::createPara
         VOLUME_ID, "Volume", 
         juce::NormalisableRange<float>(0.0f, 2.0f, 0.01f), 1.0f));
 
+    // Varispeed of plain loop playback, pitch and tempo together; unity sits mid-travel
+    juce::NormalisableRange<float> playbackRateRange(0.25f, 4.0f, 0.001f);
+    playbackRateRange.setSkewForCentre(1.0f);
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        PLAYBACK_RATE_ID, "Playback Rate", playbackRateRange, 1.0f));
+
+    // Live input in the output; Volume is the loop's level next to it
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        DRY_LEVEL_ID, "Dry Level",
+        juce::NormalisableRange<float>(0.0f, 2.0f, 0.01f), 1.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        MONITORING_ID, "Input Monitoring", juce::StringArray{"Always", "While Recording", "Never"}, 1));
+
+    // Feedback path tone shaping, the end stops switch the filters off
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        LOW_CUT_ID, "Feedback Low Cut",
+        juce::NormalisableRange<float>(20.0f, 2000.0f, 1.0f, 0.3f), 20.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        HIGH_CUT_ID, "Feedback High Cut",
+        juce::NormalisableRange<float>(1000.0f, 20000.0f, 1.0f, 0.3f), 20000.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        SATURATION_ID, "Feedback Saturation",
+        juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 0.0f));
+
+    // Loop editing options
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        REFINE_ID, "Refine Loop Edges", false));
+
+    // Memory options
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        COMPACT_ID, "Compact Idle Loops", false));
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        COMPACT_LOSSY_ID, "Lossy Compaction", false));
+
+    // Synchronization between instances
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        SYNC_ID, "Sync To Shared Clock", false));
+
+    // Clip slots, and scenes that switch the slot of every synced instance (0 launches nothing)
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        SLOT_ID, "Clip Slot", 1, numClipSlots, 1));
+    
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        SCENE_ID, "Launch Scene", 0, numClipSlots, 0));
+
+    // Slice playback; retrigger and stutter are also played from MIDI notes
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        SLICE_MODE_ID, "Slice Mode", juce::StringArray{"Grid", "Transients"}, 0));
+    
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        SLICES_ID, "Slices", 1, maxSlices, 1));
+    
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        SLICE_ORDER_ID, "Slice Order", juce::StringArray{"Forward", "Reverse", "Shuffle"}, 0));
+    
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        RETRIGGER_ID, "Retrigger Slice", 0, maxSlices, 0));
+    
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        STUTTER_ID, "Stutter", false));
+    
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        STUTTER_LENGTH_ID, "Stutter Length", juce::StringArray{"1/1", "1/2", "1/4", "1/8", "1/16"}, 2));
+
+    // Multi-tap echo on the output
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        ECHO_ID, "Echo", false));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        ECHO_TIME_ID, "Echo Time",
+        juce::NormalisableRange<float>(10.0f, 1000.0f, 1.0f, 0.5f), 375.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        ECHO_TAPS_ID, "Echo Taps", 1, 4, 1));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        ECHO_FEEDBACK_ID, "Echo Feedback",
+        juce::NormalisableRange<float>(0.0f, 0.95f, 0.01f), 0.4f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        ECHO_MIX_ID, "Echo Mix",
+        juce::NormalisableRange<float>(0.0f, 1.0f, 0.01f), 0.35f));
+
+    // Granular playback of the loop instead of the linear read
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        GRANULAR_ID, "Granular", false));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        GRAIN_POSITION_ID, "Grain Position",
+        juce::NormalisableRange<float>(0.0f, 1.0f, 0.001f), 0.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        GRAIN_SPRAY_ID, "Grain Spray",
+        juce::NormalisableRange<float>(0.0f, 1.0f, 0.001f), 0.1f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        GRAIN_SIZE_ID, "Grain Size",
+        juce::NormalisableRange<float>(10.0f, 500.0f, 1.0f, 0.5f), 80.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        GRAIN_DENSITY_ID, "Grain Density",
+        juce::NormalisableRange<float>(1.0f, 400.0f, 0.1f, 0.4f), 20.0f));
+    
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        GRAIN_PITCH_ID, "Grain Pitch",
+        juce::NormalisableRange<float>(-24.0f, 24.0f, 0.01f), 0.0f));
+
     return layout;
 }
 
@@ -83,6 +195,162 @@ void ParameterManager::updateFromParameters(const juce::AudioProcessorValueTreeS
     
     feedbackLevel.store(newFeedback, std::memory_order_release);
     volumeLevel.store(newVolume, std::memory_order_release);
+    playbackRate.store(*apvts.getRawParameterValue(PLAYBACK_RATE_ID), std::memory_order_release);
+    
+    dryLevel.store(*apvts.getRawParameterValue(DRY_LEVEL_ID), std::memory_order_release);
+    monitoring.store(juce::roundToInt(apvts.getRawParameterValue(MONITORING_ID)->load()), std::memory_order_release);
+    
+    const bool newRefine = *apvts.getRawParameterValue(REFINE_ID) > 0.5f;
+    refineBoundaries.store(newRefine, std::memory_order_release);
+    
+    const bool newCompact = *apvts.getRawParameterValue(COMPACT_ID) > 0.5f;
+    compactIdleLoops.store(newCompact, std::memory_order_release);
+    
+    const bool newCompactLossy = *apvts.getRawParameterValue(COMPACT_LOSSY_ID) > 0.5f;
+    compactLossy.store(newCompactLossy, std::memory_order_release);
+    
+    const bool newSync = *apvts.getRawParameterValue(SYNC_ID) > 0.5f;
+    clockSync.store(newSync, std::memory_order_release);
+    
+    lowCutFrequency.store(*apvts.getRawParameterValue(LOW_CUT_ID), std::memory_order_release);
+    highCutFrequency.store(*apvts.getRawParameterValue(HIGH_CUT_ID), std::memory_order_release);
+    saturationAmount.store(*apvts.getRawParameterValue(SATURATION_ID), std::memory_order_release);
+    
+    detectSelection(slotValue, slotRequest, *apvts.getRawParameterValue(SLOT_ID));
+    detectSelection(sceneValue, sceneRequest, *apvts.getRawParameterValue(SCENE_ID));
+    
+    sliceMode.store(juce::roundToInt(apvts.getRawParameterValue(SLICE_MODE_ID)->load()), std::memory_order_release);
+    numSlices.store(juce::roundToInt(apvts.getRawParameterValue(SLICES_ID)->load()), std::memory_order_release);
+    sliceOrder.store(juce::roundToInt(apvts.getRawParameterValue(SLICE_ORDER_ID)->load()), std::memory_order_release);
+    detectSelection(retriggerValue, retriggerRequest, *apvts.getRawParameterValue(RETRIGGER_ID));
+    stutterHeld.store(*apvts.getRawParameterValue(STUTTER_ID) > 0.5f, std::memory_order_release);
+    stutterLength.store(juce::roundToInt(apvts.getRawParameterValue(STUTTER_LENGTH_ID)->load()), std::memory_order_release);
+    
+    echoEnabled.store(*apvts.getRawParameterValue(ECHO_ID) > 0.5f, std::memory_order_release);
+    echoTime.store(*apvts.getRawParameterValue(ECHO_TIME_ID), std::memory_order_release);
+    echoTaps.store(juce::roundToInt(apvts.getRawParameterValue(ECHO_TAPS_ID)->load()), std::memory_order_release);
+    echoFeedback.store(*apvts.getRawParameterValue(ECHO_FEEDBACK_ID), std::memory_order_release);
+    echoMix.store(*apvts.getRawParameterValue(ECHO_MIX_ID), std::memory_order_release);
+    
+    granularEnabled.store(*apvts.getRawParameterValue(GRANULAR_ID) > 0.5f, std::memory_order_release);
+    grainPosition.store(*apvts.getRawParameterValue(GRAIN_POSITION_ID), std::memory_order_release);
+    grainSpray.store(*apvts.getRawParameterValue(GRAIN_SPRAY_ID), std::memory_order_release);
+    grainSize.store(*apvts.getRawParameterValue(GRAIN_SIZE_ID), std::memory_order_release);
+    grainDensity.store(*apvts.getRawParameterValue(GRAIN_DENSITY_ID), std::memory_order_release);
+    grainPitch.store(*apvts.getRawParameterValue(GRAIN_PITCH_ID), std::memory_order_release);
+}
+
+void ParameterManager::attachTo(juce::AudioProcessorValueTreeState& apvts)
+{
+    detach();
+    
+    attachedState = &apvts;
+    for (const auto* parameterID : parameterIDs)
+        apvts.addParameterListener(parameterID, this);
+    
+    // Start from the current values, later changes arrive through parameterChanged
+    updateFromParameters(apvts);
+}
+
+void ParameterManager::detach()
+{
+    if (attachedState == nullptr)
+        return;
+    
+    for (const auto* parameterID : parameterIDs)
+        attachedState->removeParameterListener(parameterID, this);
+    
+    attachedState = nullptr;
+}
+
+void ParameterManager::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    const bool enabled = newValue > 0.5f;
+    
+    if (parameterID == RECORD_ID)
+        detectPress(prevRecordState, recordTriggered, enabled);
+    else if (parameterID == PLAY_ID)
+        detectPress(prevPlayState, playTriggered, enabled);
+    else if (parameterID == STOP_ID)
+        detectPress(prevStopState, stopTriggered, enabled);
+    else if (parameterID == OVERDUB_ID)
+        detectPress(prevOverdubState, overdubTriggered, enabled);
+    else if (parameterID == FEEDBACK_ID)
+        feedbackLevel.store(newValue, std::memory_order_release);
+    else if (parameterID == VOLUME_ID)
+        volumeLevel.store(newValue, std::memory_order_release);
+    else if (parameterID == PLAYBACK_RATE_ID)
+        playbackRate.store(newValue, std::memory_order_release);
+    else if (parameterID == DRY_LEVEL_ID)
+        dryLevel.store(newValue, std::memory_order_release);
+    else if (parameterID == MONITORING_ID)
+        monitoring.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == REFINE_ID)
+        refineBoundaries.store(enabled, std::memory_order_release);
+    else if (parameterID == COMPACT_ID)
+        compactIdleLoops.store(enabled, std::memory_order_release);
+    else if (parameterID == COMPACT_LOSSY_ID)
+        compactLossy.store(enabled, std::memory_order_release);
+    else if (parameterID == SYNC_ID)
+        clockSync.store(enabled, std::memory_order_release);
+    else if (parameterID == LOW_CUT_ID)
+        lowCutFrequency.store(newValue, std::memory_order_release);
+    else if (parameterID == HIGH_CUT_ID)
+        highCutFrequency.store(newValue, std::memory_order_release);
+    else if (parameterID == SATURATION_ID)
+        saturationAmount.store(newValue, std::memory_order_release);
+    else if (parameterID == SLOT_ID)
+        detectSelection(slotValue, slotRequest, newValue);
+    else if (parameterID == SCENE_ID)
+        detectSelection(sceneValue, sceneRequest, newValue);
+    else if (parameterID == SLICE_MODE_ID)
+        sliceMode.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == SLICES_ID)
+        numSlices.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == SLICE_ORDER_ID)
+        sliceOrder.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == RETRIGGER_ID)
+        detectSelection(retriggerValue, retriggerRequest, newValue);
+    else if (parameterID == STUTTER_ID)
+        stutterHeld.store(enabled, std::memory_order_release);
+    else if (parameterID == STUTTER_LENGTH_ID)
+        stutterLength.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == ECHO_ID)
+        echoEnabled.store(enabled, std::memory_order_release);
+    else if (parameterID == ECHO_TIME_ID)
+        echoTime.store(newValue, std::memory_order_release);
+    else if (parameterID == ECHO_TAPS_ID)
+        echoTaps.store(juce::roundToInt(newValue), std::memory_order_release);
+    else if (parameterID == ECHO_FEEDBACK_ID)
+        echoFeedback.store(newValue, std::memory_order_release);
+    else if (parameterID == ECHO_MIX_ID)
+        echoMix.store(newValue, std::memory_order_release);
+    else if (parameterID == GRANULAR_ID)
+        granularEnabled.store(enabled, std::memory_order_release);
+    else if (parameterID == GRAIN_POSITION_ID)
+        grainPosition.store(newValue, std::memory_order_release);
+    else if (parameterID == GRAIN_SPRAY_ID)
+        grainSpray.store(newValue, std::memory_order_release);
+    else if (parameterID == GRAIN_SIZE_ID)
+        grainSize.store(newValue, std::memory_order_release);
+    else if (parameterID == GRAIN_DENSITY_ID)
+        grainDensity.store(newValue, std::memory_order_release);
+    else if (parameterID == GRAIN_PITCH_ID)
+        grainPitch.store(newValue, std::memory_order_release);
+}
+
+void ParameterManager::detectPress(std::atomic<bool>& previousState, std::atomic<bool>& trigger, bool pressed)
+{
+    const bool wasPressed = previousState.exchange(pressed, std::memory_order_acq_rel);
+    if (pressed && !wasPressed)
+        trigger.store(true, std::memory_order_release);
+}
+
+void ParameterManager::detectSelection(std::atomic<int>& previousValue, std::atomic<int>& request, float newValue)
+{
+    const int value = juce::roundToInt(newValue);
+    if (previousValue.exchange(value, std::memory_order_acq_rel) != value && value > 0)
+        request.store(value - 1, std::memory_order_release);
 }
 
 bool ParameterManager::wasRecordTriggered()
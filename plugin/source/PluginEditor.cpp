@@ -1,14 +1,54 @@
 #include "OpenLooper2/PluginProcessor.h"
 #include "OpenLooper2/PluginEditor.h"
+#include "OpenLooper2/Looper.h"
 
 //==============================================================================
 AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor& p)
     : AudioProcessorEditor(p), 
-    processorRef(p)
+    processorRef(p),
+    waveformView (p.getLooper())
 {
-    juce::ignoreUnused(processorRef);
+    addAndMakeVisible (waveformView);
     
-    setSize (400, 300);
+    // Loop length edits go through the command queue, so they land on the sample they were pressed at
+    multiplyButton.onClick = [this] { processorRef.getLooper().sendCommand (OpenLooper2::LooperCommand::Type::Multiply, 2); };
+    addAndMakeVisible (multiplyButton);
+    
+    divideButton.onClick = [this] { processorRef.getLooper().sendCommand (OpenLooper2::LooperCommand::Type::Divide, 2); };
+    addAndMakeVisible (divideButton);
+    
+    // Undo abandons a take in progress, or takes the last overdub layer back out of the loop
+    undoButton.onClick = [this] { processorRef.getLooper().sendCommand (OpenLooper2::LooperCommand::Type::Undo); };
+    addAndMakeVisible (undoButton);
+    
+    layerSelector.setSliderStyle (juce::Slider::IncDecButtons);
+    layerSelector.setTextBoxStyle (juce::Slider::TextBoxLeft, false, 60, 30);
+    layerSelector.setRange (1.0, static_cast<double> (OpenLooper2::OverdubLayers::maxLayers), 1.0);
+    layerSelector.textFromValueFunction = [] (double value) { return "Layer " + juce::String (juce::roundToInt (value)); };
+    layerSelector.onValueChange = [this] { updateLayerControls(); };
+    addAndMakeVisible (layerSelector);
+    
+    layerGainSlider.setSliderStyle (juce::Slider::LinearHorizontal);
+    layerGainSlider.setTextBoxStyle (juce::Slider::TextBoxRight, false, 50, 30);
+    layerGainSlider.setRange (0.0, 2.0, 0.01);
+    layerGainSlider.onValueChange = [this]
+    {
+        processorRef.getLooper().setLayerGain (juce::roundToInt (layerSelector.getValue()) - 1,
+                                               static_cast<float> (layerGainSlider.getValue()));
+    };
+    addAndMakeVisible (layerGainSlider);
+    
+    importButton.onClick = [this] { chooseImportFile(); };
+    addAndMakeVisible (importButton);
+    
+    exportButton.onClick = [this] { chooseExportFile(); };
+    addAndMakeVisible (exportButton);
+    
+    fileStatusLabel.setJustificationType (juce::Justification::centredLeft);
+    addAndMakeVisible (fileStatusLabel);
+    
+    setSize (400, 340);
+    startTimerHz (10);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
@@ -21,11 +61,167 @@ void AudioPluginAudioProcessorEditor::paint (juce::Graphics& g)
 
     g.setColour (juce::Colours::white);
     g.setFont (15.0f);
-    g.drawFittedText("Ron U JUCE Plugin, openlooper2 !", getLocalBounds(), juce::Justification::centred, 1);
+    g.drawFittedText("Ron U JUCE Plugin, openlooper2 !", getLocalBounds().reduced (10).removeFromTop (20), juce::Justification::centred, 1);
 }
 
 void AudioPluginAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto area = getLocalBounds().reduced (10);
+    area.removeFromTop (30);
+    auto fileArea = area.removeFromBottom (30);
+    area.removeFromBottom (10);
+    auto layerArea = area.removeFromBottom (30);
+    area.removeFromBottom (10);
+    auto lengthArea = area.removeFromBottom (30);
+    area.removeFromBottom (10);
+    waveformView.setBounds (area);
+    
+    multiplyButton.setBounds (lengthArea.removeFromLeft (100));
+    lengthArea.removeFromLeft (10);
+    divideButton.setBounds (lengthArea.removeFromLeft (100));
+    
+    undoButton.setBounds (layerArea.removeFromLeft (60));
+    layerArea.removeFromLeft (10);
+    layerSelector.setBounds (layerArea.removeFromLeft (120));
+    layerArea.removeFromLeft (10);
+    layerGainSlider.setBounds (layerArea);
+    
+    importButton.setBounds (fileArea.removeFromLeft (100));
+    fileArea.removeFromLeft (10);
+    exportButton.setBounds (fileArea.removeFromLeft (100));
+    fileArea.removeFromLeft (10);
+    fileStatusLabel.setBounds (fileArea);
+}
+
+void AudioPluginAudioProcessorEditor::updateLayerControls()
+{
+    const auto& layers = processorRef.getLooper().getOverdubLayers();
+    const int numLayers = layers.getNumLayers();
+    
+    // The selector stays on a layer that exists as passes are recorded and undone
+    if (layerSelector.getValue() > numLayers)
+        layerSelector.setValue (juce::jmax (1, numLayers), juce::dontSendNotification);
+    
+    layerSelector.setEnabled (numLayers > 1);
+    layerGainSlider.setEnabled (numLayers > 0);
+    
+    if (! layerGainSlider.isMouseButtonDown())
+        layerGainSlider.setValue (layers.getLayerGain (juce::roundToInt (layerSelector.getValue()) - 1),
+                                  juce::dontSendNotification);
+}
+
+void AudioPluginAudioProcessorEditor::chooseImportFile()
+{
+    fileChooser = std::make_unique<juce::FileChooser> ("Import Loop",
+        juce::File::getSpecialLocation (juce::File::userMusicDirectory),
+        "*.wav;*.flac;*.aif;*.aiff");
+    
+    const auto flags = juce::FileChooser::openMode | juce::FileChooser::canSelectFiles;
+    fileChooser->launchAsync (flags, [this] (const juce::FileChooser& chooser)
+    {
+        const auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        lastFileAction = FileAction::Import;
+        if (! processorRef.getLooper().importLoop (file))
+            fileStatusLabel.setText ("Import already in progress", juce::dontSendNotification);
+    });
+}
+
+void AudioPluginAudioProcessorEditor::chooseExportFile()
+{
+    fileChooser = std::make_unique<juce::FileChooser> ("Export Loop",
+        juce::File::getSpecialLocation (juce::File::userMusicDirectory).getChildFile ("loop.wav"),
+        "*.wav;*.flac");
+    
+    const auto flags = juce::FileChooser::saveMode | juce::FileChooser::warnAboutOverwriting;
+    fileChooser->launchAsync (flags, [this] (const juce::FileChooser& chooser)
+    {
+        const auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        
+        lastFileAction = FileAction::Export;
+        const auto format = file.hasFileExtension ("flac") ? OpenLooper2::LoopExporter::Format::Flac
+                                                           : OpenLooper2::LoopExporter::Format::Wav;
+        
+        if (! processorRef.getLooper().exportLoop (file, format))
+            fileStatusLabel.setText ("Nothing to export", juce::dontSendNotification);
+    });
+}
+
+void AudioPluginAudioProcessorEditor::timerCallback()
+{
+    const auto& looper = processorRef.getLooper();
+    updateLayerControls();
+    
+    if (lastFileAction == FileAction::Import)
+    {
+        using State = OpenLooper2::LoopImporter::State;
+        
+        switch (looper.getImportState())
+        {
+            case State::Opening:
+            case State::Ready:
+            case State::Streaming:
+                fileStatusLabel.setText ("Importing...", juce::dontSendNotification);
+                break;
+            
+            case State::Succeeded:
+                fileStatusLabel.setText ("Loop imported", juce::dontSendNotification);
+                break;
+            
+            case State::Failed:
+                fileStatusLabel.setText ("Import failed", juce::dontSendNotification);
+                break;
+            
+            case State::Idle:
+            default:
+                break;
+        }
+    }
+    else if (lastFileAction == FileAction::Export)
+    {
+        using State = OpenLooper2::LoopExporter::State;
+        
+        switch (looper.getExportState())
+        {
+            case State::Requested:
+            case State::Exporting:
+                fileStatusLabel.setText ("Exporting...", juce::dontSendNotification);
+                break;
+            
+            case State::Succeeded:
+                fileStatusLabel.setText ("Loop exported", juce::dontSendNotification);
+                break;
+            
+            case State::Failed:
+                fileStatusLabel.setText ("Export failed", juce::dontSendNotification);
+                break;
+            
+            case State::Idle:
+            default:
+                break;
+        }
+    }
+    else
+    {
+        // Until a file is imported or exported, the label warns when recording may hit page faults
+        const auto memoryStatus = looper.getLoopMemoryStatus();
+        const auto now = juce::Time::getMillisecondCounter();
+        
+        if (memoryStatus.lockFailures > 0 && ! lockFailureReported)
+        {
+            lockFailureReported = true;
+            lockWarningEndTime = now + lockWarningMilliseconds;
+        }
+        
+        if (memoryStatus.allocationFailures > 0)
+            fileStatusLabel.setText ("Out of loop memory", juce::dontSendNotification);
+        else if (lockFailureReported && now < lockWarningEndTime)
+            fileStatusLabel.setText ("Loop memory not locked", juce::dontSendNotification);
+        else
+            fileStatusLabel.setText ({}, juce::dontSendNotification);
+    }
 }
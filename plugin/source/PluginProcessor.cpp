@@ -1,6 +1,8 @@
 #include "OpenLooper2/PluginProcessor.h"
 #include "OpenLooper2/PluginEditor.h"
 #include "OpenLooper2/Looper.h"
+#include "OpenLooper2/RealtimeSafetyChecker.h"
+#include "OpenLooper2/AudioThreadPriority.h"
 
 //==============================================================================
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
@@ -10,15 +12,21 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                       // Optional outputs for mixing the loop and the dry input separately
+                       .withOutput ("Loop",   juce::AudioChannelSet::stereo(), false)
+                       .withOutput ("Dry",    juce::AudioChannelSet::stereo(), false)
                      #endif
                        ),
-       looper(std::make_unique<OpenLooper2::Looper>()),
+       looper(std::make_unique<OpenLooper2::Looper>(jobQueue)),
        apvts(*this, nullptr, "Parameters", OpenLooper2::Looper::createParameterLayout())
 {
+    looper->attachParameters(apvts);
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    // The state is destroyed before the looper, so stop listening to it first
+    looper->detachParameters();
 }
 
 
@@ -91,14 +99,18 @@ void AudioPluginAudioProcessor::changeProgramName (int index, const juce::String
 void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // Initialize the looper with audio specifications
-    const int numChannels = juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    // Only the main bus is looped; the auxiliary outputs carry copies of its signals
+    const int numChannels = juce::jmax(getMainBusNumInputChannels(), getMainBusNumOutputChannels());
     looper->initialize(sampleRate, samplesPerBlock, numChannels);
+
+    // Without a host, nobody else puts the device's callback thread under real-time scheduling
+    promoteAudioThread.store (wrapperType == wrapperType_Standalone, std::memory_order_release);
 }
 
 void AudioPluginAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    // An empty loop gives its buffer back; it is reacquired once processing resumes
+    looper->releaseResources();
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -121,6 +133,14 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
         return false;
    #endif
 
+    // Auxiliary outputs are either switched off or shaped like the main output
+    for (int bus = 1; bus < layouts.outputBuses.size(); ++bus)
+    {
+        const auto channelSet = layouts.getChannelSet (false, bus);
+        if (! channelSet.isDisabled() && channelSet != layouts.getMainOutputChannelSet())
+            return false;
+    }
+
     return true;
   #endif
 }
@@ -128,9 +148,14 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
-    juce::ignoreUnused (midiMessages);
-
+    // Reports allocations, locks and blocking calls in builds with OPENLOOPER2_REALTIME_CHECKS
+    OpenLooper2::RealtimeSafetyChecker::ScopedRealtimeSection realtimeSection;
     juce::ScopedNoDenormals noDenormals;
+
+    // Only the first callback after prepareToPlay pays for the exchange
+    if (promoteAudioThread.load (std::memory_order_relaxed) && promoteAudioThread.exchange (false, std::memory_order_acq_rel))
+        OpenLooper2::AudioThreadPriority::promoteCurrentThread();
+
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -138,8 +163,37 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
+    // Hand the looper the host timeline while the host plays, so synced instances share one clock
+    juce::int64 hostTimeInSamples = -1;
+    if (auto* playHead = getPlayHead())
+        if (auto position = playHead->getPosition())
+            if (position->getIsPlaying())
+                if (auto timeInSamples = position->getTimeInSamples())
+                    hostTimeInSamples = *timeInSamples;
+
+    // The bus buffers refer to the host's channels, so the looper writes each output in place
+    auto mainBuffer = getBusBuffer (buffer, false, 0);
+    auto loopBuffer = getBusBuffer (buffer, false, 1);
+    auto dryBuffer = getBusBuffer (buffer, false, 2);
+    
+    OpenLooper2::AuxOutputs auxOutputs;
+    auxOutputs.loop = loopBuffer.getNumChannels() > 0 ? &loopBuffer : nullptr;
+    auxOutputs.dry = dryBuffer.getNumChannels() > 0 ? &dryBuffer : nullptr;
+
     // Process audio through the looper
-    looper->processBlock(buffer, apvts);
+    // MIDI notes retrigger and stutter loop slices at their sample positions
+    looper->processBlock(mainBuffer, midiMessages, apvts, hostTimeInSamples, auxOutputs);
+}
+
+void AudioPluginAudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffer,
+                                                      juce::MidiBuffer& midiMessages)
+{
+    OpenLooper2::RealtimeSafetyChecker::ScopedRealtimeSection realtimeSection;
+    
+    // Lets an idle looper give back its memory while the host keeps it bypassed
+    looper->processBypassed(buffer.getNumSamples());
+
+    AudioProcessor::processBlockBypassed (buffer, midiMessages);
 }
 
 //==============================================================================
@@ -0,0 +1,154 @@
+#include "OpenLooper2/PolyphaseResampler.h"
+#include <cmath>
+
+namespace OpenLooper2 {
+
+PolyphaseResampler::PolyphaseResampler()
+{
+}
+
+PolyphaseResampler::~PolyphaseResampler()
+{
+}
+
+void PolyphaseResampler::prepare(double sourceRate, double targetRate)
+{
+    ratio = targetRate / sourceRate;
+
+    // Band-limit to the lower of the two Nyquist frequencies, relative to the input rate
+    const double cutoff = juce::jmin(1.0, ratio) * passband;
+    halfLength = static_cast<int>(std::ceil(zeroCrossings / cutoff));
+    tapsPerPhase = 2 * halfLength;
+
+    // One extra row to interpolate the last phase towards, dropped once the slopes are known
+    filterBank.assign(static_cast<size_t>((numPhases + 1) * tapsPerPhase), 0.0f);
+    const double windowNorm = 1.0 / besselI0(kaiserBeta);
+
+    for (int phase = 0; phase <= numPhases; ++phase)
+    {
+        const double fraction = static_cast<double>(phase) / numPhases;
+        float* row = filterBank.data() + phase * tapsPerPhase;
+
+        for (int tap = 0; tap < tapsPerPhase; ++tap)
+        {
+            // Distance in input samples between this tap and the output instant
+            const double x = static_cast<double>(tap - halfLength + 1) - fraction;
+            const double u = x / halfLength;
+            if (std::abs(u) >= 1.0)
+                continue;
+
+            const double arg = juce::MathConstants<double>::pi * cutoff * x;
+            const double sinc = std::abs(x) < 1.0e-9 ? 1.0 : std::sin(arg) / arg;
+            const double window = besselI0(kaiserBeta * std::sqrt(1.0 - u * u)) * windowNorm;
+
+            row[tap] = static_cast<float>(cutoff * sinc * window);
+        }
+    }
+
+    filterSlopes.resize(static_cast<size_t>(numPhases * tapsPerPhase));
+
+    for (int i = 0; i < numPhases * tapsPerPhase; ++i)
+        filterSlopes[static_cast<size_t>(i)] = filterBank[static_cast<size_t>(i + tapsPerPhase)]
+                                               - filterBank[static_cast<size_t>(i)];
+
+    filterBank.resize(static_cast<size_t>(numPhases * tapsPerPhase));
+}
+
+int PolyphaseResampler::getOutputLength(int numInputSamples) const
+{
+    return juce::jmax(1, static_cast<int>(std::llround(numInputSamples * ratio)));
+}
+
+void PolyphaseResampler::process(const float* input, int numInputSamples, float* output, int numOutputSamples) const
+{
+    process(input, numInputSamples, numOutputSamples, output, 0, numOutputSamples);
+}
+
+void PolyphaseResampler::process(const float* input, int numInputSamples, int totalOutputSamples,
+                                 float* output, int firstOutputSample, int numOutputSamples) const
+{
+    if (numInputSamples <= 0 || totalOutputSamples <= 0 || numOutputSamples <= 0 || filterBank.empty())
+        return;
+
+    // Map exactly one input period onto one output period so the loop seam stays aligned
+    const double step = static_cast<double>(numInputSamples) / totalOutputSamples;
+
+    for (int n = 0; n < numOutputSamples; ++n)
+    {
+        const double time = (firstOutputSample + n) * step;
+        const int index = static_cast<int>(time);
+        const double phasePosition = (time - index) * numPhases;
+        const int phase = juce::jmin(numPhases - 1, static_cast<int>(phasePosition));
+        const float phaseFraction = static_cast<float>(phasePosition - phase);
+
+        const float* row = filterBank.data() + phase * tapsPerPhase;
+        const float* slope = filterSlopes.data() + phase * tapsPerPhase;
+        const int first = index - halfLength + 1;
+
+        if (first >= 0 && first + tapsPerPhase <= numInputSamples)
+        {
+            // Contiguous fast path
+            output[n] = interpolatedDot(input + first, row, slope, phaseFraction, tapsPerPhase);
+        }
+        else
+        {
+            // Near the seam, wrap around the loop
+            float sum = 0.0f;
+
+            for (int tap = 0; tap < tapsPerPhase; ++tap)
+            {
+                const int wrapped = ((first + tap) % numInputSamples + numInputSamples) % numInputSamples;
+                sum += input[wrapped] * (row[tap] + phaseFraction * slope[tap]);
+            }
+
+            output[n] = sum;
+        }
+    }
+}
+
+float PolyphaseResampler::interpolatedDot(const float* input, const float* row, const float* slope,
+                                          float fraction, int numTaps)
+{
+    const float* __restrict x = input;
+    const float* __restrict h = row;
+    const float* __restrict dh = slope;
+
+    // A single running sum is a serial chain the compiler may not reorder; separate partial sums
+    // for each lane let it keep them in one vector register and add whole vectors per step
+    float partial[dotLanes] = {};
+    int tap = 0;
+
+    for (; tap + dotLanes <= numTaps; tap += dotLanes)
+        for (int lane = 0; lane < dotLanes; ++lane)
+            partial[lane] += x[tap + lane] * (h[tap + lane] + fraction * dh[tap + lane]);
+
+    float sum = 0.0f;
+
+    for (; tap < numTaps; ++tap)
+        sum += x[tap] * (h[tap] + fraction * dh[tap]);
+
+    for (int lane = 0; lane < dotLanes; ++lane)
+        sum += partial[lane];
+
+    return sum;
+}
+
+double PolyphaseResampler::besselI0(double x)
+{
+    // Power series of the zeroth-order modified Bessel function of the first kind
+    double sum = 1.0;
+    double term = 1.0;
+    const double halfX = 0.5 * x;
+
+    for (int k = 1; k < 50; ++k)
+    {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1.0e-12)
+            break;
+    }
+
+    return sum;
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
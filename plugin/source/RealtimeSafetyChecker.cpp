@@ -0,0 +1,431 @@
+#include "OpenLooper2/RealtimeSafetyChecker.h"
+
+#if OPENLOOPER2_REALTIME_CHECKS
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if JUCE_LINUX || JUCE_BSD || JUCE_MAC
+ #define OPENLOOPER2_INTERPOSE_POSIX 1
+ #include <dlfcn.h>
+ #include <fcntl.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <semaphore.h>
+ #include <stdarg.h>
+ #include <time.h>
+ #include <unistd.h>
+#else
+ #define OPENLOOPER2_INTERPOSE_POSIX 0
+#endif
+
+namespace OpenLooper2 {
+
+namespace {
+
+#if OPENLOOPER2_INTERPOSE_POSIX
+ // Initial-exec TLS never allocates on first access, which would recurse into the malloc interposer
+ #define OPENLOOPER2_THREAD_STATE __attribute__((tls_model("initial-exec"))) thread_local
+#else
+ #define OPENLOOPER2_THREAD_STATE thread_local
+#endif
+
+OPENLOOPER2_THREAD_STATE int realtimeDepth = 0;
+OPENLOOPER2_THREAD_STATE int suspendedDepth = 0;
+
+} // namespace
+
+std::array<std::atomic<int>, RealtimeSafetyChecker::numViolationKinds> RealtimeSafetyChecker::violationCounts{};
+std::atomic<int> RealtimeSafetyChecker::reportedViolations{0};
+
+bool RealtimeSafetyChecker::isRealtimeThread()
+{
+    return realtimeDepth > 0 && suspendedDepth == 0;
+}
+
+void RealtimeSafetyChecker::check(Violation violation, const char* function)
+{
+    if (!isRealtimeThread())
+        return;
+
+    // Reporting allocates and writes, which must not report itself
+    ++suspendedDepth;
+    violationCounts[static_cast<size_t>(violation)].fetch_add(1, std::memory_order_relaxed);
+
+    if (reportedViolations.fetch_add(1, std::memory_order_relaxed) < maxReportedViolations)
+    {
+        juce::Logger::writeToLog(juce::String("Real-time violation: ") + getViolationName(violation)
+                                 + " (" + function + ") on the audio thread\n"
+                                 + juce::SystemStats::getStackBacktrace());
+    }
+
+    --suspendedDepth;
+}
+
+int RealtimeSafetyChecker::getViolationCount(Violation violation)
+{
+    return violationCounts[static_cast<size_t>(violation)].load(std::memory_order_relaxed);
+}
+
+int RealtimeSafetyChecker::getTotalViolationCount()
+{
+    int total = 0;
+    for (const auto& count : violationCounts)
+        total += count.load(std::memory_order_relaxed);
+
+    return total;
+}
+
+void RealtimeSafetyChecker::resetViolationCounts()
+{
+    for (auto& count : violationCounts)
+        count.store(0, std::memory_order_relaxed);
+
+    reportedViolations.store(0, std::memory_order_relaxed);
+}
+
+const char* RealtimeSafetyChecker::getViolationName(Violation violation)
+{
+    switch (violation)
+    {
+        case Violation::Allocation:     return "allocation";
+        case Violation::Deallocation:   return "deallocation";
+        case Violation::Lock:           return "lock";
+        case Violation::BlockingCall:   return "blocking call";
+    }
+
+    return "unknown";
+}
+
+void RealtimeSafetyChecker::enterRealtimeSection()      { ++realtimeDepth; }
+void RealtimeSafetyChecker::exitRealtimeSection()       { --realtimeDepth; }
+void RealtimeSafetyChecker::enterNonRealtimeSection()   { ++suspendedDepth; }
+void RealtimeSafetyChecker::exitNonRealtimeSection()    { --suspendedDepth; }
+
+namespace {
+
+using Violation = RealtimeSafetyChecker::Violation;
+
+#if OPENLOOPER2_INTERPOSE_POSIX
+
+/**
+ * Find the definition an interposer forwards to. Cached without a static guard,
+ * since the guard itself may lock; racing threads resolve the same address.
+ */
+template <typename Function>
+Function* findNext(std::atomic<Function*>& cached, const char* name)
+{
+    auto* function = cached.load(std::memory_order_acquire);
+    if (function == nullptr)
+    {
+        function = reinterpret_cast<Function*>(dlsym(RTLD_NEXT, name));
+        cached.store(function, std::memory_order_release);
+    }
+
+    return function;
+}
+
+// dlsym may allocate while the allocator is being resolved; those requests come from here
+constexpr size_t bootstrapSize = 16384;
+alignas(std::max_align_t) char bootstrapArena[bootstrapSize];
+std::atomic<size_t> bootstrapUsed{0};
+std::atomic<int> allocatorState{0};     // 0 unresolved, 1 resolving, 2 resolved
+
+std::atomic<void* (*)(size_t)> nextMalloc{nullptr};
+std::atomic<void* (*)(size_t, size_t)> nextCalloc{nullptr};
+std::atomic<void* (*)(void*, size_t)> nextRealloc{nullptr};
+std::atomic<void (*)(void*)> nextFree{nullptr};
+
+bool isBootstrapPointer(const void* pointer)
+{
+    const auto* bytes = static_cast<const char*>(pointer);
+    return bytes >= bootstrapArena && bytes < bootstrapArena + bootstrapSize;
+}
+
+void* bootstrapAllocate(size_t size)
+{
+    const size_t alignedSize = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    const size_t offset = bootstrapUsed.fetch_add(alignedSize, std::memory_order_relaxed);
+    return offset + alignedSize <= bootstrapSize ? bootstrapArena + offset : nullptr;
+}
+
+bool resolveAllocator()
+{
+    int expected = 0;
+    if (allocatorState.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+    {
+        findNext(nextMalloc, "malloc");
+        findNext(nextCalloc, "calloc");
+        findNext(nextRealloc, "realloc");
+        findNext(nextFree, "free");
+        allocatorState.store(2, std::memory_order_release);
+        return true;
+    }
+
+    return expected == 2;
+}
+
+void* rawAllocate(size_t size)
+{
+    return resolveAllocator() ? nextMalloc.load(std::memory_order_acquire)(size) : bootstrapAllocate(size);
+}
+
+void rawFree(void* pointer)
+{
+    if (pointer != nullptr && !isBootstrapPointer(pointer) && resolveAllocator())
+        nextFree.load(std::memory_order_acquire)(pointer);
+}
+
+#else
+
+void* rawAllocate(size_t size) { return std::malloc(size); }
+void rawFree(void* pointer) { std::free(pointer); }
+
+#endif
+
+void* checkedNew(size_t size, const char* function)
+{
+    RealtimeSafetyChecker::check(Violation::Allocation, function);
+    return rawAllocate(size == 0 ? 1 : size);
+}
+
+void checkedDelete(void* pointer, const char* function)
+{
+    if (pointer == nullptr)
+        return;
+
+    RealtimeSafetyChecker::check(Violation::Deallocation, function);
+    rawFree(pointer);
+}
+
+} // namespace
+
+} // namespace OpenLooper2
+
+//==============================================================================
+// Interposers. They only count and forward, so it is harmless if calls from outside this
+// binary reach them. Inside a plugin on Linux they are bound locally by -Bsymbolic-functions.
+
+using OpenLooper2::RealtimeSafetyChecker;
+
+void* operator new(std::size_t size)
+{
+    if (auto* pointer = OpenLooper2::checkedNew(size, "operator new"))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    if (auto* pointer = OpenLooper2::checkedNew(size, "operator new[]"))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return OpenLooper2::checkedNew(size, "operator new");
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return OpenLooper2::checkedNew(size, "operator new[]");
+}
+
+void operator delete(void* pointer) noexcept
+{
+    OpenLooper2::checkedDelete(pointer, "operator delete");
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    OpenLooper2::checkedDelete(pointer, "operator delete[]");
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    OpenLooper2::checkedDelete(pointer, "operator delete");
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    OpenLooper2::checkedDelete(pointer, "operator delete[]");
+}
+
+#if OPENLOOPER2_INTERPOSE_POSIX
+
+using Violation = RealtimeSafetyChecker::Violation;
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    RealtimeSafetyChecker::check(Violation::Allocation, "malloc");
+    return OpenLooper2::rawAllocate(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    RealtimeSafetyChecker::check(Violation::Allocation, "calloc");
+
+    // The bootstrap arena is static and therefore already zeroed
+    if (!OpenLooper2::resolveAllocator())
+        return OpenLooper2::bootstrapAllocate(count * size);
+
+    return OpenLooper2::nextCalloc.load(std::memory_order_acquire)(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+    RealtimeSafetyChecker::check(Violation::Allocation, "realloc");
+
+    if (pointer != nullptr && OpenLooper2::isBootstrapPointer(pointer))
+    {
+        auto* moved = OpenLooper2::rawAllocate(size);
+        if (moved != nullptr)
+        {
+            const size_t available = static_cast<size_t>(OpenLooper2::bootstrapArena + OpenLooper2::bootstrapSize
+                                                         - static_cast<char*>(pointer));
+            std::memcpy(moved, pointer, juce::jmin(size, available));
+        }
+
+        return moved;
+    }
+
+    if (!OpenLooper2::resolveAllocator())
+        return OpenLooper2::bootstrapAllocate(size);
+
+    return OpenLooper2::nextRealloc.load(std::memory_order_acquire)(pointer, size);
+}
+
+void free(void* pointer)
+{
+    if (pointer != nullptr)
+        RealtimeSafetyChecker::check(Violation::Deallocation, "free");
+
+    OpenLooper2::rawFree(pointer);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    static std::atomic<int (*)(pthread_mutex_t*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "pthread_mutex_lock");
+    return OpenLooper2::findNext(function, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+{
+    static std::atomic<int (*)(pthread_rwlock_t*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "pthread_rwlock_rdlock");
+    return OpenLooper2::findNext(function, "pthread_rwlock_rdlock")(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+{
+    static std::atomic<int (*)(pthread_rwlock_t*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "pthread_rwlock_wrlock");
+    return OpenLooper2::findNext(function, "pthread_rwlock_wrlock")(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+{
+    static std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "pthread_cond_wait");
+    return OpenLooper2::findNext(function, "pthread_cond_wait")(condition, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const struct timespec* time)
+{
+    static std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "pthread_cond_timedwait");
+    return OpenLooper2::findNext(function, "pthread_cond_timedwait")(condition, mutex, time);
+}
+
+int sem_wait(sem_t* semaphore)
+{
+    static std::atomic<int (*)(sem_t*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::Lock, "sem_wait");
+    return OpenLooper2::findNext(function, "sem_wait")(semaphore);
+}
+
+int nanosleep(const struct timespec* duration, struct timespec* remaining)
+{
+    static std::atomic<int (*)(const struct timespec*, struct timespec*)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "nanosleep");
+    return OpenLooper2::findNext(function, "nanosleep")(duration, remaining);
+}
+
+int usleep(useconds_t duration)
+{
+    static std::atomic<int (*)(useconds_t)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "usleep");
+    return OpenLooper2::findNext(function, "usleep")(duration);
+}
+
+int sched_yield()
+{
+    static std::atomic<int (*)()> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "sched_yield");
+    return OpenLooper2::findNext(function, "sched_yield")();
+}
+
+int open(const char* path, int flags, ...)
+{
+    static std::atomic<int (*)(const char*, int, ...)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "open");
+
+    mode_t mode = 0;
+    if ((flags & O_CREAT) != 0)
+    {
+        va_list arguments;
+        va_start(arguments, flags);
+        mode = static_cast<mode_t>(va_arg(arguments, int));
+        va_end(arguments);
+    }
+
+    return OpenLooper2::findNext(function, "open")(path, flags, mode);
+}
+
+ssize_t read(int fileDescriptor, void* data, size_t numBytes)
+{
+    static std::atomic<ssize_t (*)(int, void*, size_t)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "read");
+    return OpenLooper2::findNext(function, "read")(fileDescriptor, data, numBytes);
+}
+
+ssize_t write(int fileDescriptor, const void* data, size_t numBytes)
+{
+    static std::atomic<ssize_t (*)(int, const void*, size_t)> function{nullptr};
+    RealtimeSafetyChecker::check(Violation::BlockingCall, "write");
+    return OpenLooper2::findNext(function, "write")(fileDescriptor, data, numBytes);
+}
+
+} // extern "C"
+
+#endif
+
+#else
+
+namespace OpenLooper2 {
+
+std::array<std::atomic<int>, RealtimeSafetyChecker::numViolationKinds> RealtimeSafetyChecker::violationCounts{};
+std::atomic<int> RealtimeSafetyChecker::reportedViolations{0};
+
+bool RealtimeSafetyChecker::isRealtimeThread() { return false; }
+void RealtimeSafetyChecker::check(Violation, const char*) {}
+int RealtimeSafetyChecker::getViolationCount(Violation) { return 0; }
+int RealtimeSafetyChecker::getTotalViolationCount() { return 0; }
+void RealtimeSafetyChecker::resetViolationCounts() {}
+const char* RealtimeSafetyChecker::getViolationName(Violation) { return ""; }
+void RealtimeSafetyChecker::enterRealtimeSection() {}
+void RealtimeSafetyChecker::exitRealtimeSection() {}
+void RealtimeSafetyChecker::enterNonRealtimeSection() {}
+void RealtimeSafetyChecker::exitNonRealtimeSection() {}
+
+} // namespace OpenLooper2
+
+#endif
\ No newline at end of file
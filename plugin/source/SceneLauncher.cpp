@@ -0,0 +1,46 @@
+#include "OpenLooper2/SceneLauncher.h"
+
+namespace OpenLooper2 {
+
+SceneLauncher::SceneLauncher()
+{
+}
+
+SceneLauncher::~SceneLauncher()
+{
+}
+
+void SceneLauncher::launch(int sceneIndex)
+{
+    auto current = launchWord.load(std::memory_order_relaxed);
+
+    // A failed exchange means another launch got in first; build on its sequence number
+    for (;;)
+    {
+        const auto sequence = static_cast<juce::uint32>(current >> 32) + 1;
+        const auto next = (static_cast<juce::uint64>(sequence) << 32) | static_cast<juce::uint32>(sceneIndex);
+
+        if (launchWord.compare_exchange_weak(current, next, std::memory_order_acq_rel))
+            return;
+    }
+}
+
+bool SceneLauncher::getNewLaunch(juce::uint32& lastSequence, int& sceneIndex) const
+{
+    const auto word = launchWord.load(std::memory_order_acquire);
+    const auto sequence = static_cast<juce::uint32>(word >> 32);
+
+    if (sequence == lastSequence)
+        return false;
+
+    lastSequence = sequence;
+    sceneIndex = static_cast<int>(static_cast<juce::uint32>(word));
+    return true;
+}
+
+juce::uint32 SceneLauncher::getSequence() const
+{
+    return static_cast<juce::uint32>(launchWord.load(std::memory_order_acquire) >> 32);
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "OpenLooper2/SharedLoopClock.h"
+
+namespace OpenLooper2 {
+
+int SharedLoopClock::Grid::getPhase(juce::int64 timelineSample) const
+{
+    const juce::int64 phase = (timelineSample - originSample) % loopLength;
+    return static_cast<int>(phase < 0 ? phase + loopLength : phase);
+}
+
+int SharedLoopClock::Grid::getSamplesToNextBoundary(juce::int64 timelineSample) const
+{
+    return (loopLength - getPhase(timelineSample)) % loopLength;
+}
+
+SharedLoopClock::SharedLoopClock()
+{
+}
+
+SharedLoopClock::~SharedLoopClock()
+{
+}
+
+bool SharedLoopClock::publish(const void* owner, juce::int64 newOrigin, int newLength)
+{
+    const void* expected = nullptr;
+    if (!master.compare_exchange_strong(expected, owner, std::memory_order_acq_rel) && expected != owner)
+        return false;
+
+    write(newOrigin, newLength);
+    return true;
+}
+
+void SharedLoopClock::release(const void* owner)
+{
+    if (master.load(std::memory_order_acquire) != owner)
+        return;
+
+    // Invalidate the grid while still holding the role, so there is only ever one writer
+    write(0, 0);
+    master.store(nullptr, std::memory_order_release);
+}
+
+bool SharedLoopClock::read(Grid& grid) const
+{
+    const auto before = sequence.load(std::memory_order_acquire);
+    if ((before & 1) != 0)
+        return false;
+
+    const auto origin = originSample.load(std::memory_order_relaxed);
+    const auto length = loopLength.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) != before)
+        return false;
+
+    grid.originSample = origin;
+    grid.loopLength = length;
+    return true;
+}
+
+juce::int64 SharedLoopClock::getWallClockSample(double sampleRate)
+{
+    const double seconds = static_cast<double>(juce::Time::getHighResolutionTicks())
+                           / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond());
+    return static_cast<juce::int64>(seconds * sampleRate);
+}
+
+void SharedLoopClock::write(juce::int64 newOrigin, int newLength)
+{
+    // Odd sequence numbers mark a write in progress
+    sequence.fetch_add(1, std::memory_order_acq_rel);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    originSample.store(newOrigin, std::memory_order_relaxed);
+    loopLength.store(newLength, std::memory_order_relaxed);
+
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
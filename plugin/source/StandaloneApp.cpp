@@ -0,0 +1,95 @@
+#include <juce_audio_utils/juce_audio_utils.h>
+
+#if JucePlugin_Build_Standalone && JUCE_USE_CUSTOM_PLUGIN_STANDALONE_APP
+
+#include <juce_audio_plugin_client/Standalone/juce_StandaloneFilterWindow.h>
+
+namespace OpenLooper2 {
+
+/**
+ * Application for the Standalone build, for live rigs that run the looper without a host.
+ * Same as JUCE's default standalone app, except that a first start asks the audio device for a
+ * short buffer, and MIDI inputs are opened automatically. The audio settings dialog chooses
+ * between ALSA and JACK on Linux; saved settings take precedence over the preferred setup.
+ */
+class StandaloneApp : public juce::JUCEApplication
+{
+public:
+    static constexpr int preferredBufferSize = 64;
+    static constexpr double preferredSampleRate = 48000.0;
+
+    StandaloneApp()
+    {
+        juce::PropertiesFile::Options options;
+        options.applicationName = JucePlugin_Name;
+        options.filenameSuffix = ".settings";
+        options.osxLibrarySubFolder = "Application Support";
+       #if JUCE_LINUX || JUCE_BSD
+        options.folderName = "~/.config";
+       #else
+        options.folderName = "";
+       #endif
+
+        appProperties.setStorageParameters(options);
+    }
+
+    const juce::String getApplicationName() override { return JucePlugin_Name; }
+    const juce::String getApplicationVersion() override { return JucePlugin_VersionString; }
+    bool moreThanOneInstanceAllowed() override { return true; }
+    void anotherInstanceStarted(const juce::String&) override {}
+
+    void initialise(const juce::String&) override
+    {
+        juce::AudioDeviceManager::AudioDeviceSetup preferredSetup;
+        preferredSetup.bufferSize = preferredBufferSize;
+        preferredSetup.sampleRate = preferredSampleRate;
+
+        mainWindow = std::make_unique<juce::StandaloneFilterWindow>(
+            getApplicationName(),
+            juce::LookAndFeel::getDefaultLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId),
+            appProperties.getUserSettings(), false, juce::String{}, &preferredSetup,
+            juce::Array<juce::StandalonePluginHolder::PluginInOuts>{}, true);
+
+        mainWindow->setVisible(true);
+    }
+
+    void shutdown() override
+    {
+        mainWindow = nullptr;
+        appProperties.saveIfNeeded();
+    }
+
+    void systemRequestedQuit() override
+    {
+        if (mainWindow != nullptr)
+            mainWindow->pluginHolder->savePluginState();
+
+        if (juce::ModalComponentManager::getInstance()->cancelAllModalComponents())
+        {
+            juce::Timer::callAfterDelay(100, []
+            {
+                if (auto* app = juce::JUCEApplicationBase::getInstance())
+                    app->systemRequestedQuit();
+            });
+        }
+        else
+        {
+            quit();
+        }
+    }
+
+private:
+    juce::ApplicationProperties appProperties;
+    std::unique_ptr<juce::StandaloneFilterWindow> mainWindow;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StandaloneApp)
+};
+
+} // namespace OpenLooper2
+
+juce::JUCEApplicationBase* juce_CreateApplication()
+{
+    return new OpenLooper2::StandaloneApp();
+}
+
+#endif
\ No newline at end of file
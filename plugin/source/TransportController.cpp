@@ -1,4 +1,5 @@
 #include "OpenLooper2/TransportController.h"
+#include <limits>
 
 namespace OpenLooper2 {
 
@@ -16,12 +17,18 @@ void TransportController::initialize(double sampleRate, int samplesPerBlock)
     this->samplesPerBlock = samplesPerBlock;
     
     currentState.store(State::Stopped, std::memory_order_release);
-    playbackPosition.store(0.0f, std::memory_order_release);
     playbackPositionSamples.store(0, std::memory_order_release);
+    playbackPhase.store(0, std::memory_order_release);
     loopLengthSamples.store(0, std::memory_order_release);
     initialized.store(true, std::memory_order_release);
 }
 
+void TransportController::prepare(double sampleRate, int samplesPerBlock)
+{
+    this->sampleRate = sampleRate;
+    this->samplesPerBlock = samplesPerBlock;
+}
+
 void TransportController::processBlock(int numSamples)
 {
     if (!initialized.load(std::memory_order_acquire))
@@ -59,7 +66,7 @@ void TransportController::stopRecording()
     if (state == State::Recording)
     {
         // Set the loop length based on the recorded duration
-        const int recordedLength = playbackPositionSamples.load(std::memory_order_acquire);
+        const int recordedLength = static_cast<int>(playbackPositionSamples.load(std::memory_order_acquire));
         if (recordedLength > 0)
         {
             loopLengthSamples.store(recordedLength, std::memory_order_release);
@@ -126,36 +133,80 @@ void TransportController::setLoopLength(int lengthInSamples)
     }
 }
 
+void TransportController::setPlaybackRate(double rate)
+{
+    const double clampedRate = juce::jlimit(0.0, maxPlaybackRate, rate);
+    phaseIncrement.store(static_cast<juce::uint64>(clampedRate * static_cast<double>(unityPhaseIncrement) + 0.5),
+                         std::memory_order_release);
+}
+
+double TransportController::getPlaybackRate() const
+{
+    return static_cast<double>(phaseIncrement.load(std::memory_order_acquire)) / static_cast<double>(unityPhaseIncrement);
+}
+
+juce::int64 TransportController::getSamplesToAdvance(juce::int64 loopSamples) const
+{
+    const juce::uint64 increment = phaseIncrement.load(std::memory_order_acquire);
+    if (currentState.load(std::memory_order_acquire) != State::Playing || increment == unityPhaseIncrement)
+        return loopSamples;
+    
+    if (loopSamples <= 0)
+        return 0;
+    
+    // A stopped varispeed never gets there
+    if (increment == 0)
+        return std::numeric_limits<juce::int64>::max();
+    
+    const juce::uint64 distance = (static_cast<juce::uint64>(loopSamples) << phaseBits) - playbackPhase.load(std::memory_order_acquire);
+    return static_cast<juce::int64>((distance + increment - 1) / increment);
+}
+
 void TransportController::resetPosition()
 {
-    playbackPosition.store(0.0f, std::memory_order_release);
     playbackPositionSamples.store(0, std::memory_order_release);
+    playbackPhase.store(0, std::memory_order_release);
 }
 
-void TransportController::updatePosition(int numSamples)
+void TransportController::setPositionSamples(juce::int64 positionSamples)
 {
-    const int currentPositionSamples = playbackPositionSamples.load(std::memory_order_acquire);
     const int loopLength = loopLengthSamples.load(std::memory_order_acquire);
+    if (loopLength <= 0)
+        return;
     
-    int newPositionSamples = currentPositionSamples + numSamples;
+    juce::int64 wrappedPosition = positionSamples % loopLength;
+    if (wrappedPosition < 0)
+        wrappedPosition += loopLength;
     
-    // Handle loop wrapping for playing and overdubbing states
+    playbackPositionSamples.store(wrappedPosition, std::memory_order_release);
+    playbackPhase.store(0, std::memory_order_release);
+}
+
+void TransportController::updatePosition(int numSamples)
+{
+    const juce::int64 currentPositionSamples = playbackPositionSamples.load(std::memory_order_acquire);
+    const int loopLength = loopLengthSamples.load(std::memory_order_acquire);
     const State state = currentState.load(std::memory_order_acquire);
-    if ((state == State::Playing || state == State::Overdubbing) && loopLength > 0)
+    
+    // Recording and overdubbing follow the input one to one; playback advances by the fixed-point rate
+    juce::int64 advance = numSamples;
+    if (state == State::Playing)
     {
-        newPositionSamples = newPositionSamples % loopLength;
+        const juce::uint64 phase = playbackPhase.load(std::memory_order_relaxed)
+                                   + phaseIncrement.load(std::memory_order_relaxed) * static_cast<juce::uint64>(numSamples);
+        advance = static_cast<juce::int64>(phase >> phaseBits);
+        playbackPhase.store(static_cast<juce::uint32>(phase), std::memory_order_release);
     }
     
-    playbackPositionSamples.store(newPositionSamples, std::memory_order_release);
+    juce::int64 newPositionSamples = currentPositionSamples + advance;
     
-    // Calculate normalized position
-    float normalizedPosition = 0.0f;
-    if (loopLength > 0)
+    // Handle loop wrapping for playing and overdubbing states
+    if ((state == State::Playing || state == State::Overdubbing) && loopLength > 0 && newPositionSamples >= loopLength)
     {
-        normalizedPosition = static_cast<float>(newPositionSamples) / static_cast<float>(loopLength);
+        newPositionSamples %= loopLength;
     }
     
-    playbackPosition.store(normalizedPosition, std::memory_order_release);
+    playbackPositionSamples.store(newPositionSamples, std::memory_order_release);
 }
 
 } // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "OpenLooper2/WaveformView.h"
+
+namespace OpenLooper2 {
+
+WaveformView::WaveformView(Looper& looper)
+    : looper(looper),
+      vBlankAttachment(this, [this] { onVBlank(); })
+{
+    setOpaque(true);
+}
+
+WaveformView::~WaveformView()
+{
+}
+
+void WaveformView::paint(juce::Graphics& g)
+{
+    const auto clip = g.getClipBounds();
+    const int firstTile = juce::jmax(0, clip.getX() / tileWidth);
+    const int lastTile = juce::jmin(static_cast<int>(tiles.size()) - 1, (clip.getRight() - 1) / tileWidth);
+
+    // Tiles are rendered lazily, so ones that are never shown cost nothing
+    for (int tileIndex = firstTile; tileIndex <= lastTile; ++tileIndex)
+    {
+        if (!tiles[static_cast<size_t>(tileIndex)].valid)
+            renderTile(tileIndex);
+
+        g.drawImageAt(tiles[static_cast<size_t>(tileIndex)].image, tileIndex * tileWidth, 0);
+    }
+
+    if (playheadX >= 0)
+    {
+        g.setColour(juce::Colours::white);
+        g.fillRect(playheadX, 0, playheadWidth, getHeight());
+    }
+}
+
+void WaveformView::resized()
+{
+    tiles.resize(static_cast<size_t>((getWidth() + tileWidth - 1) / tileWidth));
+    invalidateAll();
+    playheadX = -1;
+}
+
+void WaveformView::onVBlank()
+{
+    const auto& bufferManager = looper.getLoopBufferManager();
+    const int loopLength = bufferManager.getLoopLength();
+    const int slot = bufferManager.getActiveSlot();
+    const juce::uint64 changedRegions = looper.takeChangedLoopRegions();
+
+    if (loopLength != shownLength || slot != shownSlot)
+    {
+        shownLength = loopLength;
+        shownSlot = slot;
+        invalidateAll();
+        repaint();
+    }
+    else if (changedRegions != 0 && loopLength > 0)
+    {
+        invalidateRegions(changedRegions);
+    }
+
+    updatePlayhead();
+}
+
+void WaveformView::invalidateRegions(juce::uint64 regions)
+{
+    const int width = getWidth();
+    const juce::int64 regionCount = LoopBufferManager::numDirtyRegions;
+
+    for (int region = 0; region < LoopBufferManager::numDirtyRegions; ++region)
+    {
+        if ((regions & (juce::uint64{1} << region)) == 0)
+            continue;
+
+        // Pixel columns touching the region, rounded outwards
+        const int startX = static_cast<int>(region * width / regionCount);
+        const int endX = static_cast<int>(((region + 1) * width + regionCount - 1) / regionCount);
+        const int lastTile = juce::jmin(static_cast<int>(tiles.size()) - 1, (endX - 1) / tileWidth);
+
+        for (int tileIndex = startX / tileWidth; tileIndex <= lastTile; ++tileIndex)
+        {
+            auto& tile = tiles[static_cast<size_t>(tileIndex)];
+            if (!tile.valid)
+                continue;
+
+            tile.valid = false;
+            repaint(tileIndex * tileWidth, 0, tileWidth, getHeight());
+        }
+    }
+}
+
+void WaveformView::invalidateAll()
+{
+    for (auto& tile : tiles)
+        tile.valid = false;
+}
+
+void WaveformView::updatePlayhead()
+{
+    const auto& transport = looper.getTransportController();
+    const auto state = transport.getCurrentState();
+    const int width = getWidth();
+
+    int newPlayheadX = -1;
+    if ((state == TransportController::State::Playing || state == TransportController::State::Overdubbing)
+        && shownLength > 0 && width > playheadWidth)
+    {
+        const juce::int64 position = transport.getPlaybackPositionSamples();
+        newPlayheadX = juce::jlimit(0, width - playheadWidth, static_cast<int>(position * width / shownLength));
+    }
+
+    if (newPlayheadX == playheadX)
+        return;
+
+    if (playheadX >= 0)
+        repaint(playheadX, 0, playheadWidth, getHeight());
+
+    if (newPlayheadX >= 0)
+        repaint(newPlayheadX, 0, playheadWidth, getHeight());
+
+    playheadX = newPlayheadX;
+}
+
+void WaveformView::renderTile(int tileIndex)
+{
+    auto& tile = tiles[static_cast<size_t>(tileIndex)];
+    const int height = getHeight();
+
+    if (tile.image.getWidth() != tileWidth || tile.image.getHeight() != height)
+        tile.image = juce::Image(juce::Image::RGB, tileWidth, juce::jmax(1, height), false);
+
+    juce::Graphics g(tile.image);
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId).darker());
+    g.setColour(juce::Colours::skyblue);
+
+    const auto& bufferManager = looper.getLoopBufferManager();
+    const float centre = static_cast<float>(height) * 0.5f;
+    const int firstX = tileIndex * tileWidth;
+    const int lastX = juce::jmin(firstX + tileWidth, getWidth());
+
+    for (int x = firstX; x < lastX && shownLength > 0; ++x)
+    {
+        const int loopOffset = columnToLoopOffset(x);
+        const int numSamples = juce::jmax(1, columnToLoopOffset(x + 1) - loopOffset);
+        const float halfHeight = juce::jmin(1.0f, bufferManager.getLoopPeak(loopOffset, numSamples)) * centre;
+
+        if (halfHeight >= 0.5f)
+            g.drawVerticalLine(x - firstX, centre - halfHeight, centre + halfHeight);
+    }
+
+    tile.valid = true;
+}
+
+int WaveformView::columnToLoopOffset(int x) const
+{
+    return static_cast<int>(static_cast<juce::int64>(x) * shownLength / juce::jmax(1, getWidth()));
+}
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "OpenLooper2/CompactLoopStore.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace OpenLooper2 {
+
+class CompactLoopStoreTests : public juce::UnitTest
+{
+public:
+    CompactLoopStoreTests() : juce::UnitTest("CompactLoopStore", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        const auto loop = makeLoop();
+
+        beginTest("Lossless encoding comes back bit for bit");
+        {
+            CompactLoopStore store;
+            encode(store, loop, false);
+            expectEquals(store.getLength(), loop.getNumSamples());
+
+            juce::AudioBuffer<float> decoded(loop.getNumChannels(), loop.getNumSamples());
+            decoded.clear();
+            store.read(decoded, 0, loop.getNumSamples(), 0);
+            expect(isBitIdentical(loop, decoded, 0, loop.getNumSamples()), "Decoded loop differs");
+        }
+
+        beginTest("Windowed mix matches read at every jump");
+        {
+            CompactLoopStore store;
+            encode(store, loop, false);
+
+            juce::AudioBuffer<float> mixed(loop.getNumChannels(), 512);
+            juce::Random random(7);
+
+            // Sequential playback with occasional jumps to blocks outside the window
+            int offset = 0;
+            for (int i = 0; i < 200; ++i)
+            {
+                if (random.nextInt(10) == 0)
+                    offset = random.nextInt(loop.getNumSamples());
+
+                const int numSamples = juce::jmin(1 + random.nextInt(512), loop.getNumSamples() - offset);
+                mixed.clear();
+                store.mix(mixed, 0, numSamples, offset, 0.0f, 1.0f);
+
+                if (!isBitIdentical(loop, mixed, offset, numSamples))
+                {
+                    expect(false, "Mix differs at offset " + juce::String(offset));
+                    break;
+                }
+
+                offset = (offset + numSamples) % loop.getNumSamples();
+            }
+        }
+
+        beginTest("Swapped stores keep their loops");
+        {
+            CompactLoopStore store, other;
+            encode(store, loop, false);
+            store.swap(other);
+            expectEquals(store.getLength(), 0);
+            expectEquals(other.getLength(), loop.getNumSamples());
+
+            juce::AudioBuffer<float> decoded(loop.getNumChannels(), loop.getNumSamples());
+            other.mix(decoded, 0, loop.getNumSamples(), 0, 0.0f, 1.0f);
+            expect(isBitIdentical(loop, decoded, 0, loop.getNumSamples()), "Swapped loop differs");
+        }
+
+        beginTest("Lossy encoding stays on the 24-bit grid");
+        {
+            CompactLoopStore lossless, lossy;
+            encode(lossless, loop, false);
+            encode(lossy, loop, true);
+            expectLessThan(lossy.getStorageBytes(), lossless.getStorageBytes());
+
+            juce::AudioBuffer<float> decoded(loop.getNumChannels(), loop.getNumSamples());
+            decoded.clear();
+            lossy.read(decoded, 0, loop.getNumSamples(), 0);
+
+            // Coded blocks peak below 1, so they are rounded to a grid no coarser than 2^-23
+            float maxError = 0.0f;
+            for (int channel = 0; channel < loop.getNumChannels(); ++channel)
+                for (int i = 0; i < loop.getNumSamples(); ++i)
+                    if (i < specialStart || i >= specialStart + CompactLoopStore::blockSize)
+                        maxError = juce::jmax(maxError, std::abs(decoded.getSample(channel, i) - loop.getSample(channel, i)));
+
+            expectLessThan(maxError, std::ldexp(1.0f, -24) * 1.001f);
+
+            // Silence and blocks holding values off any grid are never rounded
+            expect(isBitIdentical(loop, decoded, silentStart, CompactLoopStore::blockSize, silentStart),
+                   "Silent block changed");
+            expect(isBitIdentical(loop, decoded, specialStart, CompactLoopStore::blockSize, specialStart),
+                   "Block with special values changed");
+        }
+    }
+
+private:
+    // Block layout of the test loop: noise, silence, identical channels, special values, short tail
+    static constexpr int silentStart = 3 * CompactLoopStore::blockSize;
+    static constexpr int identicalStart = silentStart + CompactLoopStore::blockSize;
+    static constexpr int specialStart = identicalStart + CompactLoopStore::blockSize;
+    static constexpr int loopLength = specialStart + CompactLoopStore::blockSize + 1000;
+
+    static juce::AudioBuffer<float> makeLoop()
+    {
+        juce::AudioBuffer<float> loop(2, loopLength);
+        loop.clear();
+        juce::Random random(42);
+
+        for (int i = 0; i < silentStart; ++i)
+        {
+            const float tone = 0.5f * std::sin(0.01f * static_cast<float>(i));
+            loop.setSample(0, i, tone + 0.01f * (random.nextFloat() - 0.5f));
+            loop.setSample(1, i, 0.8f * tone + 0.01f * (random.nextFloat() - 0.5f));
+        }
+
+        for (int i = identicalStart; i < specialStart; ++i)
+        {
+            const float sample = 0.25f * (random.nextFloat() - 0.5f);
+            loop.setSample(0, i, sample);
+            loop.setSample(1, i, sample);
+        }
+
+        for (int i = specialStart; i < loopLength; ++i)
+        {
+            loop.setSample(0, i, random.nextFloat() - 0.5f);
+            loop.setSample(1, i, 1.0e-30f * random.nextFloat());
+        }
+
+        loop.setSample(0, specialStart + 10, std::numeric_limits<float>::denorm_min());
+        loop.setSample(0, specialStart + 11, -0.0f);
+        loop.setSample(0, specialStart + 12, std::numeric_limits<float>::infinity());
+        loop.setSample(1, specialStart + 13, std::numeric_limits<float>::max());
+        return loop;
+    }
+
+    static void encode(CompactLoopStore& store, const juce::AudioBuffer<float>& loop, bool allowLossy)
+    {
+        store.beginEncoding(loop.getNumChannels(), loop.getNumSamples(), allowLossy);
+        juce::AudioBuffer<float> block(loop.getNumChannels(), CompactLoopStore::blockSize);
+
+        for (int offset = 0; offset < loop.getNumSamples(); offset += CompactLoopStore::blockSize)
+        {
+            const int numSamples = juce::jmin(CompactLoopStore::blockSize, loop.getNumSamples() - offset);
+            for (int channel = 0; channel < loop.getNumChannels(); ++channel)
+                block.copyFrom(channel, 0, loop, channel, offset, numSamples);
+
+            store.encodeBlock(block, numSamples);
+        }
+
+        store.finishEncoding();
+    }
+
+    /**
+     * Compare part of the loop with a decoded buffer bit for bit, so signed zeros and NaNs count too.
+     */
+    static bool isBitIdentical(const juce::AudioBuffer<float>& loop, const juce::AudioBuffer<float>& decoded,
+                               int loopOffset, int numSamples, int decodedStart = 0)
+    {
+        for (int channel = 0; channel < loop.getNumChannels(); ++channel)
+            if (std::memcmp(loop.getReadPointer(channel, loopOffset), decoded.getReadPointer(channel, decodedStart),
+                            sizeof(float) * static_cast<size_t>(numSamples)) != 0)
+                return false;
+
+        return true;
+    }
+};
+
+static CompactLoopStoreTests compactLoopStoreTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "OpenLooper2/LoopBufferManager.h"
+#include <vector>
+
+namespace OpenLooper2 {
+
+class LoopBufferManagerTests : public juce::UnitTest
+{
+public:
+    LoopBufferManagerTests() : juce::UnitTest("LoopBufferManager", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        BackgroundJobQueue jobQueue;
+
+        beginTest("Multiplies on top of each other repeat the loop as it plays");
+        {
+            LoopBufferManager manager(jobQueue);
+            ReferenceLoop reference;
+            juce::Random random(1);
+            record(manager, reference, 3000, random);
+
+            // Level 0 repeats 3000 samples, an overdub then gives repetition 1 its own pages
+            expect(multiply(manager, reference, 2));
+            write(manager, reference, 3500, 700, random);
+            expect(matches(manager, reference), "Level 0");
+
+            // Level 1 repeats the overdubbed 6000 samples, including the part across a page boundary
+            expect(multiply(manager, reference, 3));
+            expectEquals(manager.getLoopLength(), 18000);
+            expect(matches(manager, reference), "Level 1 before writes");
+
+            // Writes into the repeated base, a level 0 repetition and a level 1 repetition
+            write(manager, reference, 100, 2000, random);
+            write(manager, reference, 4000, 300, random);
+            write(manager, reference, 13000, 1500, random);
+            expect(matches(manager, reference), "Level 1 after writes");
+
+            // A third level over a length that is not a whole number of pages
+            expect(multiply(manager, reference, 2));
+            write(manager, reference, 17900, 400, random);
+            write(manager, reference, 35500, 1000, random);
+            expect(matches(manager, reference), "Level 2");
+        }
+
+        beginTest("Dividing drops the levels above the new length");
+        {
+            LoopBufferManager manager(jobQueue);
+            ReferenceLoop reference;
+            juce::Random random(2);
+            record(manager, reference, 2500, random);
+
+            expect(multiply(manager, reference, 2));
+            expect(multiply(manager, reference, 3));
+            write(manager, reference, 7000, 1000, random);
+
+            // Dividing back to the first level, then multiplying repeats the overdubbed loop
+            expect(divide(manager, reference, 3));
+            expectEquals(manager.getLoopLength(), 5000);
+            expect(matches(manager, reference), "Divided to level 0");
+
+            write(manager, reference, 4000, 2000, random);
+            expect(multiply(manager, reference, 3));
+            expect(matches(manager, reference), "Multiplied again");
+
+            // Only whole periods of a multiplied loop can be kept, or a part of the first one
+            expect(!manager.divideLoop(4));
+            expect(divide(manager, reference, 15));
+            expect(!manager.isLoopMultiplied());
+            expect(matches(manager, reference), "Divided into the first period");
+        }
+
+        beginTest("Random multiplies, divides and overdubs match a copied loop");
+        {
+            for (int seed = 3; seed < 13; ++seed)
+            {
+                LoopBufferManager manager(jobQueue);
+                ReferenceLoop reference;
+                juce::Random random(seed);
+                record(manager, reference, 1500 + random.nextInt(3000), random);
+
+                for (int step = 0; step < 300; ++step)
+                {
+                    const int length = reference.length();
+                    const int choice = random.nextInt(10);
+
+                    if (choice < 2 && length < 100000)
+                    {
+                        expect(multiply(manager, reference, 2 + random.nextInt(2)));
+                    }
+                    else if (choice < 4)
+                    {
+                        expect(!manager.divideLoop(2 + random.nextInt(3)) || reference.divided(manager));
+                    }
+                    else
+                    {
+                        const int loopOffset = random.nextInt(length);
+                        write(manager, reference, loopOffset, 1 + random.nextInt(3000), random);
+                    }
+
+                    if (!matches(manager, reference))
+                    {
+                        expect(false, "Loop differs after step " + juce::String(step) + " with seed " + juce::String(seed));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr int numChannels = 2;
+    static constexpr double sampleRate = 48000.0;
+
+    /**
+     * The loop as a plain copy: multiplying copies it, writing overwrites it.
+     */
+    struct ReferenceLoop
+    {
+        std::vector<float> samples[numChannels];
+        int period{0};
+
+        int length() const { return static_cast<int>(samples[0].size()); }
+
+        /**
+         * Follow a divide the manager accepted.
+         */
+        bool divided(const LoopBufferManager& manager)
+        {
+            const int newLength = manager.getLoopLength();
+            const bool valid = period == 0 || newLength <= period || newLength % period == 0;
+
+            for (auto& channel : samples)
+                channel.resize(static_cast<size_t>(newLength));
+
+            if (newLength <= period)
+                period = 0;
+
+            return valid;
+        }
+    };
+
+    static void record(LoopBufferManager& manager, ReferenceLoop& reference, int length, juce::Random& random)
+    {
+        manager.initialize(sampleRate, numChannels, 10.0f);
+        manager.waitForStorage(5000);
+
+        juce::AudioBuffer<float> input(numChannels, length);
+        fill(input, random);
+
+        manager.beginLoop();
+        manager.writeAudio(input, 0, length);
+        manager.setLoopLength(length);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            reference.samples[channel].assign(input.getReadPointer(channel), input.getReadPointer(channel) + length);
+    }
+
+    static bool multiply(LoopBufferManager& manager, ReferenceLoop& reference, int factor)
+    {
+        if (!manager.multiplyLoop(factor))
+            return false;
+
+        if (reference.period == 0)
+            reference.period = reference.length();
+
+        for (auto& channel : reference.samples)
+        {
+            const auto repeated = channel;
+            for (int i = 1; i < factor; ++i)
+                channel.insert(channel.end(), repeated.begin(), repeated.end());
+        }
+
+        return true;
+    }
+
+    static bool divide(LoopBufferManager& manager, ReferenceLoop& reference, int divisor)
+    {
+        return manager.divideLoop(divisor) && reference.divided(manager);
+    }
+
+    static void write(LoopBufferManager& manager, ReferenceLoop& reference, int loopOffset, int numSamples,
+                      juce::Random& random)
+    {
+        juce::AudioBuffer<float> input(numChannels, numSamples);
+        fill(input, random);
+        manager.writeLoop(input, 0, numSamples, loopOffset);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int i = 0; i < numSamples; ++i)
+                reference.samples[channel][static_cast<size_t>((loopOffset + i) % reference.length())]
+                    = input.getSample(channel, i);
+    }
+
+    static void fill(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(channel, i, random.nextFloat() - 0.5f);
+    }
+
+    /**
+     * Compare what the loop plays, and what readAbsolute() exports, with the reference.
+     */
+    static bool matches(LoopBufferManager& manager, const ReferenceLoop& reference)
+    {
+        const int length = reference.length();
+        if (manager.getLoopLength() != length)
+            return false;
+
+        juce::AudioBuffer<float> played(numChannels, length);
+        juce::AudioBuffer<float> exported(numChannels, length);
+        manager.readAbsolute(exported, 0, length, manager.getLoopStart());
+
+        // Blocks starting anywhere in the loop, so runs cross page and repetition boundaries
+        for (int offset = 0; offset < length; offset += 777)
+            manager.readLoop(played, offset, juce::jmin(777, length - offset), offset);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int i = 0; i < length; ++i)
+                if (played.getSample(channel, i) != reference.samples[channel][static_cast<size_t>(i)]
+                    || exported.getSample(channel, i) != reference.samples[channel][static_cast<size_t>(i)])
+                    return false;
+
+        return true;
+    }
+};
+
+static LoopBufferManagerTests loopBufferManagerTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
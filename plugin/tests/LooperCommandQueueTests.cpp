@@ -0,0 +1,137 @@
+#include "OpenLooper2/LooperCommandQueue.h"
+
+namespace OpenLooper2 {
+
+class LooperCommandQueueTests : public juce::UnitTest
+{
+public:
+    LooperCommandQueueTests() : juce::UnitTest("LooperCommandQueue", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        beginTest("Commands come out in order, each on its own");
+        {
+            LooperCommandQueue queue;
+            LooperCommand command;
+            expect(!queue.peek(command));
+
+            expect(queue.push(makeCommand(LooperCommand::Type::Record, 1)));
+            expect(queue.push(makeCommand(LooperCommand::Type::Overdub, 2)));
+            expect(queue.push(makeCommand(LooperCommand::Type::SetLength, 3)));
+
+            // Peeking leaves the command in place until it is popped
+            expect(queue.peek(command));
+            expect(command.type == LooperCommand::Type::Record);
+            expect(queue.peek(command));
+            expectEquals(command.value, 1);
+            queue.pop();
+
+            expect(queue.peek(command));
+            expect(command.type == LooperCommand::Type::Overdub);
+            queue.pop();
+
+            expect(queue.peek(command));
+            expect(command.type == LooperCommand::Type::SetLength);
+            expectEquals(command.value, 3);
+            queue.pop();
+
+            expect(!queue.peek(command));
+            queue.pop();
+            expect(!queue.peek(command));
+        }
+
+        beginTest("A full queue drops and counts what does not fit");
+        {
+            LooperCommandQueue queue;
+            int accepted = 0;
+
+            for (int i = 0; i < LooperCommandQueue::capacity + 10; ++i)
+                if (queue.push(makeCommand(LooperCommand::Type::Play, i)))
+                    ++accepted;
+
+            // The ring keeps one slot free to tell full from empty
+            expectEquals(accepted, LooperCommandQueue::capacity - 1);
+            expectEquals(queue.getNumDroppedCommands(), 11);
+
+            LooperCommand command;
+            for (int i = 0; i < accepted; ++i)
+            {
+                expect(queue.peek(command));
+                expectEquals(command.value, i);
+                queue.pop();
+            }
+
+            expect(!queue.peek(command));
+            expect(queue.push(makeCommand(LooperCommand::Type::Stop, 0)));
+        }
+
+        beginTest("Commands pushed from another thread all arrive in order");
+        {
+            LooperCommandQueue queue;
+            Producer producer(queue);
+            producer.startThread();
+
+            LooperCommand command;
+            int expected = 0;
+            bool inOrder = true;
+            const auto endTime = juce::Time::getMillisecondCounter() + 5000;
+
+            while (expected < Producer::numCommands && juce::Time::getMillisecondCounter() < endTime)
+            {
+                if (!queue.peek(command))
+                {
+                    juce::Thread::yield();
+                    continue;
+                }
+
+                inOrder = inOrder && command.value == expected && command.timelineSample == expected * 64;
+                ++expected;
+                queue.pop();
+            }
+
+            producer.stopThread(1000);
+
+            expectEquals(expected, Producer::numCommands);
+            expect(inOrder, "Commands were reordered or corrupted");
+        }
+    }
+
+private:
+    static LooperCommand makeCommand(LooperCommand::Type type, int value)
+    {
+        LooperCommand command;
+        command.type = type;
+        command.timelineSample = static_cast<juce::int64>(value) * 64;
+        command.value = value;
+        return command;
+    }
+
+    /**
+     * Pushes a numbered sequence of commands, retrying whenever the queue is full.
+     */
+    class Producer : public juce::Thread
+    {
+    public:
+        static constexpr int numCommands = 100000;
+
+        explicit Producer(LooperCommandQueue& queue) : juce::Thread("LooperCommandQueue test producer"), queue(queue) {}
+
+        void run() override
+        {
+            for (int i = 0; i < numCommands && !threadShouldExit();)
+            {
+                if (queue.push(makeCommand(LooperCommand::Type::SetLength, i)))
+                    ++i;
+                else
+                    juce::Thread::yield();
+            }
+        }
+
+    private:
+        LooperCommandQueue& queue;
+    };
+};
+
+static LooperCommandQueueTests looperCommandQueueTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,267 @@
+#include "OpenLooper2/OverdubLayers.h"
+#include <vector>
+
+namespace OpenLooper2 {
+
+class OverdubLayersTests : public juce::UnitTest
+{
+public:
+    OverdubLayersTests() : juce::UnitTest("OverdubLayers", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        BackgroundJobQueue jobQueue;
+
+        beginTest("Layer gains are remixed into the mixdown");
+        {
+            LoopBufferManager manager(jobQueue);
+            OverdubLayers layers(manager, jobQueue);
+            Reference reference;
+            juce::Random random(1);
+            record(manager, layers, reference, random);
+
+            // The second pass runs across the loop end
+            expect(overdub(layers, manager, reference, 500, 2000, random));
+            expect(overdub(layers, manager, reference, 4000, 2000, random));
+            expectEquals(layers.getNumLayers(), 2);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+
+            expect(layers.setLayerGain(0, 0.5f));
+            expectEquals(layers.getLayerGain(0), 0.5f);
+            remixAll(layers, reference);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+
+            expect(layers.setLayerGain(1, 1.5f));
+            expect(!layers.setLayerGain(2, 1.0f));
+            remixAll(layers, reference);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+        }
+
+        beginTest("A remix starts at the playhead and keeps to its budget");
+        {
+            LoopBufferManager manager(jobQueue);
+            OverdubLayers layers(manager, jobQueue);
+            Reference reference;
+            juce::Random random(2);
+            record(manager, layers, reference, random);
+
+            expect(overdub(layers, manager, reference, 0, loopLength, random));
+            expect(layers.setLayerGain(0, 0.0f));
+            reference.gains[0] = 0.0f;
+
+            // One block of 64 samples brings 512 samples up to date from where the loop plays
+            juce::AudioBuffer<float> scratch(numChannels, 256);
+            layers.remix(scratch, 3000, 64);
+            expect(layers.isRemixing());
+            expectLessThan(mixdownError(manager, reference, 3000, OverdubLayers::remixSamplesPerSample * 64), 1.0e-6f);
+            expectGreaterThan(mixdownError(manager, reference, 3000 + OverdubLayers::remixSamplesPerSample * 64, 100), 1.0e-3f);
+
+            remixAll(layers, reference);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+        }
+
+        beginTest("Removing the last layer takes it out of the mixdown");
+        {
+            LoopBufferManager manager(jobQueue);
+            OverdubLayers layers(manager, jobQueue);
+            Reference reference;
+            juce::Random random(3);
+            record(manager, layers, reference, random);
+
+            expect(overdub(layers, manager, reference, 1000, 3000, random));
+            expect(overdub(layers, manager, reference, 2000, 1000, random));
+
+            expect(layers.removeLastLayer());
+            reference.gains[1] = 0.0f;
+            expectEquals(layers.getNumLayers(), 1);
+            remixAll(layers, reference);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+
+            // The freed layer becomes a spare for the next pass
+            expect(overdub(layers, manager, reference, 0, 500, random));
+            expectEquals(layers.getNumLayers(), 2);
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+        }
+
+        beginTest("Flattening keeps the mix and forgets the layers");
+        {
+            LoopBufferManager manager(jobQueue);
+            OverdubLayers layers(manager, jobQueue);
+            Reference reference;
+            juce::Random random(4);
+            record(manager, layers, reference, random);
+
+            expect(overdub(layers, manager, reference, 0, 2500, random));
+            expect(layers.setLayerGain(0, 0.25f));
+            remixAll(layers, reference);
+
+            layers.flatten();
+            expectEquals(layers.getNumLayers(), 0);
+            expect(!layers.setLayerGain(0, 1.0f));
+            expect(!layers.removeLastLayer());
+            expectLessThan(mixdownError(manager, reference), 1.0e-6f);
+
+            // A new loop length moves the content relative to the layer offsets
+            expect(overdub(layers, manager, reference, 0, 2500, random));
+            expect(manager.multiplyLoop(2));
+            layers.update();
+            expectEquals(layers.getNumLayers(), 0);
+        }
+    }
+
+private:
+    static constexpr int numChannels = 2;
+    static constexpr int loopLength = 5000;
+
+    /**
+     * The recorded loop and every pass kept apart, the mixdown is their weighted sum.
+     */
+    struct Reference
+    {
+        std::vector<float> base[numChannels];
+        std::vector<std::vector<float>> passes[numChannels];
+        float gains[OverdubLayers::maxLayers]{};
+
+        float mixdown(int channel, int offset) const
+        {
+            float sample = base[channel][static_cast<size_t>(offset)];
+            for (size_t pass = 0; pass < passes[channel].size(); ++pass)
+                sample += gains[pass] * passes[channel][pass][static_cast<size_t>(offset)];
+
+            return sample;
+        }
+    };
+
+    static void record(LoopBufferManager& manager, OverdubLayers& layers, Reference& reference, juce::Random& random)
+    {
+        manager.initialize(48000.0, numChannels, 10.0f);
+        manager.waitForStorage(5000);
+        layers.prepare(numChannels);
+
+        juce::AudioBuffer<float> input(numChannels, loopLength);
+        fill(input, random);
+
+        manager.beginLoop();
+        manager.writeAudio(input, 0, loopLength);
+        manager.setLoopLength(loopLength);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            reference.base[channel].assign(input.getReadPointer(channel), input.getReadPointer(channel) + loopLength);
+    }
+
+    /**
+     * Overdub a region block by block the way the looper does at feedback 1: the input is added
+     * to the loop and the difference goes into the layer.
+     * @return false if no spare layer became ready
+     */
+    static bool overdub(OverdubLayers& layers, LoopBufferManager& manager, Reference& reference, int start,
+                        int numSamples, juce::Random& random)
+    {
+        if (!beginLayerWhenReady(layers))
+            return false;
+
+        const size_t pass = reference.passes[0].size();
+        reference.gains[pass] = 1.0f;
+
+        for (auto& passes : reference.passes)
+            passes.emplace_back(static_cast<size_t>(loopLength), 0.0f);
+
+        constexpr int blockSize = 256;
+        juce::AudioBuffer<float> input(numChannels, blockSize);
+        juce::AudioBuffer<float> previous(numChannels, blockSize);
+        juce::AudioBuffer<float> loopSegment(numChannels, blockSize);
+
+        // Positions run on past the loop length, as the timeline does
+        const juce::int64 firstPosition = 3 * loopLength + start;
+
+        for (int done = 0; done < numSamples; done += blockSize)
+        {
+            const int count = juce::jmin(blockSize, numSamples - done);
+            const juce::int64 position = firstPosition + done;
+            fill(input, random);
+
+            manager.readLoop(previous, 0, count, position);
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                loopSegment.copyFrom(channel, 0, previous, channel, 0, count);
+                loopSegment.addFrom(channel, 0, input, channel, 0, count);
+            }
+
+            manager.writeLoop(loopSegment, 0, count, position);
+            layers.addToLayer(input, count, position);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int i = 0; i < count; ++i)
+                    reference.passes[channel][pass][static_cast<size_t>((position + i) % loopLength)]
+                        += input.getSample(channel, i);
+        }
+
+        layers.endLayer();
+        return true;
+    }
+
+    /**
+     * Keep asking for a layer while the worker allocates the spare.
+     */
+    static bool beginLayerWhenReady(OverdubLayers& layers)
+    {
+        const auto endTime = juce::Time::getMillisecondCounter() + 5000;
+
+        while (juce::Time::getMillisecondCounter() < endTime)
+        {
+            layers.update();
+            if (layers.beginLayer())
+                return true;
+
+            juce::Thread::sleep(1);
+        }
+
+        return false;
+    }
+
+    void remixAll(OverdubLayers& layers, Reference& reference)
+    {
+        for (int pass = 0; pass < layers.getNumLayers(); ++pass)
+            reference.gains[pass] = layers.getLayerGain(pass);
+
+        juce::AudioBuffer<float> scratch(numChannels, 256);
+        juce::int64 playbackPosition = 0;
+
+        for (int block = 0; block < 1000 && (block == 0 || layers.isRemixing()); ++block)
+        {
+            layers.remix(scratch, playbackPosition, 128);
+            playbackPosition += 128;
+        }
+
+        expect(!layers.isRemixing(), "Remix did not finish");
+    }
+
+    static void fill(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(channel, i, 0.5f * (random.nextFloat() - 0.5f));
+    }
+
+    /**
+     * Get the largest difference between the loop and the weighted sum of its passes.
+     */
+    static float mixdownError(LoopBufferManager& manager, const Reference& reference, int start = 0,
+                              int numSamples = loopLength)
+    {
+        juce::AudioBuffer<float> loop(numChannels, numSamples);
+        manager.readLoop(loop, 0, numSamples, start);
+
+        float error = 0.0f;
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int i = 0; i < numSamples; ++i)
+                error = juce::jmax(error, std::abs(loop.getSample(channel, i)
+                                                   - reference.mixdown(channel, (start + i) % loopLength)));
+
+        return error;
+    }
+};
+
+static OverdubLayersTests overdubLayersTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
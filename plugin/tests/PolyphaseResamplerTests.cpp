@@ -0,0 +1,100 @@
+#include "OpenLooper2/PolyphaseResampler.h"
+#include <cmath>
+#include <vector>
+
+namespace OpenLooper2 {
+
+class PolyphaseResamplerTests : public juce::UnitTest
+{
+public:
+    PolyphaseResamplerTests() : juce::UnitTest("PolyphaseResampler", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        beginTest("Output length follows the rate ratio");
+        {
+            PolyphaseResampler resampler;
+            resampler.prepare(44100.0, 48000.0);
+            expectEquals(resampler.getOutputLength(44100), 48000);
+            resampler.prepare(96000.0, 44100.0);
+            expectEquals(resampler.getOutputLength(96000), 44100);
+        }
+
+        // A 1 kHz sine converted between the common rates stays within about -87 dBFS of the ideal
+        beginTest("Passband sine matches the ideal signal");
+        {
+            expectLessThan(convertSine(44100.0, 48000.0, 1000.0), -86.0f);
+            expectLessThan(convertSine(48000.0, 44100.0, 1000.0), -86.0f);
+            expectLessThan(convertSine(96000.0, 44100.0, 1000.0), -86.0f);
+        }
+
+        // Content above the new Nyquist frequency must not alias back into the loop
+        beginTest("Stopband content is rejected");
+        {
+            expectLessThan(convertSine(96000.0, 44100.0, 30000.0, false), -87.0f);
+            expectLessThan(convertSine(96000.0, 48000.0, 32000.0, false), -87.0f);
+        }
+
+        beginTest("Sections match the whole period");
+        {
+            PolyphaseResampler resampler;
+            resampler.prepare(48000.0, 44100.0);
+
+            const auto input = makeSine(48000.0, 1000.0, 4800);
+            const int outputLength = resampler.getOutputLength(4800);
+            std::vector<float> whole(static_cast<size_t>(outputLength));
+            std::vector<float> sections(static_cast<size_t>(outputLength));
+            resampler.process(input.data(), 4800, whole.data(), outputLength);
+
+            for (int first = 0; first < outputLength; first += 1000)
+                resampler.process(input.data(), 4800, outputLength, sections.data() + first, first,
+                                  juce::jmin(1000, outputLength - first));
+
+            expect(whole == sections, "Sectioned output differs");
+        }
+    }
+
+private:
+    static std::vector<float> makeSine(double sampleRate, double frequency, int numSamples)
+    {
+        std::vector<float> samples(static_cast<size_t>(numSamples));
+
+        for (int i = 0; i < numSamples; ++i)
+            samples[static_cast<size_t>(i)]
+                = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * i / sampleRate));
+
+        return samples;
+    }
+
+    /**
+     * Convert one second of a sine, treated as a loop, and measure the output.
+     * @param passband Whether to measure the deviation from the ideal sine rather than the level
+     * @return The peak deviation or level in dBFS
+     */
+    static float convertSine(double sourceRate, double targetRate, double frequency, bool passband = true)
+    {
+        PolyphaseResampler resampler;
+        resampler.prepare(sourceRate, targetRate);
+
+        const int inputLength = static_cast<int>(sourceRate);
+        const auto input = makeSine(sourceRate, frequency, inputLength);
+        const int outputLength = resampler.getOutputLength(inputLength);
+        std::vector<float> output(static_cast<size_t>(outputLength));
+        resampler.process(input.data(), inputLength, output.data(), outputLength);
+
+        double peak = 0.0;
+
+        for (int i = 0; i < outputLength; ++i)
+        {
+            const double ideal = passband ? std::sin(juce::MathConstants<double>::twoPi * frequency * i / targetRate)
+                                          : 0.0;
+            peak = juce::jmax(peak, std::abs(output[static_cast<size_t>(i)] - ideal));
+        }
+
+        return juce::Decibels::gainToDecibels(static_cast<float>(peak), -200.0f);
+    }
+};
+
+static PolyphaseResamplerTests polyphaseResamplerTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "OpenLooper2/SharedLoopClock.h"
+
+namespace OpenLooper2 {
+
+class SharedLoopClockTests : public juce::UnitTest
+{
+public:
+    SharedLoopClockTests() : juce::UnitTest("SharedLoopClock", "OpenLooper2") {}
+
+    void runTest() override
+    {
+        beginTest("Grid phase wraps on both sides of the origin");
+        {
+            SharedLoopClock::Grid grid;
+            grid.originSample = 1000;
+            grid.loopLength = 300;
+
+            expectEquals(grid.getPhase(1000), 0);
+            expectEquals(grid.getPhase(1299), 299);
+            expectEquals(grid.getPhase(1300), 0);
+            expectEquals(grid.getPhase(999), 299);
+            expectEquals(grid.getPhase(100), 0);
+            expectEquals(grid.getSamplesToNextBoundary(1000), 0);
+            expectEquals(grid.getSamplesToNextBoundary(1001), 299);
+            expectEquals(grid.getSamplesToNextBoundary(950), 50);
+        }
+
+        beginTest("Only the master publishes");
+        {
+            SharedLoopClock clock;
+            int first = 0, second = 0;
+            SharedLoopClock::Grid grid;
+
+            expect(clock.read(grid));
+            expect(!grid.isValid());
+
+            expect(clock.publish(&first, 500, 48000));
+            expect(clock.isMaster(&first));
+            expect(!clock.publish(&second, 0, 1000));
+
+            expect(clock.read(grid));
+            expect(grid.originSample == 500);
+            expectEquals(grid.loopLength, 48000);
+
+            // Releasing a role that is not held changes nothing
+            clock.release(&second);
+            expect(clock.isMaster(&first));
+
+            clock.release(&first);
+            expect(clock.read(grid));
+            expect(!grid.isValid());
+
+            expect(clock.publish(&second, 0, 1000));
+            expect(clock.isMaster(&second));
+        }
+
+        // Every grid published keeps origin and length in a fixed relation, a torn read breaks it
+        beginTest("Reads never see half a publish");
+        {
+            SharedLoopClock clock;
+            Publisher publisher(clock);
+            publisher.startThread();
+
+            int successfulReads = 0;
+            int tornReads = 0;
+            SharedLoopClock::Grid grid;
+
+            while (!clock.read(grid) || !grid.isValid())
+                juce::Thread::yield();
+
+            const auto endTime = juce::Time::getMillisecondCounter() + 200;
+
+            while (juce::Time::getMillisecondCounter() < endTime)
+            {
+                if (!clock.read(grid) || !grid.isValid())
+                    continue;
+
+                ++successfulReads;
+                if (grid.originSample != originFor(grid.loopLength))
+                    ++tornReads;
+            }
+
+            publisher.stopThread(1000);
+
+            expectGreaterThan(successfulReads, 0);
+            expectEquals(tornReads, 0);
+        }
+    }
+
+private:
+    static juce::int64 originFor(int loopLength) { return static_cast<juce::int64>(loopLength) * 7919 + 3; }
+
+    class Publisher : public juce::Thread
+    {
+    public:
+        explicit Publisher(SharedLoopClock& clock) : juce::Thread("SharedLoopClock test publisher"), clock(clock) {}
+
+        void run() override
+        {
+            for (int length = 1; !threadShouldExit(); length = length % 1000000 + 1)
+                clock.publish(this, originFor(length), length);
+        }
+
+    private:
+        SharedLoopClock& clock;
+    };
+};
+
+static SharedLoopClockTests sharedLoopClockTests;
+
+} // namespace OpenLooper2
\ No newline at end of file
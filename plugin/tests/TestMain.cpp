@@ -0,0 +1,20 @@
+#include <juce_core/juce_core.h>
+
+/**
+ * Runs the unit tests of the looper's DSP and lock-free building blocks. Built by the
+ * OPENLOOPER2_BUILD_TESTS option and registered with CTest.
+ * Exits with a non-zero status if any test failed.
+ */
+
+int main()
+{
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("OpenLooper2");
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+
+    return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
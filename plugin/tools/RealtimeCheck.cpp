@@ -0,0 +1,255 @@
+#include "OpenLooper2/PluginProcessor.h"
+#include "OpenLooper2/Looper.h"
+#include "OpenLooper2/ParameterManager.h"
+#include "OpenLooper2/RealtimeSafetyChecker.h"
+#include <iostream>
+
+/**
+ * Drives the processor through scripted transport sequences and reports every allocation, lock
+ * and blocking call its processBlock makes. Built by the OPENLOOPER2_REALTIME_CHECKS option.
+ * The script runs once on the main bus alone and once with the loop and dry buses enabled.
+ * Exits with a non-zero status if any step violated real-time safety.
+ */
+
+namespace {
+
+using OpenLooper2::LooperCommand;
+using OpenLooper2::LoopExporter;
+using OpenLooper2::ParameterManager;
+using OpenLooper2::RealtimeSafetyChecker;
+
+enum class Action
+{
+    None,
+    Press,      // Button parameter pushed and released
+    Set,        // Parameter set to a plain value
+    Note,       // MIDI note on at the start of the first block, off at the start of the last
+    Command,    // Looper command sent with the value, acted on at the next block
+    LayerGain,  // First overdub layer set to the value
+    Export,     // Loop written to the scratch file
+    Import,     // Scratch file loaded as the loop, once the export has finished
+    Bypass      // Blocks run through processBlockBypassed
+};
+
+struct Step
+{
+    const char* description;
+    Action action;
+    const char* parameterID;
+    float value;
+    int numBlocks;
+    LooperCommand::Type command{LooperCommand::Type::Stop};
+};
+
+// Covers every transport path, plus the features that run inside the callback
+const Step script[] = {
+    { "Idle",                     Action::None,       nullptr,                                0.0f,     16 },
+    { "Record",                   Action::Press,      ParameterManager::RECORD_ID,            0.0f,     150 },
+    { "Close take, play",         Action::Press,      ParameterManager::RECORD_ID,            0.0f,     100 },
+    { "Monitor while playing",    Action::Set,        ParameterManager::MONITORING_ID,        0.0f,     50 },
+    { "Overdub",                  Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     100 },
+    { "Stop overdub",             Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     50 },
+    { "Second overdub layer",     Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     100 },
+    { "Stop overdub",             Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     50 },
+    { "Remix layers",             Action::LayerGain,  nullptr,                                0.5f,     80 },
+    { "Undo",                     Action::Command,    nullptr,                                0.0f,     50,   LooperCommand::Type::Undo },
+    { "Refine loop edges",        Action::Set,        ParameterManager::REFINE_ID,            1.0f,     50 },
+    { "Saturate and filter",      Action::Set,        ParameterManager::SATURATION_ID,        0.5f,     50 },
+    { "Grid slices",              Action::Set,        ParameterManager::SLICES_ID,            8.0f,     50 },
+    { "Transient slices",         Action::Set,        ParameterManager::SLICE_MODE_ID,        1.0f,     50 },
+    { "Retrigger slice by MIDI",  Action::Note,       nullptr,                                38.0f,    20 },
+    { "Retrigger slice",          Action::Set,        ParameterManager::RETRIGGER_ID,         3.0f,     20 },
+    { "Stutter",                  Action::Set,        ParameterManager::STUTTER_ID,           1.0f,     40 },
+    { "Release stutter",          Action::Set,        ParameterManager::STUTTER_ID,           0.0f,     20 },
+    { "Echo",                     Action::Set,        ParameterManager::ECHO_ID,              1.0f,     80 },
+    { "Granular",                 Action::Set,        ParameterManager::GRANULAR_ID,          1.0f,     80 },
+    { "Dense grain cloud",        Action::Set,        ParameterManager::GRAIN_DENSITY_ID,     400.0f,   80 },
+    { "Pitched grains",           Action::Set,        ParameterManager::GRAIN_PITCH_ID,       7.0f,     80 },
+    { "Linear playback",          Action::Set,        ParameterManager::GRANULAR_ID,          0.0f,     20 },
+    { "Varispeed",                Action::Set,        ParameterManager::PLAYBACK_RATE_ID,     1.5f,     80 },
+    { "Unity rate",               Action::Set,        ParameterManager::PLAYBACK_RATE_ID,     1.0f,     20 },
+    { "Compact",                  Action::Set,        ParameterManager::COMPACT_ID,           1.0f,     100 },
+    { "Overdub compacted loop",   Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     100 },
+    { "Stop overdub",             Action::Press,      ParameterManager::OVERDUB_ID,           0.0f,     20 },
+    { "Multiply",                 Action::Command,    nullptr,                                2.0f,     80,   LooperCommand::Type::Multiply },
+    { "Divide",                   Action::Command,    nullptr,                                2.0f,     80,   LooperCommand::Type::Divide },
+    { "Set length",               Action::Command,    nullptr,                                24000.0f, 60,   LooperCommand::Type::SetLength },
+    { "Export",                   Action::Export,     nullptr,                                0.0f,     100 },
+    { "Import",                   Action::Import,     nullptr,                                0.0f,     150 },
+    { "Switch slot",              Action::Set,        ParameterManager::SLOT_ID,              2.0f,     20 },
+    { "Record in new slot",       Action::Press,      ParameterManager::RECORD_ID,            0.0f,     80 },
+    { "Close take",               Action::Press,      ParameterManager::RECORD_ID,            0.0f,     40 },
+    { "Launch first slot",        Action::Command,    nullptr,                                0.0f,     60,   LooperCommand::Type::LaunchSlot },
+    { "Launch scene",             Action::Set,        ParameterManager::SCENE_ID,             1.0f,     60 },
+    { "Stop",                     Action::Press,      ParameterManager::STOP_ID,              0.0f,     20 },
+    { "Play",                     Action::Press,      ParameterManager::PLAY_ID,              0.0f,     40 },
+    { "Bypass",                   Action::Bypass,     nullptr,                                0.0f,     40 },
+    { "Resume",                   Action::None,       nullptr,                                0.0f,     20 },
+    { "Clear",                    Action::Command,    nullptr,                                0.0f,     20,   LooperCommand::Type::Clear },
+    { "Stop",                     Action::Press,      ParameterManager::STOP_ID,              0.0f,     20 }
+};
+
+// Hosts may split their buffer, so block sizes vary within each step
+constexpr int blockSizes[] = { 512, 160, 512, 37, 256 };
+constexpr int maxBlockSize = 512;
+constexpr double sampleRate = 48000.0;
+
+// Export and import take longer than a block; wait for them outside the measured blocks
+constexpr int backgroundTimeoutMilliseconds = 5000;
+
+bool waitForExport(const OpenLooper2::Looper& looper)
+{
+    for (int waited = 0; waited < backgroundTimeoutMilliseconds; ++waited)
+    {
+        const auto state = looper.getExportState();
+        if (state != LoopExporter::State::Requested && state != LoopExporter::State::Exporting)
+            return state == LoopExporter::State::Succeeded;
+
+        juce::Thread::sleep(1);
+    }
+
+    return false;
+}
+
+void setParameter(juce::AudioProcessorValueTreeState& apvts, const char* parameterID, float plainValue)
+{
+    if (auto* parameter = apvts.getParameter(parameterID))
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(plainValue));
+}
+
+/**
+ * Run the whole script on a fresh processor.
+ * @param withAuxBuses Whether the loop and dry output buses are enabled
+ * @param scratchFile File the export step writes and the import step reads
+ * @return The number of steps that violated real-time safety
+ */
+int runScript(bool withAuxBuses, const juce::File& scratchFile)
+{
+    AudioPluginAudioProcessor processor;
+    if (withAuxBuses)
+        processor.enableAllBuses();
+
+    const int numChannels = juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    processor.setRateAndBufferSizeDetails(sampleRate, maxBlockSize);
+    processor.prepareToPlay(sampleRate, maxBlockSize);
+    auto& apvts = processor.getAPVTS();
+    auto& looper = processor.getLooper();
+
+    // Everything the callback touches is allocated before the script starts
+    juce::AudioBuffer<float> buffer(numChannels, maxBlockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(256);
+
+    double phase = 0.0;
+    int blockCounter = 0;
+    int failedSteps = 0;
+
+    for (const auto& step : script)
+    {
+        bool started = true;
+
+        if (step.action == Action::Press)
+        {
+            setParameter(apvts, step.parameterID, 1.0f);
+            setParameter(apvts, step.parameterID, 0.0f);
+        }
+        else if (step.action == Action::Set)
+        {
+            setParameter(apvts, step.parameterID, step.value);
+        }
+        else if (step.action == Action::Command)
+        {
+            started = looper.sendCommand(step.command, static_cast<int>(step.value));
+        }
+        else if (step.action == Action::LayerGain)
+        {
+            started = looper.setLayerGain(0, step.value);
+        }
+        else if (step.action == Action::Export)
+        {
+            started = looper.exportLoop(scratchFile, LoopExporter::Format::Wav);
+        }
+        else if (step.action == Action::Import)
+        {
+            started = waitForExport(looper) && looper.importLoop(scratchFile);
+        }
+
+        RealtimeSafetyChecker::resetViolationCounts();
+
+        for (int block = 0; block < step.numBlocks; ++block)
+        {
+            const int numSamples = blockSizes[blockCounter++ % juce::numElementsInArray(blockSizes)];
+            juce::AudioBuffer<float> hostBlock(buffer.getArrayOfWritePointers(), numChannels, numSamples);
+            hostBlock.clear();
+
+            // A quiet sine on the main input gives takes and overdubs something to hold
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                const float value = 0.25f * static_cast<float>(std::sin(phase));
+                hostBlock.setSample(0, sample, value);
+                hostBlock.setSample(1, sample, value);
+                phase += juce::MathConstants<double>::twoPi * 220.0 / sampleRate;
+            }
+
+            midi.clear();
+            if (step.action == Action::Note && block == 0)
+                midi.addEvent(juce::MidiMessage::noteOn(1, static_cast<int>(step.value), 1.0f), 0);
+            else if (step.action == Action::Note && block == step.numBlocks - 1)
+                midi.addEvent(juce::MidiMessage::noteOff(1, static_cast<int>(step.value)), 0);
+
+            if (step.action == Action::Bypass)
+                processor.processBlockBypassed(hostBlock, midi);
+            else
+                processor.processBlock(hostBlock, midi);
+
+            // Give background jobs the time a real callback period would
+            juce::Thread::sleep(1);
+        }
+
+        const int violations = RealtimeSafetyChecker::getTotalViolationCount();
+        std::cout << (violations == 0 ? "[ ok ] " : "[FAIL] ") << step.description;
+
+        // A step that could not start did not exercise its path, which is worth knowing but not a violation
+        if (!started)
+            std::cout << " (not started)";
+
+        if (violations > 0)
+        {
+            ++failedSteps;
+            for (int kind = 0; kind < RealtimeSafetyChecker::numViolationKinds; ++kind)
+            {
+                const auto violation = static_cast<RealtimeSafetyChecker::Violation>(kind);
+                if (const int count = RealtimeSafetyChecker::getViolationCount(violation))
+                    std::cout << ", " << count << " " << RealtimeSafetyChecker::getViolationName(violation);
+            }
+        }
+
+        std::cout << std::endl;
+    }
+
+    processor.releaseResources();
+    return failedSteps;
+}
+
+} // namespace
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const auto scratchFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                 .getNonexistentChildFile("OpenLooper2RealtimeCheck", ".wav");
+
+    std::cout << "Main bus" << std::endl;
+    int failedSteps = runScript(false, scratchFile);
+
+    std::cout << std::endl << "Main, loop and dry buses" << std::endl;
+    scratchFile.deleteFile();
+    failedSteps += runScript(true, scratchFile);
+
+    scratchFile.deleteFile();
+
+    std::cout << (failedSteps == 0 ? "All transport paths are real-time safe" : "Real-time safety violations found")
+              << std::endl;
+    return failedSteps == 0 ? 0 : 1;
+}
\ No newline at end of file